@@ -0,0 +1,342 @@
+#include "allocators.h"
+#include "gl_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// VS2013はthread_localに対応していないので、POD用の拡張を使う
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+static size_t align_up(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/*--------------------Allocator Statistics---------------------------*/
+static Allocator_Stats* g_tracked_allocators[MAX_TRACKED_ALLOCATORS];
+static int g_tracked_allocator_count = 0;
+static std::mutex g_tracked_allocator_mutex;
+
+void register_allocator_stats(Allocator_Stats* stats, const char* name)
+{
+	memset(stats, 0, sizeof(Allocator_Stats));
+	stats->name = name;
+	std::lock_guard<std::mutex> lock(g_tracked_allocator_mutex);
+	if (g_tracked_allocator_count >= MAX_TRACKED_ALLOCATORS)
+	{
+		gl_log_err("WARNING: too many allocators to track, %s is not logged\n", name);
+		return;
+	}
+	g_tracked_allocators[g_tracked_allocator_count++] = stats;
+}
+
+void unregister_allocator_stats(Allocator_Stats* stats)
+{
+	std::lock_guard<std::mutex> lock(g_tracked_allocator_mutex);
+	for (int i = 0; i < g_tracked_allocator_count; i++)
+	{
+		if (g_tracked_allocators[i] == stats)
+		{
+			g_tracked_allocators[i] = g_tracked_allocators[--g_tracked_allocator_count];
+			return;
+		}
+	}
+}
+
+static void count_alloc(Allocator_Stats* stats, size_t bytes)
+{
+	stats->allocations++;
+	stats->current_bytes += bytes;
+	if (stats->current_bytes > stats->peak_bytes)
+	{
+		stats->peak_bytes = stats->current_bytes;
+	}
+}
+
+void log_allocator_stats()
+{
+	std::lock_guard<std::mutex> lock(g_tracked_allocator_mutex);
+	gl_log_print("allocator stats:\n");
+	gl_log_print("  %-24s %12s %8s %12s\n", "name", "allocations", "heap", "peak KB");
+	for (int i = 0; i < g_tracked_allocator_count; i++)
+	{
+		const Allocator_Stats* s = g_tracked_allocators[i];
+		gl_log_print(
+			"  %-24s %12lld %8lld %12.1f\n",
+			s->name,
+			s->allocations,
+			s->heap_allocations,
+			s->peak_bytes / 1024.0);
+	}
+}
+
+/*--------------------Scratch Arena---------------------------*/
+void init_scratch_arena(Scratch_Arena* arena, const char* name, size_t capacity)
+{
+	memset(arena, 0, sizeof(Scratch_Arena));
+	register_allocator_stats(&arena->stats, name);
+	arena->capacity = align_up(capacity, SCRATCH_ALIGNMENT);
+	if (arena->capacity > 0)
+	{
+		arena->base = (unsigned char*)malloc(arena->capacity);
+		arena->stats.heap_allocations++;
+	}
+}
+
+void destroy_scratch_arena(Scratch_Arena* arena)
+{
+	scratch_reset(arena);
+	unregister_allocator_stats(&arena->stats);
+	free(arena->base);
+	free(arena->overflow);
+	free(arena->overflow_sizes);
+	memset(arena, 0, sizeof(Scratch_Arena));
+}
+
+void* scratch_alloc(Scratch_Arena* arena, size_t bytes)
+{
+	bytes = align_up(bytes > 0 ? bytes : 1, SCRATCH_ALIGNMENT);
+	void* p;
+	if (arena->used + bytes <= arena->capacity)
+	{
+		p = arena->base + arena->used;
+		arena->used += bytes;
+	}
+	else
+	{
+		if (arena->overflow_count >= arena->overflow_capacity)
+		{
+			arena->overflow_capacity = arena->overflow_capacity > 0 ? arena->overflow_capacity * 2 : 8;
+			arena->overflow = (void**)realloc(arena->overflow, arena->overflow_capacity * sizeof(void*));
+			arena->overflow_sizes = (size_t*)realloc(
+				arena->overflow_sizes,
+				arena->overflow_capacity * sizeof(size_t));
+		}
+		p = malloc(bytes);
+		arena->overflow[arena->overflow_count] = p;
+		arena->overflow_sizes[arena->overflow_count] = bytes;
+		arena->overflow_count++;
+		arena->overflow_bytes += bytes;
+		arena->stats.heap_allocations++;
+	}
+	count_alloc(&arena->stats, bytes);
+	size_t total = arena->used + arena->overflow_bytes;
+	if (total > arena->window_peak)
+	{
+		arena->window_peak = total;
+	}
+	if (total > arena->peak)
+	{
+		arena->peak = total;
+	}
+	return p;
+}
+
+Scratch_Marker scratch_mark(const Scratch_Arena* arena)
+{
+	Scratch_Marker marker;
+	marker.used = arena->used;
+	marker.overflow_count = arena->overflow_count;
+	return marker;
+}
+
+void scratch_release(Scratch_Arena* arena, Scratch_Marker marker)
+{
+	assert(marker.used <= arena->used && marker.overflow_count <= arena->overflow_count);
+	while (arena->overflow_count > marker.overflow_count)
+	{
+		arena->overflow_count--;
+		free(arena->overflow[arena->overflow_count]);
+		arena->overflow_bytes -= arena->overflow_sizes[arena->overflow_count];
+	}
+	arena->used = marker.used;
+	arena->stats.current_bytes = arena->used + arena->overflow_bytes;
+	if (arena->used > 0 || arena->overflow_count > 0)
+	{
+		return;
+	}
+	// 空になったので、溢れなかったはずの大きさに広げておく
+	if (arena->window_peak > arena->capacity)
+	{
+		free(arena->base);
+		arena->capacity = align_up(arena->window_peak, SCRATCH_ALIGNMENT);
+		arena->base = (unsigned char*)malloc(arena->capacity);
+		arena->stats.heap_allocations++;
+	}
+	arena->window_peak = 0;
+}
+
+void scratch_reset(Scratch_Arena* arena)
+{
+	Scratch_Marker empty;
+	empty.used = 0;
+	empty.overflow_count = 0;
+	scratch_release(arena, empty);
+}
+
+static THREAD_LOCAL Scratch_Arena* t_scratch_arena = NULL;
+static Scratch_Arena g_thread_scratch_arenas[MAX_SCRATCH_THREADS];
+static char g_thread_scratch_names[MAX_SCRATCH_THREADS][32];
+static int g_thread_scratch_count = 0;
+static std::mutex g_thread_scratch_mutex;
+
+Scratch_Arena* thread_scratch_arena()
+{
+	if (t_scratch_arena)
+	{
+		return t_scratch_arena;
+	}
+	int slot;
+	{
+		std::lock_guard<std::mutex> lock(g_thread_scratch_mutex);
+		slot = g_thread_scratch_count < MAX_SCRATCH_THREADS ? g_thread_scratch_count++ : -1;
+	}
+	if (slot < 0)
+	{
+		// 表が一杯ならこのスレッドの分は計測せず、解放もしない
+		gl_log_err("WARNING: more than %i threads use scratch arenas\n", MAX_SCRATCH_THREADS);
+		t_scratch_arena = (Scratch_Arena*)malloc(sizeof(Scratch_Arena));
+		init_scratch_arena(t_scratch_arena, "thread scratch (untracked)", THREAD_SCRATCH_SIZE);
+		unregister_allocator_stats(&t_scratch_arena->stats);
+		return t_scratch_arena;
+	}
+	sprintf(g_thread_scratch_names[slot], "thread scratch %i", slot);
+	init_scratch_arena(&g_thread_scratch_arenas[slot], g_thread_scratch_names[slot], THREAD_SCRATCH_SIZE);
+	t_scratch_arena = &g_thread_scratch_arenas[slot];
+	return t_scratch_arena;
+}
+
+void destroy_thread_scratch_arenas()
+{
+	std::lock_guard<std::mutex> lock(g_thread_scratch_mutex);
+	for (int i = 0; i < g_thread_scratch_count; i++)
+	{
+		destroy_scratch_arena(&g_thread_scratch_arenas[i]);
+	}
+	g_thread_scratch_count = 0;
+	// 呼び出したスレッドの分だけは次に使ったときに作り直せるようにする
+	t_scratch_arena = NULL;
+}
+
+/*--------------------Frame Allocator---------------------------*/
+void init_frame_allocator(Frame_Allocator* allocator, const char* name, size_t capacity)
+{
+	memset(allocator, 0, sizeof(Frame_Allocator));
+	register_allocator_stats(&allocator->stats, name);
+	allocator->capacity = align_up(capacity, SCRATCH_ALIGNMENT);
+	allocator->base = (unsigned char*)malloc(allocator->capacity);
+	allocator->stats.heap_allocations++;
+}
+
+void destroy_frame_allocator(Frame_Allocator* allocator)
+{
+	if (allocator->failed > 0)
+	{
+		gl_log_err(
+			"WARNING: frame allocator %s ran out of space %lld times\n",
+			allocator->stats.name,
+			allocator->failed);
+	}
+	unregister_allocator_stats(&allocator->stats);
+	free(allocator->base);
+	memset(allocator, 0, sizeof(Frame_Allocator));
+}
+
+void begin_frame_allocator(Frame_Allocator* allocator)
+{
+	allocator->used = 0;
+	allocator->stats.current_bytes = 0;
+}
+
+void* frame_alloc(Frame_Allocator* allocator, size_t bytes)
+{
+	bytes = align_up(bytes > 0 ? bytes : 1, SCRATCH_ALIGNMENT);
+	if (allocator->used + bytes > allocator->capacity)
+	{
+		allocator->failed++;
+		return NULL;
+	}
+	void* p = allocator->base + allocator->used;
+	allocator->used += bytes;
+	count_alloc(&allocator->stats, bytes);
+	return p;
+}
+
+/*--------------------Pool Allocator---------------------------*/
+void init_pool_allocator(Pool_Allocator* pool, const char* name, size_t block_size, int blocks_per_chunk)
+{
+	// 空きリストのポインタを書けるだけの大きさにする
+	pool->block_size = align_up(block_size < sizeof(void*) ? sizeof(void*) : block_size, sizeof(void*));
+	pool->blocks_per_chunk = blocks_per_chunk > 0 ? blocks_per_chunk : 1;
+	pool->free_list = NULL;
+	pool->chunks = NULL;
+	pool->chunk_count = 0;
+	pool->chunk_capacity = 0;
+	register_allocator_stats(&pool->stats, name);
+}
+
+void destroy_pool_allocator(Pool_Allocator* pool)
+{
+	std::lock_guard<std::mutex> lock(pool->lock);
+	if (pool->stats.current_bytes > 0)
+	{
+		gl_log_err(
+			"WARNING: pool %s destroyed with %i blocks in use\n",
+			pool->stats.name,
+			(int)(pool->stats.current_bytes / pool->block_size));
+	}
+	for (int i = 0; i < pool->chunk_count; i++)
+	{
+		free(pool->chunks[i]);
+	}
+	free(pool->chunks);
+	pool->chunks = NULL;
+	pool->chunk_count = 0;
+	pool->chunk_capacity = 0;
+	pool->free_list = NULL;
+	unregister_allocator_stats(&pool->stats);
+}
+
+void* pool_alloc(Pool_Allocator* pool)
+{
+	std::lock_guard<std::mutex> lock(pool->lock);
+	if (!pool->free_list)
+	{
+		if (pool->chunk_count >= pool->chunk_capacity)
+		{
+			pool->chunk_capacity = pool->chunk_capacity > 0 ? pool->chunk_capacity * 2 : 8;
+			pool->chunks = (void**)realloc(pool->chunks, pool->chunk_capacity * sizeof(void*));
+		}
+		unsigned char* chunk = (unsigned char*)malloc(pool->block_size * pool->blocks_per_chunk);
+		pool->chunks[pool->chunk_count++] = chunk;
+		pool->stats.heap_allocations++;
+		// 先頭のブロックから順に使われるように、後ろから空きリストに積む
+		for (int i = pool->blocks_per_chunk - 1; i >= 0; i--)
+		{
+			void* block = chunk + i * pool->block_size;
+			*(void**)block = pool->free_list;
+			pool->free_list = block;
+		}
+	}
+	void* block = pool->free_list;
+	pool->free_list = *(void**)block;
+	count_alloc(&pool->stats, pool->block_size);
+	return block;
+}
+
+void pool_free(Pool_Allocator* pool, void* block)
+{
+	if (!block)
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(pool->lock);
+	*(void**)block = pool->free_list;
+	pool->free_list = block;
+	pool->stats.current_bytes -= pool->block_size;
+}
@@ -0,0 +1,103 @@
+#ifndef _ALLOCATORS_H_
+#define _ALLOCATORS_H_
+
+#include <stddef.h>
+#include <mutex>
+
+/*--------------------Allocator Statistics---------------------------*/
+// 各アロケータが持つ計測値。登録したものはlog_allocator_stats()でまとめて表示する
+#define MAX_TRACKED_ALLOCATORS 64
+
+typedef struct Allocator_Stats
+{
+	const char* name;
+	long long allocations;		// 確保の回数
+	long long heap_allocations;	// そのうち背後でmalloc()した回数(ブロックの追加・溢れ)
+	size_t current_bytes;
+	size_t peak_bytes;
+}Allocator_Stats;
+
+void register_allocator_stats(Allocator_Stats* stats, const char* name);
+void unregister_allocator_stats(Allocator_Stats* stats);
+void log_allocator_stats();
+
+/*--------------------Scratch Arena---------------------------*/
+// 読み込み中の一時データ用の線形アロケータ。解放は個別に行わず、scratch_mark()で取った位置まで
+// scratch_release()でまとめて戻す(入れ子にできる)。
+// 容量を超えた分はその場でmalloc()し、空に戻したときに容量を広げて以降は1つのブロックに収める
+#define SCRATCH_ALIGNMENT 16
+#define THREAD_SCRATCH_SIZE (1024 * 1024)
+#define MAX_SCRATCH_THREADS 32
+
+typedef struct Scratch_Arena
+{
+	unsigned char* base;
+	size_t capacity;
+	size_t used;
+	size_t window_peak;		// 空にしてからの使用量(溢れた分を含む)の最大値
+	size_t peak;			// 作ってからの最大値
+	void** overflow;		// 容量を超えて個別に確保したブロック
+	size_t* overflow_sizes;
+	int overflow_count;
+	int overflow_capacity;
+	size_t overflow_bytes;
+	Allocator_Stats stats;
+}Scratch_Arena;
+
+typedef struct Scratch_Marker
+{
+	size_t used;
+	int overflow_count;
+}Scratch_Marker;
+
+void init_scratch_arena(Scratch_Arena* arena, const char* name, size_t capacity);
+void destroy_scratch_arena(Scratch_Arena* arena);
+// SCRATCH_ALIGNMENT境界に揃えて確保する
+void* scratch_alloc(Scratch_Arena* arena, size_t bytes);
+Scratch_Marker scratch_mark(const Scratch_Arena* arena);
+void scratch_release(Scratch_Arena* arena, Scratch_Marker marker);
+void scratch_reset(Scratch_Arena* arena);
+// 呼び出したスレッド専用のアリーナ。初回に作り、destroy_thread_scratch_arenas()まで残す。
+// ロックせずに使えるが、確保した領域を他のスレッドへ渡したままreleaseしてはいけない
+Scratch_Arena* thread_scratch_arena();
+// 全てのスレッドが止まってから呼ぶ
+void destroy_thread_scratch_arenas();
+
+/*--------------------Frame Allocator---------------------------*/
+// 1フレームの間だけ使う線形アロケータ。begin_frame_allocator()で全て戻す。
+// 足りなければNULLを返すので、容量はピークを見て決める
+typedef struct Frame_Allocator
+{
+	unsigned char* base;
+	size_t capacity;
+	size_t used;
+	long long failed;		// 容量不足で返せなかった回数
+	Allocator_Stats stats;
+}Frame_Allocator;
+
+void init_frame_allocator(Frame_Allocator* allocator, const char* name, size_t capacity);
+void destroy_frame_allocator(Frame_Allocator* allocator);
+void begin_frame_allocator(Frame_Allocator* allocator);
+void* frame_alloc(Frame_Allocator* allocator, size_t bytes);
+
+/*--------------------Pool Allocator---------------------------*/
+// 同じ大きさのブロックを使い回す。ブロックはblocks_per_chunk個ずつまとめて確保し、
+// 破棄するまで返さない。複数のスレッドから使えるようにロックする
+typedef struct Pool_Allocator
+{
+	size_t block_size;
+	int blocks_per_chunk;
+	void* free_list;		// 空きブロックの先頭に次の空きブロックを書いておく
+	void** chunks;
+	int chunk_count;
+	int chunk_capacity;
+	std::mutex lock;
+	Allocator_Stats stats;
+}Pool_Allocator;
+
+void init_pool_allocator(Pool_Allocator* pool, const char* name, size_t block_size, int blocks_per_chunk);
+void destroy_pool_allocator(Pool_Allocator* pool);
+void* pool_alloc(Pool_Allocator* pool);
+void pool_free(Pool_Allocator* pool, void* block);
+
+#endif
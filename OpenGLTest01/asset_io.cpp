@@ -0,0 +1,382 @@
+#include "asset_io.h"
+#include "asset_pack.h"
+#include "gl_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <mutex>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+/*--------------------Memory Mapped Files---------------------------*/
+bool map_file(const char* file_name, Mapped_File* mapped)
+{
+	memset(mapped, 0, sizeof(Mapped_File));
+#ifdef _WIN32
+	HANDLE file = CreateFileA(
+		file_name,
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		NULL,
+		OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN,
+		NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	mapped->size = (size_t)size.QuadPart;
+	mapped->file = file;
+	if (mapped->size == 0)
+	{
+		return true;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	mapped->mapping = mapping;
+	mapped->data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mapped->data)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+#else
+	int fd = open(file_name, O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	mapped->size = (size_t)st.st_size;
+	if (mapped->size > 0)
+	{
+		void* data = mmap(NULL, mapped->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fd);
+			return false;
+		}
+		madvise(data, mapped->size, MADV_SEQUENTIAL);
+		mapped->data = (const unsigned char*)data;
+	}
+	// マップした領域はファイルを閉じても有効
+	close(fd);
+#endif
+	return true;
+}
+
+void unmap_file(Mapped_File* mapped)
+{
+#ifdef _WIN32
+	if (mapped->data)
+	{
+		UnmapViewOfFile(mapped->data);
+	}
+	if (mapped->mapping)
+	{
+		CloseHandle(mapped->mapping);
+	}
+	if (mapped->file)
+	{
+		CloseHandle(mapped->file);
+	}
+#else
+	if (mapped->data)
+	{
+		munmap((void*)mapped->data, mapped->size);
+	}
+#endif
+	memset(mapped, 0, sizeof(Mapped_File));
+}
+
+/*--------------------Asset Sources---------------------------*/
+typedef struct Memory_File
+{
+	char path[256];
+	const void* data;
+	size_t size;
+}Memory_File;
+
+// 読み込みはワーカースレッドからも行われるので、登録表はロックで守る
+static Memory_File g_memory_files[MAX_MEMORY_FILES];
+static int g_memory_file_count = 0;
+static std::mutex g_memory_file_mutex;
+static const Asset_Pack* g_mounted_packs[MAX_MOUNTED_PACKS];
+static int g_mounted_pack_count = 0;
+
+// 区切り文字の違いで別のファイルにならないよう、'/'に揃えて比較する
+static void normalise_path(const char* path, char* out, int max_len)
+{
+	int i = 0;
+	for (; path[i] && i < max_len - 1; i++)
+	{
+		out[i] = path[i] == '\\' ? '/' : path[i];
+	}
+	out[i] = 0;
+}
+
+static int find_memory_file(const char* normalised)
+{
+	for (int i = 0; i < g_memory_file_count; i++)
+	{
+		if (strcmp(g_memory_files[i].path, normalised) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+bool mount_memory_file(const char* path, const void* data, size_t size)
+{
+	std::lock_guard<std::mutex> lock(g_memory_file_mutex);
+	char normalised[256];
+	normalise_path(path, normalised, 256);
+	int i = find_memory_file(normalised);
+	if (i < 0)
+	{
+		if (g_memory_file_count >= MAX_MEMORY_FILES)
+		{
+			gl_log_err("ERROR: too many memory files to mount %s\n", path);
+			return false;
+		}
+		i = g_memory_file_count++;
+		strcpy(g_memory_files[i].path, normalised);
+	}
+	g_memory_files[i].data = data;
+	g_memory_files[i].size = size;
+	return true;
+}
+
+void unmount_memory_file(const char* path)
+{
+	std::lock_guard<std::mutex> lock(g_memory_file_mutex);
+	char normalised[256];
+	normalise_path(path, normalised, 256);
+	int i = find_memory_file(normalised);
+	if (i >= 0)
+	{
+		g_memory_files[i] = g_memory_files[--g_memory_file_count];
+	}
+}
+
+bool mount_asset_pack(const Asset_Pack* pack)
+{
+	std::lock_guard<std::mutex> lock(g_memory_file_mutex);
+	if (g_mounted_pack_count >= MAX_MOUNTED_PACKS)
+	{
+		gl_log_err("ERROR: too many asset packs mounted\n");
+		return false;
+	}
+	g_mounted_packs[g_mounted_pack_count++] = pack;
+	return true;
+}
+
+void unmount_asset_pack(const Asset_Pack* pack)
+{
+	std::lock_guard<std::mutex> lock(g_memory_file_mutex);
+	for (int i = 0; i < g_mounted_pack_count; i++)
+	{
+		if (g_mounted_packs[i] == pack)
+		{
+			g_mounted_packs[i] = g_mounted_packs[--g_mounted_pack_count];
+			return;
+		}
+	}
+}
+
+// マウントしたパックからファイルを探す。見つからなければfile_indexは-1
+static const Asset_Pack* find_in_packs(const char* path, int* file_index)
+{
+	for (int i = 0; i < g_mounted_pack_count; i++)
+	{
+		*file_index = asset_pack_find(g_mounted_packs[i], path);
+		if (*file_index >= 0)
+		{
+			return g_mounted_packs[i];
+		}
+	}
+	*file_index = -1;
+	return NULL;
+}
+
+bool asset_exists(const char* path)
+{
+	{
+		std::lock_guard<std::mutex> lock(g_memory_file_mutex);
+		char normalised[256];
+		normalise_path(path, normalised, 256);
+		int file_index;
+		if (find_memory_file(normalised) >= 0 || find_in_packs(path, &file_index))
+		{
+			return true;
+		}
+	}
+	struct stat st;
+	return stat(path, &st) == 0;
+}
+
+bool open_asset(const char* path, Asset_Data* asset)
+{
+	memset(asset, 0, sizeof(Asset_Data));
+	{
+		std::lock_guard<std::mutex> lock(g_memory_file_mutex);
+		char normalised[256];
+		normalise_path(path, normalised, 256);
+		int i = find_memory_file(normalised);
+		if (i >= 0)
+		{
+			asset->data = (const unsigned char*)g_memory_files[i].data;
+			asset->size = g_memory_files[i].size;
+			return true;
+		}
+	}
+	const Asset_Pack* pack;
+	int file_index;
+	{
+		std::lock_guard<std::mutex> lock(g_memory_file_mutex);
+		pack = find_in_packs(path, &file_index);
+	}
+	if (pack)
+	{
+		// 展開は並列に行われるので、ロックの外で行う
+		asset->size = asset_pack_file_size(pack, file_index);
+		asset->owned = (unsigned char*)malloc(asset->size > 0 ? asset->size : 1);
+		asset->data = asset->owned;
+		if (!asset_pack_read(pack, file_index, asset->owned))
+		{
+			close_asset(asset);
+			return false;
+		}
+		return true;
+	}
+	if (!map_file(path, &asset->mapping))
+	{
+		return false;
+	}
+	asset->data = asset->mapping.data;
+	asset->size = asset->mapping.size;
+	return true;
+}
+
+void close_asset(Asset_Data* asset)
+{
+	unmap_file(&asset->mapping);
+	free(asset->owned);
+	memset(asset, 0, sizeof(Asset_Data));
+}
+
+/*--------------------Assimp IO Bridge---------------------------*/
+Asset_IO_Stream::Asset_IO_Stream(const Asset_Data& asset)
+	: asset(asset), position(0)
+{
+}
+
+Asset_IO_Stream::~Asset_IO_Stream()
+{
+	close_asset(&asset);
+}
+
+size_t Asset_IO_Stream::Read(void* buffer, size_t size, size_t count)
+{
+	if (size == 0)
+	{
+		return 0;
+	}
+	size_t available = (asset.size - position) / size;
+	if (count > available)
+	{
+		count = available;
+	}
+	memcpy(buffer, asset.data + position, size * count);
+	position += size * count;
+	return count;
+}
+
+// 読み込み専用。assimpが書き込もうとしたら記録して失敗を返す
+size_t Asset_IO_Stream::Write(const void*, size_t, size_t)
+{
+	gl_log_err("ERROR: asset stream is read-only\n");
+	return 0;
+}
+
+aiReturn Asset_IO_Stream::Seek(size_t offset, aiOrigin origin)
+{
+	size_t target;
+	switch (origin)
+	{
+	case aiOrigin_SET: target = offset; break;
+	case aiOrigin_CUR: target = position + offset; break;
+	case aiOrigin_END: target = asset.size - offset; break;
+	default: return aiReturn_FAILURE;
+	}
+	if (target > asset.size)
+	{
+		return aiReturn_FAILURE;
+	}
+	position = target;
+	return aiReturn_SUCCESS;
+}
+
+size_t Asset_IO_Stream::Tell() const
+{
+	return position;
+}
+
+size_t Asset_IO_Stream::FileSize() const
+{
+	return asset.size;
+}
+
+void Asset_IO_Stream::Flush()
+{
+}
+
+bool Asset_IO_System::Exists(const char* file) const
+{
+	return asset_exists(file);
+}
+
+char Asset_IO_System::getOsSeparator() const
+{
+	return '/';
+}
+
+Assimp::IOStream* Asset_IO_System::Open(const char* file, const char* mode)
+{
+	// 書き込みは扱わない
+	if (strchr(mode, 'w') || strchr(mode, 'a'))
+	{
+		return NULL;
+	}
+	Asset_Data asset;
+	if (!open_asset(file, &asset))
+	{
+		return NULL;
+	}
+	return new Asset_IO_Stream(asset);
+}
+
+void Asset_IO_System::Close(Assimp::IOStream* file)
+{
+	delete file;
+}
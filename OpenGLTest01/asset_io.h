@@ -0,0 +1,77 @@
+#ifndef _ASSET_IO_H_
+#define _ASSET_IO_H_
+
+#include <stddef.h>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+/*--------------------Memory Mapped Files---------------------------*/
+typedef struct Mapped_File
+{
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+}Mapped_File;
+
+bool map_file(const char* file_name, Mapped_File* mapped);
+void unmap_file(Mapped_File* mapped);
+
+/*--------------------Asset Sources---------------------------*/
+// メモリ上に置いたファイルを、ディスク上のファイルより優先して読む。
+// data はアンマウントするまで呼び出し側が保持する
+#define MAX_MEMORY_FILES 64
+bool mount_memory_file(const char* path, const void* data, size_t size);
+void unmount_memory_file(const char* path);
+// マウントしたパックは、メモリ上のファイルの次、ディスク上のファイルより先に探す
+struct Asset_Pack;
+#define MAX_MOUNTED_PACKS 4
+bool mount_asset_pack(const struct Asset_Pack* pack);
+void unmount_asset_pack(const struct Asset_Pack* pack);
+
+// 読み込んだアセットの中身。メモリ上のファイルはそのまま指し、パック内のファイルは展開し、
+// ディスク上のファイルはマップする
+typedef struct Asset_Data
+{
+	const unsigned char* data;
+	size_t size;
+	Mapped_File mapping;
+	unsigned char* owned;	// 展開したバッファ。close_asset()でfree()する
+}Asset_Data;
+
+bool asset_exists(const char* path);
+bool open_asset(const char* path, Asset_Data* asset);
+void close_asset(Asset_Data* asset);
+
+/*--------------------Assimp IO Bridge---------------------------*/
+// assimpのファイル読み込みをopen_asset()経由にする。読み込みは全てメモリ上のコピー無しの読み出しになる。
+// Assimp::Importer::SetIOHandler()に渡すと、Importerが破棄する
+class Asset_IO_Stream : public Assimp::IOStream
+{
+public:
+	Asset_IO_Stream(const Asset_Data& asset);
+	~Asset_IO_Stream();
+	size_t Read(void* buffer, size_t size, size_t count);
+	size_t Write(const void* buffer, size_t size, size_t count);
+	aiReturn Seek(size_t offset, aiOrigin origin);
+	size_t Tell() const;
+	size_t FileSize() const;
+	void Flush();
+
+private:
+	Asset_Data asset;
+	size_t position;
+};
+
+class Asset_IO_System : public Assimp::IOSystem
+{
+public:
+	bool Exists(const char* file) const;
+	char getOsSeparator() const;
+	Assimp::IOStream* Open(const char* file, const char* mode);
+	void Close(Assimp::IOStream* file);
+};
+
+#endif
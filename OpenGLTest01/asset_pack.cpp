@@ -0,0 +1,365 @@
+#include "asset_pack.h"
+#include "lz_codec.h"
+#include "job_system.h"
+#include "gl_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#define ASSET_PACK_EMPTY_SLOT 0xffffffffu
+
+// 区切り文字は'/'に揃えてからハッシュする
+unsigned long long hash_asset_path(const char* path)
+{
+	unsigned long long h = 14695981039346656037ull;
+	for (const char* p = path; *p; p++)
+	{
+		unsigned char c = (unsigned char)(*p == '\\' ? '/' : *p);
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+static bool same_asset_path(const char* a, const char* b)
+{
+	for (; *a && *b; a++, b++)
+	{
+		char ca = *a == '\\' ? '/' : *a;
+		char cb = *b == '\\' ? '/' : *b;
+		if (ca != cb)
+		{
+			return false;
+		}
+	}
+	return *a == *b;
+}
+
+/*--------------------Pack Builder---------------------------*/
+bool build_asset_pack(const char* pack_file, const char** files, int file_count)
+{
+	FILE* out = fopen(pack_file, "wb");
+	if (!out)
+	{
+		gl_log_err("ERROR: could not open %s for writing\n", pack_file);
+		return false;
+	}
+	Asset_Pack_Header header;
+	memset(&header, 0, sizeof(header));
+	fwrite(&header, sizeof(header), 1, out);
+
+	Asset_Pack_File* entries = (Asset_Pack_File*)calloc(file_count, sizeof(Asset_Pack_File));
+	Asset_Pack_Chunk* chunks = NULL;
+	int chunk_count = 0;
+	int chunk_capacity = 0;
+	int string_size = 0;
+	unsigned char* compressed = (unsigned char*)malloc(lz_compress_bound(ASSET_PACK_CHUNK_SIZE));
+	unsigned long long offset = sizeof(header);
+	unsigned long long raw_total = 0;
+	bool ok = true;
+
+	for (int f = 0; f < file_count && ok; f++)
+	{
+		Mapped_File mapped;
+		if (!map_file(files[f], &mapped))
+		{
+			gl_log_err("ERROR: could not read %s\n", files[f]);
+			ok = false;
+			break;
+		}
+		Asset_Pack_File* entry = &entries[f];
+		entry->hash = hash_asset_path(files[f]);
+		entry->size = mapped.size;
+		entry->path_offset = string_size;
+		entry->first_chunk = chunk_count;
+		string_size += (int)strlen(files[f]) + 1;
+		for (size_t pos = 0; pos < mapped.size; pos += ASSET_PACK_CHUNK_SIZE)
+		{
+			int raw_size = (int)(mapped.size - pos < ASSET_PACK_CHUNK_SIZE ? mapped.size - pos : ASSET_PACK_CHUNK_SIZE);
+			int size = lz_compress(mapped.data + pos, raw_size, compressed, raw_size - 1);
+			const unsigned char* data = compressed;
+			// 縮まなければそのまま格納する
+			if (size == 0)
+			{
+				size = raw_size;
+				data = mapped.data + pos;
+			}
+			if (chunk_count == chunk_capacity)
+			{
+				chunk_capacity = chunk_capacity ? chunk_capacity * 2 : 64;
+				chunks = (Asset_Pack_Chunk*)realloc(chunks, chunk_capacity * sizeof(Asset_Pack_Chunk));
+			}
+			Asset_Pack_Chunk* chunk = &chunks[chunk_count++];
+			chunk->offset = offset;
+			chunk->compressed_size = size;
+			chunk->raw_size = raw_size;
+			fwrite(data, 1, size, out);
+			offset += size;
+		}
+		entry->chunk_count = chunk_count - entry->first_chunk;
+		raw_total += mapped.size;
+		unmap_file(&mapped);
+	}
+
+	if (ok)
+	{
+		// ハッシュ表は負荷率50%以下にする
+		unsigned int table_size = 1;
+		while (table_size < (unsigned int)file_count * 2)
+		{
+			table_size *= 2;
+		}
+		unsigned int* table = (unsigned int*)malloc(table_size * sizeof(unsigned int));
+		for (unsigned int i = 0; i < table_size; i++)
+		{
+			table[i] = ASSET_PACK_EMPTY_SLOT;
+		}
+		for (int f = 0; f < file_count; f++)
+		{
+			unsigned int slot = (unsigned int)(entries[f].hash & (table_size - 1));
+			while (table[slot] != ASSET_PACK_EMPTY_SLOT)
+			{
+				slot = (slot + 1) & (table_size - 1);
+			}
+			table[slot] = f;
+		}
+
+		header.magic = ASSET_PACK_MAGIC;
+		header.version = ASSET_PACK_VERSION;
+		header.file_count = file_count;
+		header.chunk_count = chunk_count;
+		header.hash_table_size = table_size;
+		header.file_table_offset = offset;
+		fwrite(entries, sizeof(Asset_Pack_File), file_count, out);
+		offset += file_count * sizeof(Asset_Pack_File);
+		header.chunk_table_offset = offset;
+		fwrite(chunks, sizeof(Asset_Pack_Chunk), chunk_count, out);
+		offset += chunk_count * sizeof(Asset_Pack_Chunk);
+		header.hash_table_offset = offset;
+		fwrite(table, sizeof(unsigned int), table_size, out);
+		offset += table_size * sizeof(unsigned int);
+		header.string_offset = offset;
+		for (int f = 0; f < file_count; f++)
+		{
+			fwrite(files[f], 1, strlen(files[f]) + 1, out);
+		}
+		offset += string_size;
+		fseek(out, 0, SEEK_SET);
+		fwrite(&header, sizeof(header), 1, out);
+		free(table);
+		gl_log_print(
+			"built asset pack %s: %i files, %i chunks, %llu -> %llu bytes\n",
+			pack_file,
+			file_count,
+			chunk_count,
+			raw_total,
+			offset);
+	}
+
+	fclose(out);
+	free(compressed);
+	free(chunks);
+	free(entries);
+	return ok;
+}
+
+/*--------------------Pack Reader---------------------------*/
+// ファイル表とチャンク表の値を全て確かめる。読み出し時はここで確かめた範囲だけを信用する
+static bool validate_asset_pack(const Asset_Pack* pack, const char* pack_file)
+{
+	const Asset_Pack_Header* header = pack->header;
+	unsigned long long size = pack->mapping.size;
+	unsigned long long string_size = size - header->string_offset;
+	for (unsigned int c = 0; c < header->chunk_count; c++)
+	{
+		const Asset_Pack_Chunk* chunk = &pack->chunks[c];
+		if (chunk->raw_size > ASSET_PACK_CHUNK_SIZE ||
+			chunk->compressed_size > chunk->raw_size ||
+			chunk->offset > size ||
+			chunk->compressed_size > size - chunk->offset)
+		{
+			gl_log_err("ERROR: asset pack %s: chunk %u is out of range\n", pack_file, c);
+			return false;
+		}
+	}
+	for (unsigned int f = 0; f < header->file_count; f++)
+	{
+		const Asset_Pack_File* entry = &pack->files[f];
+		if (entry->path_offset >= string_size ||
+			!memchr(pack->strings + entry->path_offset, 0, (size_t)(string_size - entry->path_offset)))
+		{
+			gl_log_err("ERROR: asset pack %s: file %u has an invalid path\n", pack_file, f);
+			return false;
+		}
+		if ((unsigned long long)entry->first_chunk + entry->chunk_count > header->chunk_count)
+		{
+			gl_log_err("ERROR: asset pack %s: file %u has chunks out of range\n", pack_file, f);
+			return false;
+		}
+		// 展開先はチャンク番号 * ASSET_PACK_CHUNK_SIZEなので、最後以外は満杯でなければならない
+		unsigned long long raw_total = 0;
+		bool full = true;
+		for (unsigned int c = 0; c < entry->chunk_count; c++)
+		{
+			const Asset_Pack_Chunk* chunk = &pack->chunks[entry->first_chunk + c];
+			full = full && (c + 1 == entry->chunk_count || chunk->raw_size == ASSET_PACK_CHUNK_SIZE);
+			raw_total += chunk->raw_size;
+		}
+		if (!full || raw_total != entry->size)
+		{
+			gl_log_err("ERROR: asset pack %s: file %u size does not match its chunks\n", pack_file, f);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool open_asset_pack(const char* pack_file, Asset_Pack* pack)
+{
+	memset(pack, 0, sizeof(Asset_Pack));
+	if (!map_file(pack_file, &pack->mapping))
+	{
+		return false;
+	}
+	const unsigned char* base = pack->mapping.data;
+	unsigned long long size = pack->mapping.size;
+	const Asset_Pack_Header* header = (const Asset_Pack_Header*)base;
+	if (size < sizeof(Asset_Pack_Header) ||
+		header->magic != ASSET_PACK_MAGIC ||
+		header->version != ASSET_PACK_VERSION ||
+		header->file_table_offset > size ||
+		header->chunk_table_offset > size ||
+		header->hash_table_offset > size ||
+		(unsigned long long)header->file_count * sizeof(Asset_Pack_File) > size - header->file_table_offset ||
+		(unsigned long long)header->chunk_count * sizeof(Asset_Pack_Chunk) > size - header->chunk_table_offset ||
+		(unsigned long long)header->hash_table_size * sizeof(unsigned int) > size - header->hash_table_offset ||
+		header->string_offset > size ||
+		header->hash_table_size == 0 ||
+		(header->hash_table_size & (header->hash_table_size - 1)) != 0)
+	{
+		gl_log_err("ERROR: %s is not a valid asset pack\n", pack_file);
+		unmap_file(&pack->mapping);
+		return false;
+	}
+	pack->header = header;
+	pack->files = (const Asset_Pack_File*)(base + header->file_table_offset);
+	pack->chunks = (const Asset_Pack_Chunk*)(base + header->chunk_table_offset);
+	pack->hash_table = (const unsigned int*)(base + header->hash_table_offset);
+	pack->strings = (const char*)(base + header->string_offset);
+	if (!validate_asset_pack(pack, pack_file))
+	{
+		close_asset_pack(pack);
+		return false;
+	}
+	gl_log("opened asset pack %s: %u files\n", pack_file, header->file_count);
+	return true;
+}
+
+void close_asset_pack(Asset_Pack* pack)
+{
+	unmap_file(&pack->mapping);
+	memset(pack, 0, sizeof(Asset_Pack));
+}
+
+int asset_pack_find(const Asset_Pack* pack, const char* path)
+{
+	unsigned long long hash = hash_asset_path(path);
+	unsigned int mask = pack->header->hash_table_size - 1;
+	unsigned int slot = (unsigned int)(hash & mask);
+	// 壊れたパックでは空きスロットが無いかもしれないので、表を一周したら諦める
+	for (unsigned int probe = 0; probe < pack->header->hash_table_size; probe++, slot = (slot + 1) & mask)
+	{
+		unsigned int f = pack->hash_table[slot];
+		if (f == ASSET_PACK_EMPTY_SLOT || f >= pack->header->file_count)
+		{
+			return -1;
+		}
+		if (pack->files[f].hash == hash && same_asset_path(pack->strings + pack->files[f].path_offset, path))
+		{
+			return (int)f;
+		}
+	}
+	return -1;
+}
+
+size_t asset_pack_file_size(const Asset_Pack* pack, int file)
+{
+	return (size_t)pack->files[file].size;
+}
+
+// dst_capacityはファイルの残りの大きさ。表はopen_asset_pack()で確かめてあるが、念のため超えないようにする
+static bool decode_chunk(const Asset_Pack* pack, int chunk_index, unsigned char* dst, size_t dst_capacity)
+{
+	const Asset_Pack_Chunk* chunk = &pack->chunks[chunk_index];
+	if (chunk->raw_size > dst_capacity)
+	{
+		return false;
+	}
+	const unsigned char* src = pack->mapping.data + chunk->offset;
+	if (chunk->compressed_size == chunk->raw_size)
+	{
+		memcpy(dst, src, chunk->raw_size);
+		return true;
+	}
+	return lz_decompress(src, chunk->compressed_size, dst, chunk->raw_size) == (int)chunk->raw_size;
+}
+
+typedef struct Chunk_Job
+{
+	const Asset_Pack* pack;
+	int chunk_index;
+	unsigned char* dst;
+	size_t dst_capacity;
+	std::atomic<int>* failures;
+}Chunk_Job;
+
+static void decode_chunk_job(void* data)
+{
+	Chunk_Job* job = (Chunk_Job*)data;
+	if (!decode_chunk(job->pack, job->chunk_index, job->dst, job->dst_capacity))
+	{
+		(*job->failures)++;
+	}
+}
+
+bool asset_pack_read(const Asset_Pack* pack, int file, void* dst)
+{
+	const Asset_Pack_File* entry = &pack->files[file];
+	unsigned char* out = (unsigned char*)dst;
+	if (entry->chunk_count <= 1 || job_worker_count() == 0)
+	{
+		for (unsigned int c = 0; c < entry->chunk_count; c++)
+		{
+			size_t offset = (size_t)c * ASSET_PACK_CHUNK_SIZE;
+			if (!decode_chunk(pack, entry->first_chunk + c, out + offset, (size_t)entry->size - offset))
+			{
+				gl_log_err("ERROR: corrupt chunk in asset pack\n");
+				return false;
+			}
+		}
+		return true;
+	}
+
+	Chunk_Job* jobs = (Chunk_Job*)malloc(entry->chunk_count * sizeof(Chunk_Job));
+	std::atomic<int> failures(0);
+	Job_Counter counter;
+	init_job_counter(&counter);
+	for (unsigned int c = 0; c < entry->chunk_count; c++)
+	{
+		jobs[c].pack = pack;
+		jobs[c].chunk_index = entry->first_chunk + c;
+		jobs[c].dst = out + (size_t)c * ASSET_PACK_CHUNK_SIZE;
+		jobs[c].dst_capacity = (size_t)entry->size - (size_t)c * ASSET_PACK_CHUNK_SIZE;
+		jobs[c].failures = &failures;
+		submit_job(decode_chunk_job, &jobs[c], &counter);
+	}
+	wait_for_jobs(&counter);
+	free(jobs);
+	if (failures > 0)
+	{
+		gl_log_err("ERROR: corrupt chunk in asset pack\n");
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,68 @@
+#ifndef _ASSET_PACK_H_
+#define _ASSET_PACK_H_
+
+#include "asset_io.h"
+
+/*--------------------Asset Pack File---------------------------*/
+// メッシュ、スケルトン、シェーダなどを1つにまとめたファイル。
+// [ヘッダ][チャンクのデータ...][ファイル表][チャンク表][ハッシュ表][パス文字列]の順に並ぶ。
+// 各ファイルは64KBのチャンクに分け、チャンクごとに独立して圧縮する(縮まなければそのまま格納)。
+// パスはFNV-1aの64bitハッシュによるオープンアドレス法の表で引く
+#define ASSET_PACK_MAGIC 0x4b415041	// "APAK"
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_CHUNK_SIZE 65536
+
+typedef struct Asset_Pack_Header
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int file_count;
+	unsigned int chunk_count;
+	unsigned int hash_table_size;	// 2のべき乗
+	unsigned int reserved;
+	unsigned long long file_table_offset;
+	unsigned long long chunk_table_offset;
+	unsigned long long hash_table_offset;
+	unsigned long long string_offset;
+}Asset_Pack_Header;
+
+typedef struct Asset_Pack_File
+{
+	unsigned long long hash;
+	unsigned long long size;
+	unsigned int path_offset;	// パス文字列の先頭からの位置
+	unsigned int first_chunk;
+	unsigned int chunk_count;
+	unsigned int reserved;
+}Asset_Pack_File;
+
+typedef struct Asset_Pack_Chunk
+{
+	unsigned long long offset;
+	unsigned int compressed_size;	// raw_sizeと同じなら無圧縮
+	unsigned int raw_size;
+}Asset_Pack_Chunk;
+
+typedef struct Asset_Pack
+{
+	Mapped_File mapping;
+	const Asset_Pack_Header* header;
+	const Asset_Pack_File* files;
+	const Asset_Pack_Chunk* chunks;
+	const unsigned int* hash_table;	// ファイル番号。空きは0xffffffff
+	const char* strings;
+}Asset_Pack;
+
+unsigned long long hash_asset_path(const char* path);
+// files のパスをそのまま格納名にする
+bool build_asset_pack(const char* pack_file, const char** files, int file_count);
+bool open_asset_pack(const char* pack_file, Asset_Pack* pack);
+void close_asset_pack(Asset_Pack* pack);
+// 見つからなければ-1
+int asset_pack_find(const Asset_Pack* pack, const char* path);
+size_t asset_pack_file_size(const Asset_Pack* pack, int file);
+// dst に展開する。dst はアップロード用のバッファでもよい。
+// 複数チャンクのファイルはジョブシステムのワーカーで並列に展開する
+bool asset_pack_read(const Asset_Pack* pack, int file, void* dst);
+
+#endif
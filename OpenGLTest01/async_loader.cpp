@@ -0,0 +1,181 @@
+#include "async_loader.h"
+#include "job_system.h"
+#include "timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <mutex>
+
+typedef struct Async_Load
+{
+	std::atomic<int> state;
+	char file_name[256];
+	Mesh_Arena* arena;
+	int vertex_format;
+	Scene_Cpu_Data cpu;
+	int next_mesh;		// 次にアップロードするメッシュ
+	Scene_Mesh mesh;
+}Async_Load;
+
+static Async_Load g_loads[MAX_ASYNC_LOADS];
+static Job_Counter g_import_jobs;
+// 変換が終わってアップロードを待つロードのキュー
+static Async_Load_Handle g_upload_queue[MAX_ASYNC_LOADS];
+static int g_upload_head = 0;
+static int g_upload_count = 0;
+static std::mutex g_upload_mutex;
+
+static void import_job(void* data)
+{
+	Async_Load* load = (Async_Load*)data;
+	double start = get_precise_time_ms();
+	if (!import_scene_cpu(load->file_name, load->vertex_format, &load->cpu))
+	{
+		load->state = ASYNC_LOAD_FAILED;
+		return;
+	}
+	gl_log("async import of %s took %.2f ms\n", load->file_name, get_precise_time_ms() - start);
+	load->next_mesh = 0;
+	std::lock_guard<std::mutex> lock(g_upload_mutex);
+	g_upload_queue[(g_upload_head + g_upload_count) % MAX_ASYNC_LOADS] = (Async_Load_Handle)(load - g_loads);
+	g_upload_count++;
+	load->state = ASYNC_LOAD_UPLOADING;
+}
+
+bool start_async_loader(int worker_count)
+{
+	for (int i = 0; i < MAX_ASYNC_LOADS; i++)
+	{
+		g_loads[i].state = ASYNC_LOAD_FREE;
+	}
+	init_job_counter(&g_import_jobs);
+	if (job_worker_count() == 0)
+	{
+		return start_job_system(worker_count);
+	}
+	return true;
+}
+
+void stop_async_loader()
+{
+	wait_for_jobs(&g_import_jobs);
+	for (int i = 0; i < MAX_ASYNC_LOADS; i++)
+	{
+		Async_Load* load = &g_loads[i];
+		if (load->state == ASYNC_LOAD_UPLOADING)
+		{
+			free_scene_cpu(&load->cpu);
+		}
+		else if (load->state == ASYNC_LOAD_READY)
+		{
+			free_scene_mesh(&load->mesh);
+		}
+		load->state = ASYNC_LOAD_FREE;
+	}
+	g_upload_count = 0;
+	stop_job_system();
+}
+
+Async_Load_Handle load_mesh_async(const char* file_name, Mesh_Arena* arena)
+{
+	for (int i = 0; i < MAX_ASYNC_LOADS; i++)
+	{
+		Async_Load* load = &g_loads[i];
+		if (load->state != ASYNC_LOAD_FREE)
+		{
+			continue;
+		}
+		strncpy(load->file_name, file_name, sizeof(load->file_name) - 1);
+		load->file_name[sizeof(load->file_name) - 1] = 0;
+		load->arena = arena;
+		load->vertex_format = arena->vertex_format;
+		load->state = ASYNC_LOAD_IMPORTING;
+		submit_job(import_job, load, &g_import_jobs);
+		return (Async_Load_Handle)i;
+	}
+	gl_log_err("ERROR: too many async loads in flight, %s not loaded\n", file_name);
+	return INVALID_ASYNC_LOAD;
+}
+
+int async_load_state(Async_Load_Handle handle)
+{
+	if (handle < 0 || handle >= MAX_ASYNC_LOADS)
+	{
+		return ASYNC_LOAD_FAILED;
+	}
+	return g_loads[handle].state;
+}
+
+int pump_async_uploads(double budget_ms)
+{
+	double start = get_precise_time_ms();
+	int uploaded = 0;
+	for (;;)
+	{
+		if (uploaded > 0 && get_precise_time_ms() - start >= budget_ms)
+		{
+			break;
+		}
+		Async_Load_Handle handle;
+		{
+			std::lock_guard<std::mutex> lock(g_upload_mutex);
+			if (g_upload_count == 0)
+			{
+				break;
+			}
+			handle = g_upload_queue[g_upload_head];
+		}
+		Async_Load* load = &g_loads[handle];
+		bool done = false;
+		bool ok = true;
+		if (load->next_mesh < load->cpu.scene.mesh_count)
+		{
+			ok = upload_scene_cpu_mesh(&load->cpu, load->next_mesh, load->arena);
+			if (ok)
+			{
+				uploaded++;
+				load->next_mesh++;
+			}
+		}
+		if (!ok)
+		{
+			gl_log_err("ERROR: async upload of %s failed\n", load->file_name);
+			free_scene_cpu(&load->cpu);
+			load->state = ASYNC_LOAD_FAILED;
+			done = true;
+		}
+		else if (load->next_mesh >= load->cpu.scene.mesh_count)
+		{
+			finish_scene_cpu_upload(&load->cpu, &load->mesh);
+			free_scene_cpu(&load->cpu);
+			load->state = ASYNC_LOAD_READY;
+			gl_log("async load of %s ready\n", load->file_name);
+			done = true;
+		}
+		if (done)
+		{
+			std::lock_guard<std::mutex> lock(g_upload_mutex);
+			g_upload_head = (g_upload_head + 1) % MAX_ASYNC_LOADS;
+			g_upload_count--;
+		}
+	}
+	return uploaded;
+}
+
+bool take_async_loaded_mesh(Async_Load_Handle handle, Scene_Mesh* scene_mesh)
+{
+	int state = async_load_state(handle);
+	if (state == ASYNC_LOAD_FAILED && handle >= 0 && handle < MAX_ASYNC_LOADS)
+	{
+		g_loads[handle].state = ASYNC_LOAD_FREE;
+		return false;
+	}
+	if (state != ASYNC_LOAD_READY)
+	{
+		return false;
+	}
+	*scene_mesh = g_loads[handle].mesh;
+	g_loads[handle].mesh = Scene_Mesh();
+	g_loads[handle].state = ASYNC_LOAD_FREE;
+	return true;
+}
@@ -0,0 +1,34 @@
+#ifndef _ASYNC_LOADER_H_
+#define _ASYNC_LOADER_H_
+
+#include "gl_utils.h"
+
+/*--------------------Asynchronous Mesh Loader---------------------------*/
+// インポートと頂点変換はワーカースレッドで行い、変換済みのデータをキューに積む。
+// GLスレッドは毎フレームpump_async_uploads()で時間予算の範囲だけアップロードする
+#define MAX_ASYNC_LOADS 256
+
+#define ASYNC_LOAD_FREE 0
+#define ASYNC_LOAD_IMPORTING 1	// ワーカーで読み込み中
+#define ASYNC_LOAD_UPLOADING 2	// アップロード待ち・アップロード中
+#define ASYNC_LOAD_READY 3
+#define ASYNC_LOAD_FAILED 4
+
+typedef int Async_Load_Handle;
+#define INVALID_ASYNC_LOAD -1
+
+// worker_countが0以下ならハードウェアスレッド数に合わせる
+bool start_async_loader(int worker_count);
+// 読み込み中のものは完了を待ってから破棄する
+void stop_async_loader();
+// すぐにハンドルを返す。スロットが無ければINVALID_ASYNC_LOAD
+Async_Load_Handle load_mesh_async(const char* file_name, Mesh_Arena* arena);
+int async_load_state(Async_Load_Handle handle);
+// GLスレッドから呼ぶ。budget_msを超えない範囲でメッシュ単位にアップロードする
+// (進行を保証するため、1回の呼び出しで少なくとも1メッシュはアップロードする)。
+// アップロードしたメッシュ数を返す
+int pump_async_uploads(double budget_ms);
+// READYならScene_Meshを受け取ってスロットを解放する。FAILEDならスロットを解放してfalse
+bool take_async_loaded_mesh(Async_Load_Handle handle, Scene_Mesh* scene_mesh);
+
+#endif
@@ -0,0 +1,128 @@
+#include "bone_palette.h"
+#include "gl_utils.h"
+#include "gl_state.h"
+#include <stdio.h>
+#include <string.h>
+
+/*--------------------Bone Palette---------------------------*/
+static_assert(sizeof(mat4) == 16 * sizeof(float), "mat4 must match the std140 matrix stride");
+
+static Bone_Palette_Stats g_palette_stats;
+static mat4 g_identity_palette[BONE_PALETTE_SIZE];
+static bool g_identity_palette_ready = false;
+static GLuint g_palette_texture = 0;
+
+void bind_bone_palette_block(GLuint programme)
+{
+	GLint sampler = glGetUniformLocation(programme, BONE_PALETTE_SAMPLER_NAME);
+	if (sampler >= 0)
+	{
+		gl_state_use_programme(programme);
+		glUniform1i(sampler, BONE_PALETTE_TEXTURE_UNIT);
+	}
+	GLuint index = glGetUniformBlockIndex(programme, BONE_PALETTE_BLOCK_NAME);
+	if (GL_INVALID_INDEX == index)
+	{
+		return;
+	}
+	glUniformBlockBinding(programme, index, BONE_PALETTE_BINDING);
+	gl_log("programme %u: %s bound to %i\n", programme, BONE_PALETTE_BLOCK_NAME, BONE_PALETTE_BINDING);
+}
+
+bool create_bone_palette_texture(Staging_Ring* ring)
+{
+	GLint max_texels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+	if (ring->size / 16 > max_texels)
+	{
+		gl_log_err(
+			"ERROR: staging ring of %i bytes exceeds GL_MAX_TEXTURE_BUFFER_SIZE (%i texels)\n",
+			ring->size,
+			max_texels);
+		return false;
+	}
+	glGenTextures(1, &g_palette_texture);
+	glActiveTexture(GL_TEXTURE0 + BONE_PALETTE_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, g_palette_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, ring->buffer);
+	return true;
+}
+
+void destroy_bone_palette_texture()
+{
+	glDeleteTextures(1, &g_palette_texture);
+	g_palette_texture = 0;
+}
+
+GLuint bone_palette_texel(int offset)
+{
+	// パレットはUBOのオフセット境界(16の倍数)に置かれる
+	return (GLuint)offset / 16;
+}
+
+int write_bone_palette(Staging_Ring* ring, const mat4* bone_mats, int bone_count)
+{
+	static GLint alignment = 0;
+	if (0 == alignment)
+	{
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		// テクスチャバッファからも読むので、少なくともRGBA32Fの1テクセルに揃える
+		if (alignment < 16)
+		{
+			alignment = 16;
+		}
+	}
+	if (!g_identity_palette_ready)
+	{
+		for (int i = 0; i < BONE_PALETTE_SIZE; i++)
+		{
+			g_identity_palette[i] = identity_mat4();
+		}
+		g_identity_palette_ready = true;
+	}
+	if (!bone_mats || bone_count < 0)
+	{
+		bone_count = 0;
+	}
+	if (bone_count > BONE_PALETTE_SIZE)
+	{
+		bone_count = BONE_PALETTE_SIZE;
+	}
+	int offset;
+	unsigned char* dst = (unsigned char*)staging_ring_alloc(ring, BONE_PALETTE_BYTES, alignment, &offset);
+	if (!dst)
+	{
+		return -1;
+	}
+	// ブロック全体を結ぶので、使わない分も単位行列で埋めておく
+	size_t used = bone_count * sizeof(mat4);
+	if (used > 0)
+	{
+		memcpy(dst, bone_mats, used);
+	}
+	memcpy(dst + used, g_identity_palette + bone_count, BONE_PALETTE_BYTES - used);
+
+	g_palette_stats.palettes++;
+	g_palette_stats.bytes += BONE_PALETTE_BYTES;
+	g_palette_stats.frame_palettes++;
+	return offset;
+}
+
+void bind_bone_palette(Staging_Ring* ring, int offset)
+{
+	staging_ring_bind_range(ring, GL_UNIFORM_BUFFER, BONE_PALETTE_BINDING, offset, BONE_PALETTE_BYTES);
+}
+
+void begin_bone_palette_frame()
+{
+	g_palette_stats.frame_palettes = 0;
+}
+
+void log_bone_palette_stats()
+{
+	gl_log_print(
+		"bone palettes: %lld written, %.1f KB total, %i last frame\n",
+		g_palette_stats.palettes,
+		g_palette_stats.bytes / 1024.0,
+		g_palette_stats.frame_palettes);
+}
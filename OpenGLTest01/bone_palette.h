@@ -0,0 +1,49 @@
+#ifndef _BONE_PALETTE_H_
+#define _BONE_PALETTE_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+#include "maths_funcs.h"
+#include "staging_ring.h"
+#include "gl_utils.h"
+
+/*--------------------Bone Palette---------------------------*/
+// スキニングするインスタンスごとのボーン行列をstd140のuniformブロックとしてステージングリングに書き込み、
+// 描画ごとにその範囲をBONE_PALETTE_BINDINGへ結ぶ。リングは永続マップなので更新はmemcpyだけで済み、
+// GPUが読み終えるまではフェンスで上書きされない(数フレーム分が同時に存在できる)。
+// シェーダ側は次のブロックを宣言する。BONE_PALETTE_SIZEはプログラムの作成時に渡す
+//	layout(std140) uniform Bone_Palette {
+//		mat4 bone_matrices[BONE_PALETTE_SIZE];
+//	};
+// インスタンス描画ではパレットをインスタンスごとに切り替えられないので、リング全体をテクスチャバッファとして
+// BONE_PALETTE_TEXTURE_UNITに結び、各インスタンスがパレットの先頭テクセル(RGBA32Fの行列の列)を持つ
+//	uniform samplerBuffer bone_palettes;
+#define BONE_PALETTE_BLOCK_NAME "Bone_Palette"
+#define BONE_PALETTE_SAMPLER_NAME "bone_palettes"
+#define BONE_PALETTE_TEXTURE_UNIT 0
+#define BONE_PALETTE_BINDING 1
+#define BONE_PALETTE_SIZE MAX_BONES
+#define BONE_PALETTE_BYTES (BONE_PALETTE_SIZE * 16 * (int)sizeof(float))
+
+typedef struct Bone_Palette_Stats
+{
+	long long palettes;		// 書き込んだパレットの数
+	long long bytes;
+	int frame_palettes;		// 最後のフレームの分
+}Bone_Palette_Stats;
+
+// リンク直後に呼ぶ。ブロックやサンプラを宣言していないプログラムでは何もしない
+void bind_bone_palette_block(GLuint programme);
+// リングのバッファを参照するテクスチャバッファを作る。大きさが上限を超えるならfalse
+bool create_bone_palette_texture(Staging_Ring* ring);
+void destroy_bone_palette_texture();
+// write_bone_palette()のオフセットをテクスチャバッファ内の位置にする
+GLuint bone_palette_texel(int offset);
+// bone_countまでの行列を書き込み、リング内のオフセットを返す。残りは単位行列で埋める。
+// bone_matsがNULLなら全て単位行列。リングが一杯なら-1
+int write_bone_palette(Staging_Ring* ring, const mat4* bone_mats, int bone_count);
+void bind_bone_palette(Staging_Ring* ring, int offset);
+// フレームの始めに呼ぶ
+void begin_bone_palette_frame();
+void log_bone_palette_stats();
+
+#endif
@@ -1,7 +1,7 @@
-#version 410
-
-out vec4 frag_color;
-
-void main() {
-	frag_color = vec4(1.0, 1.0, 0.0, 1.0);
+#version 410
+
+out vec4 frag_color;
+
+void main() {
+	frag_color = vec4(1.0, 1.0, 0.0, 1.0);
 }
\ No newline at end of file
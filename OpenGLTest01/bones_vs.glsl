@@ -1,9 +1,13 @@
-#version 410
-
-in vec3 position;
-uniform mat4 proj, view;
-
-void main() {
-	gl_PointSize = 10.0;
-	gl_Position = proj * view * vec4(position, 1.0);
+#version 410
+
+in vec3 position;
+layout(std140) uniform Frame_Uniforms {
+	mat4 view, proj, view_proj;
+	vec4 camera_position;
+	float time;
+};
+
+void main() {
+	gl_PointSize = 10.0;
+	gl_Position = view_proj * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,1663 @@
+#include "collada_reader.h"
+#include "asset_io.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define MAX_XML_DEPTH 64
+#define MAX_XML_ATTRIBUTES 16
+#define MAX_COLLADA_ID 128
+#define MAX_PRIMITIVE_INPUTS 8
+
+/*--------------------XML Tokenizer---------------------------*/
+typedef struct Xml_Attribute
+{
+	const char* name;
+	int name_len;
+	const char* value;
+	int value_len;
+}Xml_Attribute;
+
+struct Collada_Reader;
+static void on_start_element(
+	Collada_Reader* reader,
+	const char* name,
+	int name_len,
+	const Xml_Attribute* attributes,
+	int attribute_count);
+static void on_end_element(Collada_Reader* reader);
+static void on_text(Collada_Reader* reader, const char* text, const char* end);
+
+static bool is_xml_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static const char* find_text(const char* p, const char* end, const char* pattern)
+{
+	int len = (int)strlen(pattern);
+	for (; p + len <= end; p++)
+	{
+		if (*p == pattern[0] && memcmp(p, pattern, len) == 0)
+		{
+			return p;
+		}
+	}
+	return NULL;
+}
+
+// 要素の開始・終了とテキストをその場で通知する。エンティティ参照は展開しない
+static bool parse_xml(const char* data, size_t size, Collada_Reader* reader)
+{
+	const char* p = data;
+	const char* end = data + size;
+	while (p < end)
+	{
+		const char* lt = (const char*)memchr(p, '<', end - p);
+		if (!lt)
+		{
+			on_text(reader, p, end);
+			break;
+		}
+		if (lt > p)
+		{
+			on_text(reader, p, lt);
+		}
+		p = lt + 1;
+		if (p >= end)
+		{
+			return false;
+		}
+		if (*p == '?')
+		{
+			const char* close = find_text(p, end, "?>");
+			if (!close) return false;
+			p = close + 2;
+			continue;
+		}
+		if (*p == '!')
+		{
+			if (end - p >= 3 && memcmp(p, "!--", 3) == 0)
+			{
+				const char* close = find_text(p + 3, end, "-->");
+				if (!close) return false;
+				p = close + 3;
+			}
+			else if (end - p >= 8 && memcmp(p, "![CDATA[", 8) == 0)
+			{
+				const char* close = find_text(p + 8, end, "]]>");
+				if (!close) return false;
+				on_text(reader, p + 8, close);
+				p = close + 3;
+			}
+			else
+			{
+				const char* close = (const char*)memchr(p, '>', end - p);
+				if (!close) return false;
+				p = close + 1;
+			}
+			continue;
+		}
+		if (*p == '/')
+		{
+			const char* close = (const char*)memchr(p, '>', end - p);
+			if (!close) return false;
+			on_end_element(reader);
+			p = close + 1;
+			continue;
+		}
+
+		// 開始タグ
+		const char* name = p;
+		while (p < end && !is_xml_space(*p) && *p != '>' && *p != '/')
+		{
+			p++;
+		}
+		int name_len = (int)(p - name);
+		Xml_Attribute attributes[MAX_XML_ATTRIBUTES];
+		int attribute_count = 0;
+		bool self_closing = false;
+		for (;;)
+		{
+			while (p < end && is_xml_space(*p))
+			{
+				p++;
+			}
+			if (p >= end)
+			{
+				return false;
+			}
+			if (*p == '>')
+			{
+				p++;
+				break;
+			}
+			if (*p == '/')
+			{
+				self_closing = true;
+				p++;
+				continue;
+			}
+			const char* attribute_name = p;
+			while (p < end && *p != '=' && !is_xml_space(*p) && *p != '>')
+			{
+				p++;
+			}
+			int attribute_name_len = (int)(p - attribute_name);
+			while (p < end && (is_xml_space(*p) || *p == '='))
+			{
+				p++;
+			}
+			if (p >= end || (*p != '"' && *p != '\''))
+			{
+				return false;
+			}
+			char quote = *p++;
+			const char* value = p;
+			const char* value_end = (const char*)memchr(p, quote, end - p);
+			if (!value_end)
+			{
+				return false;
+			}
+			p = value_end + 1;
+			if (attribute_count < MAX_XML_ATTRIBUTES)
+			{
+				Xml_Attribute* a = &attributes[attribute_count++];
+				a->name = attribute_name;
+				a->name_len = attribute_name_len;
+				a->value = value;
+				a->value_len = (int)(value_end - value);
+			}
+		}
+		on_start_element(reader, name, name_len, attributes, attribute_count);
+		if (self_closing)
+		{
+			on_end_element(reader);
+		}
+	}
+	return true;
+}
+
+/*--------------------Number Parsing---------------------------*/
+static const double g_powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// ロケールに依存しない10進数の読み取り。仮数は19桁まで使い、残りは指数に回す。
+// 数値が無ければ p を1文字進めて0を返す
+static const char* parse_float(const char* p, const char* end, float* out)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+	for (; p < end && *p >= '0' && *p <= '9'; p++)
+	{
+		any = true;
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa) digits++;
+		}
+		else
+		{
+			exponent++;
+		}
+	}
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+		{
+			any = true;
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa) digits++;
+				exponent--;
+			}
+		}
+	}
+	if (!any)
+	{
+		*out = 0.0f;
+		return p + 1;
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		bool exponent_negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			exponent_negative = *p == '-';
+			p++;
+		}
+		int e = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; p++)
+		{
+			if (e < 10000) e = e * 10 + (*p - '0');
+		}
+		exponent += exponent_negative ? -e : e;
+	}
+	double value = (double)mantissa;
+	if (exponent < 0)
+	{
+		value = -exponent <= 22 ? value / g_powers_of_ten[-exponent] : value * pow(10.0, exponent);
+	}
+	else if (exponent > 0)
+	{
+		value = exponent <= 22 ? value * g_powers_of_ten[exponent] : value * pow(10.0, exponent);
+	}
+	*out = (float)(negative ? -value : value);
+	return p;
+}
+
+static const char* parse_int(const char* p, const char* end, int* out)
+{
+	bool negative = false;
+	if (p < end && *p == '-')
+	{
+		negative = true;
+		p++;
+	}
+	if (p >= end || *p < '0' || *p > '9')
+	{
+		*out = 0;
+		return p + 1;
+	}
+	int value = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++)
+	{
+		value = value * 10 + (*p - '0');
+	}
+	*out = negative ? -value : value;
+	return p;
+}
+
+/*--------------------Reader State---------------------------*/
+// 扱う要素。それ以外はELEMENT_OTHERとして中身ごと無視する
+#define ELEMENT_OTHER 0
+#define ELEMENT_UP_AXIS 1
+#define ELEMENT_GEOMETRY 2
+#define ELEMENT_MESH 3
+#define ELEMENT_SOURCE 4
+#define ELEMENT_FLOAT_ARRAY 5
+#define ELEMENT_NAME_ARRAY 6
+#define ELEMENT_ACCESSOR 7
+#define ELEMENT_VERTICES 8
+#define ELEMENT_INPUT 9
+#define ELEMENT_POLYLIST 10
+#define ELEMENT_TRIANGLES 11
+#define ELEMENT_VCOUNT 12
+#define ELEMENT_P 13
+#define ELEMENT_CONTROLLER 14
+#define ELEMENT_SKIN 15
+#define ELEMENT_BIND_SHAPE_MATRIX 16
+#define ELEMENT_JOINTS 17
+#define ELEMENT_VERTEX_WEIGHTS 18
+#define ELEMENT_V 19
+#define ELEMENT_VISUAL_SCENE 20
+#define ELEMENT_NODE 21
+#define ELEMENT_MATRIX 22
+#define ELEMENT_TRANSLATE 23
+#define ELEMENT_ROTATE 24
+#define ELEMENT_SCALE 25
+#define ELEMENT_INSTANCE_GEOMETRY 26
+#define ELEMENT_INSTANCE_CONTROLLER 27
+#define ELEMENT_UNSUPPORTED 28
+
+typedef struct Element_Name
+{
+	const char* name;
+	int id;
+}Element_Name;
+
+static const Element_Name g_element_names[] = {
+	{ "up_axis", ELEMENT_UP_AXIS },
+	{ "geometry", ELEMENT_GEOMETRY },
+	{ "mesh", ELEMENT_MESH },
+	{ "source", ELEMENT_SOURCE },
+	{ "float_array", ELEMENT_FLOAT_ARRAY },
+	{ "Name_array", ELEMENT_NAME_ARRAY },
+	{ "IDREF_array", ELEMENT_NAME_ARRAY },
+	{ "accessor", ELEMENT_ACCESSOR },
+	{ "vertices", ELEMENT_VERTICES },
+	{ "input", ELEMENT_INPUT },
+	{ "polylist", ELEMENT_POLYLIST },
+	{ "triangles", ELEMENT_TRIANGLES },
+	{ "vcount", ELEMENT_VCOUNT },
+	{ "p", ELEMENT_P },
+	{ "controller", ELEMENT_CONTROLLER },
+	{ "skin", ELEMENT_SKIN },
+	{ "bind_shape_matrix", ELEMENT_BIND_SHAPE_MATRIX },
+	{ "joints", ELEMENT_JOINTS },
+	{ "vertex_weights", ELEMENT_VERTEX_WEIGHTS },
+	{ "v", ELEMENT_V },
+	{ "visual_scene", ELEMENT_VISUAL_SCENE },
+	{ "node", ELEMENT_NODE },
+	{ "matrix", ELEMENT_MATRIX },
+	{ "translate", ELEMENT_TRANSLATE },
+	{ "rotate", ELEMENT_ROTATE },
+	{ "scale", ELEMENT_SCALE },
+	{ "instance_geometry", ELEMENT_INSTANCE_GEOMETRY },
+	{ "instance_controller", ELEMENT_INSTANCE_CONTROLLER },
+	{ "polygons", ELEMENT_UNSUPPORTED },
+	{ "tristrips", ELEMENT_UNSUPPORTED },
+	{ "trifans", ELEMENT_UNSUPPORTED },
+};
+
+// テキストの取り込み先
+#define TEXT_NONE 0
+#define TEXT_FLOATS 1		// 決まった数のfloat
+#define TEXT_INTS 2			// 可変長のint
+#define TEXT_NAMES 3		// 空白区切りの名前
+#define TEXT_STRING 4
+
+typedef struct Int_Array
+{
+	int* data;
+	int count;
+	int capacity;
+}Int_Array;
+
+typedef struct Collada_Source
+{
+	char id[MAX_COLLADA_ID];
+	float* floats;
+	int float_count;
+	char (*names)[64];
+	int name_count;
+	int stride;
+}Collada_Source;
+
+typedef struct Collada_Input
+{
+	char semantic[32];
+	char source[MAX_COLLADA_ID];
+	int offset;
+	int set;
+}Collada_Input;
+
+typedef struct Collada_Geometry
+{
+	char id[MAX_COLLADA_ID];
+	int first_mesh;
+	int mesh_count;
+}Collada_Geometry;
+
+// <polylist>/<triangles>1つ分。出力頂点ごとに元の位置番号を覚えておき、後でスキンのウェイトを引く
+typedef struct Collada_Mesh
+{
+	int geometry;
+	Mesh_Source source;
+	int* position_index;
+}Collada_Mesh;
+
+typedef struct Collada_Skin
+{
+	char controller_id[MAX_COLLADA_ID];
+	char geometry_id[MAX_COLLADA_ID];
+	int joint_count;
+	char (*joint_names)[64];
+	mat4* offsets;			// INV_BIND_MATRIX * bind_shape_matrix
+	int* scene_bones;		// シーン全体のボーン番号。組み立て時に決まる
+	int position_count;
+	int* weight_offsets;	// 位置番号ごとの(joint, weight)の範囲
+	int* weight_joints;
+	float* weight_values;
+}Collada_Skin;
+
+typedef struct Collada_Node
+{
+	char name[64];
+	char sid[64];
+	int parent;
+	mat4 local;
+	mat4 world;
+}Collada_Node;
+
+typedef struct Collada_Instance
+{
+	int node;
+	char url[MAX_COLLADA_ID];
+	bool controller;
+}Collada_Instance;
+
+typedef struct Collada_Reader
+{
+	int stack[MAX_XML_DEPTH];
+	int depth;
+	bool unsupported;
+
+	int text_mode;
+	float* text_floats;
+	int text_float_capacity;
+	int* text_float_count;
+	Int_Array* text_ints;
+	char (*text_names)[64];
+	int text_name_capacity;
+	int* text_name_count;
+	char text_string[64];
+
+	// スコープ内の<source>。<mesh>と<skin>の終わりで解放する
+	Collada_Source* sources;
+	int source_count;
+	int source_capacity;
+
+	Collada_Input vertex_inputs[MAX_PRIMITIVE_INPUTS];
+	int vertex_input_count;
+	char vertices_id[MAX_COLLADA_ID];
+
+	Collada_Input inputs[MAX_PRIMITIVE_INPUTS];
+	int input_count;
+	int primitive_count;
+	bool polylist;
+	Int_Array vcount;
+	Int_Array p;
+
+	Collada_Geometry* geometries;
+	int geometry_count;
+	int geometry_capacity;
+	Collada_Mesh* meshes;
+	int mesh_count;
+	int mesh_capacity;
+
+	char controller_id[MAX_COLLADA_ID];
+	char skin_geometry[MAX_COLLADA_ID];
+	float bind_shape[16];
+	Collada_Input joint_inputs[MAX_PRIMITIVE_INPUTS];
+	int joint_input_count;
+	Collada_Input weight_inputs[MAX_PRIMITIVE_INPUTS];
+	int weight_input_count;
+	Collada_Skin* skins;
+	int skin_count;
+	int skin_capacity;
+
+	char scene_name[64];
+	Collada_Node* nodes;
+	int node_count;
+	int node_capacity;
+	int current_node;
+	float transform[16];
+	int transform_count;
+	Collada_Instance* instances;
+	int instance_count;
+	int instance_capacity;
+
+	int up_axis;	// 0: X, 1: Y, 2: Z
+}Collada_Reader;
+
+// 配列を必要なら倍に伸ばす
+static void* grow_array(void* data, int* capacity, int needed, size_t element_size)
+{
+	if (needed <= *capacity)
+	{
+		return data;
+	}
+	int new_capacity = *capacity > 0 ? *capacity * 2 : 16;
+	while (new_capacity < needed)
+	{
+		new_capacity *= 2;
+	}
+	*capacity = new_capacity;
+	return realloc(data, new_capacity * element_size);
+}
+
+static void push_int(Int_Array* a, int v)
+{
+	a->data = (int*)grow_array(a->data, &a->capacity, a->count + 1, sizeof(int));
+	a->data[a->count++] = v;
+}
+
+static bool name_equals(const char* name, int len, const char* s)
+{
+	return (int)strlen(s) == len && memcmp(name, s, len) == 0;
+}
+
+// 属性値をコピーする。URLの先頭の#は取り除く
+static bool get_attribute(
+	const Xml_Attribute* attributes,
+	int attribute_count,
+	const char* name,
+	char* out,
+	int max_len)
+{
+	for (int i = 0; i < attribute_count; i++)
+	{
+		const Xml_Attribute* a = &attributes[i];
+		if (!name_equals(a->name, a->name_len, name))
+		{
+			continue;
+		}
+		const char* value = a->value;
+		int len = a->value_len;
+		if (len > 0 && value[0] == '#')
+		{
+			value++;
+			len--;
+		}
+		if (len >= max_len)
+		{
+			len = max_len - 1;
+		}
+		memcpy(out, value, len);
+		out[len] = 0;
+		return true;
+	}
+	out[0] = 0;
+	return false;
+}
+
+static int get_int_attribute(const Xml_Attribute* attributes, int attribute_count, const char* name, int fallback)
+{
+	char value[32];
+	if (!get_attribute(attributes, attribute_count, name, value, sizeof(value)))
+	{
+		return fallback;
+	}
+	return atoi(value);
+}
+
+static Collada_Source* find_source(Collada_Reader* reader, const char* id)
+{
+	for (int i = 0; i < reader->source_count; i++)
+	{
+		if (strcmp(reader->sources[i].id, id) == 0)
+		{
+			return &reader->sources[i];
+		}
+	}
+	return NULL;
+}
+
+static void free_sources(Collada_Reader* reader)
+{
+	for (int i = 0; i < reader->source_count; i++)
+	{
+		free(reader->sources[i].floats);
+		free(reader->sources[i].names);
+	}
+	reader->source_count = 0;
+}
+
+static const Collada_Input* find_input(const Collada_Input* inputs, int count, const char* semantic)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(inputs[i].semantic, semantic) == 0)
+		{
+			return &inputs[i];
+		}
+	}
+	return NULL;
+}
+
+static void read_input(Collada_Input* input, const Xml_Attribute* attributes, int attribute_count)
+{
+	get_attribute(attributes, attribute_count, "semantic", input->semantic, sizeof(input->semantic));
+	get_attribute(attributes, attribute_count, "source", input->source, sizeof(input->source));
+	input->offset = get_int_attribute(attributes, attribute_count, "offset", 0);
+	input->set = get_int_attribute(attributes, attribute_count, "set", 0);
+}
+
+// COLLADAの行列は行優先
+static mat4 row_major_to_mat4(const float* r)
+{
+	return mat4(
+		r[0], r[4], r[8], r[12],
+		r[1], r[5], r[9], r[13],
+		r[2], r[6], r[10], r[14],
+		r[3], r[7], r[11], r[15]);
+}
+
+/*--------------------Geometry---------------------------*/
+// 頂点の組(位置, 法線, UV)が同じ角は1つの頂点にまとめる
+typedef struct Corner_Key
+{
+	int position;
+	int normal;
+	int texcoord;
+	int vertex;
+}Corner_Key;
+
+static int find_or_add_vertex(Corner_Key* table, int table_size, int position, int normal, int texcoord, int* vertex_count)
+{
+	unsigned int h = ((unsigned int)position * 73856093u) ^ ((unsigned int)normal * 19349663u) ^
+		((unsigned int)texcoord * 83492791u);
+	int slot = (int)(h & (table_size - 1));
+	for (;;)
+	{
+		Corner_Key* k = &table[slot];
+		if (k->vertex < 0)
+		{
+			k->position = position;
+			k->normal = normal;
+			k->texcoord = texcoord;
+			k->vertex = (*vertex_count)++;
+			return k->vertex;
+		}
+		if (k->position == position && k->normal == normal && k->texcoord == texcoord)
+		{
+			return k->vertex;
+		}
+		slot = (slot + 1) & (table_size - 1);
+	}
+}
+
+// <input semantic="VERTEX">は<vertices>の入力に置き換えて探す
+static const Collada_Source* primitive_source(
+	Collada_Reader* reader,
+	const char* semantic,
+	int* offset)
+{
+	const Collada_Input* input = find_input(reader->inputs, reader->input_count, semantic);
+	if (!input)
+	{
+		const Collada_Input* vertex = find_input(reader->inputs, reader->input_count, "VERTEX");
+		if (!vertex || strcmp(vertex->source, reader->vertices_id) != 0)
+		{
+			return NULL;
+		}
+		input = find_input(reader->vertex_inputs, reader->vertex_input_count, semantic);
+		if (!input)
+		{
+			return NULL;
+		}
+		*offset = vertex->offset;
+		return find_source(reader, input->source);
+	}
+	*offset = input->offset;
+	return find_source(reader, input->source);
+}
+
+static void build_primitive(Collada_Reader* reader)
+{
+	if (reader->geometry_count == 0)
+	{
+		return;
+	}
+	int position_offset = 0, normal_offset = 0, texcoord_offset = 0;
+	const Collada_Source* positions = primitive_source(reader, "POSITION", &position_offset);
+	const Collada_Source* normals = primitive_source(reader, "NORMAL", &normal_offset);
+	const Collada_Source* texcoords = primitive_source(reader, "TEXCOORD", &texcoord_offset);
+	if (!positions || !positions->floats)
+	{
+		gl_log_err("WARNING: COLLADA primitive without positions skipped\n");
+		return;
+	}
+	int stride = 0;
+	for (int i = 0; i < reader->input_count; i++)
+	{
+		if (reader->inputs[i].offset + 1 > stride)
+		{
+			stride = reader->inputs[i].offset + 1;
+		}
+	}
+	int position_stride = positions->stride > 0 ? positions->stride : 3;
+	int normal_stride = normals && normals->stride > 0 ? normals->stride : 3;
+	int texcoord_stride = texcoords && texcoords->stride > 0 ? texcoords->stride : 2;
+	int position_count = positions->float_count / position_stride;
+	int normal_count = normals ? normals->float_count / normal_stride : 0;
+	int texcoord_count = texcoords ? texcoords->float_count / texcoord_stride : 0;
+
+	// 多角形は扇形に三角形分割する
+	int corner_count = reader->p.count / (stride > 0 ? stride : 1);
+	int polygon_count = reader->polylist ? reader->vcount.count : corner_count / 3;
+	int triangle_count = 0;
+	int corners_used = 0;
+	for (int i = 0; i < polygon_count; i++)
+	{
+		int n = reader->polylist ? reader->vcount.data[i] : 3;
+		corners_used += n;
+		if (n >= 3)
+		{
+			triangle_count += n - 2;
+		}
+	}
+	if (corners_used > corner_count)
+	{
+		gl_log_err("ERROR: COLLADA primitive has fewer indices than its vcount\n");
+		reader->unsupported = true;
+		return;
+	}
+
+	int table_size = 1;
+	while (table_size < corner_count * 2)
+	{
+		table_size <<= 1;
+	}
+	Corner_Key* table = (Corner_Key*)malloc(table_size * sizeof(Corner_Key));
+	for (int i = 0; i < table_size; i++)
+	{
+		table[i].vertex = -1;
+	}
+	Collada_Mesh mesh;
+	memset(&mesh, 0, sizeof(mesh));
+	mesh.geometry = reader->geometry_count - 1;
+	Mesh_Source* source = &mesh.source;
+	source->positions = (GLfloat*)malloc(corner_count * 3 * sizeof(GLfloat));
+	source->normals = normals ? (GLfloat*)malloc(corner_count * 3 * sizeof(GLfloat)) : NULL;
+	source->texcoords = texcoords ? (GLfloat*)malloc(corner_count * 2 * sizeof(GLfloat)) : NULL;
+	source->indices = (GLuint*)malloc(triangle_count * 3 * sizeof(GLuint));
+	mesh.position_index = (int*)malloc(corner_count * sizeof(int));
+
+	int* corner_vertices = (int*)malloc((corner_count > 0 ? corner_count : 1) * sizeof(int));
+	const int* p = reader->p.data;
+	for (int c = 0; c < corners_used; c++)
+	{
+		const int* tuple = &p[c * stride];
+		int pi = tuple[position_offset];
+		int ni = normals ? tuple[normal_offset] : 0;
+		int ti = texcoords ? tuple[texcoord_offset] : 0;
+		if (pi < 0 || pi >= position_count || (normals && (ni < 0 || ni >= normal_count)) ||
+			(texcoords && (ti < 0 || ti >= texcoord_count)))
+		{
+			gl_log_err("ERROR: COLLADA index out of range\n");
+			reader->unsupported = true;
+			pi = 0;
+			ni = 0;
+			ti = 0;
+		}
+		int before = source->point_count;
+		int v = find_or_add_vertex(table, table_size, pi, ni, ti, &source->point_count);
+		corner_vertices[c] = v;
+		if (v != before)
+		{
+			continue;
+		}
+		mesh.position_index[v] = pi;
+		memcpy(&source->positions[v * 3], &positions->floats[pi * position_stride], 3 * sizeof(GLfloat));
+		if (normals)
+		{
+			memcpy(&source->normals[v * 3], &normals->floats[ni * normal_stride], 3 * sizeof(GLfloat));
+		}
+		if (texcoords)
+		{
+			memcpy(&source->texcoords[v * 2], &texcoords->floats[ti * texcoord_stride], 2 * sizeof(GLfloat));
+		}
+	}
+	int corner = 0;
+	for (int i = 0; i < polygon_count; i++)
+	{
+		int n = reader->polylist ? reader->vcount.data[i] : 3;
+		for (int k = 1; k + 1 < n; k++)
+		{
+			source->indices[source->index_count++] = corner_vertices[corner];
+			source->indices[source->index_count++] = corner_vertices[corner + k];
+			source->indices[source->index_count++] = corner_vertices[corner + k + 1];
+		}
+		corner += n;
+	}
+	free(corner_vertices);
+	free(table);
+
+	// 頂点数が確定したので詰める
+	int point_count = source->point_count > 0 ? source->point_count : 1;
+	source->positions = (GLfloat*)realloc(source->positions, point_count * 3 * sizeof(GLfloat));
+	if (source->normals)
+	{
+		source->normals = (GLfloat*)realloc(source->normals, point_count * 3 * sizeof(GLfloat));
+	}
+	if (source->texcoords)
+	{
+		source->texcoords = (GLfloat*)realloc(source->texcoords, point_count * 2 * sizeof(GLfloat));
+	}
+	mesh.position_index = (int*)realloc(mesh.position_index, point_count * sizeof(int));
+
+	reader->meshes = (Collada_Mesh*)grow_array(
+		reader->meshes, &reader->mesh_capacity, reader->mesh_count + 1, sizeof(Collada_Mesh));
+	reader->meshes[reader->mesh_count++] = mesh;
+	reader->geometries[reader->geometry_count - 1].mesh_count++;
+}
+
+/*--------------------Skin Controllers---------------------------*/
+static void build_skin(Collada_Reader* reader)
+{
+	const Collada_Input* joint_input = find_input(reader->joint_inputs, reader->joint_input_count, "JOINT");
+	const Collada_Input* bind_input = find_input(reader->joint_inputs, reader->joint_input_count, "INV_BIND_MATRIX");
+	const Collada_Input* weight_joint = find_input(reader->weight_inputs, reader->weight_input_count, "JOINT");
+	const Collada_Input* weight_value = find_input(reader->weight_inputs, reader->weight_input_count, "WEIGHT");
+	const Collada_Source* joints = joint_input ? find_source(reader, joint_input->source) : NULL;
+	const Collada_Source* binds = bind_input ? find_source(reader, bind_input->source) : NULL;
+	const Collada_Source* weights = weight_value ? find_source(reader, weight_value->source) : NULL;
+	if (!joints || !joints->names || !weight_joint || !weights || !weights->floats)
+	{
+		gl_log_err("WARNING: incomplete COLLADA skin %s skipped\n", reader->controller_id);
+		return;
+	}
+
+	Collada_Skin skin;
+	memset(&skin, 0, sizeof(skin));
+	strcpy(skin.controller_id, reader->controller_id);
+	strcpy(skin.geometry_id, reader->skin_geometry);
+	skin.joint_count = joints->name_count;
+	skin.joint_names = (char(*)[64])malloc(skin.joint_count * 64);
+	memcpy(skin.joint_names, joints->names, skin.joint_count * 64);
+	skin.offsets = (mat4*)malloc(skin.joint_count * sizeof(mat4));
+	skin.scene_bones = (int*)malloc(skin.joint_count * sizeof(int));
+	for (int j = 0; j < skin.joint_count; j++)
+	{
+		skin.scene_bones[j] = -1;
+		mat4 bind_shape = row_major_to_mat4(reader->bind_shape);
+		mat4 inverse_bind = identity_mat4();
+		if (binds && binds->floats && (j + 1) * 16 <= binds->float_count)
+		{
+			inverse_bind = row_major_to_mat4(&binds->floats[j * 16]);
+		}
+		skin.offsets[j] = inverse_bind * bind_shape;
+	}
+
+	int stride = 0;
+	for (int i = 0; i < reader->weight_input_count; i++)
+	{
+		if (reader->weight_inputs[i].offset + 1 > stride)
+		{
+			stride = reader->weight_inputs[i].offset + 1;
+		}
+	}
+	skin.position_count = reader->vcount.count;
+	skin.weight_offsets = (int*)malloc((skin.position_count + 1) * sizeof(int));
+	int pair_count = 0;
+	for (int i = 0; i < skin.position_count; i++)
+	{
+		skin.weight_offsets[i] = pair_count;
+		pair_count += reader->vcount.data[i];
+	}
+	skin.weight_offsets[skin.position_count] = pair_count;
+	if (pair_count * stride > reader->p.count)
+	{
+		gl_log_err("ERROR: COLLADA skin %s has fewer weights than its vcount\n", reader->controller_id);
+		reader->unsupported = true;
+		pair_count = 0;
+		memset(skin.weight_offsets, 0, (skin.position_count + 1) * sizeof(int));
+	}
+	skin.weight_joints = (int*)malloc((pair_count > 0 ? pair_count : 1) * sizeof(int));
+	skin.weight_values = (float*)malloc((pair_count > 0 ? pair_count : 1) * sizeof(float));
+	for (int i = 0; i < pair_count; i++)
+	{
+		int j = reader->p.data[i * stride + weight_joint->offset];
+		int w = reader->p.data[i * stride + weight_value->offset];
+		skin.weight_joints[i] = j >= 0 && j < skin.joint_count ? j : -1;
+		skin.weight_values[i] = w >= 0 && w < weights->float_count ? weights->floats[w] : 0.0f;
+	}
+
+	reader->skins = (Collada_Skin*)grow_array(
+		reader->skins, &reader->skin_capacity, reader->skin_count + 1, sizeof(Collada_Skin));
+	reader->skins[reader->skin_count++] = skin;
+}
+
+/*--------------------Element Handlers---------------------------*/
+static int parent_element(const Collada_Reader* reader)
+{
+	return reader->depth >= 2 ? reader->stack[reader->depth - 2] : ELEMENT_OTHER;
+}
+
+static void capture_floats(Collada_Reader* reader, float* dst, int capacity, int* count)
+{
+	reader->text_mode = TEXT_FLOATS;
+	reader->text_floats = dst;
+	reader->text_float_capacity = capacity;
+	reader->text_float_count = count;
+	*count = 0;
+}
+
+static void capture_ints(Collada_Reader* reader, Int_Array* dst)
+{
+	reader->text_mode = TEXT_INTS;
+	reader->text_ints = dst;
+	dst->count = 0;
+}
+
+static void on_start_element(
+	Collada_Reader* reader,
+	const char* name,
+	int name_len,
+	const Xml_Attribute* attributes,
+	int attribute_count)
+{
+	int element = ELEMENT_OTHER;
+	for (int i = 0; i < (int)(sizeof(g_element_names) / sizeof(g_element_names[0])); i++)
+	{
+		if (name_equals(name, name_len, g_element_names[i].name))
+		{
+			element = g_element_names[i].id;
+			break;
+		}
+	}
+	if (reader->depth < MAX_XML_DEPTH)
+	{
+		reader->stack[reader->depth] = element;
+	}
+	reader->depth++;
+	int parent = parent_element(reader);
+	reader->text_mode = TEXT_NONE;
+
+	switch (element) {
+	case ELEMENT_UP_AXIS:
+		reader->text_mode = TEXT_STRING;
+		reader->text_string[0] = 0;
+		break;
+	case ELEMENT_GEOMETRY:
+	{
+		reader->geometries = (Collada_Geometry*)grow_array(
+			reader->geometries, &reader->geometry_capacity, reader->geometry_count + 1, sizeof(Collada_Geometry));
+		Collada_Geometry* g = &reader->geometries[reader->geometry_count++];
+		get_attribute(attributes, attribute_count, "id", g->id, sizeof(g->id));
+		g->first_mesh = reader->mesh_count;
+		g->mesh_count = 0;
+		break;
+	}
+	case ELEMENT_MESH:
+		reader->vertex_input_count = 0;
+		reader->vertices_id[0] = 0;
+		break;
+	case ELEMENT_SOURCE:
+	{
+		reader->sources = (Collada_Source*)grow_array(
+			reader->sources, &reader->source_capacity, reader->source_count + 1, sizeof(Collada_Source));
+		Collada_Source* s = &reader->sources[reader->source_count++];
+		memset(s, 0, sizeof(Collada_Source));
+		get_attribute(attributes, attribute_count, "id", s->id, sizeof(s->id));
+		break;
+	}
+	case ELEMENT_FLOAT_ARRAY:
+		if (reader->source_count > 0)
+		{
+			Collada_Source* s = &reader->sources[reader->source_count - 1];
+			int count = get_int_attribute(attributes, attribute_count, "count", 0);
+			free(s->floats);
+			s->floats = (float*)malloc((count > 0 ? count : 1) * sizeof(float));
+			capture_floats(reader, s->floats, count, &s->float_count);
+		}
+		break;
+	case ELEMENT_NAME_ARRAY:
+		if (reader->source_count > 0)
+		{
+			Collada_Source* s = &reader->sources[reader->source_count - 1];
+			int count = get_int_attribute(attributes, attribute_count, "count", 0);
+			free(s->names);
+			s->names = (char(*)[64])malloc((count > 0 ? count : 1) * 64);
+			s->name_count = 0;
+			reader->text_mode = TEXT_NAMES;
+			reader->text_names = s->names;
+			reader->text_name_capacity = count;
+			reader->text_name_count = &s->name_count;
+		}
+		break;
+	case ELEMENT_ACCESSOR:
+		if (reader->source_count > 0)
+		{
+			reader->sources[reader->source_count - 1].stride = get_int_attribute(attributes, attribute_count, "stride", 1);
+		}
+		break;
+	case ELEMENT_VERTICES:
+		get_attribute(attributes, attribute_count, "id", reader->vertices_id, sizeof(reader->vertices_id));
+		reader->vertex_input_count = 0;
+		break;
+	case ELEMENT_INPUT:
+	{
+		Collada_Input* inputs = NULL;
+		int* count = NULL;
+		if (parent == ELEMENT_VERTICES)
+		{
+			inputs = reader->vertex_inputs;
+			count = &reader->vertex_input_count;
+		}
+		else if (parent == ELEMENT_POLYLIST || parent == ELEMENT_TRIANGLES)
+		{
+			inputs = reader->inputs;
+			count = &reader->input_count;
+		}
+		else if (parent == ELEMENT_JOINTS)
+		{
+			inputs = reader->joint_inputs;
+			count = &reader->joint_input_count;
+		}
+		else if (parent == ELEMENT_VERTEX_WEIGHTS)
+		{
+			inputs = reader->weight_inputs;
+			count = &reader->weight_input_count;
+		}
+		if (inputs && *count < MAX_PRIMITIVE_INPUTS)
+		{
+			Collada_Input* input = &inputs[(*count)++];
+			read_input(input, attributes, attribute_count);
+			// UVは最初のセットだけを使う
+			if (strcmp(input->semantic, "TEXCOORD") == 0 &&
+				find_input(inputs, *count - 1, "TEXCOORD"))
+			{
+				strcpy(input->semantic, "TEXCOORD_EXTRA");
+			}
+		}
+		break;
+	}
+	case ELEMENT_POLYLIST:
+	case ELEMENT_TRIANGLES:
+		reader->input_count = 0;
+		reader->polylist = element == ELEMENT_POLYLIST;
+		reader->primitive_count = get_int_attribute(attributes, attribute_count, "count", 0);
+		reader->vcount.count = 0;
+		reader->p.count = 0;
+		break;
+	case ELEMENT_VCOUNT:
+		if (parent == ELEMENT_POLYLIST || parent == ELEMENT_VERTEX_WEIGHTS)
+		{
+			capture_ints(reader, &reader->vcount);
+		}
+		break;
+	case ELEMENT_P:
+		if (parent == ELEMENT_POLYLIST || parent == ELEMENT_TRIANGLES)
+		{
+			capture_ints(reader, &reader->p);
+		}
+		break;
+	case ELEMENT_V:
+		if (parent == ELEMENT_VERTEX_WEIGHTS)
+		{
+			capture_ints(reader, &reader->p);
+		}
+		break;
+	case ELEMENT_CONTROLLER:
+		get_attribute(attributes, attribute_count, "id", reader->controller_id, sizeof(reader->controller_id));
+		break;
+	case ELEMENT_SKIN:
+		get_attribute(attributes, attribute_count, "source", reader->skin_geometry, sizeof(reader->skin_geometry));
+		memset(reader->bind_shape, 0, sizeof(reader->bind_shape));
+		reader->bind_shape[0] = reader->bind_shape[5] = reader->bind_shape[10] = reader->bind_shape[15] = 1.0f;
+		reader->joint_input_count = 0;
+		reader->weight_input_count = 0;
+		reader->vcount.count = 0;
+		reader->p.count = 0;
+		break;
+	case ELEMENT_BIND_SHAPE_MATRIX:
+	case ELEMENT_MATRIX:
+	case ELEMENT_TRANSLATE:
+	case ELEMENT_ROTATE:
+	case ELEMENT_SCALE:
+		capture_floats(reader, reader->transform, 16, &reader->transform_count);
+		break;
+	case ELEMENT_VISUAL_SCENE:
+		if (!get_attribute(attributes, attribute_count, "name", reader->scene_name, sizeof(reader->scene_name)))
+		{
+			get_attribute(attributes, attribute_count, "id", reader->scene_name, sizeof(reader->scene_name));
+		}
+		reader->current_node = -1;
+		break;
+	case ELEMENT_NODE:
+	{
+		reader->nodes = (Collada_Node*)grow_array(
+			reader->nodes, &reader->node_capacity, reader->node_count + 1, sizeof(Collada_Node));
+		Collada_Node* n = &reader->nodes[reader->node_count];
+		if (!get_attribute(attributes, attribute_count, "name", n->name, sizeof(n->name)))
+		{
+			get_attribute(attributes, attribute_count, "id", n->name, sizeof(n->name));
+		}
+		get_attribute(attributes, attribute_count, "sid", n->sid, sizeof(n->sid));
+		n->parent = reader->current_node;
+		n->local = identity_mat4();
+		n->world = identity_mat4();
+		reader->current_node = reader->node_count++;
+		break;
+	}
+	case ELEMENT_INSTANCE_GEOMETRY:
+	case ELEMENT_INSTANCE_CONTROLLER:
+		if (parent == ELEMENT_NODE && reader->current_node >= 0)
+		{
+			reader->instances = (Collada_Instance*)grow_array(
+				reader->instances, &reader->instance_capacity, reader->instance_count + 1, sizeof(Collada_Instance));
+			Collada_Instance* instance = &reader->instances[reader->instance_count++];
+			instance->node = reader->current_node;
+			instance->controller = element == ELEMENT_INSTANCE_CONTROLLER;
+			get_attribute(attributes, attribute_count, "url", instance->url, sizeof(instance->url));
+		}
+		break;
+	case ELEMENT_UNSUPPORTED:
+		gl_log_err("WARNING: unsupported COLLADA primitive <%.*s>\n", name_len, name);
+		reader->unsupported = true;
+		break;
+	default:
+		break;
+	}
+}
+
+// ノードの変換要素は出現順に右から掛ける
+static void apply_node_transform(Collada_Reader* reader, int element)
+{
+	if (reader->current_node < 0)
+	{
+		return;
+	}
+	Collada_Node* n = &reader->nodes[reader->current_node];
+	const float* t = reader->transform;
+	mat4 m = identity_mat4();
+	if (element == ELEMENT_MATRIX && reader->transform_count == 16)
+	{
+		m = row_major_to_mat4(t);
+	}
+	else if (element == ELEMENT_TRANSLATE && reader->transform_count == 3)
+	{
+		m = translate(identity_mat4(), vec3(t[0], t[1], t[2]));
+	}
+	else if (element == ELEMENT_ROTATE && reader->transform_count == 4)
+	{
+		m = quat_to_mat4(quat_from_axis_deg(t[3], t[0], t[1], t[2]));
+	}
+	else if (element == ELEMENT_SCALE && reader->transform_count == 3)
+	{
+		m = scale(identity_mat4(), vec3(t[0], t[1], t[2]));
+	}
+	n->local = n->local * m;
+}
+
+static void on_end_element(Collada_Reader* reader)
+{
+	if (reader->depth <= 0)
+	{
+		return;
+	}
+	int element = reader->depth <= MAX_XML_DEPTH ? reader->stack[reader->depth - 1] : ELEMENT_OTHER;
+	int parent = parent_element(reader);
+	reader->depth--;
+	reader->text_mode = TEXT_NONE;
+
+	switch (element) {
+	case ELEMENT_UP_AXIS:
+		if (strcmp(reader->text_string, "X_UP") == 0)
+		{
+			reader->up_axis = 0;
+		}
+		else if (strcmp(reader->text_string, "Z_UP") == 0)
+		{
+			reader->up_axis = 2;
+		}
+		break;
+	case ELEMENT_POLYLIST:
+	case ELEMENT_TRIANGLES:
+		build_primitive(reader);
+		break;
+	case ELEMENT_MESH:
+		free_sources(reader);
+		break;
+	case ELEMENT_SKIN:
+		build_skin(reader);
+		free_sources(reader);
+		break;
+	case ELEMENT_BIND_SHAPE_MATRIX:
+		if (reader->transform_count == 16)
+		{
+			memcpy(reader->bind_shape, reader->transform, sizeof(reader->bind_shape));
+		}
+		break;
+	case ELEMENT_MATRIX:
+	case ELEMENT_TRANSLATE:
+	case ELEMENT_ROTATE:
+	case ELEMENT_SCALE:
+		if (parent == ELEMENT_NODE)
+		{
+			apply_node_transform(reader, element);
+		}
+		break;
+	case ELEMENT_NODE:
+		if (reader->current_node >= 0)
+		{
+			reader->current_node = reader->nodes[reader->current_node].parent;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void on_text(Collada_Reader* reader, const char* text, const char* end)
+{
+	const char* p = text;
+	switch (reader->text_mode) {
+	case TEXT_FLOATS:
+		for (;;)
+		{
+			while (p < end && is_xml_space(*p))
+			{
+				p++;
+			}
+			if (p >= end || *reader->text_float_count >= reader->text_float_capacity)
+			{
+				break;
+			}
+			p = parse_float(p, end, &reader->text_floats[(*reader->text_float_count)++]);
+		}
+		break;
+	case TEXT_INTS:
+		for (;;)
+		{
+			while (p < end && is_xml_space(*p))
+			{
+				p++;
+			}
+			if (p >= end)
+			{
+				break;
+			}
+			int v;
+			p = parse_int(p, end, &v);
+			push_int(reader->text_ints, v);
+		}
+		break;
+	case TEXT_NAMES:
+		for (;;)
+		{
+			while (p < end && is_xml_space(*p))
+			{
+				p++;
+			}
+			if (p >= end || *reader->text_name_count >= reader->text_name_capacity)
+			{
+				break;
+			}
+			const char* word = p;
+			while (p < end && !is_xml_space(*p))
+			{
+				p++;
+			}
+			int len = (int)(p - word) < 63 ? (int)(p - word) : 63;
+			char* name = reader->text_names[(*reader->text_name_count)++];
+			memcpy(name, word, len);
+			name[len] = 0;
+		}
+		break;
+	case TEXT_STRING:
+	{
+		while (p < end && is_xml_space(*p))
+		{
+			p++;
+		}
+		int len = 0;
+		while (p + len < end && !is_xml_space(p[len]) && len < (int)sizeof(reader->text_string) - 1)
+		{
+			len++;
+		}
+		memcpy(reader->text_string, p, len);
+		reader->text_string[len] = 0;
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+/*--------------------Scene Assembly---------------------------*/
+static void free_collada_reader(Collada_Reader* reader)
+{
+	free_sources(reader);
+	free(reader->sources);
+	free(reader->vcount.data);
+	free(reader->p.data);
+	for (int i = 0; i < reader->mesh_count; i++)
+	{
+		free_mesh_source(&reader->meshes[i].source);
+		free(reader->meshes[i].position_index);
+	}
+	free(reader->meshes);
+	free(reader->geometries);
+	for (int i = 0; i < reader->skin_count; i++)
+	{
+		Collada_Skin* skin = &reader->skins[i];
+		free(skin->joint_names);
+		free(skin->offsets);
+		free(skin->scene_bones);
+		free(skin->weight_offsets);
+		free(skin->weight_joints);
+		free(skin->weight_values);
+	}
+	free(reader->skins);
+	free(reader->nodes);
+	free(reader->instances);
+	free(reader);
+}
+
+static int find_geometry(const Collada_Reader* reader, const char* id)
+{
+	for (int i = 0; i < reader->geometry_count; i++)
+	{
+		if (strcmp(reader->geometries[i].id, id) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static Collada_Skin* find_skin_for_geometry(Collada_Reader* reader, const char* geometry_id)
+{
+	for (int i = 0; i < reader->skin_count; i++)
+	{
+		if (strcmp(reader->skins[i].geometry_id, geometry_id) == 0)
+		{
+			return &reader->skins[i];
+		}
+	}
+	return NULL;
+}
+
+// インスタンスのURLが指すジオメトリ。コントローラならそのスキンの元のジオメトリ
+static int instance_geometry(Collada_Reader* reader, const Collada_Instance* instance)
+{
+	if (!instance->controller)
+	{
+		return find_geometry(reader, instance->url);
+	}
+	for (int i = 0; i < reader->skin_count; i++)
+	{
+		if (strcmp(reader->skins[i].controller_id, instance->url) == 0)
+		{
+			return find_geometry(reader, reader->skins[i].geometry_id);
+		}
+	}
+	return -1;
+}
+
+// ジョイントはsidで書かれることが多いので、ノード名に直してボーン名とノード名を揃える
+static const char* joint_node_name(const Collada_Reader* reader, const char* joint)
+{
+	for (int i = 0; i < reader->node_count; i++)
+	{
+		if (strcmp(reader->nodes[i].sid, joint) == 0)
+		{
+			return reader->nodes[i].name;
+		}
+	}
+	return joint;
+}
+
+// ウェイトを持つジョイントだけを、ジョイントの並び順にシーン全体のボーン表へ登録する
+static void register_skin_bones(
+	Collada_Reader* reader,
+	Collada_Skin* skin,
+	char bone_names[][64],
+	Scene_Mesh* scene_mesh)
+{
+	int pair_count = skin->weight_offsets[skin->position_count];
+	for (int j = 0; j < skin->joint_count; j++)
+	{
+		if (skin->scene_bones[j] >= 0)
+		{
+			continue;
+		}
+		bool weighted = false;
+		for (int i = 0; i < pair_count && !weighted; i++)
+		{
+			weighted = skin->weight_joints[i] == j && skin->weight_values[i] > 0.0f;
+		}
+		if (!weighted)
+		{
+			continue;
+		}
+		// オフセット行列はassimpと同じく平行移動だけを使う
+		mat4 offset = identity_mat4();
+		offset.m[12] = skin->offsets[j].m[12];
+		offset.m[13] = skin->offsets[j].m[13];
+		offset.m[14] = skin->offsets[j].m[14];
+		skin->scene_bones[j] = find_or_add_bone(
+			joint_node_name(reader, skin->joint_names[j]),
+			offset,
+			bone_names,
+			scene_mesh);
+	}
+}
+
+static void collada_mesh_influences(const Collada_Skin* skin, Collada_Mesh* mesh)
+{
+	Mesh_Source* source = &mesh->source;
+	source->influences = (Vertex_Influences*)calloc(
+		source->point_count > 0 ? source->point_count : 1,
+		sizeof(Vertex_Influences));
+	for (int v = 0; v < source->point_count; v++)
+	{
+		int position = mesh->position_index[v];
+		if (position >= skin->position_count)
+		{
+			continue;
+		}
+		for (int i = skin->weight_offsets[position]; i < skin->weight_offsets[position + 1]; i++)
+		{
+			int joint = skin->weight_joints[i];
+			if (joint >= 0 && skin->scene_bones[joint] >= 0 && skin->weight_values[i] > 0.0f)
+			{
+				add_influence(&source->influences[v], skin->scene_bones[joint], skin->weight_values[i]);
+			}
+		}
+	}
+}
+
+// import_skeleton_node()と同じく、ボーンか、ボーンを持つ子孫のあるノードだけを残す
+static bool build_skeleton_node(
+	const Collada_Reader* reader,
+	int node,
+	const char* name,
+	Skeleton_Node** skeleton_node,
+	int bone_count,
+	char bone_names[][64])
+{
+	Skeleton_Node* temp = alloc_skeleton_node();
+	strncpy(temp->name, name, sizeof(temp->name) - 1);
+	for (int i = 0; i < bone_count; i++)
+	{
+		if (strcmp(bone_names[i], temp->name) == 0)
+		{
+			temp->bone_index = i;
+			break;
+		}
+	}
+	for (int i = node + 1; i < reader->node_count; i++)
+	{
+		if (reader->nodes[i].parent != node || temp->num_children >= MAX_BONES)
+		{
+			continue;
+		}
+		if (build_skeleton_node(
+			reader,
+			i,
+			reader->nodes[i].name,
+			&temp->children[temp->num_children],
+			bone_count,
+			bone_names))
+		{
+			temp->num_children++;
+		}
+	}
+	if (temp->num_children > 0 || temp->bone_index >= 0)
+	{
+		*skeleton_node = temp;
+		return true;
+	}
+	free_skeleton_node(temp);
+	return false;
+}
+
+static bool assemble_scene(Collada_Reader* reader, int vertex_format, Scene_Cpu_Data* cpu)
+{
+	Scene_Mesh* scene_mesh = &cpu->scene;
+	Scratch_Arena* scratch = thread_scratch_arena();
+	Scratch_Marker scene_marker = scratch_mark(scratch);
+	char (*bone_names)[64] = (char (*)[64])scratch_alloc(scratch, MAX_BONES * 64);
+
+	// 上方向はassimpと同じくルートの回転でY_UPに揃える
+	mat4 root = identity_mat4();
+	if (reader->up_axis == 2)
+	{
+		root = mat4(
+			1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, -1.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+	else if (reader->up_axis == 0)
+	{
+		root = mat4(
+			0.0f, 1.0f, 0.0f, 0.0f,
+			-1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f);
+	}
+	for (int i = 0; i < reader->node_count; i++)
+	{
+		Collada_Node* n = &reader->nodes[i];
+		mat4 parent = n->parent >= 0 ? reader->nodes[n->parent].world : root;
+		n->world = parent * n->local;
+	}
+
+	int mesh_count = reader->mesh_count;
+	scene_mesh->meshes = (Submesh*)malloc((mesh_count > 0 ? mesh_count : 1) * sizeof(Submesh));
+	scene_mesh->mesh_count = mesh_count;
+	cpu->mesh_data = (Mesh_Cpu_Data*)calloc(mesh_count > 0 ? mesh_count : 1, sizeof(Mesh_Cpu_Data));
+	for (int m_i = 0; m_i < mesh_count; m_i++)
+	{
+		Collada_Mesh* mesh = &reader->meshes[m_i];
+		Collada_Skin* skin = find_skin_for_geometry(reader, reader->geometries[mesh->geometry].id);
+		if (skin)
+		{
+			register_skin_bones(reader, skin, bone_names, scene_mesh);
+			collada_mesh_influences(skin, mesh);
+		}
+		Submesh* range = &scene_mesh->meshes[m_i];
+		range->base_vertex = -1;
+		range->first_index = -1;
+		range->mesh_index = m_i;
+		range->material_index = 0;
+		range->transform = identity_mat4();
+		printf("%i vertices in mesh[%i]\n", mesh->source.point_count, m_i);
+
+		Scratch_Marker mesh_marker = scratch_mark(scratch);
+		convert_mesh_source(&mesh->source, vertex_format, scratch, &cpu->mesh_data[m_i], range);
+		scratch_release(scratch, mesh_marker);
+		free(mesh->position_index);
+		mesh->position_index = NULL;
+		scene_mesh->vertex_count += range->vertex_count;
+		scene_mesh->index_count += range->index_count;
+	}
+
+	// インスタンスごとにサブメッシュを作る
+	int reference_count = 0;
+	for (int i = 0; i < reader->instance_count; i++)
+	{
+		int g = instance_geometry(reader, &reader->instances[i]);
+		if (g >= 0)
+		{
+			reference_count += reader->geometries[g].mesh_count;
+		}
+	}
+	scene_mesh->submeshes = (Submesh*)malloc((reference_count > 0 ? reference_count : 1) * sizeof(Submesh));
+	for (int i = 0; i < reader->instance_count; i++)
+	{
+		const Collada_Instance* instance = &reader->instances[i];
+		int g = instance_geometry(reader, instance);
+		if (g < 0)
+		{
+			gl_log_err("WARNING: COLLADA instance of missing %s\n", instance->url);
+			continue;
+		}
+		const Collada_Geometry* geometry = &reader->geometries[g];
+		for (int m = 0; m < geometry->mesh_count; m++)
+		{
+			Submesh* sm = &scene_mesh->submeshes[scene_mesh->submesh_count++];
+			*sm = scene_mesh->meshes[geometry->first_mesh + m];
+			sm->transform = reader->nodes[instance->node].world;
+		}
+	}
+	printf("%i submeshes\n", scene_mesh->submesh_count);
+
+	if (scene_mesh->bone_count > 0)
+	{
+		if (!build_skeleton_node(
+			reader,
+			-1,
+			reader->scene_name,
+			&scene_mesh->skeleton_root,
+			scene_mesh->bone_count,
+			bone_names))
+		{
+			fprintf(stderr, "ERROR: could not build skeleton from COLLADA nodes\n");
+		}
+	}
+	scratch_release(scratch, scene_marker);
+	return true;
+}
+
+bool import_collada_cpu(
+	const char* file_name,
+	int vertex_format,
+	Scene_Cpu_Data* cpu)
+{
+	*cpu = Scene_Cpu_Data();
+	cpu->vertex_format = vertex_format;
+	Asset_Data asset;
+	if (!open_asset(file_name, &asset))
+	{
+		return false;
+	}
+	double start = get_precise_time_ms();
+	Collada_Reader* reader = (Collada_Reader*)calloc(1, sizeof(Collada_Reader));
+	reader->up_axis = 1;
+	reader->current_node = -1;
+	bool parsed = parse_xml((const char*)asset.data, asset.size, reader);
+	close_asset(&asset);
+	if (!parsed || reader->unsupported)
+	{
+		gl_log_err("WARNING: %s could not be streamed, falling back to assimp\n", file_name);
+		free_collada_reader(reader);
+		return false;
+	}
+	double parse_ms = get_precise_time_ms() - start;
+
+	assemble_scene(reader, vertex_format, cpu);
+	free_collada_reader(reader);
+	gl_log(
+		"streamed %s: parse %.2f ms, total %.2f ms, %i meshes, %i bones\n",
+		file_name,
+		parse_ms,
+		get_precise_time_ms() - start,
+		cpu->scene.mesh_count,
+		cpu->scene.bone_count);
+	return true;
+}
+
+void benchmark_collada_import(const char* file_name, int iterations)
+{
+	double streamed_ms = 0.0;
+	double assimp_ms = 0.0;
+	for (int i = 0; i < iterations; i++)
+	{
+		Scene_Cpu_Data cpu;
+		double start = get_precise_time_ms();
+		bool ok = import_collada_cpu(file_name, 0, &cpu);
+		streamed_ms += get_precise_time_ms() - start;
+		free_scene_cpu(&cpu);
+		if (!ok)
+		{
+			printf("%s could not be streamed\n", file_name);
+			return;
+		}
+		start = get_precise_time_ms();
+		ok = import_scene_cpu_assimp(file_name, 0, &cpu);
+		assimp_ms += get_precise_time_ms() - start;
+		free_scene_cpu(&cpu);
+		if (!ok)
+		{
+			return;
+		}
+	}
+	printf(
+		"%s: streaming reader %.2f ms, assimp %.2f ms (average of %i)\n",
+		file_name,
+		streamed_ms / iterations,
+		assimp_ms / iterations,
+		iterations);
+	log_allocator_stats();
+}
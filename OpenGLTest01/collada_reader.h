@@ -0,0 +1,18 @@
+#ifndef _COLLADA_READER_H_
+#define _COLLADA_READER_H_
+
+#include "gl_utils.h"
+
+/*--------------------Streaming COLLADA Reader---------------------------*/
+// .daeをDOMを作らずに先頭から1回だけ走査し(SAX)、数値の配列は読みながら直接float/intに変換する。
+// 扱うのはジオメトリ(<polylist>, <triangles>)、スキンコントローラ、ノード階層のみで、
+// アニメーション・マテリアル・画像などは読み飛ばす。
+// <polygons>, <tristrips>, <trifans>を含むファイルはfalseを返すので、assimpで読み直す
+bool import_collada_cpu(
+	const char* file_name,
+	int vertex_format,
+	Scene_Cpu_Data* cpu);
+// ストリーミングのリーダーとassimpで同じファイルを読み、平均時間を表示する
+void benchmark_collada_import(const char* file_name, int iterations);
+
+#endif
@@ -0,0 +1,328 @@
+#include "frame_benchmark.h"
+#include "gl_utils.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/*--------------------Frame Benchmark---------------------------*/
+static const char* g_phase_names[BENCH_PHASE_COUNT] = {
+	"update",
+	"submit",
+	"sort",
+	"flush",
+	"present",
+};
+
+bool create_frame_benchmark(Frame_Benchmark* bench, int frames, int warmup)
+{
+	memset(bench, 0, sizeof(Frame_Benchmark));
+	bool ok = true;
+	for (int i = 0; i < BENCH_PHASE_COUNT; i++)
+	{
+		bench->cpu_ms[i] = (double*)calloc(frames, sizeof(double));
+		ok = ok && bench->cpu_ms[i];
+	}
+	bench->frame_ms = (double*)calloc(frames, sizeof(double));
+	bench->gpu_ms = (double*)malloc(frames * sizeof(double));
+	if (!ok || !bench->frame_ms || !bench->gpu_ms)
+	{
+		gl_log_err("ERROR: could not allocate benchmark of %i frames\n", frames);
+		destroy_frame_benchmark(bench);
+		return false;
+	}
+	for (int i = 0; i < frames; i++)
+	{
+		bench->gpu_ms[i] = -1.0;
+	}
+	bench->frame_count = frames;
+	bench->warmup = warmup;
+	// GL_TIME_ELAPSEDは3.3のコアかARB_timer_query
+	bench->gpu_timing = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	if (bench->gpu_timing)
+	{
+		glGenQueries(BENCH_GPU_QUERY_LATENCY, bench->queries);
+	}
+	for (int i = 0; i < BENCH_GPU_QUERY_LATENCY; i++)
+	{
+		bench->query_frames[i] = -1;
+	}
+	return true;
+}
+
+void destroy_frame_benchmark(Frame_Benchmark* bench)
+{
+	for (int i = 0; i < BENCH_PHASE_COUNT; i++)
+	{
+		free(bench->cpu_ms[i]);
+	}
+	free(bench->frame_ms);
+	free(bench->gpu_ms);
+	if (bench->gpu_timing)
+	{
+		glDeleteQueries(BENCH_GPU_QUERY_LATENCY, bench->queries);
+	}
+	memset(bench, 0, sizeof(Frame_Benchmark));
+}
+
+bool benchmark_active(const Frame_Benchmark* bench)
+{
+	return bench->frame_count > 0;
+}
+
+int benchmark_total_frames(const Frame_Benchmark* bench)
+{
+	return bench->warmup + bench->frame_count;
+}
+
+double benchmark_time(const Frame_Benchmark* bench)
+{
+	return bench->frame * BENCH_TIMESTEP;
+}
+
+// ウォームアップを除いた記録先。範囲外なら-1
+static int sample_index(const Frame_Benchmark* bench, int frame)
+{
+	int i = frame - bench->warmup;
+	return i >= 0 && i < bench->frame_count ? i : -1;
+}
+
+// slotのクエリの結果を読む。まだ出ていなければ待つ
+static void collect_gpu_query(Frame_Benchmark* bench, int slot)
+{
+	int frame = bench->query_frames[slot];
+	if (frame < 0)
+	{
+		return;
+	}
+	GLuint64 ns = 0;
+	glGetQueryObjectui64v(bench->queries[slot], GL_QUERY_RESULT, &ns);
+	int i = sample_index(bench, frame);
+	if (i >= 0)
+	{
+		bench->gpu_ms[i] = ns / 1000000.0;
+	}
+	bench->query_frames[slot] = -1;
+}
+
+void begin_benchmark_frame(Frame_Benchmark* bench)
+{
+	if (!benchmark_active(bench))
+	{
+		return;
+	}
+	if (bench->gpu_timing)
+	{
+		// LATENCYフレーム前の結果は普通もう出ているので、ここではほとんど待たない
+		int slot = bench->frame % BENCH_GPU_QUERY_LATENCY;
+		collect_gpu_query(bench, slot);
+		glBeginQuery(GL_TIME_ELAPSED, bench->queries[slot]);
+		bench->query_frames[slot] = bench->frame;
+	}
+	bench->frame_start = get_precise_time_ms();
+	bench->phase_start = bench->frame_start;
+}
+
+void mark_benchmark_phase(Frame_Benchmark* bench, int phase)
+{
+	if (!benchmark_active(bench))
+	{
+		return;
+	}
+	double now = get_precise_time_ms();
+	int i = sample_index(bench, bench->frame);
+	if (i >= 0)
+	{
+		bench->cpu_ms[phase][i] += now - bench->phase_start;
+	}
+	bench->phase_start = now;
+}
+
+void end_benchmark_frame(Frame_Benchmark* bench)
+{
+	if (!benchmark_active(bench))
+	{
+		return;
+	}
+	if (bench->gpu_timing)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+	int i = sample_index(bench, bench->frame);
+	if (i >= 0)
+	{
+		bench->frame_ms[i] = get_precise_time_ms() - bench->frame_start;
+	}
+	bench->frame++;
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+typedef struct Sample_Summary
+{
+	int count;
+	double mean;
+	double min;
+	double p50;
+	double p90;
+	double p95;
+	double p99;
+	double max;
+}Sample_Summary;
+
+// 負の値(読めなかったGPU時間)は除く。パーセンタイルは最近傍順位
+static bool summarise_samples(const double* samples, int count, Sample_Summary* summary)
+{
+	memset(summary, 0, sizeof(Sample_Summary));
+	double* sorted = (double*)malloc((count > 0 ? count : 1) * sizeof(double));
+	if (!sorted)
+	{
+		return false;
+	}
+	int n = 0;
+	double sum = 0.0;
+	for (int i = 0; i < count; i++)
+	{
+		if (samples[i] >= 0.0)
+		{
+			sorted[n++] = samples[i];
+			sum += samples[i];
+		}
+	}
+	if (n == 0)
+	{
+		free(sorted);
+		return false;
+	}
+	qsort(sorted, n, sizeof(double), compare_doubles);
+	const double percentiles[4] = { 50.0, 90.0, 95.0, 99.0 };
+	double* outputs[4] = { &summary->p50, &summary->p90, &summary->p95, &summary->p99 };
+	for (int i = 0; i < 4; i++)
+	{
+		int rank = (int)ceil(percentiles[i] / 100.0 * n) - 1;
+		*outputs[i] = sorted[rank < 0 ? 0 : rank];
+	}
+	summary->count = n;
+	summary->mean = sum / n;
+	summary->min = sorted[0];
+	summary->max = sorted[n - 1];
+	free(sorted);
+	return true;
+}
+
+static void write_json_string(FILE* file, const char* str)
+{
+	fputc('"', file);
+	for (const char* c = str ? str : ""; *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			fputc('\\', file);
+		}
+		if ((unsigned char)*c >= 0x20)
+		{
+			fputc(*c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+static void write_json_summary(FILE* file, const char* name, const double* samples, int count, bool last)
+{
+	Sample_Summary s;
+	fprintf(file, "    \"%s\": ", name);
+	if (summarise_samples(samples, count, &s))
+	{
+		fprintf(
+			file,
+			"{\"samples\": %i, \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+			s.count, s.mean, s.min, s.p50, s.p90, s.p95, s.p99, s.max);
+	}
+	else
+	{
+		fprintf(file, "null");
+	}
+	fprintf(file, last ? "\n" : ",\n");
+}
+
+bool write_benchmark_json(Frame_Benchmark* bench, const Benchmark_Scene* scene, const char* file_name)
+{
+	if (!benchmark_active(bench))
+	{
+		return false;
+	}
+	if (bench->gpu_timing)
+	{
+		for (int i = 0; i < BENCH_GPU_QUERY_LATENCY; i++)
+		{
+			collect_gpu_query(bench, i);
+		}
+	}
+	FILE* file = fopen(file_name, "w");
+	if (!file)
+	{
+		gl_log_err("ERROR: could not open %s for writing\n", file_name);
+		return false;
+	}
+	int recorded = bench->frame - bench->warmup;
+	if (recorded > bench->frame_count) recorded = bench->frame_count;
+	if (recorded < 0) recorded = 0;
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"scene\": {\n    \"mesh\": ");
+	write_json_string(file, scene->mesh_file);
+	fprintf(
+		file,
+		",\n    \"instances\": %i,\n    \"static_instances\": %i,\n    \"animate\": %s,\n"
+		"    \"headless\": %s,\n    \"width\": %i,\n    \"height\": %i\n  },\n",
+		scene->instances,
+		scene->static_instances,
+		scene->animate ? "true" : "false",
+		scene->headless ? "true" : "false",
+		scene->width,
+		scene->height);
+	fprintf(file, "  \"renderer\": ");
+	write_json_string(file, (const char*)glGetString(GL_RENDERER));
+	fprintf(file, ",\n  \"version\": ");
+	write_json_string(file, (const char*)glGetString(GL_VERSION));
+	fprintf(file, ",\n  \"build\": \"%s %s\",\n", __DATE__, __TIME__);
+	fprintf(
+		file,
+		"  \"frames\": %i,\n  \"warmup\": %i,\n  \"timestep\": %.6f,\n",
+		recorded,
+		bench->warmup,
+		BENCH_TIMESTEP);
+	fprintf(file, "  \"cpu_ms\": {\n");
+	write_json_summary(file, "frame", bench->frame_ms, recorded, false);
+	for (int i = 0; i < BENCH_PHASE_COUNT; i++)
+	{
+		write_json_summary(file, g_phase_names[i], bench->cpu_ms[i], recorded, i == BENCH_PHASE_COUNT - 1);
+	}
+	fprintf(file, "  },\n  \"gpu_ms\": {\n");
+	if (bench->gpu_timing)
+	{
+		write_json_summary(file, "frame", bench->gpu_ms, recorded, true);
+	}
+	fprintf(file, "  }\n}\n");
+	fclose(file);
+
+	Sample_Summary cpu;
+	Sample_Summary gpu;
+	bool have_cpu = summarise_samples(bench->frame_ms, recorded, &cpu);
+	bool have_gpu = bench->gpu_timing && summarise_samples(bench->gpu_ms, recorded, &gpu);
+	printf(
+		"benchmark: %i frames, cpu %.3f ms mean / %.3f ms p99, gpu %.3f ms mean / %.3f ms p99, written to %s\n",
+		recorded,
+		have_cpu ? cpu.mean : 0.0,
+		have_cpu ? cpu.p99 : 0.0,
+		have_gpu ? gpu.mean : 0.0,
+		have_gpu ? gpu.p99 : 0.0,
+		file_name);
+	return true;
+}
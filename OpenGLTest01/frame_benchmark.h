@@ -0,0 +1,65 @@
+#ifndef _FRAME_BENCHMARK_H_
+#define _FRAME_BENCHMARK_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+
+/*--------------------Frame Benchmark---------------------------*/
+// 決まったフレーム数を固定のタイムステップで回し、フレームの各段階のCPU時間とGPU時間を記録する。
+// 終わったら平均とパーセンタイルをJSONに書き出す。ビルド同士を同じシーンで比べるために使う
+#define BENCH_PHASE_UPDATE 0	// アップロード・アニメーション・フレームのuniform
+#define BENCH_PHASE_SUBMIT 1	// 描画パケットを積む
+#define BENCH_PHASE_SORT 2
+#define BENCH_PHASE_FLUSH 3		// キューを発行する(GLの呼び出し)
+#define BENCH_PHASE_PRESENT 4	// 入力・リングの終了・スワップ
+#define BENCH_PHASE_COUNT 5
+// 計測に含めない最初のフレーム数(シェーダのコンパイルやキャッシュを温める)
+#define BENCH_WARMUP_FRAMES 30
+// 1フレームで進める時間(秒)
+#define BENCH_TIMESTEP (1.0 / 60.0)
+// GPU時間のクエリ。結果はこのフレーム数だけ遅れて読み、待たないようにする
+#define BENCH_GPU_QUERY_LATENCY 4
+#define BENCH_JSON_FILE "benchmark.json"
+
+// JSONにそのまま書き出すシーンの設定
+typedef struct Benchmark_Scene
+{
+	const char* mesh_file;
+	int instances;
+	int static_instances;
+	bool animate;
+	bool headless;
+	int width;
+	int height;
+}Benchmark_Scene;
+
+typedef struct Frame_Benchmark
+{
+	int frame_count;		// 計測するフレーム数
+	int warmup;
+	int frame;				// 次に始めるフレーム(ウォームアップを含む)
+	double* cpu_ms[BENCH_PHASE_COUNT];
+	double* frame_ms;
+	double* gpu_ms;			// 結果が読めなかったフレームは負
+	double frame_start;
+	double phase_start;
+	bool gpu_timing;
+	GLuint queries[BENCH_GPU_QUERY_LATENCY];
+	int query_frames[BENCH_GPU_QUERY_LATENCY];	// そのクエリが測ったフレーム。-1なら空き
+}Frame_Benchmark;
+
+bool create_frame_benchmark(Frame_Benchmark* bench, int frames, int warmup);
+void destroy_frame_benchmark(Frame_Benchmark* bench);
+// 作っていなければ以下は何もしない
+bool benchmark_active(const Frame_Benchmark* bench);
+// ウォームアップを含めて回すフレーム数
+int benchmark_total_frames(const Frame_Benchmark* bench);
+// 固定のタイムステップで数えた、このフレームの時刻(秒)
+double benchmark_time(const Frame_Benchmark* bench);
+void begin_benchmark_frame(Frame_Benchmark* bench);
+// 前の区切りからの時間をphaseに足す
+void mark_benchmark_phase(Frame_Benchmark* bench, int phase);
+void end_benchmark_frame(Frame_Benchmark* bench);
+// 残っているGPUの結果を待って読み、JSONに書き出す
+bool write_benchmark_json(Frame_Benchmark* bench, const Benchmark_Scene* scene, const char* file_name);
+
+#endif
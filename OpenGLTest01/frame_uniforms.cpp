@@ -0,0 +1,59 @@
+#include "frame_uniforms.h"
+#include "gl_utils.h"
+#include <stdio.h>
+#include <string.h>
+
+/*--------------------Per-Frame Uniform Block---------------------------*/
+static_assert(sizeof(Frame_Uniforms) == 224, "Frame_Uniforms must match the std140 layout");
+
+void bind_frame_uniform_block(GLuint programme)
+{
+	GLuint index = glGetUniformBlockIndex(programme, FRAME_UNIFORM_BLOCK_NAME);
+	if (GL_INVALID_INDEX == index)
+	{
+		return;
+	}
+	glUniformBlockBinding(programme, index, FRAME_UNIFORM_BINDING);
+	gl_log("programme %u: %s bound to %i\n", programme, FRAME_UNIFORM_BLOCK_NAME, FRAME_UNIFORM_BINDING);
+}
+
+bool upload_frame_uniforms(Staging_Ring* ring, const mat4& view, const mat4& proj, float time, Frame_Uniforms* written)
+{
+	static GLint alignment = 0;
+	if (0 == alignment)
+	{
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	}
+	// maths_funcsの演算子はconstではないのでコピーして使う
+	mat4 v = view;
+	mat4 p = proj;
+	mat4 view_proj = p * v;
+	mat4 inv_view = inverse(view);
+	Frame_Uniforms u;
+	memset(&u, 0, sizeof(Frame_Uniforms));
+	memcpy(u.view, v.m, sizeof(u.view));
+	memcpy(u.proj, p.m, sizeof(u.proj));
+	memcpy(u.view_proj, view_proj.m, sizeof(u.view_proj));
+	u.camera_position[0] = inv_view.m[12];
+	u.camera_position[1] = inv_view.m[13];
+	u.camera_position[2] = inv_view.m[14];
+	u.camera_position[3] = 1.0f;
+	u.time = time;
+	if (written)
+	{
+		*written = u;
+	}
+	int offset;
+	Frame_Uniforms* uniforms = (Frame_Uniforms*)staging_ring_alloc(
+		ring,
+		sizeof(Frame_Uniforms),
+		alignment,
+		&offset);
+	if (!uniforms)
+	{
+		return false;
+	}
+	*uniforms = u;
+	staging_ring_bind_range(ring, GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, offset, sizeof(Frame_Uniforms));
+	return true;
+}
@@ -0,0 +1,37 @@
+#ifndef _FRAME_UNIFORMS_H_
+#define _FRAME_UNIFORMS_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+#include "maths_funcs.h"
+#include "staging_ring.h"
+
+/*--------------------Per-Frame Uniform Block---------------------------*/
+// カメラと時間はstd140のuniformブロックにまとめ、1フレームに1回だけ書き込んで全てのプログラムで共有する。
+// シェーダ側は次のブロックを宣言する(メンバはブロック名無しで参照できる)
+//	layout(std140) uniform Frame_Uniforms {
+//		mat4 view, proj, view_proj;
+//		vec4 camera_position;
+//		float time;
+//	};
+#define FRAME_UNIFORM_BLOCK_NAME "Frame_Uniforms"
+#define FRAME_UNIFORM_BINDING 0
+
+// std140のレイアウトと一致させる。mat4は16float、vec4の後のfloatは16バイト境界まで詰める
+typedef struct Frame_Uniforms
+{
+	float view[16];
+	float proj[16];
+	float view_proj[16];
+	float camera_position[4];	// wは1
+	float time;
+	float padding[3];
+}Frame_Uniforms;
+
+// リンク直後に呼ぶ。ブロックを宣言していないプログラムでは何もしない
+void bind_frame_uniform_block(GLuint programme);
+// ステージングリングに書き込み、FRAME_UNIFORM_BINDINGに結ぶ。描画を積む前に毎フレーム呼ぶ。
+// writtenには書き込んだ内容を写す(CPU側でカメラ位置を使うとき。NULLでよい)。
+// リングが一杯ならfalse(writtenには書く)
+bool upload_frame_uniforms(Staging_Ring* ring, const mat4& view, const mat4& proj, float time, Frame_Uniforms* written);
+
+#endif
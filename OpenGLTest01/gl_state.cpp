@@ -0,0 +1,310 @@
+#include "gl_state.h"
+#include "gl_utils.h"
+#include "gl_trace.h"
+#include <stdio.h>
+#include <string.h>
+
+/*--------------------GL State Cache---------------------------*/
+// 0xffffffffは「不明」。GLの名前としては使われない
+#define GL_STATE_UNKNOWN 0xffffffffu
+
+#define BUFFER_TARGET_COUNT 6
+static const GLenum g_buffer_targets[BUFFER_TARGET_COUNT] = {
+	GL_ARRAY_BUFFER,
+	GL_ELEMENT_ARRAY_BUFFER,
+	GL_COPY_READ_BUFFER,
+	GL_COPY_WRITE_BUFFER,
+	GL_UNIFORM_BUFFER,
+	GL_DRAW_INDIRECT_BUFFER,
+};
+
+#define CAPABILITY_COUNT 4
+static const GLenum g_capabilities[CAPABILITY_COUNT] = {
+	GL_DEPTH_TEST,
+	GL_CULL_FACE,
+	GL_BLEND,
+	GL_PROGRAM_POINT_SIZE,
+};
+
+typedef struct Uniform_Binding
+{
+	GLuint buffer;
+	GLintptr offset;
+	GLsizeiptr size;
+}Uniform_Binding;
+
+typedef struct Gl_State
+{
+	GLuint programme;
+	GLuint vao;
+	GLuint buffers[BUFFER_TARGET_COUNT];
+	Uniform_Binding uniform_bindings[GL_STATE_UNIFORM_BINDINGS];
+	int capabilities[CAPABILITY_COUNT];	// -1は不明
+	GLenum depth_func;
+	GLint viewport[4];
+	bool viewport_known;
+	GLfloat clear_colour[4];
+	bool clear_colour_known;
+}Gl_State;
+
+static Gl_State g_state;
+static Gl_State_Stats g_state_stats;
+static bool g_state_initialised = false;
+
+static const char* g_category_names[GL_STATE_CATEGORY_COUNT] = {
+	"programme",
+	"vertex array",
+	"buffer",
+	"buffer range",
+	"capability",
+	"depth func",
+	"viewport",
+	"clear colour",
+};
+
+void invalidate_gl_state()
+{
+	g_state.programme = GL_STATE_UNKNOWN;
+	g_state.vao = GL_STATE_UNKNOWN;
+	for (int i = 0; i < BUFFER_TARGET_COUNT; i++)
+	{
+		g_state.buffers[i] = GL_STATE_UNKNOWN;
+	}
+	for (int i = 0; i < GL_STATE_UNIFORM_BINDINGS; i++)
+	{
+		g_state.uniform_bindings[i].buffer = GL_STATE_UNKNOWN;
+	}
+	for (int i = 0; i < CAPABILITY_COUNT; i++)
+	{
+		g_state.capabilities[i] = -1;
+	}
+	g_state.depth_func = GL_STATE_UNKNOWN;
+	g_state.viewport_known = false;
+	g_state.clear_colour_known = false;
+	g_state_initialised = true;
+}
+
+// 呼び出しを数え、省けるならtrueを返す
+static bool elide(int category, bool same)
+{
+	if (!g_state_initialised)
+	{
+		invalidate_gl_state();
+		same = false;
+	}
+	g_state_stats.calls[category]++;
+#ifdef DISABLE_GL_STATE_CACHE
+	same = false;
+#endif
+	if (same)
+	{
+		g_state_stats.elided[category]++;
+	}
+	return same;
+}
+
+static int buffer_target_slot(GLenum target)
+{
+	for (int i = 0; i < BUFFER_TARGET_COUNT; i++)
+	{
+		if (g_buffer_targets[i] == target)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+void gl_state_use_programme(GLuint programme)
+{
+	if (elide(GL_STATE_PROGRAMME, g_state.programme == programme))
+	{
+		return;
+	}
+	glUseProgram(programme);
+	g_state.programme = programme;
+}
+
+void gl_state_bind_vertex_array(GLuint vao)
+{
+	if (elide(GL_STATE_VERTEX_ARRAY, g_state.vao == vao))
+	{
+		return;
+	}
+	glBindVertexArray(vao);
+	g_state.vao = vao;
+	// インデックスバッファのバインドはVAOの状態
+	g_state.buffers[buffer_target_slot(GL_ELEMENT_ARRAY_BUFFER)] = GL_STATE_UNKNOWN;
+}
+
+void gl_state_bind_buffer(GLenum target, GLuint buffer)
+{
+	int slot = buffer_target_slot(target);
+	if (elide(GL_STATE_BUFFER, slot >= 0 && g_state.buffers[slot] == buffer))
+	{
+		return;
+	}
+	glBindBuffer(target, buffer);
+	if (slot >= 0)
+	{
+		g_state.buffers[slot] = buffer;
+	}
+}
+
+void gl_state_bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	bool cached = target == GL_UNIFORM_BUFFER && index < GL_STATE_UNIFORM_BINDINGS;
+	Uniform_Binding* binding = cached ? &g_state.uniform_bindings[index] : NULL;
+	if (elide(
+		GL_STATE_BUFFER_RANGE,
+		binding &&
+		binding->buffer == buffer &&
+		binding->offset == offset &&
+		binding->size == size))
+	{
+		return;
+	}
+	glBindBufferRange(target, index, buffer, offset, size);
+	if (binding)
+	{
+		binding->buffer = buffer;
+		binding->offset = offset;
+		binding->size = size;
+	}
+	// 汎用のバインドポイントも変わる
+	int slot = buffer_target_slot(target);
+	if (slot >= 0)
+	{
+		g_state.buffers[slot] = buffer;
+	}
+}
+
+void gl_state_set_capability(GLenum capability, bool enable)
+{
+	int slot = -1;
+	for (int i = 0; i < CAPABILITY_COUNT; i++)
+	{
+		if (g_capabilities[i] == capability)
+		{
+			slot = i;
+			break;
+		}
+	}
+	if (elide(GL_STATE_CAPABILITY, slot >= 0 && g_state.capabilities[slot] == (enable ? 1 : 0)))
+	{
+		return;
+	}
+	if (enable)
+	{
+		trace_gl_enable(capability);
+	}
+	else
+	{
+		trace_gl_disable(capability);
+	}
+	if (slot >= 0)
+	{
+		g_state.capabilities[slot] = enable ? 1 : 0;
+	}
+}
+
+void gl_state_depth_func(GLenum func)
+{
+	if (elide(GL_STATE_DEPTH_FUNC, g_state.depth_func == func))
+	{
+		return;
+	}
+	trace_gl_depth_func(func);
+	g_state.depth_func = func;
+}
+
+void gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	GLint viewport[4] = { x, y, width, height };
+	if (elide(
+		GL_STATE_VIEWPORT,
+		g_state.viewport_known && memcmp(g_state.viewport, viewport, sizeof(viewport)) == 0))
+	{
+		return;
+	}
+	trace_gl_viewport(x, y, width, height);
+	memcpy(g_state.viewport, viewport, sizeof(viewport));
+	g_state.viewport_known = true;
+}
+
+void gl_state_clear_colour(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+	GLfloat colour[4] = { r, g, b, a };
+	if (elide(
+		GL_STATE_CLEAR_COLOUR,
+		g_state.clear_colour_known && memcmp(g_state.clear_colour, colour, sizeof(colour)) == 0))
+	{
+		return;
+	}
+	trace_gl_clear_color(r, g, b, a);
+	memcpy(g_state.clear_colour, colour, sizeof(colour));
+	g_state.clear_colour_known = true;
+}
+
+void gl_state_forget_programme(GLuint programme)
+{
+	if (g_state.programme == programme)
+	{
+		g_state.programme = GL_STATE_UNKNOWN;
+	}
+}
+
+void gl_state_forget_vertex_array(GLuint vao)
+{
+	if (g_state.vao == vao)
+	{
+		g_state.vao = GL_STATE_UNKNOWN;
+		g_state.buffers[buffer_target_slot(GL_ELEMENT_ARRAY_BUFFER)] = GL_STATE_UNKNOWN;
+	}
+}
+
+void gl_state_forget_buffer(GLuint buffer)
+{
+	for (int i = 0; i < BUFFER_TARGET_COUNT; i++)
+	{
+		if (g_state.buffers[i] == buffer)
+		{
+			g_state.buffers[i] = GL_STATE_UNKNOWN;
+		}
+	}
+	for (int i = 0; i < GL_STATE_UNIFORM_BINDINGS; i++)
+	{
+		if (g_state.uniform_bindings[i].buffer == buffer)
+		{
+			g_state.uniform_bindings[i].buffer = GL_STATE_UNKNOWN;
+		}
+	}
+}
+
+const Gl_State_Stats* get_gl_state_stats()
+{
+	return &g_state_stats;
+}
+
+void log_gl_state_stats()
+{
+	gl_log_print("gl state cache:\n");
+	long long calls = 0;
+	long long elided = 0;
+	for (int i = 0; i < GL_STATE_CATEGORY_COUNT; i++)
+	{
+		if (g_state_stats.calls[i] == 0)
+		{
+			continue;
+		}
+		gl_log_print(
+			"  %-14s %10lld calls, %10lld elided (%.1f%%)\n",
+			g_category_names[i],
+			g_state_stats.calls[i],
+			g_state_stats.elided[i],
+			100.0 * g_state_stats.elided[i] / g_state_stats.calls[i]);
+		calls += g_state_stats.calls[i];
+		elided += g_state_stats.elided[i];
+	}
+	gl_log_print("  total          %10lld calls, %10lld elided\n", calls, elided);
+}
@@ -0,0 +1,51 @@
+#ifndef _GL_STATE_H_
+#define _GL_STATE_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+
+/*--------------------GL State Cache---------------------------*/
+// 最後に設定したGLの状態を覚えておき、同じ値を設定する呼び出しを省く。GLスレッドからだけ使う。
+// キャッシュを通さずに状態を変えたときはinvalidate_gl_state()を呼ぶ。
+// DISABLE_GL_STATE_CACHEを定義すると全ての呼び出しをそのまま発行する(数えるだけ)
+//#define DISABLE_GL_STATE_CACHE
+#define GL_STATE_UNIFORM_BINDINGS 16
+
+// 統計の分類
+#define GL_STATE_PROGRAMME 0
+#define GL_STATE_VERTEX_ARRAY 1
+#define GL_STATE_BUFFER 2
+#define GL_STATE_BUFFER_RANGE 3
+#define GL_STATE_CAPABILITY 4
+#define GL_STATE_DEPTH_FUNC 5
+#define GL_STATE_VIEWPORT 6
+#define GL_STATE_CLEAR_COLOUR 7
+#define GL_STATE_CATEGORY_COUNT 8
+
+typedef struct Gl_State_Stats
+{
+	long long calls[GL_STATE_CATEGORY_COUNT];	// 要求された回数
+	long long elided[GL_STATE_CATEGORY_COUNT];	// そのうち省いた回数
+}Gl_State_Stats;
+
+// 全ての状態を不明にする。次の設定は必ず発行される
+void invalidate_gl_state();
+void gl_state_use_programme(GLuint programme);
+// VAOを切り替えるとELEMENT_ARRAY_BUFFERのバインドも変わる
+void gl_state_bind_vertex_array(GLuint vao);
+// ARRAY, ELEMENT_ARRAY, COPY_READ, COPY_WRITE, UNIFORM, DRAW_INDIRECT以外はそのまま発行する
+void gl_state_bind_buffer(GLenum target, GLuint buffer);
+// UNIFORM_BUFFERのインデックスごとの範囲を覚える。汎用のバインドも変わる
+void gl_state_bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+// DEPTH_TEST, CULL_FACE, BLEND, PROGRAM_POINT_SIZE以外はそのまま発行する
+void gl_state_set_capability(GLenum capability, bool enable);
+void gl_state_depth_func(GLenum func);
+void gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void gl_state_clear_colour(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+// 削除したオブジェクトはGLがバインドを0に戻すので、キャッシュにも反映する
+void gl_state_forget_programme(GLuint programme);
+void gl_state_forget_vertex_array(GLuint vao);
+void gl_state_forget_buffer(GLuint buffer);
+const Gl_State_Stats* get_gl_state_stats();
+void log_gl_state_stats();
+
+#endif
@@ -0,0 +1,2055 @@
+#include "gl_trace.h"
+#include "gl_utils.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*--------------------GL Call Trace---------------------------*/
+// レコードは1バイトの呼び出しの番号と、その後に続く引数(このマシンのバイト順)。
+// 可変長のデータは4バイトの長さの後に置く。長さがTRACE_NULL_BLOBならNULL
+#define TRACE_NULL_BLOB 0xffffffffu
+
+enum Trace_Call
+{
+	TRACE_FRAME,
+	TRACE_USE_PROGRAM,
+	TRACE_BIND_VERTEX_ARRAY,
+	TRACE_BIND_BUFFER,
+	TRACE_BIND_BUFFER_RANGE,
+	TRACE_BIND_FRAMEBUFFER,
+	TRACE_BIND_RENDERBUFFER,
+	TRACE_ACTIVE_TEXTURE,
+	TRACE_VERTEX_ATTRIB_POINTER,
+	TRACE_VERTEX_ATTRIB_I_POINTER,
+	TRACE_ENABLE_VERTEX_ATTRIB_ARRAY,
+	TRACE_VERTEX_ATTRIB_DIVISOR,
+	TRACE_UNIFORM_BLOCK_BINDING,
+	TRACE_UNIFORM_1I,
+	TRACE_UNIFORM_3F,
+	TRACE_UNIFORM_3FV,
+	TRACE_UNIFORM_MATRIX_4FV,
+	TRACE_TEX_BUFFER,
+	TRACE_BUFFER_DATA,
+	TRACE_BUFFER_SUB_DATA,
+	TRACE_COPY_BUFFER_SUB_DATA,
+	TRACE_RENDERBUFFER_STORAGE,
+	TRACE_FRAMEBUFFER_RENDERBUFFER,
+	TRACE_CHECK_FRAMEBUFFER_STATUS,
+	TRACE_DRAW_ELEMENTS_BASE_VERTEX,
+	TRACE_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX,
+	TRACE_MULTI_DRAW_ELEMENTS_BASE_VERTEX,
+	TRACE_MULTI_DRAW_ELEMENTS_INDIRECT,
+	TRACE_GEN_BUFFERS,
+	TRACE_DELETE_BUFFERS,
+	TRACE_GEN_VERTEX_ARRAYS,
+	TRACE_DELETE_VERTEX_ARRAYS,
+	TRACE_GEN_FRAMEBUFFERS,
+	TRACE_DELETE_FRAMEBUFFERS,
+	TRACE_GEN_RENDERBUFFERS,
+	TRACE_DELETE_RENDERBUFFERS,
+	TRACE_GEN_QUERIES,
+	TRACE_DELETE_QUERIES,
+	TRACE_CREATE_SHADER,
+	TRACE_SHADER_SOURCE,
+	TRACE_COMPILE_SHADER,
+	TRACE_DELETE_SHADER,
+	TRACE_CREATE_PROGRAM,
+	TRACE_ATTACH_SHADER,
+	TRACE_BIND_ATTRIB_LOCATION,
+	TRACE_LINK_PROGRAM,
+	TRACE_DELETE_PROGRAM,
+	TRACE_GET_UNIFORM_LOCATION,
+	TRACE_GET_UNIFORM_BLOCK_INDEX,
+	TRACE_GET_ATTRIB_LOCATION,
+	TRACE_FENCE_SYNC,
+	TRACE_CLIENT_WAIT_SYNC,
+	TRACE_DELETE_SYNC,
+	TRACE_BEGIN_QUERY,
+	TRACE_END_QUERY,
+	TRACE_GET_QUERY_OBJECT_UI64V,
+	TRACE_ENABLE,
+	TRACE_DISABLE,
+	TRACE_DEPTH_FUNC,
+	TRACE_VIEWPORT,
+	TRACE_CLEAR_COLOR,
+	TRACE_CLEAR,
+	TRACE_DRAW_ARRAYS,
+	TRACE_CALL_COUNT
+};
+
+static const char* g_call_names[TRACE_CALL_COUNT] = {
+	"(frame)",
+	"glUseProgram",
+	"glBindVertexArray",
+	"glBindBuffer",
+	"glBindBufferRange",
+	"glBindFramebuffer",
+	"glBindRenderbuffer",
+	"glActiveTexture",
+	"glVertexAttribPointer",
+	"glVertexAttribIPointer",
+	"glEnableVertexAttribArray",
+	"glVertexAttribDivisor",
+	"glUniformBlockBinding",
+	"glUniform1i",
+	"glUniform3f",
+	"glUniform3fv",
+	"glUniformMatrix4fv",
+	"glTexBuffer",
+	"glBufferData",
+	"glBufferSubData",
+	"glCopyBufferSubData",
+	"glRenderbufferStorage",
+	"glFramebufferRenderbuffer",
+	"glCheckFramebufferStatus",
+	"glDrawElementsBaseVertex",
+	"glDrawElementsInstancedBaseVertex",
+	"glMultiDrawElementsBaseVertex",
+	"glMultiDrawElementsIndirect",
+	"glGenBuffers",
+	"glDeleteBuffers",
+	"glGenVertexArrays",
+	"glDeleteVertexArrays",
+	"glGenFramebuffers",
+	"glDeleteFramebuffers",
+	"glGenRenderbuffers",
+	"glDeleteRenderbuffers",
+	"glGenQueries",
+	"glDeleteQueries",
+	"glCreateShader",
+	"glShaderSource",
+	"glCompileShader",
+	"glDeleteShader",
+	"glCreateProgram",
+	"glAttachShader",
+	"glBindAttribLocation",
+	"glLinkProgram",
+	"glDeleteProgram",
+	"glGetUniformLocation",
+	"glGetUniformBlockIndex",
+	"glGetAttribLocation",
+	"glFenceSync",
+	"glClientWaitSync",
+	"glDeleteSync",
+	"glBeginQuery",
+	"glEndQuery",
+	"glGetQueryObjectui64v",
+	"glEnable",
+	"glDisable",
+	"glDepthFunc",
+	"glViewport",
+	"glClearColor",
+	"glClear",
+	"glDrawArrays",
+};
+
+typedef struct Trace_Call_Stats
+{
+	long long calls;
+	double ms;
+}Trace_Call_Stats;
+
+static void log_call_stats(const Trace_Call_Stats* stats, const char* title)
+{
+	printf("%s:\n", title);
+	long long calls = 0;
+	double ms = 0.0;
+	for (int i = 1; i < TRACE_CALL_COUNT; i++)
+	{
+		if (stats[i].calls == 0)
+		{
+			continue;
+		}
+		printf(
+			"  %-36s %10lld calls %10.3f ms (%.3f us/call)\n",
+			g_call_names[i],
+			stats[i].calls,
+			stats[i].ms,
+			1000.0 * stats[i].ms / stats[i].calls);
+		calls += stats[i].calls;
+		ms += stats[i].ms;
+	}
+	printf("  %-36s %10lld calls %10.3f ms\n", "total", calls, ms);
+}
+
+/*--------------------Recording---------------------------*/
+typedef struct Trace_Recorder
+{
+	FILE* file;
+	const char* file_name;
+	unsigned char* data;
+	size_t size;
+	size_t capacity;
+	long long bytes_written;
+	int frames;
+	bool failed;				// 確保か書き込みに失敗した。以降は記録しない
+	GLboolean buffer_storage;	// 記録中に隠したARB_buffer_storage
+	Trace_Call_Stats stats[TRACE_CALL_COUNT];
+}Trace_Recorder;
+
+static Trace_Recorder g_recorder;
+static bool g_tracing = false;
+
+static void put_bytes(const void* bytes, size_t size)
+{
+	Trace_Recorder* r = &g_recorder;
+	if (r->failed)
+	{
+		return;
+	}
+	if (r->size + size > r->capacity)
+	{
+		size_t capacity = r->capacity ? r->capacity : TRACE_FLUSH_BYTES;
+		while (capacity < r->size + size)
+		{
+			capacity *= 2;
+		}
+		unsigned char* data = (unsigned char*)realloc(r->data, capacity);
+		if (!data)
+		{
+			gl_log_err("ERROR: could not grow GL trace buffer to %u bytes\n", (unsigned int)capacity);
+			r->failed = true;
+			return;
+		}
+		r->data = data;
+		r->capacity = capacity;
+	}
+	memcpy(r->data + r->size, bytes, size);
+	r->size += size;
+}
+
+static void put_u8(unsigned char value) { put_bytes(&value, 1); }
+static void put_u32(GLuint value) { put_bytes(&value, 4); }
+static void put_i32(GLint value) { put_bytes(&value, 4); }
+static void put_f32(GLfloat value) { put_bytes(&value, 4); }
+static void put_u64(unsigned long long value) { put_bytes(&value, 8); }
+static void put_pointer(const void* pointer) { put_u64((unsigned long long)(size_t)pointer); }
+
+static void put_blob(const void* data, size_t size)
+{
+	if (!data)
+	{
+		put_u32(TRACE_NULL_BLOB);
+		return;
+	}
+	put_u32((GLuint)size);
+	put_bytes(data, size);
+}
+
+static void put_string(const GLchar* str)
+{
+	put_blob(str, str ? strlen(str) + 1 : 0);
+}
+
+static void flush_trace_data()
+{
+	Trace_Recorder* r = &g_recorder;
+	if (r->size == 0 || !r->file)
+	{
+		return;
+	}
+	if (fwrite(r->data, 1, r->size, r->file) != r->size)
+	{
+		gl_log_err("ERROR: could not write GL trace %s\n", r->file_name);
+		r->failed = true;
+	}
+	r->bytes_written += r->size;
+	r->size = 0;
+}
+
+// 引数より先に番号を書く。時間は引数を書いた後、本物の関数の前後で測る
+static void begin_record(int call)
+{
+	put_u8((unsigned char)call);
+}
+
+static void end_record(int call, double start)
+{
+	g_recorder.stats[call].calls++;
+	g_recorder.stats[call].ms += get_precise_time_ms() - start;
+}
+
+static void record_names(GLsizei n, const GLuint* names)
+{
+	put_i32(n);
+	for (int i = 0; i < n; i++)
+	{
+		put_u32(names[i]);
+	}
+}
+
+// 記録する関数の一覧。GLEWの名前と関数ポインタの型
+#define TRACE_FUNCTIONS(X) \
+	X(UseProgram, PFNGLUSEPROGRAMPROC) \
+	X(BindVertexArray, PFNGLBINDVERTEXARRAYPROC) \
+	X(BindBuffer, PFNGLBINDBUFFERPROC) \
+	X(BindBufferRange, PFNGLBINDBUFFERRANGEPROC) \
+	X(BindFramebuffer, PFNGLBINDFRAMEBUFFERPROC) \
+	X(BindRenderbuffer, PFNGLBINDRENDERBUFFERPROC) \
+	X(ActiveTexture, PFNGLACTIVETEXTUREPROC) \
+	X(VertexAttribPointer, PFNGLVERTEXATTRIBPOINTERPROC) \
+	X(VertexAttribIPointer, PFNGLVERTEXATTRIBIPOINTERPROC) \
+	X(EnableVertexAttribArray, PFNGLENABLEVERTEXATTRIBARRAYPROC) \
+	X(VertexAttribDivisor, PFNGLVERTEXATTRIBDIVISORPROC) \
+	X(UniformBlockBinding, PFNGLUNIFORMBLOCKBINDINGPROC) \
+	X(Uniform1i, PFNGLUNIFORM1IPROC) \
+	X(Uniform3f, PFNGLUNIFORM3FPROC) \
+	X(Uniform3fv, PFNGLUNIFORM3FVPROC) \
+	X(UniformMatrix4fv, PFNGLUNIFORMMATRIX4FVPROC) \
+	X(TexBuffer, PFNGLTEXBUFFERPROC) \
+	X(BufferData, PFNGLBUFFERDATAPROC) \
+	X(BufferSubData, PFNGLBUFFERSUBDATAPROC) \
+	X(CopyBufferSubData, PFNGLCOPYBUFFERSUBDATAPROC) \
+	X(RenderbufferStorage, PFNGLRENDERBUFFERSTORAGEPROC) \
+	X(FramebufferRenderbuffer, PFNGLFRAMEBUFFERRENDERBUFFERPROC) \
+	X(CheckFramebufferStatus, PFNGLCHECKFRAMEBUFFERSTATUSPROC) \
+	X(DrawElementsBaseVertex, PFNGLDRAWELEMENTSBASEVERTEXPROC) \
+	X(DrawElementsInstancedBaseVertex, PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC) \
+	X(MultiDrawElementsBaseVertex, PFNGLMULTIDRAWELEMENTSBASEVERTEXPROC) \
+	X(MultiDrawElementsIndirect, PFNGLMULTIDRAWELEMENTSINDIRECTPROC) \
+	X(GenBuffers, PFNGLGENBUFFERSPROC) \
+	X(DeleteBuffers, PFNGLDELETEBUFFERSPROC) \
+	X(GenVertexArrays, PFNGLGENVERTEXARRAYSPROC) \
+	X(DeleteVertexArrays, PFNGLDELETEVERTEXARRAYSPROC) \
+	X(GenFramebuffers, PFNGLGENFRAMEBUFFERSPROC) \
+	X(DeleteFramebuffers, PFNGLDELETEFRAMEBUFFERSPROC) \
+	X(GenRenderbuffers, PFNGLGENRENDERBUFFERSPROC) \
+	X(DeleteRenderbuffers, PFNGLDELETERENDERBUFFERSPROC) \
+	X(GenQueries, PFNGLGENQUERIESPROC) \
+	X(DeleteQueries, PFNGLDELETEQUERIESPROC) \
+	X(CreateShader, PFNGLCREATESHADERPROC) \
+	X(ShaderSource, PFNGLSHADERSOURCEPROC) \
+	X(CompileShader, PFNGLCOMPILESHADERPROC) \
+	X(DeleteShader, PFNGLDELETESHADERPROC) \
+	X(CreateProgram, PFNGLCREATEPROGRAMPROC) \
+	X(AttachShader, PFNGLATTACHSHADERPROC) \
+	X(BindAttribLocation, PFNGLBINDATTRIBLOCATIONPROC) \
+	X(LinkProgram, PFNGLLINKPROGRAMPROC) \
+	X(DeleteProgram, PFNGLDELETEPROGRAMPROC) \
+	X(GetUniformLocation, PFNGLGETUNIFORMLOCATIONPROC) \
+	X(GetUniformBlockIndex, PFNGLGETUNIFORMBLOCKINDEXPROC) \
+	X(GetAttribLocation, PFNGLGETATTRIBLOCATIONPROC) \
+	X(FenceSync, PFNGLFENCESYNCPROC) \
+	X(ClientWaitSync, PFNGLCLIENTWAITSYNCPROC) \
+	X(DeleteSync, PFNGLDELETESYNCPROC) \
+	X(BeginQuery, PFNGLBEGINQUERYPROC) \
+	X(EndQuery, PFNGLENDQUERYPROC) \
+	X(GetQueryObjectui64v, PFNGLGETQUERYOBJECTUI64VPROC)
+
+#define TRACE_DECLARE_REAL(name, type) static type real_##name;
+TRACE_FUNCTIONS(TRACE_DECLARE_REAL)
+
+static void GLAPIENTRY trace_UseProgram(GLuint program)
+{
+	begin_record(TRACE_USE_PROGRAM);
+	put_u32(program);
+	double start = get_precise_time_ms();
+	real_UseProgram(program);
+	end_record(TRACE_USE_PROGRAM, start);
+}
+
+static void GLAPIENTRY trace_BindVertexArray(GLuint array)
+{
+	begin_record(TRACE_BIND_VERTEX_ARRAY);
+	put_u32(array);
+	double start = get_precise_time_ms();
+	real_BindVertexArray(array);
+	end_record(TRACE_BIND_VERTEX_ARRAY, start);
+}
+
+static void GLAPIENTRY trace_BindBuffer(GLenum target, GLuint buffer)
+{
+	begin_record(TRACE_BIND_BUFFER);
+	put_u32(target);
+	put_u32(buffer);
+	double start = get_precise_time_ms();
+	real_BindBuffer(target, buffer);
+	end_record(TRACE_BIND_BUFFER, start);
+}
+
+static void GLAPIENTRY trace_BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	begin_record(TRACE_BIND_BUFFER_RANGE);
+	put_u32(target);
+	put_u32(index);
+	put_u32(buffer);
+	put_u64(offset);
+	put_u64(size);
+	double start = get_precise_time_ms();
+	real_BindBufferRange(target, index, buffer, offset, size);
+	end_record(TRACE_BIND_BUFFER_RANGE, start);
+}
+
+static void GLAPIENTRY trace_BindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	begin_record(TRACE_BIND_FRAMEBUFFER);
+	put_u32(target);
+	put_u32(framebuffer);
+	double start = get_precise_time_ms();
+	real_BindFramebuffer(target, framebuffer);
+	end_record(TRACE_BIND_FRAMEBUFFER, start);
+}
+
+static void GLAPIENTRY trace_BindRenderbuffer(GLenum target, GLuint renderbuffer)
+{
+	begin_record(TRACE_BIND_RENDERBUFFER);
+	put_u32(target);
+	put_u32(renderbuffer);
+	double start = get_precise_time_ms();
+	real_BindRenderbuffer(target, renderbuffer);
+	end_record(TRACE_BIND_RENDERBUFFER, start);
+}
+
+static void GLAPIENTRY trace_ActiveTexture(GLenum texture)
+{
+	begin_record(TRACE_ACTIVE_TEXTURE);
+	put_u32(texture);
+	double start = get_precise_time_ms();
+	real_ActiveTexture(texture);
+	end_record(TRACE_ACTIVE_TEXTURE, start);
+}
+
+static void GLAPIENTRY trace_VertexAttribPointer(
+	GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* pointer)
+{
+	begin_record(TRACE_VERTEX_ATTRIB_POINTER);
+	put_u32(index);
+	put_i32(size);
+	put_u32(type);
+	put_u8(normalized);
+	put_i32(stride);
+	put_pointer(pointer);
+	double start = get_precise_time_ms();
+	real_VertexAttribPointer(index, size, type, normalized, stride, pointer);
+	end_record(TRACE_VERTEX_ATTRIB_POINTER, start);
+}
+
+static void GLAPIENTRY trace_VertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const GLvoid* pointer)
+{
+	begin_record(TRACE_VERTEX_ATTRIB_I_POINTER);
+	put_u32(index);
+	put_i32(size);
+	put_u32(type);
+	put_i32(stride);
+	put_pointer(pointer);
+	double start = get_precise_time_ms();
+	real_VertexAttribIPointer(index, size, type, stride, pointer);
+	end_record(TRACE_VERTEX_ATTRIB_I_POINTER, start);
+}
+
+static void GLAPIENTRY trace_EnableVertexAttribArray(GLuint index)
+{
+	begin_record(TRACE_ENABLE_VERTEX_ATTRIB_ARRAY);
+	put_u32(index);
+	double start = get_precise_time_ms();
+	real_EnableVertexAttribArray(index);
+	end_record(TRACE_ENABLE_VERTEX_ATTRIB_ARRAY, start);
+}
+
+static void GLAPIENTRY trace_VertexAttribDivisor(GLuint index, GLuint divisor)
+{
+	begin_record(TRACE_VERTEX_ATTRIB_DIVISOR);
+	put_u32(index);
+	put_u32(divisor);
+	double start = get_precise_time_ms();
+	real_VertexAttribDivisor(index, divisor);
+	end_record(TRACE_VERTEX_ATTRIB_DIVISOR, start);
+}
+
+static void GLAPIENTRY trace_UniformBlockBinding(GLuint program, GLuint block_index, GLuint binding)
+{
+	begin_record(TRACE_UNIFORM_BLOCK_BINDING);
+	put_u32(program);
+	put_u32(block_index);
+	put_u32(binding);
+	double start = get_precise_time_ms();
+	real_UniformBlockBinding(program, block_index, binding);
+	end_record(TRACE_UNIFORM_BLOCK_BINDING, start);
+}
+
+static void GLAPIENTRY trace_Uniform1i(GLint location, GLint v0)
+{
+	begin_record(TRACE_UNIFORM_1I);
+	put_i32(location);
+	put_i32(v0);
+	double start = get_precise_time_ms();
+	real_Uniform1i(location, v0);
+	end_record(TRACE_UNIFORM_1I, start);
+}
+
+static void GLAPIENTRY trace_Uniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+	begin_record(TRACE_UNIFORM_3F);
+	put_i32(location);
+	put_f32(v0);
+	put_f32(v1);
+	put_f32(v2);
+	double start = get_precise_time_ms();
+	real_Uniform3f(location, v0, v1, v2);
+	end_record(TRACE_UNIFORM_3F, start);
+}
+
+static void GLAPIENTRY trace_Uniform3fv(GLint location, GLsizei count, const GLfloat* value)
+{
+	begin_record(TRACE_UNIFORM_3FV);
+	put_i32(location);
+	put_i32(count);
+	put_blob(value, count * 3 * sizeof(GLfloat));
+	double start = get_precise_time_ms();
+	real_Uniform3fv(location, count, value);
+	end_record(TRACE_UNIFORM_3FV, start);
+}
+
+static void GLAPIENTRY trace_UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+	begin_record(TRACE_UNIFORM_MATRIX_4FV);
+	put_i32(location);
+	put_i32(count);
+	put_u8(transpose);
+	put_blob(value, count * 16 * sizeof(GLfloat));
+	double start = get_precise_time_ms();
+	real_UniformMatrix4fv(location, count, transpose, value);
+	end_record(TRACE_UNIFORM_MATRIX_4FV, start);
+}
+
+static void GLAPIENTRY trace_TexBuffer(GLenum target, GLenum internal_format, GLuint buffer)
+{
+	begin_record(TRACE_TEX_BUFFER);
+	put_u32(target);
+	put_u32(internal_format);
+	put_u32(buffer);
+	double start = get_precise_time_ms();
+	real_TexBuffer(target, internal_format, buffer);
+	end_record(TRACE_TEX_BUFFER, start);
+}
+
+static void GLAPIENTRY trace_BufferData(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
+{
+	begin_record(TRACE_BUFFER_DATA);
+	put_u32(target);
+	put_u64(size);
+	put_blob(data, size);
+	put_u32(usage);
+	double start = get_precise_time_ms();
+	real_BufferData(target, size, data, usage);
+	end_record(TRACE_BUFFER_DATA, start);
+}
+
+static void GLAPIENTRY trace_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data)
+{
+	begin_record(TRACE_BUFFER_SUB_DATA);
+	put_u32(target);
+	put_u64(offset);
+	put_blob(data, size);
+	double start = get_precise_time_ms();
+	real_BufferSubData(target, offset, size, data);
+	end_record(TRACE_BUFFER_SUB_DATA, start);
+}
+
+static void GLAPIENTRY trace_CopyBufferSubData(
+	GLenum read_target, GLenum write_target, GLintptr read_offset, GLintptr write_offset, GLsizeiptr size)
+{
+	begin_record(TRACE_COPY_BUFFER_SUB_DATA);
+	put_u32(read_target);
+	put_u32(write_target);
+	put_u64(read_offset);
+	put_u64(write_offset);
+	put_u64(size);
+	double start = get_precise_time_ms();
+	real_CopyBufferSubData(read_target, write_target, read_offset, write_offset, size);
+	end_record(TRACE_COPY_BUFFER_SUB_DATA, start);
+}
+
+static void GLAPIENTRY trace_RenderbufferStorage(GLenum target, GLenum internal_format, GLsizei width, GLsizei height)
+{
+	begin_record(TRACE_RENDERBUFFER_STORAGE);
+	put_u32(target);
+	put_u32(internal_format);
+	put_i32(width);
+	put_i32(height);
+	double start = get_precise_time_ms();
+	real_RenderbufferStorage(target, internal_format, width, height);
+	end_record(TRACE_RENDERBUFFER_STORAGE, start);
+}
+
+static void GLAPIENTRY trace_FramebufferRenderbuffer(
+	GLenum target, GLenum attachment, GLenum renderbuffer_target, GLuint renderbuffer)
+{
+	begin_record(TRACE_FRAMEBUFFER_RENDERBUFFER);
+	put_u32(target);
+	put_u32(attachment);
+	put_u32(renderbuffer_target);
+	put_u32(renderbuffer);
+	double start = get_precise_time_ms();
+	real_FramebufferRenderbuffer(target, attachment, renderbuffer_target, renderbuffer);
+	end_record(TRACE_FRAMEBUFFER_RENDERBUFFER, start);
+}
+
+static GLenum GLAPIENTRY trace_CheckFramebufferStatus(GLenum target)
+{
+	begin_record(TRACE_CHECK_FRAMEBUFFER_STATUS);
+	put_u32(target);
+	double start = get_precise_time_ms();
+	GLenum status = real_CheckFramebufferStatus(target);
+	end_record(TRACE_CHECK_FRAMEBUFFER_STATUS, start);
+	return status;
+}
+
+static void GLAPIENTRY trace_DrawElementsBaseVertex(
+	GLenum mode, GLsizei count, GLenum type, const GLvoid* indices, GLint base_vertex)
+{
+	begin_record(TRACE_DRAW_ELEMENTS_BASE_VERTEX);
+	put_u32(mode);
+	put_i32(count);
+	put_u32(type);
+	put_pointer(indices);
+	put_i32(base_vertex);
+	double start = get_precise_time_ms();
+	real_DrawElementsBaseVertex(mode, count, type, indices, base_vertex);
+	end_record(TRACE_DRAW_ELEMENTS_BASE_VERTEX, start);
+}
+
+static void GLAPIENTRY trace_DrawElementsInstancedBaseVertex(
+	GLenum mode, GLsizei count, GLenum type, const GLvoid* indices, GLsizei instance_count, GLint base_vertex)
+{
+	begin_record(TRACE_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX);
+	put_u32(mode);
+	put_i32(count);
+	put_u32(type);
+	put_pointer(indices);
+	put_i32(instance_count);
+	put_i32(base_vertex);
+	double start = get_precise_time_ms();
+	real_DrawElementsInstancedBaseVertex(mode, count, type, indices, instance_count, base_vertex);
+	end_record(TRACE_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX, start);
+}
+
+static void GLAPIENTRY trace_MultiDrawElementsBaseVertex(
+	GLenum mode, const GLsizei* count, GLenum type, const GLvoid* const* indices, GLsizei draw_count, const GLint* base_vertex)
+{
+	begin_record(TRACE_MULTI_DRAW_ELEMENTS_BASE_VERTEX);
+	put_u32(mode);
+	put_u32(type);
+	put_i32(draw_count);
+	for (int i = 0; i < draw_count; i++)
+	{
+		put_i32(count[i]);
+		put_pointer(indices[i]);
+		put_i32(base_vertex[i]);
+	}
+	double start = get_precise_time_ms();
+	real_MultiDrawElementsBaseVertex(mode, count, type, indices, draw_count, base_vertex);
+	end_record(TRACE_MULTI_DRAW_ELEMENTS_BASE_VERTEX, start);
+}
+
+static void GLAPIENTRY trace_MultiDrawElementsIndirect(
+	GLenum mode, GLenum type, const GLvoid* indirect, GLsizei draw_count, GLsizei stride)
+{
+	begin_record(TRACE_MULTI_DRAW_ELEMENTS_INDIRECT);
+	put_u32(mode);
+	put_u32(type);
+	put_pointer(indirect);
+	put_i32(draw_count);
+	put_i32(stride);
+	double start = get_precise_time_ms();
+	real_MultiDrawElementsIndirect(mode, type, indirect, draw_count, stride);
+	end_record(TRACE_MULTI_DRAW_ELEMENTS_INDIRECT, start);
+}
+
+// 作成は本物を呼んでから、返った名前を記録する
+static void GLAPIENTRY trace_GenBuffers(GLsizei n, GLuint* names)
+{
+	double start = get_precise_time_ms();
+	real_GenBuffers(n, names);
+	begin_record(TRACE_GEN_BUFFERS);
+	record_names(n, names);
+	end_record(TRACE_GEN_BUFFERS, start);
+}
+
+static void GLAPIENTRY trace_DeleteBuffers(GLsizei n, const GLuint* names)
+{
+	begin_record(TRACE_DELETE_BUFFERS);
+	record_names(n, names);
+	double start = get_precise_time_ms();
+	real_DeleteBuffers(n, names);
+	end_record(TRACE_DELETE_BUFFERS, start);
+}
+
+static void GLAPIENTRY trace_GenVertexArrays(GLsizei n, GLuint* names)
+{
+	double start = get_precise_time_ms();
+	real_GenVertexArrays(n, names);
+	begin_record(TRACE_GEN_VERTEX_ARRAYS);
+	record_names(n, names);
+	end_record(TRACE_GEN_VERTEX_ARRAYS, start);
+}
+
+static void GLAPIENTRY trace_DeleteVertexArrays(GLsizei n, const GLuint* names)
+{
+	begin_record(TRACE_DELETE_VERTEX_ARRAYS);
+	record_names(n, names);
+	double start = get_precise_time_ms();
+	real_DeleteVertexArrays(n, names);
+	end_record(TRACE_DELETE_VERTEX_ARRAYS, start);
+}
+
+static void GLAPIENTRY trace_GenFramebuffers(GLsizei n, GLuint* names)
+{
+	double start = get_precise_time_ms();
+	real_GenFramebuffers(n, names);
+	begin_record(TRACE_GEN_FRAMEBUFFERS);
+	record_names(n, names);
+	end_record(TRACE_GEN_FRAMEBUFFERS, start);
+}
+
+static void GLAPIENTRY trace_DeleteFramebuffers(GLsizei n, const GLuint* names)
+{
+	begin_record(TRACE_DELETE_FRAMEBUFFERS);
+	record_names(n, names);
+	double start = get_precise_time_ms();
+	real_DeleteFramebuffers(n, names);
+	end_record(TRACE_DELETE_FRAMEBUFFERS, start);
+}
+
+static void GLAPIENTRY trace_GenRenderbuffers(GLsizei n, GLuint* names)
+{
+	double start = get_precise_time_ms();
+	real_GenRenderbuffers(n, names);
+	begin_record(TRACE_GEN_RENDERBUFFERS);
+	record_names(n, names);
+	end_record(TRACE_GEN_RENDERBUFFERS, start);
+}
+
+static void GLAPIENTRY trace_DeleteRenderbuffers(GLsizei n, const GLuint* names)
+{
+	begin_record(TRACE_DELETE_RENDERBUFFERS);
+	record_names(n, names);
+	double start = get_precise_time_ms();
+	real_DeleteRenderbuffers(n, names);
+	end_record(TRACE_DELETE_RENDERBUFFERS, start);
+}
+
+static void GLAPIENTRY trace_GenQueries(GLsizei n, GLuint* names)
+{
+	double start = get_precise_time_ms();
+	real_GenQueries(n, names);
+	begin_record(TRACE_GEN_QUERIES);
+	record_names(n, names);
+	end_record(TRACE_GEN_QUERIES, start);
+}
+
+static void GLAPIENTRY trace_DeleteQueries(GLsizei n, const GLuint* names)
+{
+	begin_record(TRACE_DELETE_QUERIES);
+	record_names(n, names);
+	double start = get_precise_time_ms();
+	real_DeleteQueries(n, names);
+	end_record(TRACE_DELETE_QUERIES, start);
+}
+
+static GLuint GLAPIENTRY trace_CreateShader(GLenum type)
+{
+	double start = get_precise_time_ms();
+	GLuint shader = real_CreateShader(type);
+	begin_record(TRACE_CREATE_SHADER);
+	put_u32(type);
+	put_u32(shader);
+	end_record(TRACE_CREATE_SHADER, start);
+	return shader;
+}
+
+static void GLAPIENTRY trace_ShaderSource(GLuint shader, GLsizei count, const GLchar** strings, const GLint* lengths)
+{
+	begin_record(TRACE_SHADER_SOURCE);
+	put_u32(shader);
+	put_i32(count);
+	for (int i = 0; i < count; i++)
+	{
+		size_t length = lengths && lengths[i] >= 0 ? (size_t)lengths[i] : strlen(strings[i]);
+		put_blob(strings[i], length);
+	}
+	double start = get_precise_time_ms();
+	real_ShaderSource(shader, count, strings, lengths);
+	end_record(TRACE_SHADER_SOURCE, start);
+}
+
+static void GLAPIENTRY trace_CompileShader(GLuint shader)
+{
+	begin_record(TRACE_COMPILE_SHADER);
+	put_u32(shader);
+	double start = get_precise_time_ms();
+	real_CompileShader(shader);
+	end_record(TRACE_COMPILE_SHADER, start);
+}
+
+static void GLAPIENTRY trace_DeleteShader(GLuint shader)
+{
+	begin_record(TRACE_DELETE_SHADER);
+	put_u32(shader);
+	double start = get_precise_time_ms();
+	real_DeleteShader(shader);
+	end_record(TRACE_DELETE_SHADER, start);
+}
+
+static GLuint GLAPIENTRY trace_CreateProgram()
+{
+	double start = get_precise_time_ms();
+	GLuint program = real_CreateProgram();
+	begin_record(TRACE_CREATE_PROGRAM);
+	put_u32(program);
+	end_record(TRACE_CREATE_PROGRAM, start);
+	return program;
+}
+
+static void GLAPIENTRY trace_AttachShader(GLuint program, GLuint shader)
+{
+	begin_record(TRACE_ATTACH_SHADER);
+	put_u32(program);
+	put_u32(shader);
+	double start = get_precise_time_ms();
+	real_AttachShader(program, shader);
+	end_record(TRACE_ATTACH_SHADER, start);
+}
+
+static void GLAPIENTRY trace_BindAttribLocation(GLuint program, GLuint index, const GLchar* name)
+{
+	begin_record(TRACE_BIND_ATTRIB_LOCATION);
+	put_u32(program);
+	put_u32(index);
+	put_string(name);
+	double start = get_precise_time_ms();
+	real_BindAttribLocation(program, index, name);
+	end_record(TRACE_BIND_ATTRIB_LOCATION, start);
+}
+
+static void GLAPIENTRY trace_LinkProgram(GLuint program)
+{
+	begin_record(TRACE_LINK_PROGRAM);
+	put_u32(program);
+	double start = get_precise_time_ms();
+	real_LinkProgram(program);
+	end_record(TRACE_LINK_PROGRAM, start);
+}
+
+static void GLAPIENTRY trace_DeleteProgram(GLuint program)
+{
+	begin_record(TRACE_DELETE_PROGRAM);
+	put_u32(program);
+	double start = get_precise_time_ms();
+	real_DeleteProgram(program);
+	end_record(TRACE_DELETE_PROGRAM, start);
+}
+
+static GLint GLAPIENTRY trace_GetUniformLocation(GLuint program, const GLchar* name)
+{
+	begin_record(TRACE_GET_UNIFORM_LOCATION);
+	put_u32(program);
+	put_string(name);
+	double start = get_precise_time_ms();
+	GLint location = real_GetUniformLocation(program, name);
+	end_record(TRACE_GET_UNIFORM_LOCATION, start);
+	return location;
+}
+
+static GLuint GLAPIENTRY trace_GetUniformBlockIndex(GLuint program, const GLchar* name)
+{
+	begin_record(TRACE_GET_UNIFORM_BLOCK_INDEX);
+	put_u32(program);
+	put_string(name);
+	double start = get_precise_time_ms();
+	GLuint index = real_GetUniformBlockIndex(program, name);
+	end_record(TRACE_GET_UNIFORM_BLOCK_INDEX, start);
+	return index;
+}
+
+static GLint GLAPIENTRY trace_GetAttribLocation(GLuint program, const GLchar* name)
+{
+	begin_record(TRACE_GET_ATTRIB_LOCATION);
+	put_u32(program);
+	put_string(name);
+	double start = get_precise_time_ms();
+	GLint location = real_GetAttribLocation(program, name);
+	end_record(TRACE_GET_ATTRIB_LOCATION, start);
+	return location;
+}
+
+static GLsync GLAPIENTRY trace_FenceSync(GLenum condition, GLbitfield flags)
+{
+	double start = get_precise_time_ms();
+	GLsync sync = real_FenceSync(condition, flags);
+	begin_record(TRACE_FENCE_SYNC);
+	put_u32(condition);
+	put_u32(flags);
+	put_pointer(sync);
+	end_record(TRACE_FENCE_SYNC, start);
+	return sync;
+}
+
+static GLenum GLAPIENTRY trace_ClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	begin_record(TRACE_CLIENT_WAIT_SYNC);
+	put_pointer(sync);
+	put_u32(flags);
+	put_u64(timeout);
+	double start = get_precise_time_ms();
+	GLenum result = real_ClientWaitSync(sync, flags, timeout);
+	end_record(TRACE_CLIENT_WAIT_SYNC, start);
+	return result;
+}
+
+static void GLAPIENTRY trace_DeleteSync(GLsync sync)
+{
+	begin_record(TRACE_DELETE_SYNC);
+	put_pointer(sync);
+	double start = get_precise_time_ms();
+	real_DeleteSync(sync);
+	end_record(TRACE_DELETE_SYNC, start);
+}
+
+static void GLAPIENTRY trace_BeginQuery(GLenum target, GLuint id)
+{
+	begin_record(TRACE_BEGIN_QUERY);
+	put_u32(target);
+	put_u32(id);
+	double start = get_precise_time_ms();
+	real_BeginQuery(target, id);
+	end_record(TRACE_BEGIN_QUERY, start);
+}
+
+static void GLAPIENTRY trace_EndQuery(GLenum target)
+{
+	begin_record(TRACE_END_QUERY);
+	put_u32(target);
+	double start = get_precise_time_ms();
+	real_EndQuery(target);
+	end_record(TRACE_END_QUERY, start);
+}
+
+static void GLAPIENTRY trace_GetQueryObjectui64v(GLuint id, GLenum pname, GLuint64* params)
+{
+	begin_record(TRACE_GET_QUERY_OBJECT_UI64V);
+	put_u32(id);
+	put_u32(pname);
+	double start = get_precise_time_ms();
+	real_GetQueryObjectui64v(id, pname, params);
+	end_record(TRACE_GET_QUERY_OBJECT_UI64V, start);
+}
+
+/*--------------------GL 1.1 Calls---------------------------*/
+// GLEWを通らないので差し替えられない。呼ぶ側(gl_state.cppなど)がこちらを使う
+void trace_gl_enable(GLenum capability)
+{
+	if (!g_tracing)
+	{
+		glEnable(capability);
+		return;
+	}
+	begin_record(TRACE_ENABLE);
+	put_u32(capability);
+	double start = get_precise_time_ms();
+	glEnable(capability);
+	end_record(TRACE_ENABLE, start);
+}
+
+void trace_gl_disable(GLenum capability)
+{
+	if (!g_tracing)
+	{
+		glDisable(capability);
+		return;
+	}
+	begin_record(TRACE_DISABLE);
+	put_u32(capability);
+	double start = get_precise_time_ms();
+	glDisable(capability);
+	end_record(TRACE_DISABLE, start);
+}
+
+void trace_gl_depth_func(GLenum func)
+{
+	if (!g_tracing)
+	{
+		glDepthFunc(func);
+		return;
+	}
+	begin_record(TRACE_DEPTH_FUNC);
+	put_u32(func);
+	double start = get_precise_time_ms();
+	glDepthFunc(func);
+	end_record(TRACE_DEPTH_FUNC, start);
+}
+
+void trace_gl_viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (!g_tracing)
+	{
+		glViewport(x, y, width, height);
+		return;
+	}
+	begin_record(TRACE_VIEWPORT);
+	put_i32(x);
+	put_i32(y);
+	put_i32(width);
+	put_i32(height);
+	double start = get_precise_time_ms();
+	glViewport(x, y, width, height);
+	end_record(TRACE_VIEWPORT, start);
+}
+
+void trace_gl_clear_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+	if (!g_tracing)
+	{
+		glClearColor(r, g, b, a);
+		return;
+	}
+	begin_record(TRACE_CLEAR_COLOR);
+	put_f32(r);
+	put_f32(g);
+	put_f32(b);
+	put_f32(a);
+	double start = get_precise_time_ms();
+	glClearColor(r, g, b, a);
+	end_record(TRACE_CLEAR_COLOR, start);
+}
+
+void trace_gl_clear(GLbitfield mask)
+{
+	if (!g_tracing)
+	{
+		glClear(mask);
+		return;
+	}
+	begin_record(TRACE_CLEAR);
+	put_u32(mask);
+	double start = get_precise_time_ms();
+	glClear(mask);
+	end_record(TRACE_CLEAR, start);
+}
+
+void trace_gl_draw_arrays(GLenum mode, GLint first, GLsizei count)
+{
+	if (!g_tracing)
+	{
+		glDrawArrays(mode, first, count);
+		return;
+	}
+	begin_record(TRACE_DRAW_ARRAYS);
+	put_u32(mode);
+	put_i32(first);
+	put_i32(count);
+	double start = get_precise_time_ms();
+	glDrawArrays(mode, first, count);
+	end_record(TRACE_DRAW_ARRAYS, start);
+}
+
+// 使えない関数(ポインタがNULL)はそのままにしておく
+#define TRACE_HOOK(name, type) \
+	real_##name = __glew##name; \
+	if (real_##name) __glew##name = trace_##name;
+#define TRACE_UNHOOK(name, type) \
+	if (real_##name) __glew##name = real_##name; \
+	real_##name = NULL;
+
+bool start_gl_trace(const char* file_name)
+{
+	if (g_tracing)
+	{
+		gl_log_err("ERROR: GL trace already running\n");
+		return false;
+	}
+	memset(&g_recorder, 0, sizeof(Trace_Recorder));
+	g_recorder.file = fopen(file_name, "wb");
+	if (!g_recorder.file)
+	{
+		gl_log_err("ERROR: could not open GL trace %s for writing\n", file_name);
+		return false;
+	}
+	g_recorder.file_name = file_name;
+	put_u32(TRACE_MAGIC);
+	put_u32(TRACE_VERSION);
+	// マップしたメモリへの書き込みは記録できないので、glBufferSubData()で送らせる
+	g_recorder.buffer_storage = __GLEW_ARB_buffer_storage;
+	__GLEW_ARB_buffer_storage = GL_FALSE;
+	TRACE_FUNCTIONS(TRACE_HOOK)
+	g_tracing = true;
+	printf("recording GL trace to %s\n", file_name);
+	return true;
+}
+
+bool gl_trace_active()
+{
+	return g_tracing;
+}
+
+void mark_gl_trace_frame()
+{
+	if (!g_tracing)
+	{
+		return;
+	}
+	put_u8(TRACE_FRAME);
+	g_recorder.frames++;
+	if (g_recorder.size >= TRACE_FLUSH_BYTES)
+	{
+		flush_trace_data();
+	}
+}
+
+void stop_gl_trace()
+{
+	if (!g_tracing)
+	{
+		return;
+	}
+	TRACE_FUNCTIONS(TRACE_UNHOOK)
+	__GLEW_ARB_buffer_storage = g_recorder.buffer_storage;
+	g_tracing = false;
+	flush_trace_data();
+	fclose(g_recorder.file);
+	free(g_recorder.data);
+	printf(
+		"GL trace: %i frames, %lld bytes written to %s%s\n",
+		g_recorder.frames,
+		g_recorder.bytes_written,
+		g_recorder.file_name,
+		g_recorder.failed ? " (incomplete)" : "");
+	log_call_stats(g_recorder.stats, "GL trace calls (time in driver)");
+	memset(&g_recorder, 0, sizeof(Trace_Recorder));
+}
+
+/*--------------------Replay---------------------------*/
+// 再生で付け替える名前の種類。シェーダとプログラムは同じ名前空間
+#define TRACE_NAME_BUFFER 0
+#define TRACE_NAME_VERTEX_ARRAY 1
+#define TRACE_NAME_PROGRAM 2
+#define TRACE_NAME_FRAMEBUFFER 3
+#define TRACE_NAME_RENDERBUFFER 4
+#define TRACE_NAME_QUERY 5
+#define TRACE_NAME_TYPE_COUNT 6
+
+typedef struct Trace_Replay
+{
+	const unsigned char* data;
+	size_t size;
+	size_t position;
+	bool error;
+	bool execute;		// falseならGLを呼ばない(nullバックエンドと、フレームの区切りを探すとき)
+	bool timing;		// 呼び出しごとの時間を測る
+	GLuint* names[TRACE_NAME_TYPE_COUNT];	// 記録した名前 -> 再生で作った名前。0は未対応
+	unsigned long long sync_keys[TRACE_MAX_SYNCS];
+	GLsync syncs[TRACE_MAX_SYNCS];
+	unsigned char* scratch;
+	size_t scratch_capacity;
+	Trace_Call_Stats stats[TRACE_CALL_COUNT];
+}Trace_Replay;
+
+static void get_bytes(Trace_Replay* p, void* out, size_t size)
+{
+	if (p->error || p->position + size > p->size)
+	{
+		p->error = true;
+		memset(out, 0, size);
+		return;
+	}
+	memcpy(out, p->data + p->position, size);
+	p->position += size;
+}
+
+static unsigned char get_u8(Trace_Replay* p) { unsigned char v; get_bytes(p, &v, 1); return v; }
+static GLuint get_u32(Trace_Replay* p) { GLuint v; get_bytes(p, &v, 4); return v; }
+static GLint get_i32(Trace_Replay* p) { GLint v; get_bytes(p, &v, 4); return v; }
+static GLfloat get_f32(Trace_Replay* p) { GLfloat v; get_bytes(p, &v, 4); return v; }
+static unsigned long long get_u64(Trace_Replay* p) { unsigned long long v; get_bytes(p, &v, 8); return v; }
+static const GLvoid* get_pointer(Trace_Replay* p) { return (const GLvoid*)(size_t)get_u64(p); }
+
+// トレースの中を指す。NULLのデータならNULLを返す
+static const unsigned char* get_blob(Trace_Replay* p, GLuint* size)
+{
+	GLuint length = get_u32(p);
+	*size = 0;
+	if (p->error || length == TRACE_NULL_BLOB)
+	{
+		return NULL;
+	}
+	if (p->position + length > p->size)
+	{
+		p->error = true;
+		return NULL;
+	}
+	const unsigned char* blob = p->data + p->position;
+	p->position += length;
+	*size = length;
+	return blob;
+}
+
+static void* replay_scratch(Trace_Replay* p, size_t size)
+{
+	if (size > p->scratch_capacity)
+	{
+		unsigned char* scratch = (unsigned char*)realloc(p->scratch, size);
+		if (!scratch)
+		{
+			p->error = true;
+			return NULL;
+		}
+		p->scratch = scratch;
+		p->scratch_capacity = size;
+	}
+	return p->scratch;
+}
+
+// floatの配列は揃った位置に写してから渡す。長さがcount * components個でなければ壊れている
+static const GLfloat* get_floats(Trace_Replay* p, GLsizei count, int components)
+{
+	GLuint size = 0;
+	const unsigned char* blob = get_blob(p, &size);
+	if (!blob || count < 0 || (size_t)size != (size_t)count * components * sizeof(GLfloat))
+	{
+		p->error = true;
+		return NULL;
+	}
+	void* floats = replay_scratch(p, size > 0 ? size : 1);
+	if (floats)
+	{
+		memcpy(floats, blob, size);
+	}
+	return (const GLfloat*)floats;
+}
+
+// 終端まで含めて記録した文字列。NULLか終端が無ければ壊れている
+static const GLchar* get_string(Trace_Replay* p)
+{
+	GLuint size = 0;
+	const GLchar* str = (const GLchar*)get_blob(p, &size);
+	if (!str || size == 0 || str[size - 1] != 0)
+	{
+		p->error = true;
+		return NULL;
+	}
+	return str;
+}
+
+// 読み出しが全て成功したときだけGLを呼ぶ。途中で切れたり値が合わなかったりしたレコードは発行しない
+static bool issue(const Trace_Replay* p)
+{
+	return p->execute && !p->error;
+}
+
+// 残りのデータがbytes以上あるか。無ければ壊れている
+static bool have_bytes(Trace_Replay* p, size_t bytes)
+{
+	if (p->error || bytes > p->size - p->position)
+	{
+		p->error = true;
+		return false;
+	}
+	return true;
+}
+
+static GLuint replay_name(const Trace_Replay* p, int type, GLuint recorded)
+{
+	if (!p->execute || recorded == 0 || recorded >= TRACE_MAX_NAMES || p->names[type][recorded] == 0)
+	{
+		return recorded;
+	}
+	return p->names[type][recorded];
+}
+
+static void set_replay_name(Trace_Replay* p, int type, GLuint recorded, GLuint actual)
+{
+	if (recorded < TRACE_MAX_NAMES)
+	{
+		p->names[type][recorded] = actual;
+	}
+}
+
+typedef void (GLAPIENTRY * Gen_Names_Function)(GLsizei n, GLuint* names);
+typedef void (GLAPIENTRY * Delete_Names_Function)(GLsizei n, const GLuint* names);
+
+static void replay_gen_names(Trace_Replay* p, int type, Gen_Names_Function gen)
+{
+	GLsizei n = get_i32(p);
+	if (n < 0 || !have_bytes(p, (size_t)n * sizeof(GLuint)))
+	{
+		p->error = true;
+		return;
+	}
+	GLuint* names = n > 0 ? (GLuint*)replay_scratch(p, n * sizeof(GLuint)) : NULL;
+	if (!names)
+	{
+		return;
+	}
+	if (issue(p))
+	{
+		gen(n, names);
+	}
+	for (int i = 0; i < n; i++)
+	{
+		GLuint recorded = get_u32(p);
+		if (p->execute)
+		{
+			set_replay_name(p, type, recorded, names[i]);
+		}
+	}
+}
+
+static void replay_delete_names(Trace_Replay* p, int type, Delete_Names_Function del)
+{
+	GLsizei n = get_i32(p);
+	if (n < 0 || !have_bytes(p, (size_t)n * sizeof(GLuint)))
+	{
+		p->error = true;
+		return;
+	}
+	GLuint* names = n > 0 ? (GLuint*)replay_scratch(p, n * sizeof(GLuint)) : NULL;
+	if (!names)
+	{
+		return;
+	}
+	for (int i = 0; i < n; i++)
+	{
+		GLuint recorded = get_u32(p);
+		names[i] = replay_name(p, type, recorded);
+		if (p->execute)
+		{
+			set_replay_name(p, type, recorded, 0);
+		}
+	}
+	if (issue(p))
+	{
+		del(n, names);
+	}
+}
+
+static int find_replay_sync(const Trace_Replay* p, unsigned long long key)
+{
+	for (int i = 0; i < TRACE_MAX_SYNCS; i++)
+	{
+		if (p->syncs[i] && p->sync_keys[i] == key)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+// 同じフレームを繰り返すと同じ記録のフェンスがまた作られるので、古い方を消してから置き換える
+static void replay_fence_sync(Trace_Replay* p, GLenum condition, GLbitfield flags, unsigned long long key)
+{
+	int slot = find_replay_sync(p, key);
+	if (slot >= 0)
+	{
+		glDeleteSync(p->syncs[slot]);
+		p->syncs[slot] = NULL;
+	}
+	else
+	{
+		slot = find_replay_sync(p, 0);
+		for (int i = 0; i < TRACE_MAX_SYNCS && slot < 0; i++)
+		{
+			slot = p->syncs[i] ? -1 : i;
+		}
+	}
+	GLsync sync = glFenceSync(condition, flags);
+	if (slot < 0)
+	{
+		glDeleteSync(sync);
+		return;
+	}
+	p->syncs[slot] = sync;
+	p->sync_keys[slot] = key;
+}
+
+// 1レコードを読み、executeなら発行する
+static void replay_record(Trace_Replay* p)
+{
+	int call = get_u8(p);
+	if (p->error || call >= TRACE_CALL_COUNT)
+	{
+		p->error = true;
+		return;
+	}
+	double start = p->timing ? get_precise_time_ms() : 0.0;
+	switch (call)
+	{
+	case TRACE_FRAME:
+		break;
+	case TRACE_USE_PROGRAM:
+	{
+		GLuint program = replay_name(p, TRACE_NAME_PROGRAM, get_u32(p));
+		if (issue(p)) glUseProgram(program);
+		break;
+	}
+	case TRACE_BIND_VERTEX_ARRAY:
+	{
+		GLuint array = replay_name(p, TRACE_NAME_VERTEX_ARRAY, get_u32(p));
+		if (issue(p)) glBindVertexArray(array);
+		break;
+	}
+	case TRACE_BIND_BUFFER:
+	{
+		GLenum target = get_u32(p);
+		GLuint buffer = replay_name(p, TRACE_NAME_BUFFER, get_u32(p));
+		if (issue(p)) glBindBuffer(target, buffer);
+		break;
+	}
+	case TRACE_BIND_BUFFER_RANGE:
+	{
+		GLenum target = get_u32(p);
+		GLuint index = get_u32(p);
+		GLuint buffer = replay_name(p, TRACE_NAME_BUFFER, get_u32(p));
+		GLintptr offset = (GLintptr)get_u64(p);
+		GLsizeiptr size = (GLsizeiptr)get_u64(p);
+		if (issue(p)) glBindBufferRange(target, index, buffer, offset, size);
+		break;
+	}
+	case TRACE_BIND_FRAMEBUFFER:
+	{
+		GLenum target = get_u32(p);
+		GLuint framebuffer = replay_name(p, TRACE_NAME_FRAMEBUFFER, get_u32(p));
+		if (issue(p)) glBindFramebuffer(target, framebuffer);
+		break;
+	}
+	case TRACE_BIND_RENDERBUFFER:
+	{
+		GLenum target = get_u32(p);
+		GLuint renderbuffer = replay_name(p, TRACE_NAME_RENDERBUFFER, get_u32(p));
+		if (issue(p)) glBindRenderbuffer(target, renderbuffer);
+		break;
+	}
+	case TRACE_ACTIVE_TEXTURE:
+	{
+		GLenum texture = get_u32(p);
+		if (issue(p)) glActiveTexture(texture);
+		break;
+	}
+	case TRACE_VERTEX_ATTRIB_POINTER:
+	{
+		GLuint index = get_u32(p);
+		GLint size = get_i32(p);
+		GLenum type = get_u32(p);
+		GLboolean normalized = get_u8(p);
+		GLsizei stride = get_i32(p);
+		const GLvoid* pointer = get_pointer(p);
+		if (issue(p)) glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+		break;
+	}
+	case TRACE_VERTEX_ATTRIB_I_POINTER:
+	{
+		GLuint index = get_u32(p);
+		GLint size = get_i32(p);
+		GLenum type = get_u32(p);
+		GLsizei stride = get_i32(p);
+		const GLvoid* pointer = get_pointer(p);
+		if (issue(p)) glVertexAttribIPointer(index, size, type, stride, pointer);
+		break;
+	}
+	case TRACE_ENABLE_VERTEX_ATTRIB_ARRAY:
+	{
+		GLuint index = get_u32(p);
+		if (issue(p)) glEnableVertexAttribArray(index);
+		break;
+	}
+	case TRACE_VERTEX_ATTRIB_DIVISOR:
+	{
+		GLuint index = get_u32(p);
+		GLuint divisor = get_u32(p);
+		if (issue(p)) glVertexAttribDivisor(index, divisor);
+		break;
+	}
+	case TRACE_UNIFORM_BLOCK_BINDING:
+	{
+		GLuint program = replay_name(p, TRACE_NAME_PROGRAM, get_u32(p));
+		GLuint block_index = get_u32(p);
+		GLuint binding = get_u32(p);
+		if (issue(p)) glUniformBlockBinding(program, block_index, binding);
+		break;
+	}
+	case TRACE_UNIFORM_1I:
+	{
+		GLint location = get_i32(p);
+		GLint v0 = get_i32(p);
+		if (issue(p)) glUniform1i(location, v0);
+		break;
+	}
+	case TRACE_UNIFORM_3F:
+	{
+		GLint location = get_i32(p);
+		GLfloat v0 = get_f32(p);
+		GLfloat v1 = get_f32(p);
+		GLfloat v2 = get_f32(p);
+		if (issue(p)) glUniform3f(location, v0, v1, v2);
+		break;
+	}
+	case TRACE_UNIFORM_3FV:
+	{
+		GLint location = get_i32(p);
+		GLsizei count = get_i32(p);
+		const GLfloat* value = get_floats(p, count, 3);
+		if (issue(p) && value) glUniform3fv(location, count, value);
+		break;
+	}
+	case TRACE_UNIFORM_MATRIX_4FV:
+	{
+		GLint location = get_i32(p);
+		GLsizei count = get_i32(p);
+		GLboolean transpose = get_u8(p);
+		const GLfloat* value = get_floats(p, count, 16);
+		if (issue(p) && value) glUniformMatrix4fv(location, count, transpose, value);
+		break;
+	}
+	case TRACE_TEX_BUFFER:
+	{
+		GLenum target = get_u32(p);
+		GLenum internal_format = get_u32(p);
+		GLuint buffer = replay_name(p, TRACE_NAME_BUFFER, get_u32(p));
+		if (issue(p)) glTexBuffer(target, internal_format, buffer);
+		break;
+	}
+	case TRACE_BUFFER_DATA:
+	{
+		GLenum target = get_u32(p);
+		GLsizeiptr size = (GLsizeiptr)get_u64(p);
+		GLuint data_size = 0;
+		const unsigned char* data = get_blob(p, &data_size);
+		GLenum usage = get_u32(p);
+		if (data && (size < 0 || (unsigned long long)data_size != (unsigned long long)size))
+		{
+			p->error = true;
+		}
+		if (issue(p)) glBufferData(target, size, data, usage);
+		break;
+	}
+	case TRACE_BUFFER_SUB_DATA:
+	{
+		GLenum target = get_u32(p);
+		GLintptr offset = (GLintptr)get_u64(p);
+		GLuint size = 0;
+		const unsigned char* data = get_blob(p, &size);
+		if (issue(p)) glBufferSubData(target, offset, size, data);
+		break;
+	}
+	case TRACE_COPY_BUFFER_SUB_DATA:
+	{
+		GLenum read_target = get_u32(p);
+		GLenum write_target = get_u32(p);
+		GLintptr read_offset = (GLintptr)get_u64(p);
+		GLintptr write_offset = (GLintptr)get_u64(p);
+		GLsizeiptr size = (GLsizeiptr)get_u64(p);
+		if (issue(p)) glCopyBufferSubData(read_target, write_target, read_offset, write_offset, size);
+		break;
+	}
+	case TRACE_RENDERBUFFER_STORAGE:
+	{
+		GLenum target = get_u32(p);
+		GLenum internal_format = get_u32(p);
+		GLsizei width = get_i32(p);
+		GLsizei height = get_i32(p);
+		if (issue(p)) glRenderbufferStorage(target, internal_format, width, height);
+		break;
+	}
+	case TRACE_FRAMEBUFFER_RENDERBUFFER:
+	{
+		GLenum target = get_u32(p);
+		GLenum attachment = get_u32(p);
+		GLenum renderbuffer_target = get_u32(p);
+		GLuint renderbuffer = replay_name(p, TRACE_NAME_RENDERBUFFER, get_u32(p));
+		if (issue(p)) glFramebufferRenderbuffer(target, attachment, renderbuffer_target, renderbuffer);
+		break;
+	}
+	case TRACE_CHECK_FRAMEBUFFER_STATUS:
+	{
+		GLenum target = get_u32(p);
+		if (issue(p)) glCheckFramebufferStatus(target);
+		break;
+	}
+	case TRACE_DRAW_ELEMENTS_BASE_VERTEX:
+	{
+		GLenum mode = get_u32(p);
+		GLsizei count = get_i32(p);
+		GLenum type = get_u32(p);
+		const GLvoid* indices = get_pointer(p);
+		GLint base_vertex = get_i32(p);
+		if (issue(p)) glDrawElementsBaseVertex(mode, count, type, indices, base_vertex);
+		break;
+	}
+	case TRACE_DRAW_ELEMENTS_INSTANCED_BASE_VERTEX:
+	{
+		GLenum mode = get_u32(p);
+		GLsizei count = get_i32(p);
+		GLenum type = get_u32(p);
+		const GLvoid* indices = get_pointer(p);
+		GLsizei instance_count = get_i32(p);
+		GLint base_vertex = get_i32(p);
+		if (issue(p)) glDrawElementsInstancedBaseVertex(mode, count, type, indices, instance_count, base_vertex);
+		break;
+	}
+	case TRACE_MULTI_DRAW_ELEMENTS_BASE_VERTEX:
+	{
+		GLenum mode = get_u32(p);
+		GLenum type = get_u32(p);
+		GLsizei draw_count = get_i32(p);
+		// 1つあたり回数・オフセット・基準頂点の16バイト
+		if (draw_count < 0 || !have_bytes(p, (size_t)draw_count * 16))
+		{
+			p->error = true;
+			break;
+		}
+		// 回数・オフセット・基準頂点の配列を1つの領域に並べる
+		size_t bytes = draw_count * (sizeof(GLsizei) + sizeof(GLvoid*) + sizeof(GLint));
+		unsigned char* arrays = (unsigned char*)replay_scratch(p, bytes > 0 ? bytes : 1);
+		if (!arrays)
+		{
+			break;
+		}
+		const GLvoid** indices = (const GLvoid**)arrays;
+		GLsizei* counts = (GLsizei*)(arrays + draw_count * sizeof(GLvoid*));
+		GLint* base_vertices = (GLint*)(arrays + draw_count * (sizeof(GLvoid*) + sizeof(GLsizei)));
+		for (int i = 0; i < draw_count; i++)
+		{
+			counts[i] = get_i32(p);
+			indices[i] = get_pointer(p);
+			base_vertices[i] = get_i32(p);
+		}
+		if (issue(p)) glMultiDrawElementsBaseVertex(mode, counts, type, indices, draw_count, base_vertices);
+		break;
+	}
+	case TRACE_MULTI_DRAW_ELEMENTS_INDIRECT:
+	{
+		GLenum mode = get_u32(p);
+		GLenum type = get_u32(p);
+		const GLvoid* indirect = get_pointer(p);
+		GLsizei draw_count = get_i32(p);
+		GLsizei stride = get_i32(p);
+		if (issue(p)) glMultiDrawElementsIndirect(mode, type, indirect, draw_count, stride);
+		break;
+	}
+	case TRACE_GEN_BUFFERS:
+		replay_gen_names(p, TRACE_NAME_BUFFER, glGenBuffers);
+		break;
+	case TRACE_DELETE_BUFFERS:
+		replay_delete_names(p, TRACE_NAME_BUFFER, glDeleteBuffers);
+		break;
+	case TRACE_GEN_VERTEX_ARRAYS:
+		replay_gen_names(p, TRACE_NAME_VERTEX_ARRAY, glGenVertexArrays);
+		break;
+	case TRACE_DELETE_VERTEX_ARRAYS:
+		replay_delete_names(p, TRACE_NAME_VERTEX_ARRAY, glDeleteVertexArrays);
+		break;
+	case TRACE_GEN_FRAMEBUFFERS:
+		replay_gen_names(p, TRACE_NAME_FRAMEBUFFER, glGenFramebuffers);
+		break;
+	case TRACE_DELETE_FRAMEBUFFERS:
+		replay_delete_names(p, TRACE_NAME_FRAMEBUFFER, glDeleteFramebuffers);
+		break;
+	case TRACE_GEN_RENDERBUFFERS:
+		replay_gen_names(p, TRACE_NAME_RENDERBUFFER, glGenRenderbuffers);
+		break;
+	case TRACE_DELETE_RENDERBUFFERS:
+		replay_delete_names(p, TRACE_NAME_RENDERBUFFER, glDeleteRenderbuffers);
+		break;
+	case TRACE_GEN_QUERIES:
+		replay_gen_names(p, TRACE_NAME_QUERY, glGenQueries);
+		break;
+	case TRACE_DELETE_QUERIES:
+		replay_delete_names(p, TRACE_NAME_QUERY, glDeleteQueries);
+		break;
+	case TRACE_CREATE_SHADER:
+	{
+		GLenum type = get_u32(p);
+		GLuint recorded = get_u32(p);
+		if (issue(p)) set_replay_name(p, TRACE_NAME_PROGRAM, recorded, glCreateShader(type));
+		break;
+	}
+	case TRACE_SHADER_SOURCE:
+	{
+		GLuint shader = replay_name(p, TRACE_NAME_PROGRAM, get_u32(p));
+		GLsizei count = get_i32(p);
+		// 文字列1つあたり少なくとも長さの4バイト
+		if (count < 0 || !have_bytes(p, (size_t)count * 4))
+		{
+			p->error = true;
+			break;
+		}
+		unsigned char* arrays = (unsigned char*)replay_scratch(p, count * (sizeof(GLchar*) + sizeof(GLint)) + 1);
+		if (!arrays)
+		{
+			break;
+		}
+		const GLchar** strings = (const GLchar**)arrays;
+		GLint* lengths = (GLint*)(arrays + count * sizeof(GLchar*));
+		for (int i = 0; i < count; i++)
+		{
+			GLuint length = 0;
+			strings[i] = (const GLchar*)get_blob(p, &length);
+			lengths[i] = (GLint)length;
+			if (!strings[i])
+			{
+				p->error = true;
+			}
+		}
+		if (issue(p)) glShaderSource(shader, count, strings, lengths);
+		break;
+	}
+	case TRACE_COMPILE_SHADER:
+	{
+		GLuint shader = replay_name(p, TRACE_NAME_PROGRAM, get_u32(p));
+		if (issue(p)) glCompileShader(shader);
+		break;
+	}
+	case TRACE_DELETE_SHADER:
+	{
+		GLuint recorded = get_u32(p);
+		GLuint shader = replay_name(p, TRACE_NAME_PROGRAM, recorded);
+		if (issue(p))
+		{
+			glDeleteShader(shader);
+			set_replay_name(p, TRACE_NAME_PROGRAM, recorded, 0);
+		}
+		break;
+	}
+	case TRACE_CREATE_PROGRAM:
+	{
+		GLuint recorded = get_u32(p);
+		if (issue(p)) set_replay_name(p, TRACE_NAME_PROGRAM, recorded, glCreateProgram());
+		break;
+	}
+	case TRACE_ATTACH_SHADER:
+	{
+		GLuint program = replay_name(p, TRACE_NAME_PROGRAM, get_u32(p));
+		GLuint shader = replay_name(p, TRACE_NAME_PROGRAM, get_u32(p));
+		if (issue(p)) glAttachShader(program, shader);
+		break;
+	}
+	case TRACE_BIND_ATTRIB_LOCATION:
+	{
+		GLuint program = replay_name(p, TRACE_NAME_PROGRAM, get_u32(p));
+		GLuint index = get_u32(p);
+		const GLchar* name = get_string(p);
+		if (issue(p) && name) glBindAttribLocation(program, index, name);
+		break;
+	}
+	case TRACE_LINK_PROGRAM:
+	{
+		GLuint program = replay_name(p, TRACE_NAME_PROGRAM, get_u32(p));
+		if (issue(p)) glLinkProgram(program);
+		break;
+	}
+	case TRACE_DELETE_PROGRAM:
+	{
+		GLuint recorded = get_u32(p);
+		GLuint program = replay_name(p, TRACE_NAME_PROGRAM, recorded);
+		if (issue(p))
+		{
+			glDeleteProgram(program);
+			set_replay_name(p, TRACE_NAME_PROGRAM, recorded, 0);
+		}
+		break;
+	}
+	case TRACE_GET_UNIFORM_LOCATION:
+	case TRACE_GET_UNIFORM_BLOCK_INDEX:
+	case TRACE_GET_ATTRIB_LOCATION:
+	{
+		// 結果は使わないが、ドライバの問い合わせのコストを再現する
+		GLuint program = replay_name(p, TRACE_NAME_PROGRAM, get_u32(p));
+		const GLchar* name = get_string(p);
+		if (!issue(p)) break;
+		if (call == TRACE_GET_UNIFORM_LOCATION) glGetUniformLocation(program, name);
+		else if (call == TRACE_GET_UNIFORM_BLOCK_INDEX) glGetUniformBlockIndex(program, name);
+		else glGetAttribLocation(program, name);
+		break;
+	}
+	case TRACE_FENCE_SYNC:
+	{
+		GLenum condition = get_u32(p);
+		GLbitfield flags = get_u32(p);
+		unsigned long long key = get_u64(p);
+		if (issue(p)) replay_fence_sync(p, condition, flags, key);
+		break;
+	}
+	case TRACE_CLIENT_WAIT_SYNC:
+	{
+		// 再生の範囲の外で作られたフェンスは飛ばす
+		int slot = find_replay_sync(p, get_u64(p));
+		GLbitfield flags = get_u32(p);
+		GLuint64 timeout = get_u64(p);
+		if (issue(p) && slot >= 0) glClientWaitSync(p->syncs[slot], flags, timeout);
+		break;
+	}
+	case TRACE_DELETE_SYNC:
+	{
+		int slot = find_replay_sync(p, get_u64(p));
+		if (issue(p) && slot >= 0)
+		{
+			glDeleteSync(p->syncs[slot]);
+			p->syncs[slot] = NULL;
+		}
+		break;
+	}
+	case TRACE_BEGIN_QUERY:
+	{
+		GLenum target = get_u32(p);
+		GLuint id = replay_name(p, TRACE_NAME_QUERY, get_u32(p));
+		if (issue(p)) glBeginQuery(target, id);
+		break;
+	}
+	case TRACE_END_QUERY:
+	{
+		GLenum target = get_u32(p);
+		if (issue(p)) glEndQuery(target);
+		break;
+	}
+	case TRACE_GET_QUERY_OBJECT_UI64V:
+	{
+		GLuint id = replay_name(p, TRACE_NAME_QUERY, get_u32(p));
+		GLenum pname = get_u32(p);
+		GLuint64 result = 0;
+		if (issue(p)) glGetQueryObjectui64v(id, pname, &result);
+		break;
+	}
+	case TRACE_ENABLE:
+	{
+		GLenum capability = get_u32(p);
+		if (issue(p)) glEnable(capability);
+		break;
+	}
+	case TRACE_DISABLE:
+	{
+		GLenum capability = get_u32(p);
+		if (issue(p)) glDisable(capability);
+		break;
+	}
+	case TRACE_DEPTH_FUNC:
+	{
+		GLenum func = get_u32(p);
+		if (issue(p)) glDepthFunc(func);
+		break;
+	}
+	case TRACE_VIEWPORT:
+	{
+		GLint x = get_i32(p);
+		GLint y = get_i32(p);
+		GLsizei width = get_i32(p);
+		GLsizei height = get_i32(p);
+		if (issue(p)) glViewport(x, y, width, height);
+		break;
+	}
+	case TRACE_CLEAR_COLOR:
+	{
+		GLfloat r = get_f32(p);
+		GLfloat g = get_f32(p);
+		GLfloat b = get_f32(p);
+		GLfloat a = get_f32(p);
+		if (issue(p)) glClearColor(r, g, b, a);
+		break;
+	}
+	case TRACE_CLEAR:
+	{
+		GLbitfield mask = get_u32(p);
+		if (issue(p)) glClear(mask);
+		break;
+	}
+	case TRACE_DRAW_ARRAYS:
+	{
+		GLenum mode = get_u32(p);
+		GLint first = get_i32(p);
+		GLsizei count = get_i32(p);
+		if (issue(p)) glDrawArrays(mode, first, count);
+		break;
+	}
+	}
+	p->stats[call].calls++;
+	if (p->timing)
+	{
+		p->stats[call].ms += get_precise_time_ms() - start;
+	}
+}
+
+// [begin, end)のレコードを再生する
+static void replay_range(Trace_Replay* p, size_t begin, size_t end)
+{
+	p->position = begin;
+	while (p->position < end && !p->error)
+	{
+		replay_record(p);
+	}
+}
+
+static unsigned char* load_trace_file(const char* file_name, size_t* size)
+{
+	FILE* file = fopen(file_name, "rb");
+	if (!file)
+	{
+		gl_log_err("ERROR: could not open GL trace %s\n", file_name);
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	unsigned char* data = length > 0 ? (unsigned char*)malloc(length) : NULL;
+	if (!data || fread(data, 1, length, file) != (size_t)length)
+	{
+		gl_log_err("ERROR: could not read GL trace %s\n", file_name);
+		free(data);
+		fclose(file);
+		return NULL;
+	}
+	fclose(file);
+	*size = (size_t)length;
+	return data;
+}
+
+static void free_trace_replay(Trace_Replay* p)
+{
+	for (int i = 0; i < TRACE_MAX_SYNCS; i++)
+	{
+		if (p->syncs[i])
+		{
+			glDeleteSync(p->syncs[i]);
+		}
+	}
+	for (int i = 0; i < TRACE_NAME_TYPE_COUNT; i++)
+	{
+		free(p->names[i]);
+	}
+	free(p->scratch);
+	free((void*)p->data);
+	memset(p, 0, sizeof(Trace_Replay));
+}
+
+bool replay_gl_trace(const char* file_name, const Trace_Replay_Options* options)
+{
+	if (g_tracing)
+	{
+		gl_log_err("ERROR: cannot replay a GL trace while recording\n");
+		return false;
+	}
+	Trace_Replay replay;
+	memset(&replay, 0, sizeof(Trace_Replay));
+	Trace_Replay* p = &replay;
+	p->data = load_trace_file(file_name, &p->size);
+	if (!p->data)
+	{
+		return false;
+	}
+	if (get_u32(p) != TRACE_MAGIC || get_u32(p) != TRACE_VERSION)
+	{
+		gl_log_err("ERROR: %s is not a version %i GL trace\n", file_name, TRACE_VERSION);
+		free_trace_replay(p);
+		return false;
+	}
+	size_t header_size = p->position;
+
+	// フレームの区切りを探す。frame_starts[i]はフレームiの最初のレコード
+	int frame_count = 0;
+	int frame_capacity = 256;
+	size_t* frame_starts = (size_t*)malloc((frame_capacity + 1) * sizeof(size_t));
+	bool ok = frame_starts != NULL;
+	if (ok)
+	{
+		frame_starts[0] = header_size;
+	}
+	while (ok && p->position < p->size && !p->error)
+	{
+		bool frame_end = p->data[p->position] == TRACE_FRAME;
+		replay_record(p);
+		if (frame_end)
+		{
+			if (frame_count + 1 >= frame_capacity)
+			{
+				frame_capacity *= 2;
+				size_t* grown = (size_t*)realloc(frame_starts, (frame_capacity + 1) * sizeof(size_t));
+				if (!grown)
+				{
+					ok = false;
+					break;
+				}
+				frame_starts = grown;
+			}
+			frame_starts[++frame_count] = p->position;
+		}
+	}
+	if (!ok || p->error)
+	{
+		gl_log_err("ERROR: GL trace %s is corrupt at byte %u\n", file_name, (unsigned int)p->position);
+		free(frame_starts);
+		free_trace_replay(p);
+		return false;
+	}
+
+	int first = options->first_frame;
+	int count = options->frame_count > 0 ? options->frame_count : frame_count - first;
+	int repeat = options->repeat > 0 ? options->repeat : 1;
+	if (first < 0 || count <= 0 || first + count > frame_count)
+	{
+		gl_log_err(
+			"ERROR: GL trace %s has %i frames, cannot replay %i from frame %i\n",
+			file_name, frame_count, count, first);
+		free(frame_starts);
+		free_trace_replay(p);
+		return false;
+	}
+
+	p->execute = !options->null_backend;
+	for (int i = 0; p->execute && i < TRACE_NAME_TYPE_COUNT; i++)
+	{
+		p->names[i] = (GLuint*)calloc(TRACE_MAX_NAMES, sizeof(GLuint));
+		ok = ok && p->names[i];
+	}
+	if (!ok)
+	{
+		gl_log_err("ERROR: could not allocate GL trace name tables\n");
+		free(frame_starts);
+		free_trace_replay(p);
+		return false;
+	}
+	// 最初のフレームまでのオブジェクトの作成などは計測せずに1回だけ流す
+	if (p->execute)
+	{
+		replay_range(p, header_size, frame_starts[first]);
+		glFinish();
+	}
+	memset(p->stats, 0, sizeof(p->stats));
+
+	double total_ms = 0.0;
+	double best_ms = 0.0;
+	for (int i = 0; i < repeat && !p->error; i++)
+	{
+		p->timing = i == 0;
+		double start = get_precise_time_ms();
+		replay_range(p, frame_starts[first], frame_starts[first + count]);
+		double ms = get_precise_time_ms() - start;
+		// GPUの処理は計測に含めない。溜めすぎないように繰り返しごとに待つ
+		if (p->execute)
+		{
+			glFinish();
+		}
+		total_ms += ms;
+		if (i == 0 || ms < best_ms)
+		{
+			best_ms = ms;
+		}
+	}
+	ok = !p->error;
+	printf(
+		"GL trace replay%s: %s, frames %i-%i of %i x %i: %.4f ms/frame mean, %.4f ms/frame best\n",
+		p->execute ? "" : " (null backend)",
+		file_name,
+		first,
+		first + count - 1,
+		frame_count,
+		repeat,
+		total_ms / ((double)repeat * count),
+		best_ms / count);
+	// 回数は全ての繰り返し分、時間は最初の1回だけ
+	log_call_stats(p->stats, "GL trace replay calls (first pass time, including decode)");
+	if (!ok)
+	{
+		gl_log_err("ERROR: GL trace %s is corrupt at byte %u\n", file_name, (unsigned int)p->position);
+	}
+	free(frame_starts);
+	free_trace_replay(p);
+	return ok;
+}
@@ -0,0 +1,52 @@
+#ifndef _GL_TRACE_H_
+#define _GL_TRACE_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+
+/*--------------------GL Call Trace---------------------------*/
+// GLEWの関数ポインタを差し替えて、描画に使うGLの呼び出しと引数をバイナリのトレースに記録する。
+// 記録したトレースは実際のコンテキストか、GLを呼ばないnullバックエンドで再生できる。
+// 指定したフレームだけを何度も再生すれば、発行のコストだけを切り出して測れる。
+// 制限:
+//   GL 1.1の関数はGLEWを通らないので、下のtrace_gl_*()を通したものだけが記録される
+//   (glBindTextureなどは記録されない)
+//   マップしたメモリへの書き込みは見えないので、記録中はARB_buffer_storageを無いことにする
+//   (ステージングリングがglBufferSubData()で送るようになる)。コンテキストを作った直後に始めること
+//   uniformの位置やテクスチャの名前は記録した値をそのまま使う(同じドライバでの再生を想定)
+#define TRACE_MAGIC 0x52544c47	// "GLTR"
+#define TRACE_VERSION 1
+// 記録したデータはこの量を超えたフレームの区切りでファイルに書く
+#define TRACE_FLUSH_BYTES (1024 * 1024)
+// 再生で名前を付け替えるGLの名前の上限
+#define TRACE_MAX_NAMES 65536
+#define TRACE_MAX_SYNCS 64
+
+typedef struct Trace_Replay_Options
+{
+	int first_frame;
+	int frame_count;		// 0なら最後まで
+	int repeat;
+	bool null_backend;		// GLを呼ばず、読み出しだけを行う
+}Trace_Replay_Options;
+
+// 記録を始める。既に記録中ならfalse
+bool start_gl_trace(const char* file_name);
+bool gl_trace_active();
+// フレームの終わりに呼ぶ。再生はこの区切りでフレームを数える
+void mark_gl_trace_frame();
+// 関数ポインタを戻してファイルを閉じ、呼び出しごとの回数と時間を表示する
+void stop_gl_trace();
+// 最初のフレームより前の呼び出しは計測せずに1回だけ再生し(オブジェクトの作成など)、
+// 指定したフレームをrepeat回再生する。呼び出しごとの時間は最初の1回だけ測る(タイマーの分だけ遅くなるため)
+bool replay_gl_trace(const char* file_name, const Trace_Replay_Options* options);
+
+// GL 1.1の関数の代わりに呼ぶ。記録中でなければそのまま発行する
+void trace_gl_enable(GLenum capability);
+void trace_gl_disable(GLenum capability);
+void trace_gl_depth_func(GLenum func);
+void trace_gl_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void trace_gl_clear_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+void trace_gl_clear(GLbitfield mask);
+void trace_gl_draw_arrays(GLenum mode, GLint first, GLsizei count);
+
+#endif
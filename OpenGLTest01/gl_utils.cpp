@@ -1,694 +1,1482 @@
-#include "gl_utils.h"
-#include "maths_funcs.h"
-#include <assimp/cimport.h> // C importer
-#include <assimp/scene.h> // collects data
-#include <assimp/postprocess.h> // various extra operations
-#include <stdio.h>
-#include <time.h>
-#include <string.h>
-#include <assert.h>
-#define MAX_SHADER_LENGTH 262144
-
-/*-----------------------GL Information Logger-----------------------------*/
-
-/* start a new log file. put the time and date at the top */
-bool restart_gl_log() {
-	time_t now;
-	char* date;
-	FILE* file = fopen(GL_LOG_FILE, "w");
-
-	if (!file) {
-		fprintf(
-			stderr,
-			"ERROR: could not open GL_LOG_FILE log file %s for writing\n",
-			GL_LOG_FILE
-			);
-		return false;
-	}
-	now = time(NULL);
-	date = ctime(&now);
-	fprintf(file, "GL_LOG_FILE log. local time %s", date);
-	fprintf(file, "build version: %s %s\n\n", __DATE__, __TIME__);
-	fclose(file);
-	return true;
-}
-
-/* add a message to the log file. arguments work the same way as printf() */
-bool gl_log(const char* message, ...) {
-	va_list argptr;
-	FILE* file = fopen(GL_LOG_FILE, "a");
-	if (!file) {
-		fprintf(
-			stderr,
-			"ERROR: could not open GL_LOG_FILE %s file for appending\n",
-			GL_LOG_FILE
-			);
-		return false;
-	}
-	va_start(argptr, message);
-	vfprintf(file, message, argptr);
-	va_end(argptr);
-	fclose(file);
-	return true;
-}
-
-/* same as gl_log except also prints to stderr */
-bool gl_log_err(const char* message, ...) {
-	va_list argptr;
-	FILE* file = fopen(GL_LOG_FILE, "a");
-	if (!file) {
-		fprintf(
-			stderr,
-			"ERROR: could not open GL_LOG_FILE %s file for appending\n",
-			GL_LOG_FILE
-			);
-		return false;
-	}
-	va_start(argptr, message);
-	vfprintf(file, message, argptr);
-	va_end(argptr);
-	va_start(argptr, message);
-	vfprintf(stderr, message, argptr);
-	va_end(argptr);
-	fclose(file);
-	return true;
-}
-
-/* we will tell GLFW to run this function whenever it finds an error */
-void glfw_error_callback(int error, const char* description) {
-	gl_log_err("GLFW ERROR: code %i msg: %s\n", error, description);
-}
-
-/* we will tell GLFW to run this function whenever the window is resized */
-void glfw_window_size_callback(GLFWwindow* window, int width, int height) {
-	g_gl_width = width;
-	g_gl_height = height;
-	printf("width %i height %i\n", width, height);
-	/* update any perspective matrices used here */
-}
-
-/* we can use a function like this to print some GL capabilities of our adapter
-to the log file. handy if we want to debug problems on other people's computers
-*/
-void log_gl_params() {
-	int i;
-	int v[2];
-	unsigned char s = 0;
-	GLenum params[] = {
-		GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS,
-		GL_MAX_CUBE_MAP_TEXTURE_SIZE,
-		GL_MAX_DRAW_BUFFERS,
-		GL_MAX_FRAGMENT_UNIFORM_COMPONENTS,
-		GL_MAX_TEXTURE_IMAGE_UNITS,
-		GL_MAX_TEXTURE_SIZE,
-		GL_MAX_VARYING_FLOATS,
-		GL_MAX_VERTEX_ATTRIBS,
-		GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS,
-		GL_MAX_VERTEX_UNIFORM_COMPONENTS,
-		GL_MAX_VIEWPORT_DIMS,
-		GL_STEREO,
-	};
-	const char* names[] = {
-		"GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS",
-		"GL_MAX_CUBE_MAP_TEXTURE_SIZE",
-		"GL_MAX_DRAW_BUFFERS",
-		"GL_MAX_FRAGMENT_UNIFORM_COMPONENTS",
-		"GL_MAX_TEXTURE_IMAGE_UNITS",
-		"GL_MAX_TEXTURE_SIZE",
-		"GL_MAX_VARYING_FLOATS",
-		"GL_MAX_VERTEX_ATTRIBS",
-		"GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS",
-		"GL_MAX_VERTEX_UNIFORM_COMPONENTS",
-		"GL_MAX_VIEWPORT_DIMS",
-		"GL_STEREO",
-	};
-	gl_log("GL Context Params:\n");
-	// integers - only works if the order is 0-10 integer return types
-	for (i = 0; i < 10; i++) {
-		int v = 0;
-		glGetIntegerv(params[i], &v);
-		gl_log("%s %i\n", names[i], v);
-	}
-	// others
-	v[0] = v[1] = 0;
-	glGetIntegerv(params[10], v);
-	gl_log("%s %i %i\n", names[10], v[0], v[1]);
-	glGetBooleanv(params[11], &s);
-	gl_log("%s %i\n", names[11], (unsigned int)s);
-	gl_log("-----------------------------\n");
-}
-
-double previous_seconds;
-int frame_count;
-
-/* we will use this function to update the window title with a frame rate */
-void update_fps_counter(GLFWwindow* window) {
-	double current_seconds;
-	double elapsed_seconds;
-	char tmp[128];
-
-	current_seconds = glfwGetTime();
-	elapsed_seconds = current_seconds - previous_seconds;
-	if (elapsed_seconds > 0.25) {
-		previous_seconds = current_seconds;
-
-		double fps = (double)frame_count / elapsed_seconds;
-		sprintf(tmp, "opengl @ fps: %.2f", fps);
-		glfwSetWindowTitle(window, tmp);
-		frame_count = 0;
-	}
-	frame_count++;
-}
-
-bool start_gl()
-{
-	const GLubyte* renderer;
-	const GLubyte* version;
-
-	gl_log("starting GLFW %s", glfwGetVersionString());
-
-	glfwSetErrorCallback(glfw_error_callback);
-	if (!glfwInit())
-	{
-		fprintf(stderr, "ERROR: could not start GLFW3\n");
-		return false;
-	}
-
-	/* We must specify 3.2 core if on Apple OS X -- other O/S can specify
-	anything here. I defined 'APPLE' in the makefile for OS X */
-#ifdef APPLE
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-#endif
-	/*GLFWmonitor* mon = glfwGetPrimaryMonitor ();
-	const GLFWvidmode* vmode = glfwGetVideoMode (mon);
-	g_window = glfwCreateWindow (
-	vmode->width, vmode->height, "Extended GL Init", mon, NULL
-	);*/
-
-	g_window = glfwCreateWindow(g_gl_width, g_gl_height, "Shader Program", NULL, NULL);
-	if (!g_window) {
-		fprintf(stderr, "ERROR: could not open window with GLFW3\n");
-		glfwTerminate();
-		return false;
-	}
-	glfwSetWindowSizeCallback(g_window, glfw_window_size_callback);
-	glfwMakeContextCurrent(g_window);
-
-	glfwWindowHint(GLFW_SAMPLES, 4);
-
-	/* start GLEW extension handler */
-	glewExperimental = GL_TRUE;
-	glewInit();
-
-	/* get version info */
-	renderer = glGetString(GL_RENDERER); /* get renderer string */
-	version = glGetString(GL_VERSION); /* version as a string */
-	printf("Renderer: %s\n", renderer);
-	printf("OpenGL version supported %s\n", version);
-	gl_log("renderer: %s\nversion: %s\n", renderer, version);
-	log_gl_params();
-
-	return true;
-}
-
-
-/*--------------------GL Shader Util and Debug---------------------------*/
-const char* GL_type_to_string(GLenum type) {
-	switch (type) {
-	case GL_BOOL: return "bool";
-	case GL_INT: return "int";
-	case GL_FLOAT: return "float";
-	case GL_FLOAT_VEC2: return "vec2";
-	case GL_FLOAT_VEC3: return "vec3";
-	case GL_FLOAT_VEC4: return "vec4";
-	case GL_FLOAT_MAT2: return "mat2";
-	case GL_FLOAT_MAT3: return "mat3";
-	case GL_FLOAT_MAT4: return "mat4";
-	case GL_SAMPLER_2D: return "sampler2D";
-	case GL_SAMPLER_3D: return "sampler3D";
-	case GL_SAMPLER_CUBE: return "samplerCube";
-	case GL_SAMPLER_2D_SHADOW: return "sampler2DShadow";
-	default: break;
-	}
-	return "other";
-}
-
-/* print errors in shader compilation */
-void print_shader_info_log(GLuint shader_index) {
-	int max_length = 2048;
-	int actual_length = 0;
-	char log[2048];
-	glGetShaderInfoLog(shader_index, max_length, &actual_length, log);
-	printf("shader info log for GL index %i:\n%s\n", shader_index, log);
-}
-
-/* print errors in shader linking */
-void print_programme_info_log(GLuint sp) {
-	int max_length = 2048;
-	int actual_length = 0;
-	char log[2048];
-	glGetProgramInfoLog(sp, max_length, &actual_length, log);
-	printf("program info log for GL index %i:\n%s", sp, log);
-}
-
-/* validate shader */
-bool is_valid(GLuint sp) {
-	int params = -1;
-
-	glValidateProgram(sp);
-	glGetProgramiv(sp, GL_VALIDATE_STATUS, &params);
-	printf("program %i GL_VALIDATE_STATUS = %i\n", sp, params);
-	if (GL_TRUE != params) {
-		print_programme_info_log(sp);
-		return false;
-	}
-	return true;
-}
-
-/* print absolutely everything about a shader - only useful if you get really
-stuck wondering why a shader isn't working properly */
-void print_all(GLuint sp) {
-	int params = -1;
-	int i;
-
-	printf("--------------------\nshader programme %i info:\n", sp);
-	glGetProgramiv(sp, GL_LINK_STATUS, &params);
-	printf("GL_LINK_STATUS = %i\n", params);
-
-	glGetProgramiv(sp, GL_ATTACHED_SHADERS, &params);
-	printf("GL_ATTACHED_SHADERS = %i\n", params);
-
-	glGetProgramiv(sp, GL_ACTIVE_ATTRIBUTES, &params);
-	printf("GL_ACTIVE_ATTRIBUTES = %i\n", params);
-
-	for (i = 0; i < params; i++) {
-		char name[64];
-		int max_length = 64;
-		int actual_length = 0;
-		int size = 0;
-		GLenum type;
-		glGetActiveAttrib(sp, i, max_length, &actual_length, &size, &type,
-			name);
-		if (size > 1) {
-			int j;
-			for (j = 0; j < size; j++) {
-				char long_name[64];
-				int location;
-
-				sprintf(long_name, "%s[%i]", name, j);
-				location = glGetAttribLocation(sp, long_name);
-				printf("  %i) type:%s name:%s location:%i\n",
-					i, GL_type_to_string(type), long_name, location);
-			}
-		}
-		else {
-			int location = glGetAttribLocation(sp, name);
-			printf("  %i) type:%s name:%s location:%i\n",
-				i, GL_type_to_string(type), name, location);
-		}
-	}
-
-	glGetProgramiv(sp, GL_ACTIVE_UNIFORMS, &params);
-	printf("GL_ACTIVE_UNIFORMS = %i\n", params);
-	for (i = 0; i < params; i++) {
-		char name[64];
-		int max_length = 64;
-		int actual_length = 0;
-		int size = 0;
-		GLenum type;
-		glGetActiveUniform(sp, i, max_length, &actual_length, &size, &type,
-			name);
-		if (size > 1) {
-			int j;
-			for (j = 0; j < size; j++) {
-				char long_name[64];
-				int location;
-
-				sprintf(long_name, "%s[%i]", name, j);
-				location = glGetUniformLocation(sp, long_name);
-				printf("  %i) type:%s name:%s location:%i\n",
-					i, GL_type_to_string(type), long_name, location);
-			}
-		}
-		else {
-			int location = glGetUniformLocation(sp, name);
-			printf("  %i) type:%s name:%s location:%i\n",
-				i, GL_type_to_string(type), name, location);
-		}
-	}
-
-	print_programme_info_log(sp);
-}
-
-/* copy a shader from a plain text file into a character array */
-bool parse_file_into_str(const char* file_name, char* shader_str, int max_len
-	) {
-	FILE* file = fopen(file_name, "r");
-	if (!file) {
-		gl_log_err("ERROR: opening file for reading: %s\n", file_name);
-		return false;
-	}
-	size_t cnt = fread(shader_str, 1, max_len - 1, file);
-	if (cnt >= max_len - 1) {
-		gl_log_err("WARNING: file %s too big - truncated.\n", file_name);
-	}
-	if (ferror(file)) {
-		gl_log_err("ERROR: reading shader file %s\n", file_name);
-		fclose(file);
-		return false;
-	}
-	// append \0 to end of file string
-	shader_str[cnt] = 0;
-	fclose(file);
-	return true;
-}
-
-bool create_shader(const char* file_name, GLuint* shader, GLenum type)
-{
-	gl_log("creating shader form %s...\n", file_name);
-	char shader_string[MAX_SHADER_LENGTH];
-	assert(parse_file_into_str(file_name, shader_string, MAX_SHADER_LENGTH));
-	*shader = glCreateShader(type);
-	const GLchar* p = (const GLchar*)shader_string;
-	glShaderSource(*shader, 1, &p, NULL);
-	glCompileShader(*shader);
-
-	// check for compile errors
-	int params = -1;
-	glGetShaderiv(*shader, GL_COMPILE_STATUS, &params);
-	if (GL_TRUE != params)
-	{
-		gl_log_err("ERROR: GL shader index %i dit not compile\n", *shader);
-		print_shader_info_log(*shader);
-		return false;
-	}
-	gl_log("shader compiled. index %i", *shader);
-	return true;
-}
-
-bool is_programme_valid(GLuint sp)
-{
-	glValidateProgram(sp);
-	GLint params = -1;
-	glGetProgramiv(sp, GL_VALIDATE_STATUS, &params);
-	if (GL_TRUE != params)
-	{
-		gl_log_err("program %i GL_VALIDATE_STATUS = GL_FALSE\n", sp);
-		print_programme_info_log(sp);
-		return false;
-	}
-	gl_log("program %i GL_VALIDATE_STATUS = GL_TRUE\n", sp);
-	return true;
-}
-
-bool create_programme(GLuint vs, GLuint fs, GLuint* programme)
-{
-	*programme = glCreateProgram();
-	gl_log(
-		"created programme %u, attaching shaders %u and %u...\n",
-		*programme,
-		vs,
-		fs
-	);
-	glAttachShader(*programme, vs);
-	glAttachShader(*programme, fs);
-	// link the shader programme. if binding input attributes, do that before link 
-	// (attribute(in)ϐ̃oCĥ߂GLSLlocationL[[hgȂꍇBglBindAttribLocation()Link̑Oɍs)
-	glLinkProgram(*programme);
-	GLint params = -1;
-	glGetProgramiv(*programme, GL_LINK_STATUS, &params);
-	if (GL_TRUE != params)
-	{
-		gl_log_err("ERROR: could not link shader programme GL index %u\n", *programme);
-		print_programme_info_log(*programme);
-		return false;
-	}
-	assert(is_programme_valid(*programme));
-	
-	glDeleteShader(vs);
-	glDeleteShader(fs);
-
-	return true;
-}
-
-GLuint create_programme_from_files(const char* vs_filename, const char* fs_filename)
-{
-	GLuint vs, fs, programme;
-	assert(create_shader(vs_filename, &vs, GL_VERTEX_SHADER));
-	assert(create_shader(fs_filename, &fs, GL_FRAGMENT_SHADER));
-	assert(create_programme(vs, fs, &programme));
-	return programme;
-}
-
-/*--------------------Skeleton Structure and its Loader---------------------------*/
-// V[OtɊ܂܂Sm[hċAIɂǂBm[h\̂AArmature(skeleton)̂ݒo邽߂ɁA
-// m[hƃ{[̖OƍāAv̂𔲂oB
-bool import_skeleton_node(
-	aiNode* assimp_node,
-	Skeleton_Node** skeleton_node,
-	int bone_count,
-	char bone_names[][64])
-{
-	Skeleton_Node* temp = (Skeleton_Node*)malloc(sizeof(Skeleton_Node));
-
-	// vf̏
-	strcpy(temp->name, assimp_node->mName.C_Str());
-	printf("--node name = %s\n", temp->name);
-	temp->num_children = 0;
-	printf("node has %i children\n", (int)assimp_node->mNumChildren);
-	temp->bone_index = -1;
-	for (int i = 0; i < MAX_BONES; i++){
-		temp->children[i] = NULL;
-	}
-
-	// {[̖Oƃm[h̏ƍ
-	bool has_bone = false;
-	for (int i = 0; i < bone_count; i++)
-	{
-		if (strcmp(bone_names[i], temp->name) == 0){
-			printf("node uses bone %i\n", i);
-			temp->bone_index = i;
-			has_bone = true;
-			break;
-		}
-	}
-	if (!has_bone){
-		printf("no bone found for node\n");
-	}
-
-	// q̃{[ċAIɒTāALȃ{[邩T
-	bool has_useful_child = false;
-	for (int i = 0; i < (int)assimp_node->mNumChildren; i++)
-	{
-		if (import_skeleton_node(
-			assimp_node->mChildren[i],
-			&temp->children[temp->num_children],
-			bone_count,
-			bone_names
-			)){
-			has_useful_child = true;
-			temp->num_children++;
-		}
-		else{
-			printf("useless child culled\n");
-		}
-	}
-	if (has_useful_child || has_bone)
-	{
-		// m[h{[ƂėLAqɗLȃ{[Ă΃XPgm[hɒǉ
-		*skeleton_node = temp;
-		return true;
-	}
-
-	free(temp);
-	temp = NULL;
-	return false;
-}
-
-/*--------------------3D Object File Importer---------------------------*/
-mat4 convert_assimp_matrix(aiMatrix4x4 m)
-{
-	return mat4(
-		1.0f, 0.0f, 0.0f, 0.0f,
-		0.0f, 1.0f, 0.0f, 0.0f,
-		0.0f, 0.0f, 1.0f, 0.0f,
-		m.a4, m.b4, m.c4, m.d4);
-}
-
-
-bool load_mesh(
-	const char* file_name,
-	GLuint* vao,
-	int* point_count,
-	mat4* bone_offset_mats,
-	int* bone_count,
-	Skeleton_Node** root_node)
-{
-	const aiScene* scene = aiImportFile(file_name, aiProcess_Triangulate);
-
-	if (!scene)
-	{
-		fprintf(stderr, "ERROR, reading mesh %s\n", file_name);
-		return false;
-	}
-	printf("%i cameras\n", scene->mNumCameras);
-	printf("%i lights\n", scene->mNumLights);
-	printf("%i materials\n", scene->mNumMaterials);
-	printf("%i meshes\n", scene->mNumMeshes);
-	printf("%i textures\n", scene->mNumTextures);
-
-	const aiMesh* mesh = scene->mMeshes[0];
-	printf("%i vertices in mesh[0]\n", mesh->mNumVertices);
-
-	*point_count = mesh->mNumVertices;
-
-	glGenVertexArrays(1, vao);
-	glBindVertexArray(*vao);
-
-	GLfloat* points = NULL;
-	GLfloat* normals = NULL;
-	GLfloat* texcoords = NULL;
-	GLint* bone_ids = NULL;
-
-	if (mesh->HasPositions())
-	{
-		points = (GLfloat*)malloc(*point_count * 3 * sizeof(GLfloat));
-		for (int i = 0; i < *point_count; i++)
-		{
-			const aiVector3D* vp = &(mesh->mVertices[i]);
-			points[i * 3] = (GLfloat)vp->x;
-			points[i * 3 + 1] = (GLfloat)vp->y;
-			points[i * 3 + 2] = (GLfloat)vp->z;
-		}
-	}
-	if (mesh->HasNormals()) {
-		normals = (GLfloat*)malloc(*point_count * 3 * sizeof (GLfloat));
-		for (int i = 0; i < *point_count; i++) {
-			const aiVector3D* vn = &(mesh->mNormals[i]);
-			normals[i * 3] = (GLfloat)vn->x;
-			normals[i * 3 + 1] = (GLfloat)vn->y;
-			normals[i * 3 + 2] = (GLfloat)vn->z;
-		}
-	}
-	if (mesh->HasTextureCoords(0)) {
-		texcoords = (GLfloat*)malloc(*point_count * 2 * sizeof (GLfloat));
-		for (int i = 0; i < *point_count; i++) {
-			const aiVector3D* vt = &(mesh->mTextureCoords[0][i]);
-			texcoords[i * 2] = (GLfloat)vt->x;
-			texcoords[i * 2 + 1] = (GLfloat)vt->y;
-		}
-	}
-	if (mesh->HasBones())
-	{
-		*bone_count = (int)mesh->mNumBones;
-		bone_ids = (GLint*)malloc(*point_count * sizeof(GLint));
-
-		// bone names. max 256 bones, max name length 64.
-		char bonenames[256][64];
-		for (int b_i = 0; b_i < *bone_count; b_i++)
-		{
-			const aiBone* bone = mesh->mBones[b_i];
-			strcpy(bonenames[b_i], bone->mName.data);
-			printf("bonenames[%i] = %s\n", b_i, bonenames[b_i]);
-			bone_offset_mats[b_i] = convert_assimp_matrix(bone->mOffsetMatrix);
-
-			// get bone ids and weigthts
-			int num_weights = (int)bone->mNumWeights;
-			for (int w_i = 0; w_i < num_weights; w_i++)
-			{
-				aiVertexWeight weight = bone->mWeights[w_i];
-				int vertex_id = (int)weight.mVertexId;
-				if (weight.mWeight >= 0.3f)
-				{
-					bone_ids[vertex_id] = b_i;
-				}
-			}
-		}
-
-		/* get the skeleton hierarchy*/
-
-		aiNode* assimp_node = scene->mRootNode;
-
-		if (!import_skeleton_node(
-			assimp_node,
-			root_node,
-			*bone_count,
-			bonenames)){
-			fprintf(stderr, "ERROR: could not iport node tree from mesh\n");
-		}
-	}
-
-	if (mesh->HasPositions())
-	{
-		GLuint vbo;
-		glGenBuffers(1, &vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData
-			(
-			GL_ARRAY_BUFFER,
-			3 * (*point_count) * sizeof(GLfloat),
-			points,
-			GL_STATIC_DRAW
-			);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-		glEnableVertexAttribArray(0);
-		free(points);
-	}
-	if (mesh->HasNormals())
-	{
-		GLuint vbo;
-		glGenBuffers(1, &vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData
-			(
-			GL_ARRAY_BUFFER,
-			3 * (*point_count) * sizeof(GLfloat),
-			normals,
-			GL_STATIC_DRAW
-			);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-		glEnableVertexAttribArray(1);
-		free(normals);
-	}
-	if (mesh->HasTextureCoords(0))
-	{
-		GLuint vbo;
-		glGenBuffers(1, &vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData
-			(
-			GL_ARRAY_BUFFER,
-			2 * (*point_count) * sizeof(GLfloat),
-			texcoords,
-			GL_STATIC_DRAW
-			);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-		glEnableVertexAttribArray(2);
-		free(texcoords);
-	}
-	if (mesh->HasTangentsAndBitangents())
-	{
-	}
-	if (mesh->HasBones())
-	{
-		GLuint vbo;
-		glGenBuffers(1, &vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(
-			GL_ARRAY_BUFFER,
-			*point_count * sizeof(GLint),
-			bone_ids,
-			GL_STATIC_DRAW);
-		glVertexAttribIPointer(3, 1, GL_INT, 0, NULL);
-		glEnableVertexAttribArray(3);
-		free(bone_ids);
-	}
-
-	aiReleaseImport(scene);
-	printf("mesh loaded\n");
-
-	return true;
-}
\ No newline at end of file
+#include "gl_utils.h"
+#include "maths_funcs.h"
+#include <assimp/cimport.h> // C importer
+#include <assimp/scene.h> // collects data
+#include <assimp/postprocess.h> // various extra operations
+#include <assimp/Importer.hpp> // C++ importer, for the custom IO system
+#include "asset_io.h"
+#include "tangent_space.h"
+#include "collada_reader.h"
+#include "timer.h"
+#include "frame_uniforms.h"
+#include "bone_palette.h"
+#include "headless_gl.h"
+#include <stdio.h>
+#include <time.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <mutex>
+
+/*-----------------------GL Information Logger-----------------------------*/
+
+/* start a new log file. put the time and date at the top */
+bool restart_gl_log() {
+	time_t now;
+	char* date;
+	FILE* file = fopen(GL_LOG_FILE, "w");
+
+	if (!file) {
+		fprintf(
+			stderr,
+			"ERROR: could not open GL_LOG_FILE log file %s for writing\n",
+			GL_LOG_FILE
+			);
+		return false;
+	}
+	now = time(NULL);
+	date = ctime(&now);
+	fprintf(file, "GL_LOG_FILE log. local time %s", date);
+	fprintf(file, "build version: %s %s\n\n", __DATE__, __TIME__);
+	fclose(file);
+	return true;
+}
+
+/* add a message to the log file. arguments work the same way as printf() */
+bool gl_log(const char* message, ...) {
+	va_list argptr;
+	FILE* file = fopen(GL_LOG_FILE, "a");
+	if (!file) {
+		fprintf(
+			stderr,
+			"ERROR: could not open GL_LOG_FILE %s file for appending\n",
+			GL_LOG_FILE
+			);
+		return false;
+	}
+	va_start(argptr, message);
+	vfprintf(file, message, argptr);
+	va_end(argptr);
+	fclose(file);
+	return true;
+}
+
+/* same as gl_log except also prints to stderr */
+bool gl_log_err(const char* message, ...) {
+	va_list argptr;
+	FILE* file = fopen(GL_LOG_FILE, "a");
+	if (!file) {
+		fprintf(
+			stderr,
+			"ERROR: could not open GL_LOG_FILE %s file for appending\n",
+			GL_LOG_FILE
+			);
+		return false;
+	}
+	va_start(argptr, message);
+	vfprintf(file, message, argptr);
+	va_end(argptr);
+	va_start(argptr, message);
+	vfprintf(stderr, message, argptr);
+	va_end(argptr);
+	fclose(file);
+	return true;
+}
+
+bool gl_log_print(const char* message, ...) {
+	va_list argptr;
+	FILE* file = fopen(GL_LOG_FILE, "a");
+	if (!file) {
+		fprintf(
+			stderr,
+			"ERROR: could not open GL_LOG_FILE %s file for appending\n",
+			GL_LOG_FILE
+			);
+		return false;
+	}
+	va_start(argptr, message);
+	vfprintf(file, message, argptr);
+	va_end(argptr);
+	va_start(argptr, message);
+	vprintf(message, argptr);
+	va_end(argptr);
+	fclose(file);
+	return true;
+}
+
+/* we will tell GLFW to run this function whenever it finds an error */
+void glfw_error_callback(int error, const char* description) {
+	gl_log_err("GLFW ERROR: code %i msg: %s\n", error, description);
+}
+
+/* we will tell GLFW to run this function whenever the window is resized */
+void glfw_window_size_callback(GLFWwindow* window, int width, int height) {
+	g_gl_width = width;
+	g_gl_height = height;
+	printf("width %i height %i\n", width, height);
+	/* update any perspective matrices used here */
+}
+
+/* we can use a function like this to print some GL capabilities of our adapter
+to the log file. handy if we want to debug problems on other people's computers
+*/
+void log_gl_params() {
+	int i;
+	int v[2];
+	unsigned char s = 0;
+	GLenum params[] = {
+		GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS,
+		GL_MAX_CUBE_MAP_TEXTURE_SIZE,
+		GL_MAX_DRAW_BUFFERS,
+		GL_MAX_FRAGMENT_UNIFORM_COMPONENTS,
+		GL_MAX_TEXTURE_IMAGE_UNITS,
+		GL_MAX_TEXTURE_SIZE,
+		GL_MAX_VARYING_FLOATS,
+		GL_MAX_VERTEX_ATTRIBS,
+		GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS,
+		GL_MAX_VERTEX_UNIFORM_COMPONENTS,
+		GL_MAX_VIEWPORT_DIMS,
+		GL_STEREO,
+	};
+	const char* names[] = {
+		"GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS",
+		"GL_MAX_CUBE_MAP_TEXTURE_SIZE",
+		"GL_MAX_DRAW_BUFFERS",
+		"GL_MAX_FRAGMENT_UNIFORM_COMPONENTS",
+		"GL_MAX_TEXTURE_IMAGE_UNITS",
+		"GL_MAX_TEXTURE_SIZE",
+		"GL_MAX_VARYING_FLOATS",
+		"GL_MAX_VERTEX_ATTRIBS",
+		"GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS",
+		"GL_MAX_VERTEX_UNIFORM_COMPONENTS",
+		"GL_MAX_VIEWPORT_DIMS",
+		"GL_STEREO",
+	};
+	gl_log("GL Context Params:\n");
+	// integers - only works if the order is 0-10 integer return types
+	for (i = 0; i < 10; i++) {
+		int v = 0;
+		glGetIntegerv(params[i], &v);
+		gl_log("%s %i\n", names[i], v);
+	}
+	// others
+	v[0] = v[1] = 0;
+	glGetIntegerv(params[10], v);
+	gl_log("%s %i %i\n", names[10], v[0], v[1]);
+	glGetBooleanv(params[11], &s);
+	gl_log("%s %i\n", names[11], (unsigned int)s);
+	gl_log("-----------------------------\n");
+}
+
+double previous_seconds;
+int frame_count;
+
+/* we will use this function to update the window title with a frame rate */
+void update_fps_counter(GLFWwindow* window) {
+	double current_seconds;
+	double elapsed_seconds;
+	char tmp[128];
+
+	current_seconds = glfwGetTime();
+	elapsed_seconds = current_seconds - previous_seconds;
+	if (elapsed_seconds > 0.25) {
+		previous_seconds = current_seconds;
+
+		double fps = (double)frame_count / elapsed_seconds;
+		sprintf(tmp, "opengl @ fps: %.2f", fps);
+		glfwSetWindowTitle(window, tmp);
+		frame_count = 0;
+	}
+	frame_count++;
+}
+
+bool start_gl()
+{
+	gl_log("starting GLFW %s", glfwGetVersionString());
+
+	glfwSetErrorCallback(glfw_error_callback);
+	if (!glfwInit())
+	{
+		fprintf(stderr, "ERROR: could not start GLFW3\n");
+		return false;
+	}
+
+	/* We must specify 3.2 core if on Apple OS X -- other O/S can specify
+	anything here. I defined 'APPLE' in the makefile for OS X */
+#ifdef APPLE
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#endif
+	/*GLFWmonitor* mon = glfwGetPrimaryMonitor ();
+	const GLFWvidmode* vmode = glfwGetVideoMode (mon);
+	g_window = glfwCreateWindow (
+	vmode->width, vmode->height, "Extended GL Init", mon, NULL
+	);*/
+
+	g_window = glfwCreateWindow(g_gl_width, g_gl_height, "Shader Program", NULL, NULL);
+	if (!g_window) {
+		fprintf(stderr, "ERROR: could not open window with GLFW3\n");
+		glfwTerminate();
+		return false;
+	}
+	glfwSetWindowSizeCallback(g_window, glfw_window_size_callback);
+	glfwMakeContextCurrent(g_window);
+
+	glfwWindowHint(GLFW_SAMPLES, 4);
+
+	return start_glew();
+}
+
+// コンテキストを作った後に呼ぶ。ヘッドレスのコンテキストからも使う
+#if defined(HEADLESS_EGL) && !defined(GLEW_ERROR_NO_GLX_DISPLAY)
+#define GLEW_ERROR_NO_GLX_DISPLAY 4	// GLEW 2.1以降
+#endif
+
+bool start_glew()
+{
+	const GLubyte* renderer;
+	const GLubyte* version;
+
+	/* start GLEW extension handler */
+	glewExperimental = GL_TRUE;
+	GLenum err = glewInit();
+#if defined(HEADLESS_EGL)
+	// EGLのコンテキストにはGLXの表示が無い。GLEW 2.1以降はGL側の関数を読み込んだ後でこのエラーを返すので、成功として扱う
+	if (err == GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		err = GLEW_OK;
+	}
+#endif
+	if (err != GLEW_OK)
+	{
+		gl_log_err("ERROR: could not start GLEW: %s\n", glewGetErrorString(err));
+		return false;
+	}
+
+	/* get version info */
+	renderer = glGetString(GL_RENDERER); /* get renderer string */
+	version = glGetString(GL_VERSION); /* version as a string */
+	printf("Renderer: %s\n", renderer);
+	printf("OpenGL version supported %s\n", version);
+	gl_log("renderer: %s\nversion: %s\n", renderer, version);
+	log_gl_params();
+	// 量子化した法線の復元はコンテキストのバージョンで変わる
+	set_snorm_rule(GLEW_VERSION_4_2 ? SNORM_RULE_GL42 : SNORM_RULE_LEGACY);
+	gl_log("snorm decode rule: %s\n", GLEW_VERSION_4_2 ? "GL 4.2 (c / 511)" : "legacy ((2c + 1) / 1023)");
+
+	return true;
+}
+
+
+/*--------------------GL Shader Util and Debug---------------------------*/
+const char* GL_type_to_string(GLenum type) {
+	switch (type) {
+	case GL_BOOL: return "bool";
+	case GL_INT: return "int";
+	case GL_FLOAT: return "float";
+	case GL_FLOAT_VEC2: return "vec2";
+	case GL_FLOAT_VEC3: return "vec3";
+	case GL_FLOAT_VEC4: return "vec4";
+	case GL_FLOAT_MAT2: return "mat2";
+	case GL_FLOAT_MAT3: return "mat3";
+	case GL_FLOAT_MAT4: return "mat4";
+	case GL_SAMPLER_2D: return "sampler2D";
+	case GL_SAMPLER_3D: return "sampler3D";
+	case GL_SAMPLER_CUBE: return "samplerCube";
+	case GL_SAMPLER_2D_SHADOW: return "sampler2DShadow";
+	default: break;
+	}
+	return "other";
+}
+
+/* print errors in shader compilation */
+void print_shader_info_log(GLuint shader_index) {
+	int max_length = 2048;
+	int actual_length = 0;
+	char log[2048];
+	glGetShaderInfoLog(shader_index, max_length, &actual_length, log);
+	printf("shader info log for GL index %i:\n%s\n", shader_index, log);
+}
+
+/* print errors in shader linking */
+void print_programme_info_log(GLuint sp) {
+	int max_length = 2048;
+	int actual_length = 0;
+	char log[2048];
+	glGetProgramInfoLog(sp, max_length, &actual_length, log);
+	printf("program info log for GL index %i:\n%s", sp, log);
+}
+
+/* validate shader */
+bool is_valid(GLuint sp) {
+	int params = -1;
+
+	glValidateProgram(sp);
+	glGetProgramiv(sp, GL_VALIDATE_STATUS, &params);
+	printf("program %i GL_VALIDATE_STATUS = %i\n", sp, params);
+	if (GL_TRUE != params) {
+		print_programme_info_log(sp);
+		return false;
+	}
+	return true;
+}
+
+/* print absolutely everything about a shader - only useful if you get really
+stuck wondering why a shader isn't working properly */
+void print_all(GLuint sp) {
+	int params = -1;
+	int i;
+
+	printf("--------------------\nshader programme %i info:\n", sp);
+	glGetProgramiv(sp, GL_LINK_STATUS, &params);
+	printf("GL_LINK_STATUS = %i\n", params);
+
+	glGetProgramiv(sp, GL_ATTACHED_SHADERS, &params);
+	printf("GL_ATTACHED_SHADERS = %i\n", params);
+
+	glGetProgramiv(sp, GL_ACTIVE_ATTRIBUTES, &params);
+	printf("GL_ACTIVE_ATTRIBUTES = %i\n", params);
+
+	for (i = 0; i < params; i++) {
+		char name[64];
+		int max_length = 64;
+		int actual_length = 0;
+		int size = 0;
+		GLenum type;
+		glGetActiveAttrib(sp, i, max_length, &actual_length, &size, &type,
+			name);
+		if (size > 1) {
+			int j;
+			for (j = 0; j < size; j++) {
+				char long_name[64];
+				int location;
+
+				sprintf(long_name, "%s[%i]", name, j);
+				location = glGetAttribLocation(sp, long_name);
+				printf("  %i) type:%s name:%s location:%i\n",
+					i, GL_type_to_string(type), long_name, location);
+			}
+		}
+		else {
+			int location = glGetAttribLocation(sp, name);
+			printf("  %i) type:%s name:%s location:%i\n",
+				i, GL_type_to_string(type), name, location);
+		}
+	}
+
+	glGetProgramiv(sp, GL_ACTIVE_UNIFORMS, &params);
+	printf("GL_ACTIVE_UNIFORMS = %i\n", params);
+	for (i = 0; i < params; i++) {
+		char name[64];
+		int max_length = 64;
+		int actual_length = 0;
+		int size = 0;
+		GLenum type;
+		glGetActiveUniform(sp, i, max_length, &actual_length, &size, &type,
+			name);
+		if (size > 1) {
+			int j;
+			for (j = 0; j < size; j++) {
+				char long_name[64];
+				int location;
+
+				sprintf(long_name, "%s[%i]", name, j);
+				location = glGetUniformLocation(sp, long_name);
+				printf("  %i) type:%s name:%s location:%i\n",
+					i, GL_type_to_string(type), long_name, location);
+			}
+		}
+		else {
+			int location = glGetUniformLocation(sp, name);
+			printf("  %i) type:%s name:%s location:%i\n",
+				i, GL_type_to_string(type), name, location);
+		}
+	}
+
+	print_programme_info_log(sp);
+}
+
+/* copy a shader from a plain text file into a character array */
+// マウントしたアセットパックかマップしたファイルから読む
+bool parse_file_into_str(const char* file_name, char* shader_str, int max_len
+	) {
+	Asset_Data asset;
+	if (!open_asset(file_name, &asset)) {
+		gl_log_err("ERROR: opening file for reading: %s\n", file_name);
+		return false;
+	}
+	size_t cnt = asset.size;
+	if (cnt >= (size_t)max_len - 1) {
+		gl_log_err("WARNING: file %s too big - truncated.\n", file_name);
+		cnt = max_len - 1;
+	}
+	memcpy(shader_str, asset.data, cnt);
+	// append \0 to end of file string
+	shader_str[cnt] = 0;
+	close_asset(&asset);
+	return true;
+}
+
+bool create_shader(const char* file_name, GLuint* shader, GLenum type)
+{
+	return create_shader_with_defines(file_name, shader, type, NULL);
+}
+
+// #versionの行の直後にdefinesを差し込んでコンパイルする(シェーダバリアント用)
+bool create_shader_with_defines(
+	const char* file_name,
+	GLuint* shader,
+	GLenum type,
+	const char* defines)
+{
+	gl_log("creating shader form %s...\n", file_name);
+	// ソースはファイルの大きさだけスクラッチに取る
+	Scratch_Arena* scratch = thread_scratch_arena();
+	Scratch_Marker marker = scratch_mark(scratch);
+	Asset_Data asset;
+	if (!open_asset(file_name, &asset))
+	{
+		gl_log_err("ERROR: opening file for reading: %s\n", file_name);
+		return false;
+	}
+	char* shader_string = (char*)scratch_alloc(scratch, asset.size + 1);
+	memcpy(shader_string, asset.data, asset.size);
+	shader_string[asset.size] = 0;
+	close_asset(&asset);
+	*shader = glCreateShader(type);
+	const GLchar* p = (const GLchar*)shader_string;
+	if (defines && strncmp(shader_string, "#version", 8) == 0)
+	{
+		const char* body = strchr(shader_string, '\n');
+		body = body ? body + 1 : shader_string + strlen(shader_string);
+		const GLchar* sources[3] = { shader_string, defines, body };
+		GLint lengths[3] = { (GLint)(body - shader_string), -1, -1 };
+		gl_log("defines: %s", defines);
+		glShaderSource(*shader, 3, sources, lengths);
+	}
+	else if (defines)
+	{
+		const GLchar* sources[2] = { defines, p };
+		glShaderSource(*shader, 2, sources, NULL);
+	}
+	else
+	{
+		glShaderSource(*shader, 1, &p, NULL);
+	}
+	// glShaderSource()がコピーするので、ここで返してよい
+	scratch_release(scratch, marker);
+	glCompileShader(*shader);
+
+	// check for compile errors
+	int params = -1;
+	glGetShaderiv(*shader, GL_COMPILE_STATUS, &params);
+	if (GL_TRUE != params)
+	{
+		gl_log_err("ERROR: GL shader index %i dit not compile\n", *shader);
+		print_shader_info_log(*shader);
+		return false;
+	}
+	gl_log("shader compiled. index %i", *shader);
+	return true;
+}
+
+bool is_programme_valid(GLuint sp)
+{
+	glValidateProgram(sp);
+	GLint params = -1;
+	glGetProgramiv(sp, GL_VALIDATE_STATUS, &params);
+	if (GL_TRUE != params)
+	{
+		gl_log_err("program %i GL_VALIDATE_STATUS = GL_FALSE\n", sp);
+		print_programme_info_log(sp);
+		return false;
+	}
+	gl_log("program %i GL_VALIDATE_STATUS = GL_TRUE\n", sp);
+	return true;
+}
+
+bool create_programme(GLuint vs, GLuint fs, GLuint* programme)
+{
+	*programme = glCreateProgram();
+	gl_log(
+		"created programme %u, attaching shaders %u and %u...\n",
+		*programme,
+		vs,
+		fs
+	);
+	glAttachShader(*programme, vs);
+	glAttachShader(*programme, fs);
+	// link the shader programme. if binding input attributes, do that before link 
+	// (attribute(in)変数のバインドのためにGLSLのlocationキーワードが使えない場合。glBindAttribLocation()をLinkの前に行う)
+	glLinkProgram(*programme);
+	GLint params = -1;
+	glGetProgramiv(*programme, GL_LINK_STATUS, &params);
+	if (GL_TRUE != params)
+	{
+		gl_log_err("ERROR: could not link shader programme GL index %u\n", *programme);
+		print_programme_info_log(*programme);
+		return false;
+	}
+	assert(is_programme_valid(*programme));
+	bind_frame_uniform_block(*programme);
+	bind_bone_palette_block(*programme);
+	
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	return true;
+}
+
+GLuint create_programme_from_files(const char* vs_filename, const char* fs_filename)
+{
+	return create_programme_from_files_with_defines(vs_filename, fs_filename, NULL);
+}
+
+// 失敗したら作りかけのシェーダとプログラムを消して0を返す(glDelete*は0を無視する)
+GLuint create_programme_from_files_with_defines(
+	const char* vs_filename,
+	const char* fs_filename,
+	const char* defines)
+{
+	GLuint vs = 0, fs = 0, programme = 0;
+	if (!create_shader_with_defines(vs_filename, &vs, GL_VERTEX_SHADER, defines) ||
+		!create_shader_with_defines(fs_filename, &fs, GL_FRAGMENT_SHADER, defines) ||
+		!create_programme(vs, fs, &programme))
+	{
+		glDeleteShader(vs);
+		glDeleteShader(fs);
+		glDeleteProgram(programme);
+		return 0;
+	}
+	return programme;
+}
+
+/*--------------------Skeleton Structure and its Loader---------------------------*/
+// ノードは読み込みのたびに1つずつ確保・解放されるので、プールから取る。
+// 読み込みはワーカースレッドでも行われるため、初期化は最初に使ったスレッドで1回だけ行う
+static Pool_Allocator g_skeleton_node_pool;
+static std::once_flag g_skeleton_node_pool_once;
+
+Skeleton_Node* alloc_skeleton_node()
+{
+	std::call_once(
+		g_skeleton_node_pool_once,
+		init_pool_allocator,
+		&g_skeleton_node_pool,
+		"skeleton nodes",
+		sizeof(Skeleton_Node),
+		SKELETON_NODES_PER_CHUNK);
+	Skeleton_Node* node = (Skeleton_Node*)pool_alloc(&g_skeleton_node_pool);
+	memset(node, 0, sizeof(Skeleton_Node));
+	node->bone_index = -1;
+	return node;
+}
+
+void free_skeleton_node(Skeleton_Node* node)
+{
+	if (!node)
+	{
+		return;
+	}
+	for (int i = 0; i < node->num_children; i++)
+	{
+		free_skeleton_node(node->children[i]);
+	}
+	pool_free(&g_skeleton_node_pool, node);
+}
+
+// シーングラフに含まれる全ノードを再帰的にたどる。ノード構造のうち、Armature(skeleton)のみ抽出するために、
+// ノード名とボーンの名前を照合して、合致するものを抜き出す。
+bool import_skeleton_node(
+	aiNode* assimp_node,
+	Skeleton_Node** skeleton_node,
+	int bone_count,
+	char bone_names[][64])
+{
+	Skeleton_Node* temp = alloc_skeleton_node();
+
+	// 要素の初期化
+	strcpy(temp->name, assimp_node->mName.C_Str());
+	printf("--node name = %s\n", temp->name);
+	printf("node has %i children\n", (int)assimp_node->mNumChildren);
+
+	// ボーンの名前とノード名の照合
+	bool has_bone = false;
+	for (int i = 0; i < bone_count; i++)
+	{
+		if (strcmp(bone_names[i], temp->name) == 0){
+			printf("node uses bone %i\n", i);
+			temp->bone_index = i;
+			has_bone = true;
+			break;
+		}
+	}
+	if (!has_bone){
+		printf("no bone found for node\n");
+	}
+
+	// 子のボーンを再帰的に探索して、有効なボーンがあるかを探す
+	bool has_useful_child = false;
+	for (int i = 0; i < (int)assimp_node->mNumChildren; i++)
+	{
+		if (import_skeleton_node(
+			assimp_node->mChildren[i],
+			&temp->children[temp->num_children],
+			bone_count,
+			bone_names
+			)){
+			has_useful_child = true;
+			temp->num_children++;
+		}
+		else{
+			printf("useless child culled\n");
+		}
+	}
+	if (has_useful_child || has_bone)
+	{
+		// ノードがボーンとして有効か、子に有効なボーンを持っていればスケルトンノードに追加
+		*skeleton_node = temp;
+		return true;
+	}
+
+	free_skeleton_node(temp);
+	temp = NULL;
+	return false;
+}
+
+/*--------------------3D Object File Importer---------------------------*/
+mat4 convert_assimp_matrix(aiMatrix4x4 m)
+{
+	return mat4(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		m.a4, m.b4, m.c4, m.d4);
+}
+
+// ノードのトランスフォームは回転・スケールも含めて変換する(aiMatrix4x4は行優先)
+mat4 convert_assimp_node_matrix(aiMatrix4x4 m)
+{
+	return mat4(
+		m.a1, m.b1, m.c1, m.d1,
+		m.a2, m.b2, m.c2, m.d2,
+		m.a3, m.b3, m.c3, m.d3,
+		m.a4, m.b4, m.c4, m.d4);
+}
+
+// ノード階層に含まれるメッシュ参照の総数を数える
+static int count_mesh_references(const aiNode* node)
+{
+	int count = (int)node->mNumMeshes;
+	for (int i = 0; i < (int)node->mNumChildren; i++)
+	{
+		count += count_mesh_references(node->mChildren[i]);
+	}
+	return count;
+}
+
+// ノード階層を辿ってトランスフォームを累積し、メッシュ参照ごとにサブメッシュを作る
+static void collect_submeshes(
+	const aiNode* node,
+	mat4 parent_mat,
+	const Submesh* mesh_ranges,
+	Scene_Mesh* scene_mesh)
+{
+	mat4 node_mat = parent_mat * convert_assimp_node_matrix(node->mTransformation);
+	for (int i = 0; i < (int)node->mNumMeshes; i++)
+	{
+		Submesh* sm = &scene_mesh->submeshes[scene_mesh->submesh_count++];
+		*sm = mesh_ranges[node->mMeshes[i]];
+		sm->transform = node_mat;
+	}
+	for (int i = 0; i < (int)node->mNumChildren; i++)
+	{
+		collect_submeshes(node->mChildren[i], node_mat, mesh_ranges, scene_mesh);
+	}
+}
+
+int find_or_add_bone(
+	const char* name,
+	mat4 offset,
+	char bone_names[][64],
+	Scene_Mesh* scene_mesh)
+{
+	for (int i = 0; i < scene_mesh->bone_count; i++)
+	{
+		if (strcmp(bone_names[i], name) == 0)
+		{
+			return i;
+		}
+	}
+	if (scene_mesh->bone_count >= MAX_BONES)
+	{
+		gl_log_err("WARNING: too many bones, %s ignored\n", name);
+		return -1;
+	}
+	int b_i = scene_mesh->bone_count++;
+	strncpy(bone_names[b_i], name, 63);
+	bone_names[b_i][63] = 0;
+	printf("bonenames[%i] = %s\n", b_i, bone_names[b_i]);
+	scene_mesh->bone_offset_mats[b_i] = offset;
+	return b_i;
+}
+
+/*--------------------Skinning Weights---------------------------*/
+void add_influence(Vertex_Influences* vi, int bone_id, float weight)
+{
+	vi->total++;
+	int pos = vi->count;
+	while (pos > 0 && vi->weights[pos - 1] < weight)
+	{
+		pos--;
+	}
+	if (pos >= SKIN_INFLUENCES)
+	{
+		return;
+	}
+	// 溢れた場合は最も小さいウェイトが押し出される
+	int last = vi->count < SKIN_INFLUENCES ? vi->count : SKIN_INFLUENCES - 1;
+	for (int i = last; i > pos; i--)
+	{
+		vi->bone_ids[i] = vi->bone_ids[i - 1];
+		vi->weights[i] = vi->weights[i - 1];
+	}
+	vi->bone_ids[pos] = bone_id;
+	vi->weights[pos] = weight;
+	if (vi->count < SKIN_INFLUENCES)
+	{
+		vi->count++;
+	}
+}
+
+// ウェイトを合計1に正規化して量子化する。丸め誤差は最大のウェイトに寄せて、
+// 量子化後の合計がちょうどSKIN_WEIGHT_MAXになるようにする。
+// どのボーンにも割り当てられていない頂点はウェイト0のままとし、シェーダ側で単位行列になる
+static void pack_influences(const Vertex_Influences* vi, GLubyte* ids, Skin_Weight* weights)
+{
+	for (int i = 0; i < SKIN_INFLUENCES; i++)
+	{
+		ids[i] = 0;
+		weights[i] = 0;
+	}
+	float sum = 0.0f;
+	for (int i = 0; i < vi->count; i++)
+	{
+		sum += vi->weights[i];
+	}
+	if (vi->count == 0 || sum <= 0.0f)
+	{
+		return;
+	}
+	int quantized_sum = 0;
+	for (int i = 0; i < vi->count; i++)
+	{
+		int q = (int)(vi->weights[i] / sum * (float)SKIN_WEIGHT_MAX + 0.5f);
+		ids[i] = (GLubyte)vi->bone_ids[i];
+		weights[i] = (Skin_Weight)q;
+		quantized_sum += q;
+	}
+	weights[0] = (Skin_Weight)((int)weights[0] + SKIN_WEIGHT_MAX - quantized_sum);
+}
+
+// 頂点ごとのボーン影響をストリームに変換する。ボーンを持たないメッシュも
+// アリーナの範囲が再利用されるためウェイト0のストリームを作っておく
+static void convert_skin_weights(
+	const Mesh_Source* source,
+	Mesh_Cpu_Data* mesh_data,
+	Submesh* range)
+{
+	int point_count = source->point_count;
+	Vertex_Influences empty;
+	memset(&empty, 0, sizeof(empty));
+
+	GLubyte* bone_ids = (GLubyte*)malloc(point_count * 4 * sizeof(GLubyte));
+	Skin_Weight* bone_weights = (Skin_Weight*)malloc(point_count * 4 * sizeof(Skin_Weight));
+#if SKIN_INFLUENCES > 4
+	GLubyte* bone_ids_1 = (GLubyte*)malloc(point_count * 4 * sizeof(GLubyte));
+	Skin_Weight* bone_weights_1 = (Skin_Weight*)malloc(point_count * 4 * sizeof(Skin_Weight));
+#endif
+	int truncated = 0;
+	range->max_influences = 0;
+	for (int v_i = 0; v_i < point_count; v_i++)
+	{
+		const Vertex_Influences* vi = source->influences ? &source->influences[v_i] : &empty;
+		GLubyte ids[SKIN_INFLUENCES];
+		Skin_Weight weights[SKIN_INFLUENCES];
+		pack_influences(vi, ids, weights);
+		memcpy(&bone_ids[v_i * 4], ids, 4 * sizeof(GLubyte));
+		memcpy(&bone_weights[v_i * 4], weights, 4 * sizeof(Skin_Weight));
+#if SKIN_INFLUENCES > 4
+		memcpy(&bone_ids_1[v_i * 4], &ids[4], 4 * sizeof(GLubyte));
+		memcpy(&bone_weights_1[v_i * 4], &weights[4], 4 * sizeof(Skin_Weight));
+#endif
+		if (vi->count > range->max_influences)
+		{
+			range->max_influences = vi->count;
+		}
+		if (vi->total > vi->count)
+		{
+			truncated++;
+		}
+	}
+	if (source->influences)
+	{
+		printf(
+			"mesh[%i] max %i bone influences, %i vertices truncated to %i\n",
+			range->mesh_index,
+			range->max_influences,
+			truncated,
+			SKIN_INFLUENCES);
+	}
+
+	mesh_data->streams[ARENA_STREAM_BONE_ID] = bone_ids;
+	mesh_data->streams[ARENA_STREAM_BONE_WEIGHT] = bone_weights;
+#if SKIN_INFLUENCES > 4
+	mesh_data->streams[ARENA_STREAM_BONE_ID_1] = bone_ids_1;
+	mesh_data->streams[ARENA_STREAM_BONE_WEIGHT_1] = bone_weights_1;
+#endif
+}
+
+int skin_variant_influences(int max_influences)
+{
+	if (max_influences <= 0)
+	{
+		return 0;
+	}
+	if (max_influences <= 2)
+	{
+		return max_influences;
+	}
+	if (max_influences <= 4)
+	{
+		return 4;
+	}
+	return SKIN_INFLUENCES;
+}
+
+static int count_triangle_indices(const aiMesh* mesh)
+{
+	int count = 0;
+	for (int f_i = 0; f_i < (int)mesh->mNumFaces; f_i++)
+	{
+		if (mesh->mFaces[f_i].mNumIndices == 3)
+		{
+			count += 3;
+		}
+	}
+	return count;
+}
+
+void free_mesh_source(Mesh_Source* source)
+{
+	if (!(source->borrowed & MESH_SOURCE_POSITIONS)) free(source->positions);
+	if (!(source->borrowed & MESH_SOURCE_NORMALS)) free(source->normals);
+	if (!(source->borrowed & MESH_SOURCE_TEXCOORDS)) free(source->texcoords);
+	free(source->tangents);
+	free(source->indices);
+	free(source->influences);
+	memset(source, 0, sizeof(Mesh_Source));
+}
+
+// ストリームにならない一時配列はスクラッチから、ストリームになる配列はmalloc()で取る
+static void* alloc_attribute(Scratch_Arena* scratch, bool temporary, size_t bytes)
+{
+	return temporary ? scratch_alloc(scratch, bytes) : malloc(bytes);
+}
+
+// 頂点ごとにstride個並んだfloatからuvだけを詰める
+static void pack_texcoords(const GLfloat* src, int stride, int count, GLfloat* dst)
+{
+	for (int i = 0; i < count; i++)
+	{
+		dst[i * 2] = src[i * stride];
+		dst[i * 2 + 1] = src[i * stride + 1];
+	}
+}
+
+void convert_mesh_source(
+	Mesh_Source* source,
+	int vertex_format,
+	Scratch_Arena* scratch,
+	Mesh_Cpu_Data* mesh_data,
+	Submesh* range)
+{
+	int point_count = source->point_count;
+	range->vertex_count = point_count;
+	Quantization_Error error;
+	memset(&error, 0, sizeof(error));
+	// 量子化しない場合の復元は恒等変換
+	range->position_offset = vec3(0.0f, 0.0f, 0.0f);
+	range->position_scale = vec3(1.0f, 1.0f, 1.0f);
+	range->meshlets = NULL;
+	range->meshlet_count = 0;
+	range->lod_count = 1;
+	range->bounds_center = vec3(0.0f, 0.0f, 0.0f);
+	range->bounds_radius = 0.0f;
+	// メッシュレットの境界を求めるため、量子化前の位置を最後まで残しておく
+	GLfloat* points = source->positions;
+	GLuint* indices = source->indices;
+	int index_count = source->index_count;
+	mesh_data->indices = indices;
+
+	if (points)
+	{
+		// AABBの中心を球の中心にする
+		vec3 mn(points[0], points[1], points[2]);
+		vec3 mx = mn;
+		for (int i = 1; i < point_count; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				if (points[i * 3 + c] < mn.v[c]) mn.v[c] = points[i * 3 + c];
+				if (points[i * 3 + c] > mx.v[c]) mx.v[c] = points[i * 3 + c];
+			}
+		}
+		range->bounds_center = (mn + mx) * 0.5f;
+		float radius2 = 0.0f;
+		for (int i = 0; i < point_count; i++)
+		{
+			vec3 p(points[i * 3], points[i * 3 + 1], points[i * 3 + 2]);
+			float d2 = get_squared_dist(range->bounds_center, p);
+			if (d2 > radius2)
+			{
+				radius2 = d2;
+			}
+		}
+		range->bounds_radius = sqrtf(radius2);
+		if (vertex_format & VERTEX_QUANTIZE_POSITION)
+		{
+			GLushort* quantized = (GLushort*)malloc(point_count * 4 * sizeof(GLushort));
+			quantize_positions(
+				points,
+				point_count,
+				quantized,
+				range->position_offset.v,
+				range->position_scale.v,
+				&error);
+			mesh_data->streams[ARENA_STREAM_POSITION] = quantized;
+		}
+		else
+		{
+			// ストリームと共有するので、後で解放しない
+			mesh_data->streams[ARENA_STREAM_POSITION] = points;
+			if (source->borrowed & MESH_SOURCE_POSITIONS)
+			{
+				mesh_data->borrowed_streams |= 1 << ARENA_STREAM_POSITION;
+			}
+		}
+	}
+
+	// 法線と接線は量子化する前のfloatで揃えてから、アリーナのフォーマットに詰める。
+	// 量子化するなら途中のfloat配列はスクラッチに置き、量子化しないならそのままストリームにする。
+	// *_ownedがfalseの配列は、量子化しない場合は読み込み元のもの、量子化する場合はスクラッチのもの
+	bool quantize_normal = (vertex_format & VERTEX_QUANTIZE_NORMAL) != 0;
+	bool quantize_texcoord = (vertex_format & VERTEX_QUANTIZE_TEXCOORD) != 0;
+	GLfloat* normals = source->normals;
+	bool normals_owned = normals && !(source->borrowed & MESH_SOURCE_NORMALS);
+	if (!normals && points && index_count > 0)
+	{
+		normals = (GLfloat*)alloc_attribute(scratch, quantize_normal, point_count * 3 * sizeof(GLfloat));
+		normals_owned = !quantize_normal;
+		double start = get_precise_time_ms();
+		generate_smooth_normals(points, point_count, indices, index_count, normals);
+		gl_log("generated normals for mesh[%i] in %.2f ms\n", range->mesh_index, get_precise_time_ms() - start);
+	}
+	GLfloat* texcoords = source->texcoords;
+	bool texcoords_owned = texcoords && !(source->borrowed & MESH_SOURCE_TEXCOORDS);
+	int texcoord_stride = source->texcoord_stride > 0 ? source->texcoord_stride : 2;
+	if (texcoords && texcoord_stride != 2)
+	{
+		GLfloat* packed = (GLfloat*)alloc_attribute(scratch, quantize_texcoord, point_count * 2 * sizeof(GLfloat));
+		pack_texcoords(texcoords, texcoord_stride, point_count, packed);
+		if (texcoords_owned)
+		{
+			free(texcoords);
+		}
+		texcoords = packed;
+		texcoords_owned = !quantize_texcoord;
+	}
+	GLfloat* tangents = normals ? source->tangents : NULL;
+	if (!normals)
+	{
+		free(source->tangents);
+	}
+	if (!tangents && normals && texcoords && index_count > 0)
+	{
+		tangents = (GLfloat*)alloc_attribute(scratch, quantize_normal, point_count * 4 * sizeof(GLfloat));
+		double start = get_precise_time_ms();
+		generate_tangents(points, normals, texcoords, point_count, indices, index_count, tangents);
+		gl_log("generated tangents for mesh[%i] in %.2f ms\n", range->mesh_index, get_precise_time_ms() - start);
+	}
+	bool tangents_owned = tangents && (tangents == source->tangents || !quantize_normal);
+	if (normals)
+	{
+		if (quantize_normal)
+		{
+			GLuint* quantized = (GLuint*)malloc(point_count * sizeof(GLuint));
+			quantize_normals(normals, point_count, quantized, &error);
+			mesh_data->streams[ARENA_STREAM_NORMAL] = quantized;
+			if (normals_owned)
+			{
+				free(normals);
+			}
+		}
+		else
+		{
+			mesh_data->streams[ARENA_STREAM_NORMAL] = normals;
+			if (!normals_owned)
+			{
+				mesh_data->borrowed_streams |= 1 << ARENA_STREAM_NORMAL;
+			}
+		}
+	}
+	if (texcoords)
+	{
+		if (quantize_texcoord)
+		{
+			GLushort* quantized = (GLushort*)malloc(point_count * 2 * sizeof(GLushort));
+			quantize_texcoords(texcoords, point_count, quantized, &error);
+			mesh_data->streams[ARENA_STREAM_TEXCOORD] = quantized;
+			if (texcoords_owned)
+			{
+				free(texcoords);
+			}
+		}
+		else
+		{
+			mesh_data->streams[ARENA_STREAM_TEXCOORD] = texcoords;
+			if (!texcoords_owned)
+			{
+				mesh_data->borrowed_streams |= 1 << ARENA_STREAM_TEXCOORD;
+			}
+		}
+	}
+	if (tangents)
+	{
+		if (quantize_normal)
+		{
+			GLuint* quantized = (GLuint*)malloc(point_count * sizeof(GLuint));
+			quantize_tangents(tangents, point_count, quantized);
+			mesh_data->streams[ARENA_STREAM_TANGENT] = quantized;
+			if (tangents_owned)
+			{
+				free(tangents);
+			}
+		}
+		else
+		{
+			mesh_data->streams[ARENA_STREAM_TANGENT] = tangents;
+		}
+	}
+	if (vertex_format)
+	{
+		char mesh_name[64];
+		sprintf(mesh_name, "mesh[%i]", range->mesh_index);
+		print_quantization_error(mesh_name, vertex_format, &error);
+	}
+
+	convert_skin_weights(source, mesh_data, range);
+	free(source->influences);
+
+	// 頂点がボーンで動くメッシュは境界が変わるのでカリングしない
+	if (points && range->max_influences == 0 && index_count > MESHLET_MAX_TRIANGLES * 3)
+	{
+		range->meshlet_count = build_meshlets(points, point_count, indices, index_count, &range->meshlets);
+		printf("%i meshlets in mesh[%i]\n", range->meshlet_count, range->mesh_index);
+	}
+	// メッシュレットで並べ替えたLOD0の後ろに、簡略化したLODを連結する
+	range->lods[0].first_index = 0;
+	range->lods[0].index_count = index_count;
+	range->lods[0].error = 0.0f;
+	range->index_count = index_count;
+	if (points && index_count > 0)
+	{
+		range->lod_count = build_lod_chain(
+			points,
+			point_count,
+			(const GLubyte*)mesh_data->streams[ARENA_STREAM_BONE_ID],
+			&indices,
+			index_count,
+			range->lods);
+		mesh_data->indices = indices;
+		range->index_count = range->lods[range->lod_count - 1].first_index +
+			range->lods[range->lod_count - 1].index_count;
+		for (int i = 1; i < range->lod_count; i++)
+		{
+			printf(
+				"mesh[%i] lod %i: %i triangles, error %f\n",
+				range->mesh_index,
+				i,
+				range->lods[i].index_count / 3,
+				range->lods[i].error);
+		}
+	}
+	if (points != mesh_data->streams[ARENA_STREAM_POSITION] && !(source->borrowed & MESH_SOURCE_POSITIONS))
+	{
+		free(points);
+	}
+	// 配列は全てストリームに渡すか解放した
+	memset(source, 0, sizeof(Mesh_Source));
+}
+
+// aiVector3Dは詰まったfloat3なので、aiMeshの配列をそのままGLfloat*として読める
+static_assert(sizeof(aiVector3D) == 3 * sizeof(GLfloat), "aiVector3D must be three packed floats");
+
+// aiMeshの位置・法線・UVはコピーせずに借り、ボーンはシーン全体のボーン表に登録する。
+// 借りた配列のバイト数をborrowed_bytesに足す
+static void mesh_source_from_assimp(
+	const aiMesh* mesh,
+	char bone_names[][64],
+	Scene_Mesh* scene_mesh,
+	Mesh_Source* source,
+	size_t* borrowed_bytes)
+{
+	memset(source, 0, sizeof(Mesh_Source));
+	int point_count = (int)mesh->mNumVertices;
+	source->point_count = point_count;
+	if (mesh->HasPositions())
+	{
+		source->positions = (GLfloat*)mesh->mVertices;
+		source->borrowed |= MESH_SOURCE_POSITIONS;
+		*borrowed_bytes += point_count * sizeof(aiVector3D);
+	}
+	if (mesh->HasNormals())
+	{
+		source->normals = (GLfloat*)mesh->mNormals;
+		source->borrowed |= MESH_SOURCE_NORMALS;
+		*borrowed_bytes += point_count * sizeof(aiVector3D);
+	}
+	if (mesh->HasTextureCoords(0))
+	{
+		// uvwなので、変換時にuvだけを詰める
+		source->texcoords = (GLfloat*)mesh->mTextureCoords[0];
+		source->texcoord_stride = 3;
+		source->borrowed |= MESH_SOURCE_TEXCOORDS;
+		*borrowed_bytes += point_count * sizeof(aiVector3D);
+	}
+	if (mesh->HasNormals() && mesh->HasTangentsAndBitangents())
+	{
+		// ファイルにある接線を使い、従接線は符号だけ残す
+		source->tangents = (GLfloat*)malloc(point_count * 4 * sizeof(GLfloat));
+		for (int i = 0; i < point_count; i++)
+		{
+			const aiVector3D* t = &(mesh->mTangents[i]);
+			const aiVector3D* b = &(mesh->mBitangents[i]);
+			const GLfloat* n = &source->normals[i * 3];
+			float w = (n[1] * t->z - n[2] * t->y) * b->x +
+				(n[2] * t->x - n[0] * t->z) * b->y +
+				(n[0] * t->y - n[1] * t->x) * b->z;
+			source->tangents[i * 4] = (GLfloat)t->x;
+			source->tangents[i * 4 + 1] = (GLfloat)t->y;
+			source->tangents[i * 4 + 2] = (GLfloat)t->z;
+			source->tangents[i * 4 + 3] = w < 0.0f ? -1.0f : 1.0f;
+		}
+	}
+
+	// 三角形以外の面(点・線)は描画対象から外す
+	source->indices = (GLuint*)malloc(count_triangle_indices(mesh) * sizeof(GLuint));
+	for (int f_i = 0; f_i < (int)mesh->mNumFaces; f_i++)
+	{
+		const aiFace* face = &mesh->mFaces[f_i];
+		if (face->mNumIndices != 3)
+		{
+			continue;
+		}
+		source->indices[source->index_count++] = face->mIndices[0];
+		source->indices[source->index_count++] = face->mIndices[1];
+		source->indices[source->index_count++] = face->mIndices[2];
+	}
+
+	if (!mesh->HasBones())
+	{
+		return;
+	}
+	source->influences = (Vertex_Influences*)calloc(point_count, sizeof(Vertex_Influences));
+	for (int b_i = 0; b_i < (int)mesh->mNumBones; b_i++)
+	{
+		const aiBone* bone = mesh->mBones[b_i];
+		// メッシュ内のボーン番号をシーン全体のボーン番号に付け替える
+		int scene_bone = find_or_add_bone(
+			bone->mName.data,
+			convert_assimp_matrix(bone->mOffsetMatrix),
+			bone_names,
+			scene_mesh);
+		if (scene_bone < 0)
+		{
+			continue;
+		}
+
+		// get bone ids and weigthts
+		int num_weights = (int)bone->mNumWeights;
+		for (int w_i = 0; w_i < num_weights; w_i++)
+		{
+			aiVertexWeight weight = bone->mWeights[w_i];
+			if (weight.mWeight > 0.0f)
+			{
+				add_influence(&source->influences[weight.mVertexId], scene_bone, weight.mWeight);
+			}
+		}
+	}
+}
+
+bool import_scene_cpu(
+	const char* file_name,
+	int vertex_format,
+	Scene_Cpu_Data* cpu)
+{
+#ifndef DISABLE_STREAMING_COLLADA
+	// COLLADAはまずストリーミングのリーダーで読み、扱えない内容ならassimpで読み直す
+	size_t len = strlen(file_name);
+	if (len > 4 && strcmp(file_name + len - 4, ".dae") == 0 &&
+		import_collada_cpu(file_name, vertex_format, cpu))
+	{
+		return true;
+	}
+#endif
+	return import_scene_cpu_assimp(file_name, vertex_format, cpu);
+}
+
+bool import_scene_cpu_assimp(
+	const char* file_name,
+	int vertex_format,
+	Scene_Cpu_Data* cpu)
+{
+	*cpu = Scene_Cpu_Data();
+	cpu->vertex_format = vertex_format;
+
+	// ファイルはマップしたメモリかメモリ上のファイルから読む。シーンはimporterと一緒に破棄される
+	Assimp::Importer* importer = new Assimp::Importer();
+	importer->SetIOHandler(new Asset_IO_System());
+	const aiScene* scene = importer->ReadFile(
+		file_name,
+		aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
+
+	if (!scene)
+	{
+		fprintf(stderr, "ERROR, reading mesh %s\n", file_name);
+		delete importer;
+		return false;
+	}
+	printf("%i cameras\n", scene->mNumCameras);
+	printf("%i lights\n", scene->mNumLights);
+	printf("%i materials\n", scene->mNumMaterials);
+	printf("%i meshes\n", scene->mNumMeshes);
+	printf("%i textures\n", scene->mNumTextures);
+
+	Scene_Mesh* scene_mesh = &cpu->scene;
+	int mesh_count = (int)scene->mNumMeshes;
+
+	// 全メッシュをアリーナのフォーマットに変換しておく。アリーナ上の範囲はアップロード時に決まる
+	scene_mesh->meshes = (Submesh*)malloc(mesh_count * sizeof(Submesh));
+	scene_mesh->mesh_count = mesh_count;
+	cpu->mesh_data = (Mesh_Cpu_Data*)calloc(mesh_count, sizeof(Mesh_Cpu_Data));
+	// 量子化の途中のfloat配列などを置く。メッシュごとに戻して使い回す
+	Scratch_Arena* scratch = thread_scratch_arena();
+	Scratch_Marker import_marker = scratch_mark(scratch);
+	// bone names. max MAX_BONES bones, max name length 64.
+	char (*bonenames)[64] = (char (*)[64])scratch_alloc(scratch, MAX_BONES * 64);
+	size_t borrowed_bytes = 0;
+	unsigned int borrowed_streams = 0;
+	for (int m_i = 0; m_i < mesh_count; m_i++)
+	{
+		const aiMesh* mesh = scene->mMeshes[m_i];
+		Submesh* range = &scene_mesh->meshes[m_i];
+		range->base_vertex = -1;
+		range->first_index = -1;
+		range->mesh_index = m_i;
+		range->material_index = (int)mesh->mMaterialIndex;
+		range->transform = identity_mat4();
+		printf("%i vertices in mesh[%i]\n", mesh->mNumVertices, m_i);
+
+		Mesh_Source source;
+		Scratch_Marker mesh_marker = scratch_mark(scratch);
+		mesh_source_from_assimp(mesh, bonenames, scene_mesh, &source, &borrowed_bytes);
+		convert_mesh_source(&source, vertex_format, scratch, &cpu->mesh_data[m_i], range);
+		scratch_release(scratch, mesh_marker);
+		borrowed_streams |= cpu->mesh_data[m_i].borrowed_streams;
+		scene_mesh->vertex_count += range->vertex_count;
+		scene_mesh->index_count += range->index_count;
+	}
+	gl_log(
+		"%s: %.1f KB of attributes read in place, scratch peak %.1f KB, aiScene %s\n",
+		file_name,
+		borrowed_bytes / 1024.0,
+		scratch->window_peak / 1024.0,
+		borrowed_streams ? "kept until upload" : "released");
+
+	// ノード階層からサブメッシュとそのトランスフォームを作る
+	scene_mesh->submeshes = (Submesh*)malloc(
+		count_mesh_references(scene->mRootNode) * sizeof(Submesh));
+	collect_submeshes(scene->mRootNode, identity_mat4(), scene_mesh->meshes, scene_mesh);
+	printf("%i submeshes\n", scene_mesh->submesh_count);
+
+	/* get the skeleton hierarchy*/
+	if (scene_mesh->bone_count > 0)
+	{
+		aiNode* assimp_node = scene->mRootNode;
+
+		if (!import_skeleton_node(
+			assimp_node,
+			&scene_mesh->skeleton_root,
+			scene_mesh->bone_count,
+			bonenames)){
+			fprintf(stderr, "ERROR: could not iport node tree from mesh\n");
+		}
+	}
+	scratch_release(scratch, import_marker);
+
+	// 全て量子化したならaiSceneを指すストリームは無いので、ここで破棄する
+	if (borrowed_streams)
+	{
+		cpu->importer = importer;
+	}
+	else
+	{
+		delete importer;
+	}
+	return true;
+}
+
+bool upload_scene_cpu_mesh(Scene_Cpu_Data* cpu, int mesh_i, Mesh_Arena* arena)
+{
+	assert(arena->vertex_format == cpu->vertex_format);
+	Submesh* range = &cpu->scene.meshes[mesh_i];
+	const Mesh_Cpu_Data* mesh_data = &cpu->mesh_data[mesh_i];
+
+	if (!mesh_arena_alloc(
+		arena,
+		range->vertex_count,
+		range->index_count,
+		&range->base_vertex,
+		&range->first_index))
+	{
+		range->base_vertex = -1;
+		range->first_index = -1;
+		fprintf(stderr, "ERROR: no space in arena for mesh[%i]\n", mesh_i);
+		return false;
+	}
+	cpu->scene.arena = arena;
+	for (int s = 0; s < ARENA_STREAM_COUNT; s++)
+	{
+		if (mesh_data->streams[s])
+		{
+			mesh_arena_upload(arena, s, range->base_vertex, range->vertex_count, mesh_data->streams[s]);
+		}
+	}
+	mesh_arena_upload_indices(arena, range->first_index, range->index_count, mesh_data->indices);
+	return true;
+}
+
+void finish_scene_cpu_upload(Scene_Cpu_Data* cpu, Scene_Mesh* scene_mesh)
+{
+	// サブメッシュにアリーナ上の範囲を反映する
+	Scene_Mesh* scene = &cpu->scene;
+	for (int i = 0; i < scene->submesh_count; i++)
+	{
+		Submesh* sm = &scene->submeshes[i];
+		const Submesh* range = &scene->meshes[sm->mesh_index];
+		sm->base_vertex = range->base_vertex;
+		sm->first_index = range->first_index;
+	}
+	// 所有権を移す
+	*scene_mesh = *scene;
+	*scene = Scene_Mesh();
+}
+
+void free_scene_cpu(Scene_Cpu_Data* cpu)
+{
+	for (int m_i = 0; m_i < cpu->scene.mesh_count && cpu->mesh_data; m_i++)
+	{
+		for (int s = 0; s < ARENA_STREAM_COUNT; s++)
+		{
+			if (!(cpu->mesh_data[m_i].borrowed_streams & (1 << s)))
+			{
+				free(cpu->mesh_data[m_i].streams[s]);
+			}
+		}
+		free(cpu->mesh_data[m_i].indices);
+	}
+	free(cpu->mesh_data);
+	cpu->mesh_data = NULL;
+	// 借りていたストリームの元になったaiSceneもここで破棄する
+	delete cpu->importer;
+	cpu->importer = NULL;
+	// アップロード前に破棄された場合はシーンもここで解放する
+	free_scene_mesh(&cpu->scene);
+}
+
+bool load_mesh(
+	const char* file_name,
+	Mesh_Arena* arena,
+	Scene_Mesh* scene_mesh)
+{
+	*scene_mesh = Scene_Mesh();
+	Scene_Cpu_Data cpu;
+	if (!import_scene_cpu(file_name, arena->vertex_format, &cpu))
+	{
+		return false;
+	}
+	for (int m_i = 0; m_i < cpu.scene.mesh_count; m_i++)
+	{
+		if (!upload_scene_cpu_mesh(&cpu, m_i, arena))
+		{
+			fprintf(stderr, "ERROR: could not upload %s\n", file_name);
+			free_scene_cpu(&cpu);
+			return false;
+		}
+	}
+	finish_scene_cpu_upload(&cpu, scene_mesh);
+	free_scene_cpu(&cpu);
+	printf("mesh loaded\n");
+
+	return true;
+}
+
+void free_scene_mesh(Scene_Mesh* scene_mesh)
+{
+	// サブメッシュはメッシュの範囲を共有しているので、メッシュ単位で解放する
+	for (int i = 0; i < scene_mesh->mesh_count && scene_mesh->meshes; i++)
+	{
+		const Submesh* m = &scene_mesh->meshes[i];
+		free(m->meshlets);
+		if (!scene_mesh->arena || m->base_vertex < 0)
+		{
+			continue;
+		}
+		mesh_arena_free(
+			scene_mesh->arena,
+			m->base_vertex,
+			m->vertex_count,
+			m->first_index,
+			m->index_count);
+	}
+	free(scene_mesh->meshes);
+	free(scene_mesh->submeshes);
+	free_skeleton_node(scene_mesh->skeleton_root);
+	*scene_mesh = Scene_Mesh();
+}
+
+void draw_submesh(const Submesh* submesh, int lod_index)
+{
+	const Mesh_Lod* lod = &submesh->lods[lod_index];
+	glDrawElementsBaseVertex(
+		GL_TRIANGLES,
+		lod->index_count,
+		GL_UNSIGNED_INT,
+		(void*)((submesh->first_index + lod->first_index) * sizeof(GLuint)),
+		submesh->base_vertex);
+}
+
+void draw_submesh_instanced(const Submesh* submesh, int lod_index, int instance_count)
+{
+	const Mesh_Lod* lod = &submesh->lods[lod_index];
+	glDrawElementsInstancedBaseVertex(
+		GL_TRIANGLES,
+		lod->index_count,
+		GL_UNSIGNED_INT,
+		(void*)((submesh->first_index + lod->first_index) * sizeof(GLuint)),
+		instance_count,
+		submesh->base_vertex);
+}
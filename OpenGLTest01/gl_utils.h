@@ -1,66 +1,215 @@
-#ifndef _GL_UTILS_H_
-#define _GL_UTILS_H_
-
-#include <stdarg.h> // used by log functions to have variable number of args
-#include <GL/glew.h> // include GLEW and new version of GL on Windows
-#include <GLFW/glfw3.h> // GLFW helper library
-#include <assimp/scene.h> // collects data
-
-#define GL_LOG_FILE "gl.log"
-#define MAX_BONES 32
-
-extern int g_gl_width;
-extern int g_gl_height;
-extern GLFWwindow* g_window;
-
-struct mat4;
-
-/*--------------------GL Information Logger---------------------------*/
-bool start_gl();
-bool restart_gl_log();
-bool gl_log(const char* message, ...);
-/* same as gl_log except also prints to stderr */
-bool gl_log_err(const char* message, ...);
-void glfw_error_callback(int error, const char* description);
-void log_gl_params();
-void update_fps_counter(GLFWwindow* window);
-void glfw_window_size_callback(GLFWwindow* window, int width, int height);
-
-/*--------------------GL Shader Util and Debug---------------------------*/
-const char* GL_type_to_string(GLenum type);
-void print_shader_info_log(GLuint shader_index);
-void print_programme_info_log(GLuint sp);
-bool is_valid(GLuint sp);
-void print_all(GLuint sp);
-bool parse_file_into_str(const char* file_name, char* shader_str, int max_len);
-bool create_shader(const char* file_name, GLuint* shader, GLenum type);
-bool create_programme(GLuint vs, GLuint fs, GLuint* programme);
-bool is_programme_valid(GLuint sp);
-GLuint create_programme_from_files(const char* vs_filename, const char* fs_filename);
-
-/*--------------------Skeleton Structure and its Loader---------------------------*/
-typedef struct Skeleton_Node
-{
-	Skeleton_Node* children[MAX_BONES];
-	char name[64];
-	int num_children;
-	// EFCgyCgĂȂ{[ID-1
-	int bone_index;
-}Skeleton_Node;
-bool import_skeleton_node(
-	aiNode* assimp_node,
-	Skeleton_Node** skeleton_node,
-	int bone_count,
-	char bone_names[][64]);
-
-
-/*--------------------3D Object File Importer---------------------------*/
-bool load_mesh(
-	const char* file_name, 
-	GLuint* vao, 
-	int* point_count,
-	mat4* bone_offset_mats,
-	int* bone_count,
-	Skeleton_Node** root_node);
-
+#ifndef _GL_UTILS_H_
+#define _GL_UTILS_H_
+
+#include <stdarg.h> // used by log functions to have variable number of args
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+#include <GLFW/glfw3.h> // GLFW helper library
+#include <assimp/scene.h> // collects data
+#include "maths_funcs.h"
+#include "mesh_arena.h"
+#include "meshlet.h"
+#include "mesh_lod.h"
+#include "allocators.h"
+
+#define GL_LOG_FILE "gl.log"
+#define MAX_BONES 32
+
+namespace Assimp { class Importer; }
+
+extern int g_gl_width;
+extern int g_gl_height;
+extern GLFWwindow* g_window;
+
+/*--------------------GL Information Logger---------------------------*/
+bool start_gl();
+bool start_glew();
+bool restart_gl_log();
+bool gl_log(const char* message, ...);
+/* same as gl_log except also prints to stderr */
+bool gl_log_err(const char* message, ...);
+/* same as gl_log except also prints to stdout */
+bool gl_log_print(const char* message, ...);
+void glfw_error_callback(int error, const char* description);
+void log_gl_params();
+void update_fps_counter(GLFWwindow* window);
+void glfw_window_size_callback(GLFWwindow* window, int width, int height);
+
+/*--------------------GL Shader Util and Debug---------------------------*/
+const char* GL_type_to_string(GLenum type);
+void print_shader_info_log(GLuint shader_index);
+void print_programme_info_log(GLuint sp);
+bool is_valid(GLuint sp);
+void print_all(GLuint sp);
+bool parse_file_into_str(const char* file_name, char* shader_str, int max_len);
+bool create_shader(const char* file_name, GLuint* shader, GLenum type);
+bool create_shader_with_defines(
+	const char* file_name,
+	GLuint* shader,
+	GLenum type,
+	const char* defines);
+bool create_programme(GLuint vs, GLuint fs, GLuint* programme);
+bool is_programme_valid(GLuint sp);
+GLuint create_programme_from_files(const char* vs_filename, const char* fs_filename);
+GLuint create_programme_from_files_with_defines(
+	const char* vs_filename,
+	const char* fs_filename,
+	const char* defines);
+
+/*--------------------Skeleton Structure and its Loader---------------------------*/
+#define SKELETON_NODES_PER_CHUNK 64
+
+typedef struct Skeleton_Node
+{
+	Skeleton_Node* children[MAX_BONES];
+	char name[64];
+	int num_children;
+	// ウェイトペイントされていないボーンのIDは-1
+	int bone_index;
+}Skeleton_Node;
+// ノードはプールから取る。子も含めてfree_skeleton_node()で返す
+Skeleton_Node* alloc_skeleton_node();
+void free_skeleton_node(Skeleton_Node* node);
+bool import_skeleton_node(
+	aiNode* assimp_node,
+	Skeleton_Node** skeleton_node,
+	int bone_count,
+	char bone_names[][64]);
+
+
+/*--------------------3D Object File Importer---------------------------*/
+// シーン内の1つのメッシュ参照。同じaiMeshを複数のノードが参照する場合は
+// アリーナ上の範囲を共有し、transformだけが異なる
+typedef struct Submesh
+{
+	int base_vertex;
+	int first_index;
+	int index_count;	// 全LODを合わせたアリーナ上のインデックス数
+	int vertex_count;
+	int mesh_index;		// aiScene::mMeshes内のインデックス
+	int material_index;
+	int max_influences;	// 頂点あたりの最大ボーン影響数。0ならスキニング無し
+	vec3 position_offset;	// 量子化した位置の復元: offset + scale * q
+	vec3 position_scale;
+	mat4 transform;		// ノード階層を累積したトランスフォーム
+	// スキニング無しの大きなメッシュだけが持つ。インデックスはメッシュレット順に並べ替え済み。
+	// 配列はaiMeshごとの範囲が所有し、サブメッシュは参照するだけ
+	Meshlet* meshlets;
+	int meshlet_count;
+	// LOD0が先頭で、以降は簡略化したインデックスが続く。頂点は全LODで共有する
+	Mesh_Lod lods[MAX_MESH_LODS];
+	int lod_count;
+	vec3 bounds_center;	// LOD選択に使うバウンディングスフィア(モデル空間)
+	float bounds_radius;
+}Submesh;
+
+// aiScene全体をアリーナに読み込んだもの。ボーンはシーン全体で名前により統合される
+typedef struct Scene_Mesh
+{
+	Mesh_Arena* arena;
+	Submesh* meshes;	// aiMeshごとのアリーナ上の範囲
+	int mesh_count;
+	Submesh* submeshes;	// ノードからのメッシュ参照ごと
+	int submesh_count;
+	int vertex_count;
+	int index_count;
+	mat4 bone_offset_mats[MAX_BONES];
+	int bone_count;
+	Skeleton_Node* skeleton_root;
+}Scene_Mesh;
+
+// GLを使わずにaiSceneを読み込み、アリーナのフォーマットに変換したCPU側のデータ
+typedef struct Mesh_Cpu_Data
+{
+	void* streams[ARENA_STREAM_COUNT];	// 無い属性はNULL
+	unsigned int borrowed_streams;		// (1 << stream)。読み込み元の配列を指しているので解放しない
+	GLuint* indices;
+}Mesh_Cpu_Data;
+
+typedef struct Scene_Cpu_Data
+{
+	int vertex_format;
+	Scene_Mesh scene;			// アリーナ上の範囲(base_vertex, first_index)は-1のまま
+	Mesh_Cpu_Data* mesh_data;	// scene.meshesと同じ並び
+	// ストリームがaiSceneの配列をそのまま指している間はシーンごと残し、free_scene_cpu()で破棄する
+	Assimp::Importer* importer;
+}Scene_Cpu_Data;
+
+/*--------------------Mesh Conversion---------------------------*/
+// 1頂点分のボーン影響。ウェイトの大きい順に最大SKIN_INFLUENCES個まで保持する
+typedef struct Vertex_Influences
+{
+	int bone_ids[SKIN_INFLUENCES];
+	float weights[SKIN_INFLUENCES];
+	int count;		// 保持している影響数
+	int total;		// 切り捨て前の影響数
+}Vertex_Influences;
+
+// borrowedのビット。その配列は読み込み元が持っていて、Scene_Cpu_Dataを解放するまで有効
+#define MESH_SOURCE_POSITIONS 0x1
+#define MESH_SOURCE_NORMALS 0x2
+#define MESH_SOURCE_TEXCOORDS 0x4
+
+// ファイル形式ごとの読み込み処理が作る、変換前の1メッシュ分のデータ。
+// 配列はmalloc()で確保するか、borrowedに印を付けて読み込み元の配列をそのまま指す
+typedef struct Mesh_Source
+{
+	int point_count;
+	GLfloat* positions;		// xyz
+	GLfloat* normals;		// xyz。NULLなら滑らかな法線を作る
+	GLfloat* texcoords;		// uv。NULLなら接線も作らない
+	int texcoord_stride;	// texcoordsの頂点あたりのfloat数。0なら2
+	GLfloat* tangents;		// xyzw。NULLならUVから作る
+	GLuint* indices;		// 三角形のみ
+	int index_count;
+	Vertex_Influences* influences;	// NULLならスキニング無し
+	unsigned int borrowed;	// MESH_SOURCE_*
+}Mesh_Source;
+
+void add_influence(Vertex_Influences* vi, int bone_id, float weight);
+// シーン全体のボーン表からボーン名を探す。無ければ追加する。表が一杯なら-1
+int find_or_add_bone(
+	const char* name,
+	mat4 offset,
+	char bone_names[][64],
+	Scene_Mesh* scene_mesh);
+// アリーナの頂点フォーマットに変換する。GLは呼ばないのでワーカースレッドから使える。
+// フォーマットが一致する借りた配列はコピーせずストリームにし、量子化の入力は直接読む。
+// 途中の一時配列はscratchから取る(呼び出し側がメッシュごとにリセットする)。
+// source の配列はストリームに渡すか解放され、source は空になる
+void convert_mesh_source(
+	Mesh_Source* source,
+	int vertex_format,
+	Scratch_Arena* scratch,
+	Mesh_Cpu_Data* mesh_data,
+	Submesh* range);
+void free_mesh_source(Mesh_Source* source);
+
+// import_scene_cpu()はGLを呼ばないのでワーカースレッドから使える。
+// GLスレッドでメッシュ単位にアップロードし、最後にfinishでScene_Meshへ所有権を移す。
+// .daeはストリーミングのCOLLADAリーダーで読む(DISABLE_STREAMING_COLLADAを定義すると常にassimp)
+bool import_scene_cpu(
+	const char* file_name,
+	int vertex_format,
+	Scene_Cpu_Data* cpu);
+// assimpだけで読む。比較用
+bool import_scene_cpu_assimp(
+	const char* file_name,
+	int vertex_format,
+	Scene_Cpu_Data* cpu);
+bool upload_scene_cpu_mesh(Scene_Cpu_Data* cpu, int mesh_i, Mesh_Arena* arena);
+void finish_scene_cpu_upload(Scene_Cpu_Data* cpu, Scene_Mesh* scene_mesh);
+void free_scene_cpu(Scene_Cpu_Data* cpu);
+// 同期読み込み。import, upload, finishを続けて行う
+bool load_mesh(
+	const char* file_name,
+	Mesh_Arena* arena,
+	Scene_Mesh* scene_mesh);
+void free_scene_mesh(Scene_Mesh* scene_mesh);
+// 最大影響数に対応するシェーダバリアント(0, 1, 2, 4, SKIN_INFLUENCES)を返す
+int skin_variant_influences(int max_influences);
+// arenaのVAOがバインドされている前提で、サブメッシュをlodで1つ描画する
+void draw_submesh(const Submesh* submesh, int lod);
+// instanced_vaoがバインドされている前提で、同じサブメッシュをlodでinstance_count個まとめて描画する
+void draw_submesh_instanced(const Submesh* submesh, int lod, int instance_count);
+
 #endif
\ No newline at end of file
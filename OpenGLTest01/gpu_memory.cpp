@@ -0,0 +1,176 @@
+#include "gpu_memory.h"
+#include "gl_utils.h"
+#include "gl_state.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+typedef struct Gpu_Allocation
+{
+	GLuint object;
+	int category;
+	size_t bytes;
+	char owner[64];
+}Gpu_Allocation;
+
+static Gpu_Allocation g_allocations[MAX_TRACKED_ALLOCATIONS];
+static int g_allocation_count = 0;
+static Gpu_Memory_Stats g_stats;
+
+static const char* g_category_names[GPU_MEMORY_CATEGORY_COUNT] = {
+	"vertex", "index", "uniform", "staging", "texture", "other"
+};
+
+static int find_allocation(GLuint object, int category)
+{
+	for (int i = 0; i < g_allocation_count; i++)
+	{
+		if (g_allocations[i].object == object && g_allocations[i].category == category)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void update_totals(int category, size_t removed, size_t added)
+{
+	g_stats.current[category] = g_stats.current[category] - removed + added;
+	if (g_stats.current[category] > g_stats.peak[category])
+	{
+		g_stats.peak[category] = g_stats.current[category];
+	}
+	g_stats.total = g_stats.total - removed + added;
+	if (g_stats.total > g_stats.total_peak)
+	{
+		g_stats.total_peak = g_stats.total;
+	}
+}
+
+void track_gpu_alloc(GLuint object, int category, const char* owner, size_t bytes)
+{
+	assert(category >= 0 && category < GPU_MEMORY_CATEGORY_COUNT);
+	int i = find_allocation(object, category);
+	if (i < 0)
+	{
+		if (g_allocation_count >= MAX_TRACKED_ALLOCATIONS)
+		{
+			gl_log_err("ERROR: too many tracked GPU allocations (%s)\n", owner);
+			return;
+		}
+		i = g_allocation_count++;
+		g_allocations[i].object = object;
+		g_allocations[i].category = category;
+		g_allocations[i].bytes = 0;
+	}
+	Gpu_Allocation* a = &g_allocations[i];
+	update_totals(category, a->bytes, bytes);
+	a->bytes = bytes;
+	strncpy(a->owner, owner ? owner : "", 63);
+	a->owner[63] = 0;
+	g_stats.allocation_count = g_allocation_count;
+}
+
+void track_gpu_free(GLuint object, int category)
+{
+	int i = find_allocation(object, category);
+	if (i < 0)
+	{
+		return;
+	}
+	update_totals(category, g_allocations[i].bytes, 0);
+	g_allocations[i] = g_allocations[--g_allocation_count];
+	g_stats.allocation_count = g_allocation_count;
+}
+
+void gpu_buffer_data(
+	GLuint buffer,
+	GLenum target,
+	GLsizeiptr size,
+	const void* data,
+	GLenum usage,
+	int category,
+	const char* owner)
+{
+	gl_state_bind_buffer(target, buffer);
+	glBufferData(target, size, data, usage);
+	track_gpu_alloc(buffer, category, owner, (size_t)size);
+}
+
+void gpu_delete_buffers(GLsizei count, const GLuint* buffers, int category)
+{
+	for (int i = 0; i < count; i++)
+	{
+		track_gpu_free(buffers[i], category);
+		gl_state_forget_buffer(buffers[i]);
+	}
+	glDeleteBuffers(count, buffers);
+}
+
+void add_arena_occupancy(size_t bytes)
+{
+	g_stats.arena_used += bytes;
+	if (g_stats.arena_used > g_stats.arena_peak)
+	{
+		g_stats.arena_peak = g_stats.arena_used;
+	}
+}
+
+void remove_arena_occupancy(size_t bytes)
+{
+	assert(bytes <= g_stats.arena_used);
+	g_stats.arena_used -= bytes;
+}
+
+void set_gpu_memory_budget(size_t mesh_bytes)
+{
+	g_stats.budget = mesh_bytes;
+}
+
+size_t gpu_memory_budget()
+{
+	return g_stats.budget;
+}
+
+size_t gpu_memory_over_budget()
+{
+	size_t used = g_stats.arena_used;
+	if (g_stats.budget == 0 || used <= g_stats.budget)
+	{
+		return 0;
+	}
+	return used - g_stats.budget;
+}
+
+void get_gpu_memory_stats(Gpu_Memory_Stats* stats)
+{
+	*stats = g_stats;
+}
+
+void log_gpu_memory_stats()
+{
+	gl_log_print(
+		"GPU memory: %.2f MB (peak %.2f MB) in %i allocations, arena mesh data %.2f MB (peak %.2f MB, budget %.2f MB)\n",
+		g_stats.total / 1048576.0,
+		g_stats.total_peak / 1048576.0,
+		g_stats.allocation_count,
+		g_stats.arena_used / 1048576.0,
+		g_stats.arena_peak / 1048576.0,
+		g_stats.budget / 1048576.0);
+	for (int c = 0; c < GPU_MEMORY_CATEGORY_COUNT; c++)
+	{
+		gl_log(
+			"  %-8s %10lu bytes (peak %lu)\n",
+			g_category_names[c],
+			(unsigned long)g_stats.current[c],
+			(unsigned long)g_stats.peak[c]);
+	}
+	for (int i = 0; i < g_allocation_count; i++)
+	{
+		gl_log(
+			"  [%s] %s: %lu bytes\n",
+			g_category_names[g_allocations[i].category],
+			g_allocations[i].owner,
+			(unsigned long)g_allocations[i].bytes);
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef _GPU_MEMORY_H_
+#define _GPU_MEMORY_H_
+
+#include <stddef.h>
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+
+/*--------------------GPU Memory Tracker---------------------------*/
+// バッファとテクスチャの確保を所有者・種類・サイズごとに記録し、合計と最大値を集計する。
+// アリーナ内のメッシュは確保済みのバッファの中に置くだけなので、確保としては数えず、占有量として別に数える。
+// 予算はこの占有量だけにかかり、超えた分は最後に描画されてから時間が経ったものから追い出される。
+// アリーナのバッファは作った時に最大の大きさで確保されるので、追い出してもドライバのメモリは減らない
+// (アリーナの空きが増えるだけ)。予算はアリーナの容量以下にしておくこと
+#define GPU_MEMORY_VERTEX 0		// 頂点バッファ
+#define GPU_MEMORY_INDEX 1		// インデックスバッファ
+#define GPU_MEMORY_UNIFORM 2	// UBO・TBO
+#define GPU_MEMORY_STAGING 3	// アップロード用のバッファ
+#define GPU_MEMORY_TEXTURE 4
+#define GPU_MEMORY_OTHER 5
+#define GPU_MEMORY_CATEGORY_COUNT 6
+
+#define MAX_TRACKED_ALLOCATIONS 1024
+
+typedef struct Gpu_Memory_Stats
+{
+	size_t current[GPU_MEMORY_CATEGORY_COUNT];
+	size_t peak[GPU_MEMORY_CATEGORY_COUNT];
+	size_t total;		// ドライバに確保させた量
+	size_t total_peak;
+	size_t arena_used;	// アリーナ内に常駐しているメッシュデータ
+	size_t arena_peak;
+	size_t budget;		// arena_usedの上限。0なら無制限
+	int allocation_count;
+}Gpu_Memory_Stats;
+
+// object と category の組で確保を識別する。同じ組で再度記録するとサイズを置き換える
+void track_gpu_alloc(GLuint object, int category, const char* owner, size_t bytes);
+void track_gpu_free(GLuint object, int category);
+// glBufferData()を呼んで記録する。buffer は target にバインドされる
+void gpu_buffer_data(
+	GLuint buffer,
+	GLenum target,
+	GLsizeiptr size,
+	const void* data,
+	GLenum usage,
+	int category,
+	const char* owner);
+// glDeleteBuffers()を呼んで、記録からも消す
+void gpu_delete_buffers(GLsizei count, const GLuint* buffers, int category);
+// アリーナ内にメッシュを置いた・明け渡したときに呼ぶ
+void add_arena_occupancy(size_t bytes);
+void remove_arena_occupancy(size_t bytes);
+
+void set_gpu_memory_budget(size_t mesh_bytes);
+size_t gpu_memory_budget();
+// アリーナの占有量が予算を超えている量。超えていなければ0
+size_t gpu_memory_over_budget();
+void get_gpu_memory_stats(Gpu_Memory_Stats* stats);
+void log_gpu_memory_stats();
+
+#endif
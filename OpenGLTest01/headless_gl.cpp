@@ -0,0 +1,320 @@
+#include "headless_gl.h"
+#include "gl_utils.h"
+#include "gpu_memory.h"
+#include "timer.h"
+#if defined(HEADLESS_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*--------------------Headless Offscreen Context---------------------------*/
+#if defined(HEADLESS_EGL) && !defined(EGL_PLATFORM_SURFACELESS_MESA)
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+bool g_headless = false;
+
+typedef struct Headless_Context
+{
+	GLuint fbo;
+	GLuint colour;
+	GLuint depth;
+	int width;
+	int height;
+	long long frames;
+	double first_frame_seconds;
+	double last_frame_seconds;
+#if defined(HEADLESS_EGL)
+	EGLDisplay display;
+	EGLContext context;
+	EGLSurface surface;
+#endif
+}Headless_Context;
+
+static Headless_Context g_context;
+
+bool parse_headless_size(const char* str, int* width, int* height)
+{
+	int w = 0;
+	int h = 0;
+	if (!str || sscanf(str, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+	{
+		return false;
+	}
+	*width = w;
+	*height = h;
+	return true;
+}
+
+#if defined(HEADLESS_EGL)
+static bool create_headless_context()
+{
+	Headless_Context* c = &g_context;
+	// 表示の無い環境ではsurfacelessプラットフォームを優先する
+	c->display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (get_platform_display)
+	{
+		c->display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (c->display == EGL_NO_DISPLAY)
+	{
+		c->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	EGLint major = 0;
+	EGLint minor = 0;
+	if (c->display == EGL_NO_DISPLAY || !eglInitialize(c->display, &major, &minor))
+	{
+		gl_log_err("ERROR: could not initialise EGL (0x%x)\n", eglGetError());
+		return false;
+	}
+	gl_log("starting EGL %i.%i %s\n", major, minor, eglQueryString(c->display, EGL_VENDOR));
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		gl_log_err("ERROR: EGL does not support desktop OpenGL\n");
+		return false;
+	}
+
+	const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_NONE,
+	};
+	EGLConfig config;
+	EGLint config_count = 0;
+	if (!eglChooseConfig(c->display, config_attribs, &config, 1, &config_count) || config_count == 0)
+	{
+		gl_log_err("ERROR: no suitable EGL config\n");
+		return false;
+	}
+	const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+		EGL_CONTEXT_MINOR_VERSION_KHR, 1,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+		EGL_NONE,
+	};
+	c->context = eglCreateContext(c->display, config, EGL_NO_CONTEXT, context_attribs);
+	if (c->context == EGL_NO_CONTEXT)
+	{
+		gl_log_err("ERROR: could not create EGL context (0x%x)\n", eglGetError());
+		return false;
+	}
+
+	// 描画先はFBOなので、できればサーフェスを作らない
+	c->surface = EGL_NO_SURFACE;
+	const char* extensions = eglQueryString(c->display, EGL_EXTENSIONS);
+	if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+	{
+		const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		c->surface = eglCreatePbufferSurface(c->display, config, pbuffer_attribs);
+		if (c->surface == EGL_NO_SURFACE)
+		{
+			gl_log_err("ERROR: could not create EGL pbuffer (0x%x)\n", eglGetError());
+			return false;
+		}
+	}
+	if (!eglMakeCurrent(c->display, c->surface, c->surface, c->context))
+	{
+		gl_log_err("ERROR: could not make EGL context current (0x%x)\n", eglGetError());
+		return false;
+	}
+	return true;
+}
+
+static void destroy_headless_context()
+{
+	Headless_Context* c = &g_context;
+	if (c->display == EGL_NO_DISPLAY)
+	{
+		return;
+	}
+	eglMakeCurrent(c->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (c->surface != EGL_NO_SURFACE)
+	{
+		eglDestroySurface(c->display, c->surface);
+	}
+	if (c->context != EGL_NO_CONTEXT)
+	{
+		eglDestroyContext(c->display, c->context);
+	}
+	eglTerminate(c->display);
+}
+#else
+static bool create_headless_context()
+{
+	gl_log("starting GLFW %s (hidden window)\n", glfwGetVersionString());
+	glfwSetErrorCallback(glfw_error_callback);
+	if (!glfwInit())
+	{
+		fprintf(stderr, "ERROR: could not start GLFW3\n");
+		return false;
+	}
+#ifdef APPLE
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#endif
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	g_window = glfwCreateWindow(1, 1, "Headless", NULL, NULL);
+	if (!g_window)
+	{
+		fprintf(stderr, "ERROR: could not open hidden window with GLFW3\n");
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(g_window);
+	glfwSwapInterval(0);
+	return true;
+}
+
+static void destroy_headless_context()
+{
+	glfwTerminate();
+	g_window = NULL;
+}
+#endif
+
+static bool create_headless_target(int width, int height)
+{
+	Headless_Context* c = &g_context;
+	glGenRenderbuffers(1, &c->colour);
+	glBindRenderbuffer(GL_RENDERBUFFER, c->colour);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	track_gpu_alloc(c->colour, GPU_MEMORY_TEXTURE, "headless colour", (size_t)width * height * 4);
+	glGenRenderbuffers(1, &c->depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, c->depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	track_gpu_alloc(c->depth, GPU_MEMORY_TEXTURE, "headless depth", (size_t)width * height * 4);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &c->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, c->fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, c->colour);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, c->depth);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		gl_log_err("ERROR: headless framebuffer incomplete (0x%x)\n", status);
+		return false;
+	}
+	c->width = width;
+	c->height = height;
+	return true;
+}
+
+bool start_headless_gl(int width, int height)
+{
+	memset(&g_context, 0, sizeof(Headless_Context));
+	if (!create_headless_context())
+	{
+		destroy_headless_context();
+		return false;
+	}
+	if (!start_glew() || !create_headless_target(width, height))
+	{
+		stop_headless_gl();
+		return false;
+	}
+	g_gl_width = width;
+	g_gl_height = height;
+	g_headless = true;
+	gl_log_print("headless rendering to %ix%i framebuffer\n", width, height);
+	return true;
+}
+
+void end_headless_frame()
+{
+	// スワップで行われる送出だけを行い、完了は待たない(ステージングリングのフェンスで追い越しを抑える)
+	glFlush();
+	// 描画コードが既定のフレームバッファを結んでも、次のフレームはFBOに描く
+	glBindFramebuffer(GL_FRAMEBUFFER, g_context.fbo);
+	double now = get_precise_time();
+	if (g_context.frames == 0)
+	{
+		g_context.first_frame_seconds = now;
+	}
+	g_context.last_frame_seconds = now;
+	g_context.frames++;
+}
+
+bool save_headless_frame(const char* file_name)
+{
+	Headless_Context* c = &g_context;
+	int row_bytes = c->width * 3;
+	unsigned char* pixels = (unsigned char*)malloc((size_t)row_bytes * c->height);
+	if (!pixels)
+	{
+		gl_log_err("ERROR: could not allocate %ix%i capture\n", c->width, c->height);
+		return false;
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, c->fbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, c->width, c->height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+
+	FILE* file = fopen(file_name, "wb");
+	if (!file)
+	{
+		gl_log_err("ERROR: could not open %s for writing\n", file_name);
+		free(pixels);
+		return false;
+	}
+	// GLは下の行から返すので、上下を入れ替えて書く
+	fprintf(file, "P6\n%i %i\n255\n", c->width, c->height);
+	for (int y = c->height - 1; y >= 0; y--)
+	{
+		fwrite(pixels + (size_t)y * row_bytes, 1, row_bytes, file);
+	}
+	fclose(file);
+	free(pixels);
+	printf("saved headless frame %lld to %s\n", c->frames, file_name);
+	return true;
+}
+
+void log_headless_stats()
+{
+	if (!g_headless)
+	{
+		return;
+	}
+	// 最初のフレームの終わりから数える(読み込みの時間を含めない)
+	double ms = g_context.frames > 1 ?
+		(g_context.last_frame_seconds - g_context.first_frame_seconds) * 1000.0 / (g_context.frames - 1) : 0.0;
+	printf(
+		"headless: %lld frames at %ix%i, %.3f ms/frame (%.1f fps)\n",
+		g_context.frames,
+		g_context.width,
+		g_context.height,
+		ms,
+		ms > 0.0 ? 1000.0 / ms : 0.0);
+}
+
+void stop_headless_gl()
+{
+	Headless_Context* c = &g_context;
+	if (c->fbo)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &c->fbo);
+	}
+	if (c->colour)
+	{
+		track_gpu_free(c->colour, GPU_MEMORY_TEXTURE);
+		glDeleteRenderbuffers(1, &c->colour);
+	}
+	if (c->depth)
+	{
+		track_gpu_free(c->depth, GPU_MEMORY_TEXTURE);
+		glDeleteRenderbuffers(1, &c->depth);
+	}
+	destroy_headless_context();
+	memset(c, 0, sizeof(Headless_Context));
+	g_headless = false;
+}
@@ -0,0 +1,32 @@
+#ifndef _HEADLESS_GL_H_
+#define _HEADLESS_GL_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+
+/*--------------------Headless Offscreen Context---------------------------*/
+// ウィンドウを作らず、オフスクリーンのコンテキストでFBOに描く。表示の無い計測機でもフレーム全体を回せる。
+// スワップしないので垂直同期も無い。--headless [WxH]か、環境変数HEADLESS_ENVで選ぶ。
+// コンテキストの作り方はビルド時に選ぶ:
+//   HEADLESS_EGL    EGLのsurfaceless(拡張が無ければ1x1のpbuffer)。表示の無いLinuxで使う。libEGLとリンクする。
+//                   GLEWは通常の(GLX向けの)ビルドでよい。glvndのlibGLなら、GLXで引いた関数がEGLのコンテキストでも使える
+//   無し            見えないGLFWウィンドウ。表示は要るがWindowsの既定のビルドで使える
+//#define HEADLESS_EGL
+// 値は"1"か"1280x720"のような解像度
+#define HEADLESS_ENV "OPENGLTEST_HEADLESS"
+// --framesを指定しなかったときに描くフレーム数
+#define HEADLESS_DEFAULT_FRAMES 600
+
+extern bool g_headless;
+
+// "WxH"を読む。読めなければfalse
+bool parse_headless_size(const char* str, int* width, int* height);
+// コンテキストとFBOを作って結ぶ。g_gl_width/g_gl_heightも設定する
+bool start_headless_gl(int width, int height);
+// glfwSwapBuffers()の代わり。溜まったコマンドを送り、FBOを結び直す
+void end_headless_frame();
+// 最後に描いたフレームをPPMに書き出す。結果の比較に使う
+bool save_headless_frame(const char* file_name);
+void log_headless_stats();
+void stop_headless_gl();
+
+#endif
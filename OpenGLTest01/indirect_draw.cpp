@@ -0,0 +1,251 @@
+#include "indirect_draw.h"
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "meshlet.h"
+#include "mesh_lod.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/*--------------------Static Multi-Draw-Indirect List---------------------------*/
+bool create_static_draw_list(Static_Draw_List* list, int capacity)
+{
+	memset(list, 0, sizeof(Static_Draw_List));
+	list->draws = (Static_Draw*)malloc(capacity * sizeof(Static_Draw));
+	list->commands = (Draw_Elements_Indirect_Command*)malloc(capacity * sizeof(Draw_Elements_Indirect_Command));
+	list->instances = (Mesh_Instance*)malloc(capacity * sizeof(Mesh_Instance));
+	if (!list->draws || !list->commands || !list->instances)
+	{
+		gl_log_err("ERROR: could not allocate static draw list of %i draws\n", capacity);
+		free(list->draws);
+		free(list->commands);
+		free(list->instances);
+		memset(list, 0, sizeof(Static_Draw_List));
+		return false;
+	}
+	list->capacity = capacity;
+	list->dirty_first = capacity;
+	list->dirty_last = -1;
+	list->multi_draw = GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+
+	glGenBuffers(1, &list->command_buffer);
+	gpu_buffer_data(
+		list->command_buffer,
+		GL_DRAW_INDIRECT_BUFFER,
+		capacity * sizeof(Draw_Elements_Indirect_Command),
+		NULL,
+		GL_DYNAMIC_DRAW,
+		GPU_MEMORY_OTHER,
+		"static draw commands");
+	glGenBuffers(1, &list->instance_buffer);
+	gpu_buffer_data(
+		list->instance_buffer,
+		GL_ARRAY_BUFFER,
+		capacity * sizeof(Mesh_Instance),
+		NULL,
+		GL_STATIC_DRAW,
+		GPU_MEMORY_VERTEX,
+		"static draw instances");
+	gl_log(
+		"created static draw list: %i draws, %s\n",
+		capacity,
+		list->multi_draw ? "glMultiDrawElementsIndirect" : "one draw per command fallback");
+	return true;
+}
+
+void destroy_static_draw_list(Static_Draw_List* list)
+{
+	gpu_delete_buffers(1, &list->command_buffer, GPU_MEMORY_OTHER);
+	gpu_delete_buffers(1, &list->instance_buffer, GPU_MEMORY_VERTEX);
+	free(list->draws);
+	free(list->commands);
+	free(list->instances);
+	memset(list, 0, sizeof(Static_Draw_List));
+}
+
+bool add_static_draw(Static_Draw_List* list, Submesh* submesh, mat4 submesh_model)
+{
+	if (list->count >= list->capacity || submesh->max_influences > 0)
+	{
+		return false;
+	}
+	int i = list->count++;
+	Static_Draw* draw = &list->draws[i];
+	draw->submesh = submesh;
+	draw->lod = -1;
+	vec4 center = submesh_model * vec4(submesh->bounds_center, 1.0f);
+	draw->center = vec3(center.v[0], center.v[1], center.v[2]);
+	draw->scale = 0.0f;
+	for (int c = 0; c < 3; c++)
+	{
+		vec3 axis(submesh_model.m[c * 4], submesh_model.m[c * 4 + 1], submesh_model.m[c * 4 + 2]);
+		float len = length(axis);
+		if (len > draw->scale)
+		{
+			draw->scale = len;
+		}
+	}
+	draw->radius = submesh->bounds_radius * draw->scale;
+
+	// 位置の復元 offset + scale * q をモデル行列に畳み込む
+	float* m = list->instances[i].model;
+	const float* offset = submesh->position_offset.v;
+	const float* scale = submesh->position_scale.v;
+	for (int c = 0; c < 3; c++)
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			m[c * 4 + r] = submesh_model.m[c * 4 + r] * scale[c];
+		}
+	}
+	for (int r = 0; r < 4; r++)
+	{
+		m[12 + r] =
+			submesh_model.m[r] * offset[0] +
+			submesh_model.m[4 + r] * offset[1] +
+			submesh_model.m[8 + r] * offset[2] +
+			submesh_model.m[12 + r];
+	}
+	list->instances[i].palette_texel = 0;
+
+	// 最初の更新で必ず送るように、描画しないコマンドで埋めておく
+	memset(&list->commands[i], 0, sizeof(Draw_Elements_Indirect_Command));
+	list->commands[i].base_instance = i;
+	if (i < list->dirty_first) list->dirty_first = i;
+	if (i > list->dirty_last) list->dirty_last = i;
+	return true;
+}
+
+void update_static_draw_list(
+	Static_Draw_List* list,
+	mat4 view,
+	mat4 proj,
+	float pixel_scale,
+	float lod_threshold)
+{
+	// 追加されたインスタンス属性は1回だけ送る
+	if (list->uploaded < list->count)
+	{
+		gl_state_bind_buffer(GL_ARRAY_BUFFER, list->instance_buffer);
+		glBufferSubData(
+			GL_ARRAY_BUFFER,
+			list->uploaded * sizeof(Mesh_Instance),
+			(list->count - list->uploaded) * sizeof(Mesh_Instance),
+			list->instances + list->uploaded);
+		list->uploaded = list->count;
+	}
+
+	Frustum frustum;
+	extract_frustum(proj * view, &frustum);
+	mat4 inv_view = inverse(view);
+	vec3 camera(inv_view.m[12], inv_view.m[13], inv_view.m[14]);
+	list->visible = 0;
+	list->frame_patched = 0;
+	for (int i = 0; i < list->count; i++)
+	{
+		Static_Draw* draw = &list->draws[i];
+		const Submesh* sm = draw->submesh;
+		bool visible = !sphere_outside_frustum(&frustum, draw->center, draw->radius);
+		if (visible)
+		{
+			list->visible++;
+			// 見えない間はLODを選び直さない
+			int lod = 0;
+			if (lod_threshold > 0.0f && sm->lod_count > 1)
+			{
+				float distance = length(draw->center - camera) - draw->radius;
+				lod = select_lod(
+					sm->lods,
+					sm->lod_count,
+					draw->lod < 0 ? 0 : draw->lod,
+					draw->scale > 0.0f ? distance / draw->scale : distance,
+					pixel_scale,
+					lod_threshold);
+			}
+			draw->lod = lod;
+		}
+		Draw_Elements_Indirect_Command command;
+		memset(&command, 0, sizeof(command));
+		if (draw->lod >= 0)
+		{
+			const Mesh_Lod* lod = &sm->lods[draw->lod];
+			command.count = lod->index_count;
+			command.first_index = sm->first_index + lod->first_index;
+			command.base_vertex = sm->base_vertex;
+		}
+		command.instance_count = visible ? 1 : 0;
+		command.base_instance = i;
+		if (memcmp(&command, &list->commands[i], sizeof(command)) != 0)
+		{
+			list->commands[i] = command;
+			if (i < list->dirty_first) list->dirty_first = i;
+			if (i > list->dirty_last) list->dirty_last = i;
+		}
+	}
+
+	// 変わった範囲をまとめて1回で送る
+	if (list->dirty_first <= list->dirty_last)
+	{
+		int n = list->dirty_last - list->dirty_first + 1;
+		gl_state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, list->command_buffer);
+		glBufferSubData(
+			GL_DRAW_INDIRECT_BUFFER,
+			list->dirty_first * sizeof(Draw_Elements_Indirect_Command),
+			n * sizeof(Draw_Elements_Indirect_Command),
+			list->commands + list->dirty_first);
+		list->frame_patched = n;
+		list->patched += n;
+		list->patch_uploads++;
+		list->dirty_first = list->capacity;
+		list->dirty_last = -1;
+	}
+	list->frames++;
+}
+
+void draw_static_draw_list(Static_Draw_List* list)
+{
+	if (list->count == 0)
+	{
+		return;
+	}
+	if (list->multi_draw)
+	{
+		mesh_arena_bind_instances(list->instance_buffer, 0);
+		gl_state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, list->command_buffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, list->count, 0);
+		list->draw_calls++;
+		return;
+	}
+	// base_instanceが使えないので、コマンドごとにインスタンス属性の位置をずらす
+	for (int i = 0; i < list->count; i++)
+	{
+		const Draw_Elements_Indirect_Command* command = &list->commands[i];
+		if (command->instance_count == 0)
+		{
+			continue;
+		}
+		mesh_arena_bind_instances(list->instance_buffer, i * sizeof(Mesh_Instance));
+		glDrawElementsInstancedBaseVertex(
+			GL_TRIANGLES,
+			command->count,
+			GL_UNSIGNED_INT,
+			(void*)(command->first_index * sizeof(GLuint)),
+			command->instance_count,
+			command->base_vertex);
+		list->draw_calls++;
+	}
+}
+
+void log_static_draw_list_stats(const Static_Draw_List* list)
+{
+	int frames = list->frames > 0 ? list->frames : 1;
+	gl_log_print(
+		"static draw list: %i draws, %i visible last frame, %.1f commands patched/frame in %.2f uploads/frame, %.1f draw calls/frame (%s)\n",
+		list->count,
+		list->visible,
+		(double)list->patched / frames,
+		(double)list->patch_uploads / frames,
+		(double)list->draw_calls / frames,
+		list->multi_draw ? "multi-draw-indirect" : "fallback");
+}
@@ -0,0 +1,75 @@
+#ifndef _INDIRECT_DRAW_H_
+#define _INDIRECT_DRAW_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+#include "maths_funcs.h"
+#include "gl_utils.h"
+#include "mesh_arena.h"
+
+/*--------------------Static Multi-Draw-Indirect List---------------------------*/
+// 動かないサブメッシュの描画コマンドをGL_DRAW_INDIRECT_BUFFERに置いたままフレームをまたいで使い回し、
+// glMultiDrawElementsIndirect()の1回で全て描く。毎フレーム視錐台カリングとLOD選択だけを行い、
+// 変わったコマンドの範囲だけを書き換える(見えないものはinstance_countを0にする)。
+// モデル行列はbase_instanceで引くインスタンス属性(Mesh_Instance)に置く。
+// メッシュごとに違う位置の量子化はモデル行列に畳み込むので、スキニングするサブメッシュは扱えない。
+// ARB_multi_draw_indirectとARB_base_instanceが無ければ、見えるコマンドを1つずつ描く
+typedef struct Draw_Elements_Indirect_Command
+{
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;
+}Draw_Elements_Indirect_Command;
+
+typedef struct Static_Draw
+{
+	Submesh* submesh;
+	vec3 center;		// ワールド空間のバウンディングスフィア
+	float radius;
+	float scale;		// モデル行列の最大の軸のスケール(LOD選択用)
+	int lod;
+}Static_Draw;
+
+typedef struct Static_Draw_List
+{
+	Static_Draw* draws;
+	Draw_Elements_Indirect_Command* commands;	// GPU側のコマンドの写し
+	Mesh_Instance* instances;
+	int count;
+	int capacity;
+	int uploaded;		// インスタンス属性を送り終えた数
+	GLuint command_buffer;
+	GLuint instance_buffer;
+	bool multi_draw;
+	// 書き換えが必要なコマンドの範囲。dirty_first > dirty_lastなら無し
+	int dirty_first;
+	int dirty_last;
+
+	// 統計
+	int visible;			// 最後のフレームで見えたもの
+	int frame_patched;		// 最後のフレームで書き換えたコマンドの数
+	long long patched;
+	long long patch_uploads;	// glBufferSubData()の回数
+	long long draw_calls;
+	int frames;
+}Static_Draw_List;
+
+bool create_static_draw_list(Static_Draw_List* list, int capacity);
+void destroy_static_draw_list(Static_Draw_List* list);
+// submesh_modelはノードのトランスフォームを掛けたもの。一杯かスキニングするサブメッシュならfalse
+bool add_static_draw(Static_Draw_List* list, Submesh* submesh, mat4 submesh_model);
+// 視錐台カリングとLOD選択を行い、変わったコマンドだけをバッファに送る。
+// pixel_scaleとlod_thresholdはselect_lod()と同じ。lod_thresholdが0以下ならLOD0に固定する
+void update_static_draw_list(
+	Static_Draw_List* list,
+	mat4 view,
+	mat4 proj,
+	float pixel_scale,
+	float lod_threshold);
+// arenaのinstanced_vaoとインスタンス描画のプログラムが結ばれている前提で描く。
+// プログラムの位置の復元(position_offset, position_scale)は0と1にしておく
+void draw_static_draw_list(Static_Draw_List* list);
+void log_static_draw_list_stats(const Static_Draw_List* list);
+
+#endif
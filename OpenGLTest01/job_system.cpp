@@ -0,0 +1,160 @@
+#include "job_system.h"
+#include "gl_utils.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <assert.h>
+
+typedef struct Job
+{
+	Job_Function function;
+	void* data;
+	Job_Counter* counter;
+}Job;
+
+static std::thread g_workers[MAX_JOB_WORKERS];
+static int g_worker_count = 0;
+static Job g_job_queue[MAX_QUEUED_JOBS];
+static int g_job_head = 0;
+static int g_job_count = 0;
+static bool g_job_system_quit = false;
+static std::mutex g_job_mutex;
+static std::condition_variable g_job_cv;
+
+static void run_job(const Job* job)
+{
+	job->function(job->data);
+	if (job->counter)
+	{
+		job->counter->remaining--;
+	}
+}
+
+// ロック済みの状態で呼ぶ
+static bool pop_job_locked(Job* job)
+{
+	if (g_job_count == 0)
+	{
+		return false;
+	}
+	*job = g_job_queue[g_job_head];
+	g_job_head = (g_job_head + 1) % MAX_QUEUED_JOBS;
+	g_job_count--;
+	return true;
+}
+
+static void worker_main()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(g_job_mutex);
+			while (g_job_count == 0 && !g_job_system_quit)
+			{
+				g_job_cv.wait(lock);
+			}
+			if (!pop_job_locked(&job))
+			{
+				return;
+			}
+		}
+		run_job(&job);
+	}
+}
+
+bool start_job_system(int worker_count)
+{
+	assert(g_worker_count == 0);
+	if (worker_count <= 0)
+	{
+		worker_count = (int)std::thread::hardware_concurrency() - 1;
+		if (worker_count < 1)
+		{
+			worker_count = 1;
+		}
+	}
+	if (worker_count > MAX_JOB_WORKERS)
+	{
+		worker_count = MAX_JOB_WORKERS;
+	}
+	g_job_system_quit = false;
+	for (int i = 0; i < worker_count; i++)
+	{
+		g_workers[i] = std::thread(worker_main);
+	}
+	g_worker_count = worker_count;
+	gl_log("job system started with %i workers\n", worker_count);
+	return true;
+}
+
+// 残っているジョブを全て実行してからワーカーを止める
+void stop_job_system()
+{
+	{
+		std::lock_guard<std::mutex> lock(g_job_mutex);
+		g_job_system_quit = true;
+	}
+	g_job_cv.notify_all();
+	for (int i = 0; i < g_worker_count; i++)
+	{
+		g_workers[i].join();
+	}
+	g_worker_count = 0;
+}
+
+int job_worker_count()
+{
+	return g_worker_count;
+}
+
+void init_job_counter(Job_Counter* counter)
+{
+	counter->remaining = 0;
+}
+
+void submit_job(Job_Function function, void* data, Job_Counter* counter)
+{
+	Job job;
+	job.function = function;
+	job.data = data;
+	job.counter = counter;
+	if (counter)
+	{
+		counter->remaining++;
+	}
+	if (g_worker_count > 0)
+	{
+		std::lock_guard<std::mutex> lock(g_job_mutex);
+		if (g_job_count < MAX_QUEUED_JOBS)
+		{
+			g_job_queue[(g_job_head + g_job_count) % MAX_QUEUED_JOBS] = job;
+			g_job_count++;
+			g_job_cv.notify_one();
+			return;
+		}
+	}
+	// ワーカーが無いかキューが一杯なら、その場で実行する
+	run_job(&job);
+}
+
+void wait_for_jobs(Job_Counter* counter)
+{
+	while (counter->remaining > 0)
+	{
+		Job job;
+		bool has_job;
+		{
+			std::lock_guard<std::mutex> lock(g_job_mutex);
+			has_job = pop_job_locked(&job);
+		}
+		if (has_job)
+		{
+			run_job(&job);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
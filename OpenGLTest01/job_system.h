@@ -0,0 +1,29 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+#include <atomic>
+
+/*--------------------Worker Thread Pool---------------------------*/
+// 固定数のワーカースレッドで関数ポインタのジョブを実行する。
+// ワーカーが無い(起動前・停止後)場合、ジョブは呼び出したスレッドでその場で実行される
+#define MAX_JOB_WORKERS 16
+#define MAX_QUEUED_JOBS 4096
+
+typedef void (*Job_Function)(void* data);
+
+// 完了待ち用のカウンタ。submit_job()で増え、ジョブの終了で減る
+typedef struct Job_Counter
+{
+	std::atomic<int> remaining;
+}Job_Counter;
+
+// worker_countが0以下ならハードウェアスレッド数-1
+bool start_job_system(int worker_count);
+void stop_job_system();
+int job_worker_count();
+void init_job_counter(Job_Counter* counter);
+void submit_job(Job_Function function, void* data, Job_Counter* counter);
+// 待っている間もキューのジョブを実行して手伝う
+void wait_for_jobs(Job_Counter* counter);
+
+#endif
@@ -0,0 +1,197 @@
+#include "lz_codec.h"
+#include <string.h>
+
+#define LZ_HASH_BITS 14
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+
+int lz_compress_bound(int src_size)
+{
+	return src_size + src_size / 255 + 16;
+}
+
+static unsigned int read_u32(const unsigned char* p)
+{
+	unsigned int v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static unsigned int hash_u32(unsigned int v)
+{
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// 15以上の長さを255ずつ書き足す
+static unsigned char* write_length(unsigned char* op, unsigned char* oend, int length)
+{
+	while (length >= 255)
+	{
+		if (op >= oend)
+		{
+			return NULL;
+		}
+		*op++ = 255;
+		length -= 255;
+	}
+	if (op >= oend)
+	{
+		return NULL;
+	}
+	*op++ = (unsigned char)length;
+	return op;
+}
+
+static unsigned char* write_sequence(
+	unsigned char* op,
+	unsigned char* oend,
+	const unsigned char* literals,
+	int literal_length,
+	int offset,
+	int match_length)
+{
+	if (op >= oend)
+	{
+		return NULL;
+	}
+	unsigned char* token = op++;
+	int match_code = match_length - LZ_MIN_MATCH;
+	*token = (unsigned char)(((literal_length < 15 ? literal_length : 15) << 4) |
+		(match_length > 0 ? (match_code < 15 ? match_code : 15) : 0));
+	if (literal_length >= 15 && !(op = write_length(op, oend, literal_length - 15)))
+	{
+		return NULL;
+	}
+	if (oend - op < literal_length)
+	{
+		return NULL;
+	}
+	memcpy(op, literals, literal_length);
+	op += literal_length;
+	// 最後のシーケンスはリテラルだけ
+	if (match_length == 0)
+	{
+		return op;
+	}
+	if (oend - op < 2)
+	{
+		return NULL;
+	}
+	*op++ = (unsigned char)(offset & 0xff);
+	*op++ = (unsigned char)(offset >> 8);
+	if (match_code >= 15 && !(op = write_length(op, oend, match_code - 15)))
+	{
+		return NULL;
+	}
+	return op;
+}
+
+int lz_compress(const unsigned char* src, int src_size, unsigned char* dst, int dst_capacity)
+{
+	int table[LZ_HASH_SIZE];
+	for (int i = 0; i < LZ_HASH_SIZE; i++)
+	{
+		table[i] = -1;
+	}
+	unsigned char* op = dst;
+	unsigned char* oend = dst + dst_capacity;
+	int anchor = 0;
+	int i = 0;
+	while (i + LZ_MIN_MATCH <= src_size)
+	{
+		unsigned int sequence = read_u32(src + i);
+		unsigned int h = hash_u32(sequence);
+		int candidate = table[h];
+		table[h] = i;
+		if (candidate < 0 || i - candidate > LZ_MAX_OFFSET || read_u32(src + candidate) != sequence)
+		{
+			i++;
+			continue;
+		}
+		int length = LZ_MIN_MATCH;
+		while (i + length < src_size && src[candidate + length] == src[i + length])
+		{
+			length++;
+		}
+		op = write_sequence(op, oend, src + anchor, i - anchor, i - candidate, length);
+		if (!op)
+		{
+			return 0;
+		}
+		i += length;
+		anchor = i;
+	}
+	op = write_sequence(op, oend, src + anchor, src_size - anchor, 0, 0);
+	if (!op)
+	{
+		return 0;
+	}
+	return (int)(op - dst);
+}
+
+static const unsigned char* read_length(const unsigned char* ip, const unsigned char* iend, int* length)
+{
+	unsigned char b;
+	do
+	{
+		if (ip >= iend)
+		{
+			return NULL;
+		}
+		b = *ip++;
+		*length += b;
+	} while (b == 255);
+	return ip;
+}
+
+int lz_decompress(const unsigned char* src, int src_size, unsigned char* dst, int dst_capacity)
+{
+	const unsigned char* ip = src;
+	const unsigned char* iend = src + src_size;
+	unsigned char* op = dst;
+	unsigned char* oend = dst + dst_capacity;
+	while (ip < iend)
+	{
+		unsigned char token = *ip++;
+		int literal_length = token >> 4;
+		if (literal_length == 15 && !(ip = read_length(ip, iend, &literal_length)))
+		{
+			return -1;
+		}
+		if (iend - ip < literal_length || oend - op < literal_length)
+		{
+			return -1;
+		}
+		memcpy(op, ip, literal_length);
+		ip += literal_length;
+		op += literal_length;
+		if (ip == iend)
+		{
+			break;
+		}
+
+		if (iend - ip < 2)
+		{
+			return -1;
+		}
+		int offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		int match_length = token & 15;
+		if (match_length == 15 && !(ip = read_length(ip, iend, &match_length)))
+		{
+			return -1;
+		}
+		match_length += LZ_MIN_MATCH;
+		if (offset == 0 || offset > op - dst || oend - op < match_length)
+		{
+			return -1;
+		}
+		// 一致範囲が重なることがあるので1バイトずつ写す
+		const unsigned char* match = op - offset;
+		for (int k = 0; k < match_length; k++)
+		{
+			op[k] = match[k];
+		}
+		op += match_length;
+	}
+	return (int)(op - dst);
+}
@@ -0,0 +1,18 @@
+#ifndef _LZ_CODEC_H_
+#define _LZ_CODEC_H_
+
+/*--------------------LZ Block Codec---------------------------*/
+// LZ4と同系統のバイト単位のLZ圧縮。ブロックは独立していて、最大64KB後方まで参照する。
+// シーケンスは [トークン][リテラル長の延長][リテラル][オフセット(u16)][一致長の延長]。
+// トークンの上位4bitはリテラル長、下位4bitは一致長-4で、15なら255単位で延長する
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+
+// 入力が圧縮できない場合に備えた出力の最大サイズ
+int lz_compress_bound(int src_size);
+// 圧縮後のサイズを返す。dst_capacity に収まらなければ0
+int lz_compress(const unsigned char* src, int src_size, unsigned char* dst, int dst_capacity);
+// 展開後のサイズを返す。壊れたデータや容量不足なら-1
+int lz_decompress(const unsigned char* src, int src_size, unsigned char* dst, int dst_capacity);
+
+#endif
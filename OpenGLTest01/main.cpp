@@ -1,292 +1,1336 @@
-#include "maths_funcs.h"
-#include "gl_utils.h"
-#include <GL/glew.h> // include GLEW and new version of GL on Windows
-#include <GLFW/glfw3.h> // GLFW helper library
-#include <stdio.h>
-#include <stdlib.h>
-#include <assert.h>
-
-#define GL_LOG_FILE "gl.log"
-#define VERTEX_SHADER_FILE "test_vs.glsl"
-#define FRAGMENT_SHADER_FILE "test_fs.glsl"
-#define MESH_FILE "suzanne_skeleton.dae" //"suzanne_bone.dae" //"suzanne.dae"
-
-/* keep track of window size for things like the viewport and the mouse
-cursor */
-int g_gl_width = 640;
-int g_gl_height = 480;
-GLFWwindow* g_window = NULL;
-
-mat4 g_local_anim[MAX_BONES];
-
-// XPg\ċAIɒHāA{[̃Aj[Vs̔z𐶐
-void skeleton_animate(
-	Skeleton_Node* node,
-	mat4 parent_mat,
-	mat4* bone_offset_mats,
-	mat4* bone_animation_mats){
-
-	assert(node);
-
-	mat4 our_mat = parent_mat;			// {[̍ŏIIȃgXtH[s
-	mat4 local_anim = identity_mat4();	// ̃t[ɂ邱̃{[ɑ΂Aj[Vs
-
-	int bone_i = node->bone_index;
-	if (bone_i > -1)
-	{
-		mat4 bone_offset = bone_offset_mats[bone_i];
-		mat4 inv_bone_offset = inverse(bone_offset);
-		local_anim = g_local_anim[bone_i];
-
-		our_mat = parent_mat * inv_bone_offset * local_anim * bone_offset;
-		bone_animation_mats[bone_i] = our_mat;
-	}
-	for (int i = 0; i < node->num_children; i++)
-	{
-		skeleton_animate(
-			node->children[i],
-			our_mat,
-			bone_offset_mats,
-			bone_animation_mats
-			);
-	}
-}
-
-int main() {
-	assert(restart_gl_log());
-	assert(start_gl());
-
-	/* tell GL to only draw onto a pixel if the shape is closer to the viewer*/
-	glEnable(GL_DEPTH_TEST); /* enable depth-testing */
-	glDepthFunc(GL_LESS); /* depth-testing interprets a smaller value as"closer" */
-	glEnable(GL_CULL_FACE); // cull face
-	glCullFace(GL_BACK); // cull back face
-	glFrontFace(GL_CCW); // GL_CCW for counter clock-wise
-	glClearColor(0.6f, 0.6f, 0.6f, 1.0f);
-	glViewport(0, 0, g_gl_width, g_gl_height);
-
-	// load the mesh using assimp
-	GLuint monkey_vao;
-	mat4 monkey_bone_offset_matrices[MAX_BONES];
-	Skeleton_Node* monkey_skeleton_root;
-	int monkey_point_count = 0;
-	int monkey_bone_count = 0;
-	assert(load_mesh(MESH_FILE, &monkey_vao, &monkey_point_count, monkey_bone_offset_matrices, &monkey_bone_count, &monkey_skeleton_root));
-	printf("%s bone count: %i\n", MESH_FILE, monkey_bone_count);
-
-	mat4 monkey_bone_animation_mats[MAX_BONES];
-	for (int i = 0; i < MAX_BONES; i++) {
-		monkey_bone_animation_mats[i] = identity_mat4();
-		monkey_bone_offset_matrices[i] = identity_mat4();
-		monkey_bone_animation_mats[i] = identity_mat4();
-		g_local_anim[i] = identity_mat4();
-	}
-
-	// boneʒumFp̃obt@쐬ƃ{[ʒus̕\
-	float bone_positions[3 * 256];
-	int c = 0;
-	for (int i = 0; i < monkey_bone_count; i++)
-	{
-		print(monkey_bone_offset_matrices[i]);
-
-		bone_positions[c++] = -monkey_bone_offset_matrices[i].m[12];
-		bone_positions[c++] = -monkey_bone_offset_matrices[i].m[13];
-		bone_positions[c++] = -monkey_bone_offset_matrices[i].m[14];
-	}
-	GLuint bones_vao;
-	glGenVertexArrays(1, &bones_vao);
-	glBindVertexArray(bones_vao);
-	GLuint bones_vbo;
-	glGenBuffers(1, &bones_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, bones_vbo);
-	glBufferData(
-		GL_ARRAY_BUFFER,
-		3 * monkey_bone_count * sizeof(float),
-		bone_positions,
-		GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(0);
-
-	/* load shaders from files here */
-	GLuint shader_programme = create_programme_from_files(VERTEX_SHADER_FILE, FRAGMENT_SHADER_FILE);
-	GLuint bones_shader_programme = create_programme_from_files("bones_vs.glsl", "bones_fs.glsl");
-
-	// make view matrix
-	vec3 cam_pos = vec3(0.0f, 0.0f, 300.0f);
-	vec3 target_pos = vec3( 0.0f, 0.0f, 0.0f );
-	vec3 up_vec = vec3(0.0f, 1.0f, 0.0f);
-	mat4 viewMat = look_at(cam_pos, target_pos, up_vec);
-	// make projection matrix
-	float near = 0.1f;
-	float far = 1000.0f;
-	float fov = 67.0f * ONE_DEG_IN_RAD;
-	float aspect = (float)g_gl_width / (float)g_gl_height;
-	mat4 projMat = perspective(fov, aspect, near, far);
-	// make projection-view Matrix
-	mat4 pvMat = projMat * viewMat;
-
-	// set matrices to shader uniform variables
-	glUseProgram(shader_programme);
-	mat4 model_matrix = identity_mat4();
-	int model_location = glGetUniformLocation(shader_programme, "model");
-	glUniformMatrix4fv(model_location, 1, GL_FALSE, model_matrix.m);
-	// view
-	GLint view_mat_location = glGetUniformLocation(shader_programme, "view");
-	glUniformMatrix4fv(view_mat_location, 1, GL_FALSE, viewMat.m);
-	// proj
-	GLint proj_mat_location = glGetUniformLocation(shader_programme, "proj");
-	glUniformMatrix4fv(proj_mat_location, 1, GL_FALSE, projMat.m);
-	// bone matrices@OpenGL̎ł́Auniformϐ̔zlocationl͘AƂ͌Ȃ̂ŁAꂼ̃CfbNXɑ΂locationT
-	int bone_matrices_locations[MAX_BONES];
-	char name[64];
-	for (int i = 0; i < MAX_BONES; i++)
-	{
-		sprintf(name, "bone_matrices[%i]", i);
-		bone_matrices_locations[i] = glGetUniformLocation(shader_programme, name);
-		glUniformMatrix4fv(bone_matrices_locations[i], 1, GL_FALSE, identity_mat4().m);	// Pʍsŏ
-	}
-
-	// {[ʒu\邽߂̃VF[_UniformϐɒlZbg
-	glUseProgram(bones_shader_programme);
-	int bones_view_mat_location = glGetUniformLocation(bones_shader_programme, "view");
-	glUniformMatrix4fv(bones_view_mat_location, 1, GL_FALSE, viewMat.m);
-	int bones_proj_mat_location = glGetUniformLocation(bones_shader_programme, "proj");
-	glUniformMatrix4fv(bones_proj_mat_location, 1, GL_FALSE, projMat.m);
-	
-	float cam_speed = 3.0f;
-	float cam_yaw = 0.0f;
-	float cam_yaw_speed = 5.0f;
-
-	float model_speed = 1.0f;
-	float model_last_position = 0.0f;
-	double previous_seconds = glfwGetTime();
-
-	// XPgAj[Vpp[^
-	float bone_theta = 0.0f;
-	float bone_y = 0.0f;
-	float bone_rot_speed = 50.0f;
-
-	while (!glfwWindowShouldClose(g_window)) {
-		double current_seconds = glfwGetTime();
-		double elapsed_seconds = current_seconds - previous_seconds;
-		previous_seconds = current_seconds;
-		update_fps_counter(g_window);
-		
-		/* wipe the drawing surface clear */
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glViewport(0, 0, g_gl_width, g_gl_height);
-		
-		// draw mesh
-		// udpate model matrix
-		glUseProgram(shader_programme);
-		/*model_matrix.m[12] = elapsed_seconds * model_speed + model_last_position;
-		model_last_position = model_matrix.m[12];
-		if (fabs(model_last_position) > 1.0)
-			model_speed = -model_speed;
-		glUniformMatrix4fv(model_location, 1, GL_FALSE, model_matrix.m);*/
-
-		glEnable(GL_DEPTH_TEST);
-		glBindVertexArray(monkey_vao);
-		glDrawArrays(GL_TRIANGLES, 0, monkey_point_count);
-
-		// {[ʒu`
-		glDisable(GL_DEPTH_TEST);
-		glEnable(GL_PROGRAM_POINT_SIZE);
-		glUseProgram(bones_shader_programme);
-		glBindVertexArray(bones_vao);
-		glDrawArrays(GL_POINTS, 0, monkey_bone_count);
-		glDisable(GL_PROGRAM_POINT_SIZE);
-
-		/* update other events like input handling */
-		glfwPollEvents();
-
-		// control keys
-		bool cam_moved = false;
-		if (glfwGetKey(g_window, GLFW_KEY_A)) {
-			cam_pos.v[0] -= cam_speed * elapsed_seconds;
-			cam_moved = true;
-		}
-		if (glfwGetKey(g_window, GLFW_KEY_D)) {
-			cam_pos.v[0] += cam_speed * elapsed_seconds;
-			cam_moved = true;
-		}
-		if (glfwGetKey(g_window, GLFW_KEY_PAGE_UP)) {
-			cam_pos.v[1] += cam_speed * elapsed_seconds;
-			cam_moved = true;
-		}
-		if (glfwGetKey(g_window, GLFW_KEY_PAGE_DOWN)) {
-			cam_pos.v[1] -= cam_speed * elapsed_seconds;
-			cam_moved = true;
-		}
-		if (glfwGetKey(g_window, GLFW_KEY_W)) {
-			cam_pos.v[2] -= cam_speed * elapsed_seconds;
-			cam_moved = true;
-		}
-		if (glfwGetKey(g_window, GLFW_KEY_S)) {
-			cam_pos.v[2] += cam_speed * elapsed_seconds;
-			cam_moved = true;
-		}
-		if (glfwGetKey(g_window, GLFW_KEY_LEFT)) {
-			cam_yaw += cam_yaw_speed * elapsed_seconds;
-			cam_moved = true;
-		}
-		if (glfwGetKey(g_window, GLFW_KEY_RIGHT)) {
-			cam_yaw -= cam_yaw_speed * elapsed_seconds;
-			cam_moved = true;
-		}
-		if (cam_moved)
-		{
-			mat4 T = translate(identity_mat4(), vec3(-cam_pos.v[0], -cam_pos.v[1], -cam_pos.v[2]));
-			mat4 R = rotate_y_deg(identity_mat4(), -cam_yaw);
-			mat4 view_mat = R * T;
-			glUniformMatrix4fv(view_mat_location, 1, GL_FALSE, view_mat.m);
-		}
-		bool monkey_moved = false;
-		if (glfwGetKey(g_window, 'Z')){
-			bone_theta += bone_rot_speed * elapsed_seconds;
-			g_local_anim[1] = rotate_z_deg(identity_mat4(), bone_theta);
-			g_local_anim[2] = rotate_z_deg(identity_mat4(), -bone_theta);
-			monkey_moved = true;
-		}
-		if (glfwGetKey(g_window, 'X')){
-			bone_theta -= bone_rot_speed * elapsed_seconds;
-			g_local_anim[1] = rotate_z_deg(identity_mat4(), bone_theta);
-			g_local_anim[2] = rotate_z_deg(identity_mat4(), -bone_theta);
-			monkey_moved = true;
-		}
-		if (glfwGetKey(g_window, 'C')){
-			bone_y += 0.5f * elapsed_seconds;
-			g_local_anim[0] = translate(identity_mat4(), vec3(0.0f, bone_y, 0.0f));
-			monkey_moved = true;
-		}
-		if (glfwGetKey(g_window, 'V')){
-			bone_y -= 0.5f * elapsed_seconds;
-			g_local_anim[0] = translate(identity_mat4(), vec3(0.0f, bone_y, 0.0f));
-			monkey_moved = true;
-		}
-		if (monkey_moved)
-		{
-			skeleton_animate(
-				monkey_skeleton_root,
-				identity_mat4(),
-				monkey_bone_offset_matrices,
-				monkey_bone_animation_mats);
-			glUseProgram(shader_programme);
-			glUniformMatrix4fv(
-				bone_matrices_locations[0],
-				monkey_bone_count,
-				GL_FALSE,
-				monkey_bone_animation_mats[0].m);
-		}
-
-		if (GLFW_PRESS == glfwGetKey(g_window, GLFW_KEY_ESCAPE)) {
-			glfwSetWindowShouldClose(g_window, 1);
-		}
-		/* put the stuff we've been drawing onto the display */
-		glfwSwapBuffers(g_window);
-	}
-
-	/* close GL context and any other GLFW resources */
-	glfwTerminate();
-	return 0;
-}
+#include "maths_funcs.h"
+#include "gl_utils.h"
+#include "async_loader.h"
+#include "asset_pack.h"
+#include "resource_cache.h"
+#include "collada_reader.h"
+#include "gpu_memory.h"
+#include "render_queue.h"
+#include "gl_state.h"
+#include "frame_uniforms.h"
+#include "bone_palette.h"
+#include "indirect_draw.h"
+#include "headless_gl.h"
+#include "frame_benchmark.h"
+#include "gl_trace.h"
+#include "timer.h"
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+#include <GLFW/glfw3.h> // GLFW helper library
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#define GL_LOG_FILE "gl.log"
+#define VERTEX_SHADER_FILE "test_vs.glsl"
+#define FRAGMENT_SHADER_FILE "test_fs.glsl"
+#define MESH_FILE "suzanne_skeleton.dae" //"suzanne_bone.dae" //"suzanne.dae"
+#define ARENA_MAX_VERTICES 262144
+#define ARENA_MAX_INDICES 1048576
+// 頂点属性の量子化。0にすると全てfloatで格納する
+#define MESH_VERTEX_FORMAT VERTEX_QUANTIZE_ALL
+// Lキーで実行中に読み込むメッシュと、1フレームあたりのアップロード時間の予算
+#define STREAM_MESH_FILE "suzanne.dae"
+#define MAX_STREAMED_MESHES 256
+#define UPLOAD_BUDGET_MS 2.0
+// GPUへのアップロードに使う永続マップのリングバッファの大きさ
+#define STAGING_RING_SIZE (8 * 1024 * 1024)
+// LODの切り替え。画面上の誤差がこのピクセル数を超えない範囲で粗いLODを使う
+#define LOD_PIXEL_ERROR 1.0f
+#define LOD_CHAIN_COUNT 5
+#define LOD_CHAIN_REDUCTION 0.5f
+// 存在すれば、メッシュやシェーダはディスク上のファイルより先にこのパックから読む
+#define ASSET_PACK_FILE "assets.pak"
+// アリーナに常駐させるメッシュデータの上限。超えると最後に描画されたのが古いものから追い出す
+#define MESH_MEMORY_BUDGET (32 * 1024 * 1024)
+// 1フレームの間だけ使う一時データの上限
+#define FRAME_ALLOCATOR_SIZE (1024 * 1024)
+#define RENDER_QUEUE_CAPACITY 8192
+#define CAMERA_FAR 1000.0f
+// インスタンス描画で1回に描く最大数と、--instancesで並べるときの間隔
+#define MAX_INSTANCES_PER_DRAW 1024
+#define INSTANCE_SPACING 3.0f
+// --staticで並べる動かないメッシュ。メインのメッシュの下にXZ平面の格子で置く
+#define STATIC_SCENE_FILE "suzanne.dae"
+#define STATIC_SCENE_SPACING 4.0f
+#define STATIC_SCENE_HEIGHT -20.0f
+// --benchのカメラ。格子の外側からこの距離を保って原点の周りを回る
+#define BENCH_CAMERA_DISTANCE 8.0f
+#define BENCH_CAMERA_SPEED 30.0f	// 度/秒
+// --animateのボーンの振れ幅(度)と周期(秒)
+#define ANIMATION_SWING 45.0f
+#define ANIMATION_PERIOD 2.0
+
+/* keep track of window size for things like the viewport and the mouse
+cursor */
+int g_gl_width = 640;
+int g_gl_height = 480;
+GLFWwindow* g_window = NULL;
+
+mat4 g_local_anim[MAX_BONES];
+// 後から作られるシェーダバリアントにも設定するため、現在のカメラ行列を保持しておく
+mat4 g_view_mat;
+mat4 g_proj_mat;
+// メッシュレット単位のカリング。Mキーで切り替える
+bool g_meshlet_culling = true;
+Meshlet_Draw_List g_meshlet_draws;
+Frame_Allocator g_frame_allocator;
+Render_Queue g_render_queue;
+// GPUへのアップロードと、フレームごとのuniformブロック・ボーンパレットに使う
+Staging_Ring g_staging_ring;
+// Qキーで切り替える。切ると積んだ順に描く
+bool g_sort_render_queue = true;
+// Kキーで切り替える
+bool g_lod_selection = true;
+// Iキーで切り替える。切ると1インスタンスごとに積む(動的バッチが有効ならキューでまとめられる)
+bool g_instancing = true;
+// ボーンパレットのテクスチャバッファが作れたか。作れなければインスタンス描画と動的バッチを使わない
+bool g_instancing_supported = false;
+// --benchで作る。計測中は入力を無視する
+Frame_Benchmark g_benchmark;
+
+// スケルトン構造を再帰的に辿って、ボーンのアニメーション行列の配列を生成する
+void skeleton_animate(
+	Skeleton_Node* node,
+	mat4 parent_mat,
+	mat4* bone_offset_mats,
+	mat4* bone_animation_mats){
+
+	assert(node);
+
+	mat4 our_mat = parent_mat;			// ボーンの最終的なトランスフォーム行列
+	mat4 local_anim = identity_mat4();	// このフレームにおけるこのボーンに対するアニメーション行列
+
+	int bone_i = node->bone_index;
+	if (bone_i > -1)
+	{
+		mat4 bone_offset = bone_offset_mats[bone_i];
+		mat4 inv_bone_offset = inverse(bone_offset);
+		local_anim = g_local_anim[bone_i];
+
+		our_mat = parent_mat * inv_bone_offset * local_anim * bone_offset;
+		bone_animation_mats[bone_i] = our_mat;
+	}
+	for (int i = 0; i < node->num_children; i++)
+	{
+		skeleton_animate(
+			node->children[i],
+			our_mat,
+			bone_offset_mats,
+			bone_animation_mats
+			);
+	}
+}
+
+// スキニングの最大ボーン影響数ごとのシェーダバリアント
+typedef struct Skin_Programme
+{
+	GLuint programme;
+	int influences;
+	bool instanced;			// モデル行列とパレットをインスタンスごとの属性から読む
+	GLint model_location;
+	GLint position_offset_location;
+	GLint position_scale_location;
+}Skin_Programme;
+
+#define MAX_SKIN_VARIANTS 10
+Skin_Programme g_skin_programmes[MAX_SKIN_VARIANTS];
+int g_skin_programme_count = 0;
+
+// 必要になった時点でバリアントをコンパイルし、uniformのlocationを調べておく。
+// ボーン1本だけのメッシュはウェイトの合成を省いた安価なバリアントになる
+Skin_Programme* get_skin_programme(int max_influences, bool instanced)
+{
+	int influences = skin_variant_influences(max_influences);
+	for (int i = 0; i < g_skin_programme_count; i++)
+	{
+		if (g_skin_programmes[i].influences == influences && g_skin_programmes[i].instanced == instanced)
+		{
+			return &g_skin_programmes[i];
+		}
+	}
+	assert(g_skin_programme_count < MAX_SKIN_VARIANTS);
+	Skin_Programme* sp = &g_skin_programmes[g_skin_programme_count++];
+	char defines[256];
+	vertex_format_defines(MESH_VERTEX_FORMAT, defines, 192);
+	sprintf(
+		defines + strlen(defines),
+		"#define SKIN_INFLUENCES %i\n#define BONE_PALETTE_SIZE %i\n",
+		influences,
+		BONE_PALETTE_SIZE);
+	if (instanced)
+	{
+		strcat(defines, "#define INSTANCED\n");
+	}
+	sp->programme = acquire_programme(
+		VERTEX_SHADER_FILE,
+		FRAGMENT_SHADER_FILE,
+		defines);
+	sp->influences = influences;
+	sp->instanced = instanced;
+
+	gl_state_use_programme(sp->programme);
+	sp->model_location = glGetUniformLocation(sp->programme, "model");
+	glUniformMatrix4fv(sp->model_location, 1, GL_FALSE, identity_mat4().m);
+	sp->position_offset_location = glGetUniformLocation(sp->programme, "position_offset");
+	sp->position_scale_location = glGetUniformLocation(sp->programme, "position_scale");
+	// ボーン行列はインスタンスごとのパレット(uniformブロックかテクスチャバッファ)で渡す
+	return sp;
+}
+
+// LODの選択に使うカメラ。フレームごとに1回だけ求めて、全てのサブメッシュに渡す
+typedef struct Lod_View
+{
+	vec3 camera_position;
+	float pixel_scale;	// 1 / distance あたりのピクセル数
+}Lod_View;
+
+// アップロードしたフレームのuniformから作る
+void make_lod_view(const Frame_Uniforms* uniforms, Lod_View* view)
+{
+	view->camera_position = vec3(
+		uniforms->camera_position[0],
+		uniforms->camera_position[1],
+		uniforms->camera_position[2]);
+	view->pixel_scale = uniforms->proj[5] * g_gl_height * 0.5f;
+}
+
+// 投影したバウンディングスフィアの大きさからLODを選ぶ。previous_lodはそのインスタンスが前フレームに選んだもの
+int choose_submesh_lod(const Submesh* sm, mat4 submesh_model, int previous_lod, const Lod_View* view)
+{
+	if (!g_lod_selection || sm->lod_count <= 1)
+	{
+		return 0;
+	}
+	// 誤差はモデル空間の距離なので、最も大きい軸のスケールで距離を割って比較する
+	float scale = 0.0f;
+	for (int c = 0; c < 3; c++)
+	{
+		vec3 axis(submesh_model.m[c * 4], submesh_model.m[c * 4 + 1], submesh_model.m[c * 4 + 2]);
+		float len = length(axis);
+		if (len > scale)
+		{
+			scale = len;
+		}
+	}
+	vec4 center = submesh_model * vec4(sm->bounds_center, 1.0f);
+	vec3 to_center(
+		center.v[0] - view->camera_position.v[0],
+		center.v[1] - view->camera_position.v[1],
+		center.v[2] - view->camera_position.v[2]);
+	float distance = length(to_center) - sm->bounds_radius * scale;
+	return select_lod(
+		sm->lods,
+		sm->lod_count,
+		previous_lod,
+		scale > 0.0f ? distance / scale : distance,
+		view->pixel_scale,
+		LOD_PIXEL_ERROR);
+}
+
+// 1つのサブメッシュの描画に必要なもの。フレームアロケータから取る
+typedef struct Submesh_Draw
+{
+	Skin_Programme* sp;
+	const Submesh* submesh;
+	mat4 model;
+	int lod;
+	GLuint instanced_vao;	// 動的バッチでまとめて描くときに使う
+	int palette_offset;		// ステージングリング内のボーンパレット。スキニングしないなら-1
+	int instance_offset;	// ステージングリング内のMesh_Instanceの配列
+	int instance_count;		// 0ならインスタンス描画しない
+}Submesh_Draw;
+
+// プログラムとVAOはキューが結んでおく
+void draw_submesh_packet(void* data)
+{
+	Submesh_Draw* draw = (Submesh_Draw*)data;
+	Skin_Programme* sp = draw->sp;
+	const Submesh* sm = draw->submesh;
+	glUniform3fv(sp->position_offset_location, 1, sm->position_offset.v);
+	glUniform3fv(sp->position_scale_location, 1, sm->position_scale.v);
+	if (draw->instance_count > 0)
+	{
+		// インスタンスの属性とパレットはリングから直接読む
+		staging_ring_flush_range(&g_staging_ring, draw->instance_offset, draw->instance_count * sizeof(Mesh_Instance));
+		if (draw->palette_offset >= 0)
+		{
+			staging_ring_flush_range(&g_staging_ring, draw->palette_offset, BONE_PALETTE_BYTES);
+		}
+		mesh_arena_bind_instances(g_staging_ring.buffer, draw->instance_offset);
+		draw_submesh_instanced(sm, draw->lod, draw->instance_count);
+		return;
+	}
+	// サブメッシュごとにノードのトランスフォームを掛ける
+	glUniformMatrix4fv(sp->model_location, 1, GL_FALSE, draw->model.m);
+	if (draw->palette_offset >= 0)
+	{
+		bind_bone_palette(&g_staging_ring, draw->palette_offset);
+	}
+	// メッシュレットはLOD0にしか無い
+	if (g_meshlet_culling && sm->meshlet_count > 0 && draw->lod == 0)
+	{
+		// 視錐台と視点をモデル空間に移して判定する
+		Frustum frustum;
+		extract_frustum(g_proj_mat * g_view_mat * draw->model, &frustum);
+		mat4 inv_view = inverse(g_view_mat);
+		vec4 camera = inverse(draw->model) * vec4(inv_view.m[12], inv_view.m[13], inv_view.m[14], 1.0f);
+		g_meshlet_draws.draw_count = 0;
+		cull_meshlets(
+			sm->meshlets,
+			sm->meshlet_count,
+			&frustum,
+			vec3(camera.v[0], camera.v[1], camera.v[2]),
+			sm->first_index,
+			sm->base_vertex,
+			&g_meshlet_draws);
+		draw_meshlet_list(&g_meshlet_draws);
+	}
+	else
+	{
+		draw_submesh(sm, draw->lod);
+	}
+}
+
+// 同じサブメッシュを1つずつ積んだパケットが続いたとき、キューがまとめて呼ぶ。
+// インスタンス描画のバリアントに切り替え、各パケットのモデル行列とパレットをインスタンスの属性にする。
+// batch_keyはサブメッシュのLODなので、まとめたパケットは全て同じLOD。メッシュレットのカリングは行わない
+void draw_submesh_batch(void** datas, int count)
+{
+	Submesh_Draw* first = (Submesh_Draw*)datas[0];
+	const Submesh* sm = first->submesh;
+	Skin_Programme* sp = get_skin_programme(sm->max_influences, true);
+	int instance_offset;
+	Mesh_Instance* instances = (Mesh_Instance*)staging_ring_alloc(
+		&g_staging_ring,
+		count * sizeof(Mesh_Instance),
+		16,
+		&instance_offset);
+	if (!instances)
+	{
+		// リングが一杯なら、キューが結んだプログラムとVAOのまま1つずつ描く
+		for (int i = 0; i < count; i++)
+		{
+			draw_submesh_packet(datas[i]);
+		}
+		return;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		Submesh_Draw* draw = (Submesh_Draw*)datas[i];
+		memcpy(instances[i].model, draw->model.m, sizeof(instances[i].model));
+		instances[i].palette_texel = 0;
+		if (draw->palette_offset >= 0)
+		{
+			instances[i].palette_texel = bone_palette_texel(draw->palette_offset);
+			staging_ring_flush_range(&g_staging_ring, draw->palette_offset, BONE_PALETTE_BYTES);
+		}
+	}
+	staging_ring_flush_range(&g_staging_ring, instance_offset, count * sizeof(Mesh_Instance));
+	gl_state_use_programme(sp->programme);
+	gl_state_bind_vertex_array(first->instanced_vao);
+	glUniform3fv(sp->position_offset_location, 1, sm->position_offset.v);
+	glUniform3fv(sp->position_scale_location, 1, sm->position_scale.v);
+	mesh_arena_bind_instances(g_staging_ring.buffer, instance_offset);
+	draw_submesh_instanced(sm, first->lod, count);
+}
+
+// スキニングするサブメッシュがあれば、インスタンスのボーン行列(NULLなら単位行列)をパレットに書き込む。無ければ-1。
+// リングが一杯で書き込めなければfalse
+bool write_scene_mesh_palette(Scene_Mesh* scene_mesh, const mat4* bone_mats, int* palette_offset)
+{
+	*palette_offset = -1;
+	for (int i = 0; i < scene_mesh->submesh_count; i++)
+	{
+		if (skin_variant_influences(scene_mesh->submeshes[i].max_influences) > 0)
+		{
+			*palette_offset = write_bone_palette(&g_staging_ring, bone_mats, scene_mesh->bone_count);
+			return *palette_offset >= 0;
+		}
+	}
+	return true;
+}
+
+// サブメッシュを1つ、プログラム・マテリアル・サブメッシュのLOD・深度のキーでキューに積む
+void submit_submesh_packet(const Submesh* sm, mat4 submesh_model, int lod, const Mesh_Arena* arena, int palette_offset)
+{
+	// 最大ボーン影響数に合ったバリアントで描画する
+	Skin_Programme* sp = get_skin_programme(sm->max_influences, false);
+	GLuint vao = arena->vao;
+	// バウンディングスフィアの中心のビュー空間の深さで並べる
+	vec4 center = g_view_mat * (submesh_model * vec4(sm->bounds_center, 1.0f));
+	// 1回の描画では1つのLODしか使えないので、サブメッシュのLODごとにまとめる
+	const void* batch_key = g_instancing_supported ? &sm->lods[lod] : NULL;
+	Submesh_Draw* draw = (Submesh_Draw*)frame_alloc(&g_frame_allocator, sizeof(Submesh_Draw));
+	Draw_Packet* packet = draw ? submit_draw_packet(
+		&g_render_queue,
+		make_render_key(RENDER_PASS_OPAQUE, sp->programme, sm->material_index, vao, batch_key, -center.v[2] / CAMERA_FAR)) : NULL;
+	if (!packet)
+	{
+		return;
+	}
+	draw->sp = sp;
+	draw->submesh = sm;
+	draw->model = submesh_model;
+	draw->lod = lod;
+	draw->instanced_vao = arena->instanced_vao;
+	draw->palette_offset = sp->influences > 0 ? palette_offset : -1;
+	draw->instance_offset = 0;
+	draw->instance_count = 0;
+	packet->programme = sp->programme;
+	packet->vao = vao;
+	packet->state = RENDER_STATE_DEPTH_TEST;
+	packet->draw = draw_submesh_packet;
+	packet->data = draw;
+	packet->batch = batch_key ? draw_submesh_batch : NULL;
+	packet->batch_key = batch_key;
+}
+
+// サブメッシュごとにLODを選び、プログラム・マテリアル・サブメッシュのLOD・深度のキーでキューに積む。
+// 同じサブメッシュのLODが続けば、インスタンス描画が使えるときはキューが自動でまとめる。
+// lodsはこのインスタンスのサブメッシュごとに前フレームに選んだLOD。選んだものを書き戻す。NULLなら毎回LOD0から選ぶ
+void submit_scene_mesh(
+	Scene_Mesh* scene_mesh,
+	mat4 model_matrix,
+	int* lods,
+	const Lod_View* view,
+	const Mesh_Arena* arena,
+	int palette_offset)
+{
+	for (int i = 0; i < scene_mesh->submesh_count; i++)
+	{
+		const Submesh* sm = &scene_mesh->submeshes[i];
+		mat4 submesh_model = model_matrix * sm->transform;
+		int lod = choose_submesh_lod(sm, submesh_model, lods ? lods[i] : 0, view);
+		if (lods)
+		{
+			lods[i] = lod;
+		}
+		submit_submesh_packet(sm, submesh_model, lod, arena, palette_offset);
+	}
+}
+
+// 同じメッシュをcount個描く。インスタンス描画が有効で2個以上なら、サブメッシュとLODの組ごとに最大MAX_INSTANCES_PER_DRAW個を1回で描く。
+// 全てのインスタンスが同じボーン行列(bone_mats)を使う。
+// lodsはインスタンスごと・サブメッシュごとのLOD(count * submesh_count個、インスタンス順)。NULLでもよい
+void submit_scene_mesh_instances(
+	Scene_Mesh* scene_mesh,
+	const mat4* models,
+	int* lods,
+	int count,
+	const Lod_View* view,
+	const Mesh_Arena* arena,
+	const mat4* bone_mats)
+{
+	int palette_offset;
+	if (!write_scene_mesh_palette(scene_mesh, bone_mats, &palette_offset))
+	{
+		// パレットが無いとスキニングできないので、このフレームは描かない
+		return;
+	}
+	// 1つだけならインスタンス描画にしても得は無い。1つずつ積めばメッシュレットのカリングが効き、
+	// 同じサブメッシュが他にもあればキューの動的バッチでまとまる
+	if (!g_instancing || count == 1)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			submit_scene_mesh(
+				scene_mesh,
+				models[i],
+				lods ? lods + i * scene_mesh->submesh_count : NULL,
+				view,
+				arena,
+				palette_offset);
+		}
+		return;
+	}
+	// LODはインスタンスごとに選ぶので、lodsが無ければこのフレームだけの置き場を使う(毎回LOD0から選ぶ)
+	int submesh_count = scene_mesh->submesh_count;
+	if (!lods)
+	{
+		lods = (int*)frame_alloc(&g_frame_allocator, count * submesh_count * sizeof(int));
+		if (!lods)
+		{
+			return;
+		}
+		memset(lods, 0, count * submesh_count * sizeof(int));
+	}
+	GLuint palette_texel = palette_offset >= 0 ? bone_palette_texel(palette_offset) : 0;
+	for (int i = 0; i < submesh_count; i++)
+	{
+		const Submesh* sm = &scene_mesh->submeshes[i];
+		Skin_Programme* sp = get_skin_programme(sm->max_influences, true);
+		// 1回の描画では1つのLODしか使えないので、先に全インスタンスのLODを選んでLODごとに分けて描く
+		int lod_counts[MAX_MESH_LODS];
+		memset(lod_counts, 0, sizeof(lod_counts));
+		for (int j = 0; j < count; j++)
+		{
+			mat4 instance_model = models[j];
+			int* lod = &lods[j * submesh_count + i];
+			*lod = choose_submesh_lod(sm, instance_model * sm->transform, *lod, view);
+			lod_counts[*lod]++;
+		}
+		for (int lod = 0; lod < MAX_MESH_LODS; lod++)
+		{
+			int next = 0;	// このLODのインスタンスを次に探し始める位置
+			for (int first = 0; first < lod_counts[lod]; first += MAX_INSTANCES_PER_DRAW)
+			{
+				int n = lod_counts[lod] - first < MAX_INSTANCES_PER_DRAW ? lod_counts[lod] - first : MAX_INSTANCES_PER_DRAW;
+				int instance_offset;
+				Mesh_Instance* instances = (Mesh_Instance*)staging_ring_alloc(
+					&g_staging_ring,
+					n * sizeof(Mesh_Instance),
+					16,
+					&instance_offset);
+				// 深さはまとめたうちで最も手前のもの
+				float depth = CAMERA_FAR;
+				for (int k = 0; k < n; next++)
+				{
+					if (lods[next * submesh_count + i] != lod)
+					{
+						continue;
+					}
+					mat4 instance_model = models[next];
+					mat4 submesh_model = instance_model * sm->transform;
+					// リングが一杯なら1つずつ積む(リングを使わずに描ける)
+					if (!instances)
+					{
+						submit_submesh_packet(sm, submesh_model, lod, arena, palette_offset);
+						k++;
+						continue;
+					}
+					vec4 center = g_view_mat * (submesh_model * vec4(sm->bounds_center, 1.0f));
+					if (-center.v[2] < depth)
+					{
+						depth = -center.v[2];
+					}
+					memcpy(instances[k].model, submesh_model.m, sizeof(instances[k].model));
+					instances[k].palette_texel = palette_texel;
+					k++;
+				}
+				if (!instances)
+				{
+					continue;
+				}
+				Submesh_Draw* draw = (Submesh_Draw*)frame_alloc(&g_frame_allocator, sizeof(Submesh_Draw));
+				Draw_Packet* packet = draw ? submit_draw_packet(
+					&g_render_queue,
+					make_render_key(RENDER_PASS_OPAQUE, sp->programme, sm->material_index, arena->instanced_vao, NULL, depth / CAMERA_FAR)) : NULL;
+				if (!packet)
+				{
+					continue;
+				}
+				draw->sp = sp;
+				draw->submesh = sm;
+				draw->model = identity_mat4();
+				draw->lod = lod;
+				draw->palette_offset = sp->influences > 0 ? palette_offset : -1;
+				draw->instance_offset = instance_offset;
+				draw->instance_count = n;
+				packet->programme = sp->programme;
+				packet->vao = arena->instanced_vao;
+				packet->state = RENDER_STATE_DEPTH_TEST;
+				packet->draw = draw_submesh_packet;
+				packet->data = draw;
+			}
+		}
+	}
+}
+
+// 動かないメッシュはインスタンス描画のバリアントで、位置の復元を畳み込んだモデル行列を使う
+void draw_static_packet(void* data)
+{
+	Skin_Programme* sp = get_skin_programme(0, true);
+	glUniform3f(sp->position_offset_location, 0.0f, 0.0f, 0.0f);
+	glUniform3f(sp->position_scale_location, 1.0f, 1.0f, 1.0f);
+	draw_static_draw_list((Static_Draw_List*)data);
+}
+
+void draw_points_packet(void* data)
+{
+	trace_gl_draw_arrays(GL_POINTS, 0, *(int*)data);
+}
+
+// ヘッドレスとベンチマークでは入力を使わないので常にfalse
+static bool key_down(int key)
+{
+	return !g_headless && !benchmark_active(&g_benchmark) && GLFW_PRESS == glfwGetKey(g_window, key);
+}
+
+// frame_limitが0ならウィンドウが閉じられるまで続ける
+static bool keep_running(int frame, int frame_limit)
+{
+	if (frame_limit > 0 && frame >= frame_limit)
+	{
+		return false;
+	}
+	return g_headless || !glfwWindowShouldClose(g_window);
+}
+
+int main(int argc, char** argv) {
+	assert(restart_gl_log());
+	int monkey_instances = 1;
+	int static_instances = 0;
+	int frame_limit = 0;
+	const char* capture_file = NULL;
+	const char* mesh_file = MESH_FILE;
+	bool animate = false;
+	int bench_frames = 0;
+	const char* bench_file = BENCH_JSON_FILE;
+	bool headless = false;
+	int headless_width = g_gl_width;
+	int headless_height = g_gl_height;
+	const char* trace_file = NULL;
+	const char* replay_file = NULL;
+	Trace_Replay_Options replay_options;
+	memset(&replay_options, 0, sizeof(Trace_Replay_Options));
+	replay_options.repeat = 1;
+	// 環境変数でも選べる。値が解像度ならそれを使う
+	const char* headless_env = getenv(HEADLESS_ENV);
+	if (headless_env && headless_env[0] && strcmp(headless_env, "0") != 0)
+	{
+		headless = true;
+		parse_headless_size(headless_env, &headless_width, &headless_height);
+	}
+	// --bench-culling: ウィンドウを作らずにメッシュレットのカリング速度を測って終わる
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--bench-culling") == 0)
+		{
+			benchmark_meshlet_culling(256, 1000);
+			return 0;
+		}
+		// --build-pack <pack> <files...>: 指定したファイルをアセットパックにまとめて終わる
+		if (strcmp(argv[i], "--build-pack") == 0 && i + 2 < argc)
+		{
+			return build_asset_pack(argv[i + 1], (const char**)&argv[i + 2], argc - i - 2) ? 0 : 1;
+		}
+		// --bench-import <file>: ストリーミングのCOLLADAリーダーとassimpの読み込み時間を比べて終わる
+		if (strcmp(argv[i], "--bench-import") == 0 && i + 1 < argc)
+		{
+			benchmark_collada_import(argv[i + 1], 10);
+			return 0;
+		}
+		// --static <n>: 動かないメッシュをn個並べ、multi-draw-indirectで描く
+		if (strcmp(argv[i], "--static") == 0 && i + 1 < argc)
+		{
+			static_instances = atoi(argv[++i]);
+		}
+		// --headless [WxH]: ウィンドウを作らずオフスクリーンのFBOに描く
+		if (strcmp(argv[i], "--headless") == 0)
+		{
+			headless = true;
+			if (i + 1 < argc && parse_headless_size(argv[i + 1], &headless_width, &headless_height))
+			{
+				i++;
+			}
+		}
+		// --frames <n>: nフレーム描いたら終わる。ヘッドレスで省略するとHEADLESS_DEFAULT_FRAMES
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+		{
+			frame_limit = atoi(argv[++i]);
+		}
+		// --capture <file>: ヘッドレスで最後に描いたフレームをPPMに書き出す
+		if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+		{
+			capture_file = argv[++i];
+		}
+		// --bench <n>: 固定のタイムステップと決まったカメラでnフレーム測り、結果をJSONに書いて終わる
+		if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+		{
+			bench_frames = atoi(argv[++i]);
+		}
+		// --bench-out <file>: ベンチマークの結果の書き出し先
+		if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc)
+		{
+			bench_file = argv[++i];
+		}
+		// --mesh <file>: メインのメッシュを差し替える
+		if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+		{
+			mesh_file = argv[++i];
+		}
+		// --animate: ボーンを時間で揺らす
+		if (strcmp(argv[i], "--animate") == 0)
+		{
+			animate = true;
+		}
+		// --trace <file>: GLEWを通るGLの呼び出しをファイルに記録する
+		if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+		{
+			trace_file = argv[++i];
+		}
+		// --replay <file>: 記録したトレースを再生し、呼び出しごとの回数と時間を表示して終わる
+		if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+		{
+			replay_file = argv[++i];
+		}
+		// --replay-frames <first> <count>: 再生するフレームの範囲。既定は全部
+		if (strcmp(argv[i], "--replay-frames") == 0 && i + 2 < argc)
+		{
+			replay_options.first_frame = atoi(argv[++i]);
+			replay_options.frame_count = atoi(argv[++i]);
+		}
+		// --replay-repeat <n>: 範囲をn回繰り返して発行のコストを測る
+		if (strcmp(argv[i], "--replay-repeat") == 0 && i + 1 < argc)
+		{
+			replay_options.repeat = atoi(argv[++i]);
+		}
+		// --replay-null: GLを呼ばずに再生する(読み出しのコストだけを測る)
+		if (strcmp(argv[i], "--replay-null") == 0)
+		{
+			replay_options.null_backend = true;
+		}
+		// --instances <n>: メインのメッシュをn個、格子状に並べて描く
+		if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+		{
+			monkey_instances = atoi(argv[++i]);
+			if (monkey_instances < 1)
+			{
+				monkey_instances = 1;
+			}
+		}
+	}
+	// nullバックエンドの再生にはコンテキストが要らない
+	if (replay_file && replay_options.null_backend)
+	{
+		return replay_gl_trace(replay_file, &replay_options) ? 0 : 1;
+	}
+	if (headless)
+	{
+		// assertはRelease(NDEBUG)で消えるので、必ず呼んで結果を見る
+		if (!start_headless_gl(headless_width, headless_height))
+		{
+			gl_log_err("ERROR: could not start headless GL (%ix%i)\n", headless_width, headless_height);
+			return 1;
+		}
+		if (frame_limit <= 0)
+		{
+			frame_limit = HEADLESS_DEFAULT_FRAMES;
+		}
+	}
+	else
+	{
+		assert(start_gl());
+	}
+	if (replay_file)
+	{
+		bool replayed = replay_gl_trace(replay_file, &replay_options);
+		if (g_headless)
+		{
+			stop_headless_gl();
+		}
+		else
+		{
+			glfwTerminate();
+		}
+		return replayed ? 0 : 1;
+	}
+	// ステージングリングなどを作る前に始め、オブジェクトの作成から記録する
+	if (trace_file)
+	{
+		if (!start_gl_trace(trace_file))
+		{
+			return 1;
+		}
+	}
+	if (bench_frames > 0)
+	{
+		// ウォームアップの分も含めて回したら終わる
+		if (!create_frame_benchmark(&g_benchmark, bench_frames, BENCH_WARMUP_FRAMES))
+		{
+			gl_log_err("ERROR: could not start benchmark of %i frames\n", bench_frames);
+			return 1;
+		}
+		frame_limit = benchmark_total_frames(&g_benchmark);
+		if (!g_headless)
+		{
+			glfwSwapInterval(0);
+		}
+		printf("benchmark: %i frames after %i warmup frames\n", bench_frames, BENCH_WARMUP_FRAMES);
+	}
+
+	// パックの展開はジョブシステムで並列に行うので、読み込みより先に起動しておく
+	if (!start_async_loader(0))
+	{
+		gl_log_err("ERROR: could not start async loader\n");
+		return 1;
+	}
+	Asset_Pack asset_pack;
+	bool asset_pack_mounted = asset_exists(ASSET_PACK_FILE) && open_asset_pack(ASSET_PACK_FILE, &asset_pack);
+	if (asset_pack_mounted)
+	{
+		mount_asset_pack(&asset_pack);
+	}
+
+	/* tell GL to only draw onto a pixel if the shape is closer to the viewer*/
+	gl_state_set_capability(GL_DEPTH_TEST, true); /* enable depth-testing */
+	gl_state_depth_func(GL_LESS); /* depth-testing interprets a smaller value as"closer" */
+	gl_state_set_capability(GL_CULL_FACE, true); // cull face
+	glCullFace(GL_BACK); // cull back face
+	glFrontFace(GL_CCW); // GL_CCW for counter clock-wise
+	gl_state_clear_colour(0.6f, 0.6f, 0.6f, 1.0f);
+	gl_state_viewport(0, 0, g_gl_width, g_gl_height);
+
+	set_lod_chain_settings(LOD_CHAIN_COUNT, LOD_CHAIN_REDUCTION);
+	set_gpu_memory_budget(MESH_MEMORY_BUDGET);
+	init_frame_allocator(&g_frame_allocator, "frame", FRAME_ALLOCATOR_SIZE);
+	if (!create_render_queue(&g_render_queue, RENDER_QUEUE_CAPACITY))
+	{
+		return 1;
+	}
+	if (!create_staging_ring(&g_staging_ring, STAGING_RING_SIZE))
+	{
+		return 1;
+	}
+	// インスタンス描画ではボーンパレットをリング全体のテクスチャバッファから読む
+	g_instancing_supported = create_bone_palette_texture(&g_staging_ring);
+	g_instancing = g_instancing && g_instancing_supported;
+
+	// 全メッシュの頂点・インデックスを格納する共有アリーナ
+	Mesh_Arena mesh_arena;
+	if (!create_mesh_arena(&mesh_arena, ARENA_MAX_VERTICES, ARENA_MAX_INDICES, MESH_VERTEX_FORMAT))
+	{
+		gl_log_err("ERROR: could not create mesh arena\n");
+		return 1;
+	}
+	mesh_arena.staging = &g_staging_ring;
+
+	// load the mesh using assimp
+	Mesh_Handle monkey_handle = acquire_mesh(mesh_file, &mesh_arena, false);
+	Scene_Mesh* monkey = get_mesh(monkey_handle);
+	assert(monkey);
+	// スケルトンなどへのポインタを持ち続けるので追い出さない
+	pin_mesh(monkey_handle, true);
+	// キャッシュしたメッシュは他でも共有するので、書き換える前に手元に写す
+	mat4 monkey_bone_offset_matrices[MAX_BONES];
+	for (int i = 0; i < MAX_BONES; i++)
+	{
+		monkey_bone_offset_matrices[i] = monkey->bone_offset_mats[i];
+	}
+	Skeleton_Node* monkey_skeleton_root = monkey->skeleton_root;
+	int monkey_bone_count = monkey->bone_count;
+	printf("%s bone count: %i\n", mesh_file, monkey_bone_count);
+
+	mat4 monkey_bone_animation_mats[MAX_BONES];
+	for (int i = 0; i < MAX_BONES; i++) {
+		monkey_bone_animation_mats[i] = identity_mat4();
+		monkey_bone_offset_matrices[i] = identity_mat4();
+		monkey_bone_animation_mats[i] = identity_mat4();
+		g_local_anim[i] = identity_mat4();
+	}
+
+	// bone位置確認用のバッファ作成とボーン位置行列の表示
+	float bone_positions[3 * 256];
+	int c = 0;
+	for (int i = 0; i < monkey_bone_count; i++)
+	{
+		print(monkey_bone_offset_matrices[i]);
+
+		bone_positions[c++] = -monkey_bone_offset_matrices[i].m[12];
+		bone_positions[c++] = -monkey_bone_offset_matrices[i].m[13];
+		bone_positions[c++] = -monkey_bone_offset_matrices[i].m[14];
+	}
+	GLuint bones_vao;
+	glGenVertexArrays(1, &bones_vao);
+	gl_state_bind_vertex_array(bones_vao);
+	GLuint bones_vbo;
+	glGenBuffers(1, &bones_vbo);
+	gpu_buffer_data(
+		bones_vbo,
+		GL_ARRAY_BUFFER,
+		3 * monkey_bone_count * sizeof(float),
+		bone_positions,
+		GL_STATIC_DRAW,
+		GPU_MEMORY_VERTEX,
+		"bone markers");
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	glEnableVertexAttribArray(0);
+
+	/* load shaders from files here */
+	GLuint bones_shader_programme = acquire_programme("bones_vs.glsl", "bones_fs.glsl", NULL);
+
+	// make view matrix
+	vec3 cam_pos = vec3(0.0f, 0.0f, 300.0f);
+	vec3 target_pos = vec3( 0.0f, 0.0f, 0.0f );
+	vec3 up_vec = vec3(0.0f, 1.0f, 0.0f);
+	mat4 viewMat = look_at(cam_pos, target_pos, up_vec);
+	// make projection matrix
+	float near = 0.1f;
+	float far = CAMERA_FAR;
+	float fov = 67.0f * ONE_DEG_IN_RAD;
+	float aspect = (float)g_gl_width / (float)g_gl_height;
+	mat4 projMat = perspective(fov, aspect, near, far);
+	// make projection-view Matrix
+	mat4 pvMat = projMat * viewMat;
+
+	// view/projはフレームごとのuniformブロックで全てのプログラムに渡す
+	// メッシュが使うバリアントを先に作っておく
+	g_view_mat = viewMat;
+	g_proj_mat = projMat;
+	mat4 model_matrix = identity_mat4();
+	for (int i = 0; i < monkey->submesh_count; i++)
+	{
+		get_skin_programme(monkey->submeshes[i].max_influences, false);
+		get_skin_programme(monkey->submeshes[i].max_influences, true);
+	}
+	// 原点を中心にXY平面の格子に並べる。1個なら原点に置く
+	mat4* monkey_models = (mat4*)malloc(monkey_instances * sizeof(mat4));
+	int monkey_columns = (int)ceil(sqrt((double)monkey_instances));
+	for (int i = 0; i < monkey_instances; i++)
+	{
+		float x = (i % monkey_columns - (monkey_columns - 1) * 0.5f) * INSTANCE_SPACING;
+		float y = (i / monkey_columns - (monkey_columns - 1) * 0.5f) * INSTANCE_SPACING;
+		monkey_models[i] = translate(model_matrix, vec3(x, y, 0.0f));
+	}
+	// インスタンスごと・サブメッシュごとに前フレームに選んだLOD(ヒステリシス用)
+	int* monkey_lods = (int*)calloc(monkey_instances * monkey->submesh_count, sizeof(int));
+	printf("%s instances: %i\n", mesh_file, monkey_instances);
+
+	// 動かない背景。コマンドはフレームをまたいで使い回し、変わった分だけ書き換える
+	Static_Draw_List static_draws;
+	memset(&static_draws, 0, sizeof(Static_Draw_List));
+	Mesh_Handle static_handle = INVALID_MESH_HANDLE;
+	Scene_Mesh* static_mesh = NULL;
+	if (static_instances > 0)
+	{
+		static_handle = acquire_mesh(STATIC_SCENE_FILE, &mesh_arena, false);
+		static_mesh = get_mesh(static_handle);
+	}
+	if (static_mesh && create_static_draw_list(&static_draws, static_instances * static_mesh->submesh_count))
+	{
+		// 描画リストがサブメッシュを指し続けるので追い出さない
+		pin_mesh(static_handle, true);
+		int static_columns = (int)ceil(sqrt((double)static_instances));
+		for (int i = 0; i < static_instances; i++)
+		{
+			float x = (i % static_columns - (static_columns - 1) * 0.5f) * STATIC_SCENE_SPACING;
+			float z = (i / static_columns - (static_columns - 1) * 0.5f) * STATIC_SCENE_SPACING;
+			mat4 static_model = translate(rotate_y_deg(identity_mat4(), i * 37.0f), vec3(x, STATIC_SCENE_HEIGHT, z));
+			for (int j = 0; j < static_mesh->submesh_count; j++)
+			{
+				Submesh* sm = &static_mesh->submeshes[j];
+				add_static_draw(&static_draws, sm, static_model * sm->transform);
+			}
+		}
+		get_skin_programme(0, true);
+		printf("%s static instances: %i (%i draws)\n", STATIC_SCENE_FILE, static_instances, static_draws.count);
+	}
+	
+	float cam_speed = 3.0f;
+	float cam_yaw = 0.0f;
+	float cam_yaw_speed = 5.0f;
+
+	float model_speed = 1.0f;
+	float model_last_position = 0.0f;
+	// GLFWを使わないヘッドレスのコンテキストでも測れるように、起動からの時間を使う
+	double start_seconds = get_precise_time();
+	double previous_seconds = 0.0;
+
+	// スケルトンアニメーション用パラメータ
+	float bone_theta = 0.0f;
+	float bone_y = 0.0f;
+	float bone_rot_speed = 50.0f;
+
+	// 実行中に読み込むメッシュ。インポートはワーカースレッドで行う
+	// 同じファイルは一度だけ読み込まれ、全てのインスタンスで共有される
+	Mesh_Handle streamed_meshes[MAX_STREAMED_MESHES];
+	// サブメッシュの数は読み込みが終わるまで分からないので、最初に描くときに確保する
+	int* streamed_lods[MAX_STREAMED_MESHES];
+	memset(streamed_lods, 0, sizeof(streamed_lods));
+	int streamed_mesh_count = 0;
+	bool unload_key_down = false;
+	bool load_key_down = false;
+	bool cull_key_down = false;
+	bool lod_key_down = false;
+	bool sort_key_down = false;
+	bool instancing_key_down = false;
+	bool batching_key_down = false;
+
+	int frame = 0;
+	while (keep_running(frame, frame_limit)) {
+		// ベンチマークでは実時間の代わりに固定のタイムステップで進める
+		double current_seconds = benchmark_active(&g_benchmark) ?
+			benchmark_time(&g_benchmark) : get_precise_time() - start_seconds;
+		double elapsed_seconds = current_seconds - previous_seconds;
+		previous_seconds = current_seconds;
+		if (!g_headless)
+		{
+			update_fps_counter(g_window);
+		}
+		begin_benchmark_frame(&g_benchmark);
+		begin_frame_allocator(&g_frame_allocator);
+		begin_bone_palette_frame();
+
+		// 入力の代わりに決まった経路でカメラを回す。格子全体が入るように離れる
+		if (benchmark_active(&g_benchmark))
+		{
+			float orbit = BENCH_CAMERA_DISTANCE + monkey_columns * INSTANCE_SPACING;
+			float angle = (float)(current_seconds * BENCH_CAMERA_SPEED * ONE_DEG_IN_RAD);
+			vec3 eye = vec3(sinf(angle) * orbit, orbit * 0.25f, cosf(angle) * orbit);
+			g_view_mat = look_at(eye, vec3(0.0f, 0.0f, 0.0f), up_vec);
+		}
+		if (animate && monkey_skeleton_root)
+		{
+			float swing = ANIMATION_SWING * (float)sin(current_seconds * TAU / ANIMATION_PERIOD);
+			g_local_anim[1] = rotate_z_deg(identity_mat4(), swing);
+			g_local_anim[2] = rotate_z_deg(identity_mat4(), -swing);
+			skeleton_animate(
+				monkey_skeleton_root,
+				identity_mat4(),
+				monkey_bone_offset_matrices,
+				monkey_bone_animation_mats);
+		}
+		
+		/* wipe the drawing surface clear */
+		trace_gl_clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		gl_state_viewport(0, 0, g_gl_width, g_gl_height);
+		
+		// draw mesh
+		// udpate model matrix
+		/*model_matrix.m[12] = elapsed_seconds * model_speed + model_last_position;
+		model_last_position = model_matrix.m[12];
+		if (fabs(model_last_position) > 1.0)
+			model_speed = -model_speed;
+		glUniformMatrix4fv(model_location, 1, GL_FALSE, model_matrix.m);*/
+
+		// 読み込みが終わったメッシュを予算の範囲でアップロードする
+		pump_async_uploads(UPLOAD_BUDGET_MS);
+		update_resource_cache();
+
+		// カメラは全てのプログラムで共有するので、描画を積む前に1回だけ書き込む
+		Frame_Uniforms frame_uniforms;
+		if (!upload_frame_uniforms(&g_staging_ring, g_view_mat, g_proj_mat, (float)current_seconds, &frame_uniforms))
+		{
+			gl_log_err("ERROR: staging ring full, frame uniforms not updated\n");
+		}
+		Lod_View lod_view;
+		make_lod_view(&frame_uniforms, &lod_view);
+		mark_benchmark_phase(&g_benchmark, BENCH_PHASE_UPDATE);
+
+		// 描画はキューに積み、ソートしてからまとめて発行する
+		begin_render_queue(&g_render_queue);
+		reset_meshlet_draw_list(&g_meshlet_draws);
+		submit_scene_mesh_instances(
+			monkey,
+			monkey_models,
+			monkey_lods,
+			monkey_instances,
+			&lod_view,
+			&mesh_arena,
+			monkey_bone_animation_mats);
+		for (int i = 0; i < streamed_mesh_count; i++)
+		{
+			// 読み込み中のものは飛ばす。追加した順に右へ並べる
+			Scene_Mesh* streamed = get_mesh(streamed_meshes[i]);
+			if (!streamed)
+			{
+				continue;
+			}
+			if (!streamed_lods[i])
+			{
+				streamed_lods[i] = (int*)calloc(streamed->submesh_count, sizeof(int));
+			}
+			mat4 streamed_model = translate(identity_mat4(), vec3(3.0f * (i + 1), 0.0f, 0.0f));
+			submit_scene_mesh_instances(streamed, &streamed_model, streamed_lods[i], 1, &lod_view, &mesh_arena, NULL);
+		}
+
+		if (static_draws.count > 0)
+		{
+			update_static_draw_list(
+				&static_draws,
+				g_view_mat,
+				g_proj_mat,
+				lod_view.pixel_scale,
+				g_lod_selection ? LOD_PIXEL_ERROR : 0.0f);
+			Skin_Programme* static_sp = get_skin_programme(0, true);
+			Draw_Packet* static_packet = submit_draw_packet(
+				&g_render_queue,
+				make_render_key(RENDER_PASS_OPAQUE, static_sp->programme, 0, mesh_arena.instanced_vao, NULL, 0.0f));
+			if (static_packet)
+			{
+				static_packet->programme = static_sp->programme;
+				static_packet->vao = mesh_arena.instanced_vao;
+				static_packet->state = RENDER_STATE_DEPTH_TEST;
+				static_packet->draw = draw_static_packet;
+				static_packet->data = &static_draws;
+			}
+		}
+
+		// ボーン位置は深度テスト無しで最後に描く
+		int* bone_point_count = (int*)frame_alloc(&g_frame_allocator, sizeof(int));
+		Draw_Packet* bones_packet = bone_point_count ? submit_draw_packet(
+			&g_render_queue,
+			make_render_key(RENDER_PASS_OVERLAY, bones_shader_programme, 0, bones_vao, NULL, 0.0f)) : NULL;
+		if (bones_packet)
+		{
+			*bone_point_count = monkey_bone_count;
+			bones_packet->programme = bones_shader_programme;
+			bones_packet->vao = bones_vao;
+			bones_packet->state = RENDER_STATE_PROGRAM_POINT_SIZE;
+			bones_packet->draw = draw_points_packet;
+			bones_packet->data = bone_point_count;
+		}
+		mark_benchmark_phase(&g_benchmark, BENCH_PHASE_SUBMIT);
+		if (g_sort_render_queue)
+		{
+			sort_render_queue(&g_render_queue);
+		}
+		mark_benchmark_phase(&g_benchmark, BENCH_PHASE_SORT);
+		flush_render_queue(&g_render_queue);
+		mark_benchmark_phase(&g_benchmark, BENCH_PHASE_FLUSH);
+
+		/* update other events like input handling */
+		if (g_window)
+		{
+			glfwPollEvents();
+		}
+
+		// control keys
+		bool cam_moved = false;
+		if (key_down(GLFW_KEY_A)) {
+			cam_pos.v[0] -= cam_speed * elapsed_seconds;
+			cam_moved = true;
+		}
+		if (key_down(GLFW_KEY_D)) {
+			cam_pos.v[0] += cam_speed * elapsed_seconds;
+			cam_moved = true;
+		}
+		if (key_down(GLFW_KEY_PAGE_UP)) {
+			cam_pos.v[1] += cam_speed * elapsed_seconds;
+			cam_moved = true;
+		}
+		if (key_down(GLFW_KEY_PAGE_DOWN)) {
+			cam_pos.v[1] -= cam_speed * elapsed_seconds;
+			cam_moved = true;
+		}
+		if (key_down(GLFW_KEY_W)) {
+			cam_pos.v[2] -= cam_speed * elapsed_seconds;
+			cam_moved = true;
+		}
+		if (key_down(GLFW_KEY_S)) {
+			cam_pos.v[2] += cam_speed * elapsed_seconds;
+			cam_moved = true;
+		}
+		if (key_down(GLFW_KEY_LEFT)) {
+			cam_yaw += cam_yaw_speed * elapsed_seconds;
+			cam_moved = true;
+		}
+		if (key_down(GLFW_KEY_RIGHT)) {
+			cam_yaw -= cam_yaw_speed * elapsed_seconds;
+			cam_moved = true;
+		}
+		if (cam_moved)
+		{
+			mat4 T = translate(identity_mat4(), vec3(-cam_pos.v[0], -cam_pos.v[1], -cam_pos.v[2]));
+			mat4 R = rotate_y_deg(identity_mat4(), -cam_yaw);
+			g_view_mat = R * T;
+		}
+		bool monkey_moved = false;
+		if (key_down('Z')){
+			bone_theta += bone_rot_speed * elapsed_seconds;
+			g_local_anim[1] = rotate_z_deg(identity_mat4(), bone_theta);
+			g_local_anim[2] = rotate_z_deg(identity_mat4(), -bone_theta);
+			monkey_moved = true;
+		}
+		if (key_down('X')){
+			bone_theta -= bone_rot_speed * elapsed_seconds;
+			g_local_anim[1] = rotate_z_deg(identity_mat4(), bone_theta);
+			g_local_anim[2] = rotate_z_deg(identity_mat4(), -bone_theta);
+			monkey_moved = true;
+		}
+		if (key_down('C')){
+			bone_y += 0.5f * elapsed_seconds;
+			g_local_anim[0] = translate(identity_mat4(), vec3(0.0f, bone_y, 0.0f));
+			monkey_moved = true;
+		}
+		if (key_down('V')){
+			bone_y -= 0.5f * elapsed_seconds;
+			g_local_anim[0] = translate(identity_mat4(), vec3(0.0f, bone_y, 0.0f));
+			monkey_moved = true;
+		}
+		if (monkey_moved)
+		{
+			skeleton_animate(
+				monkey_skeleton_root,
+				identity_mat4(),
+				monkey_bone_offset_matrices,
+				monkey_bone_animation_mats);
+		}
+
+		// Lキーを押すたびにインスタンスを1つ増やす。最初の1回だけ非同期で読み込まれる
+		bool load_key = key_down('L');
+		if (load_key && !load_key_down && streamed_mesh_count < MAX_STREAMED_MESHES)
+		{
+			Mesh_Handle handle = acquire_mesh(STREAM_MESH_FILE, &mesh_arena, true);
+			if (handle != INVALID_MESH_HANDLE)
+			{
+				streamed_meshes[streamed_mesh_count++] = handle;
+			}
+		}
+		load_key_down = load_key;
+		// Uキーで最後のインスタンスを消す。全て消えたメッシュは一定時間後に解放される
+		bool unload_key = key_down('U');
+		if (unload_key && !unload_key_down && streamed_mesh_count > 0)
+		{
+			release_mesh(streamed_meshes[--streamed_mesh_count]);
+			free(streamed_lods[streamed_mesh_count]);
+			streamed_lods[streamed_mesh_count] = NULL;
+		}
+		unload_key_down = unload_key;
+
+		bool cull_key = key_down('M');
+		if (cull_key && !cull_key_down)
+		{
+			g_meshlet_culling = !g_meshlet_culling;
+			printf(
+				"meshlet culling %s (last frame: %i/%i triangles, %i frustum / %i cone culled)\n",
+				g_meshlet_culling ? "on" : "off",
+				g_meshlet_draws.visible_triangle_count,
+				g_meshlet_draws.triangle_count,
+				g_meshlet_draws.frustum_culled,
+				g_meshlet_draws.cone_culled);
+		}
+		cull_key_down = cull_key;
+
+		bool lod_key = key_down('K');
+		if (lod_key && !lod_key_down)
+		{
+			g_lod_selection = !g_lod_selection;
+			printf("lod selection %s\n", g_lod_selection ? "on" : "off");
+		}
+		lod_key_down = lod_key;
+
+		bool sort_key = key_down('Q');
+		if (sort_key && !sort_key_down)
+		{
+			g_sort_render_queue = !g_sort_render_queue;
+			printf(
+				"render queue sorting %s (last frame: %i packets, %i programme binds, %i vao binds, %i state changes)\n",
+				g_sort_render_queue ? "on" : "off",
+				g_render_queue.frame.packets,
+				g_render_queue.frame.programme_binds,
+				g_render_queue.frame.vao_binds,
+				g_render_queue.frame.state_changes);
+		}
+		sort_key_down = sort_key;
+
+		bool instancing_key = key_down('I');
+		if (instancing_key && !instancing_key_down && g_instancing_supported)
+		{
+			g_instancing = !g_instancing;
+			printf(
+				"instancing %s (last frame: %i packets, %i dropped)\n",
+				g_instancing ? "on" : "off",
+				g_render_queue.frame.packets,
+				g_render_queue.frame.dropped);
+		}
+		instancing_key_down = instancing_key;
+
+		// Bキーで動的バッチを切り替える。Iキーで明示的なインスタンス描画を切ったときに効く
+		bool batching_key = key_down('B');
+		if (batching_key && !batching_key_down)
+		{
+			g_render_queue.batching = !g_render_queue.batching;
+			printf(
+				"dynamic batching %s (last frame: %i packets, %i batched into %i batches, %i draw calls)\n",
+				g_render_queue.batching ? "on" : "off",
+				g_render_queue.frame.packets,
+				g_render_queue.frame.batched_packets,
+				g_render_queue.frame.batches,
+				g_render_queue.frame.draw_calls);
+		}
+		batching_key_down = batching_key;
+
+		if (key_down(GLFW_KEY_ESCAPE)) {
+			glfwSetWindowShouldClose(g_window, 1);
+		}
+		staging_ring_end_frame(&g_staging_ring);
+		/* put the stuff we've been drawing onto the display */
+		if (g_headless)
+		{
+			end_headless_frame();
+		}
+		else
+		{
+			glfwSwapBuffers(g_window);
+		}
+		mark_benchmark_phase(&g_benchmark, BENCH_PHASE_PRESENT);
+		end_benchmark_frame(&g_benchmark);
+		mark_gl_trace_frame();
+		frame++;
+	}
+	// 後片付けの呼び出しは記録しない
+	stop_gl_trace();
+	if (g_headless && capture_file)
+	{
+		save_headless_frame(capture_file);
+	}
+	if (benchmark_active(&g_benchmark))
+	{
+		Benchmark_Scene scene;
+		scene.mesh_file = mesh_file;
+		scene.instances = monkey_instances;
+		scene.static_instances = static_draws.count > 0 ? static_instances : 0;
+		scene.animate = animate;
+		scene.headless = g_headless;
+		scene.width = g_gl_width;
+		scene.height = g_gl_height;
+		write_benchmark_json(&g_benchmark, &scene, bench_file);
+		destroy_frame_benchmark(&g_benchmark);
+	}
+
+	stop_async_loader();
+	for (int i = 0; i < streamed_mesh_count; i++)
+	{
+		release_mesh(streamed_meshes[i]);
+		free(streamed_lods[i]);
+	}
+	release_mesh(monkey_handle);
+	if (static_draws.capacity > 0)
+	{
+		log_static_draw_list_stats(&static_draws);
+		destroy_static_draw_list(&static_draws);
+	}
+	if (static_handle != INVALID_MESH_HANDLE)
+	{
+		release_mesh(static_handle);
+	}
+	log_resource_cache_stats();
+	log_gpu_memory_stats();
+	clear_resource_cache();
+	free_meshlet_draw_list(&g_meshlet_draws);
+	destroy_mesh_arena(&mesh_arena);
+	free(monkey_models);
+	free(monkey_lods);
+	destroy_bone_palette_texture();
+	log_staging_ring_stats(&g_staging_ring);
+	destroy_staging_ring(&g_staging_ring);
+	log_render_queue_stats(&g_render_queue);
+	log_bone_palette_stats();
+	log_gl_state_stats();
+	log_headless_stats();
+	destroy_render_queue(&g_render_queue);
+	log_allocator_stats();
+	destroy_frame_allocator(&g_frame_allocator);
+	// ワーカーはstop_async_loader()で止まっている
+	destroy_thread_scratch_arenas();
+
+	if (asset_pack_mounted)
+	{
+		unmount_asset_pack(&asset_pack);
+		close_asset_pack(&asset_pack);
+	}
+
+	/* close GL context and any other GLFW resources */
+	if (g_headless)
+	{
+		stop_headless_gl();
+	}
+	else
+	{
+		glfwTerminate();
+	}
+	return 0;
+}
@@ -0,0 +1,352 @@
+#include "mesh_arena.h"
+#include "gl_utils.h"
+#include "gpu_memory.h"
+#include "gl_state.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+/*--------------------Range Allocator---------------------------*/
+static void init_range_allocator(Range_Allocator* ra, int capacity)
+{
+	ra->capacity = capacity;
+	ra->top = 0;
+	ra->free_range_count = 0;
+}
+
+static bool range_alloc(Range_Allocator* ra, int count, int* offset)
+{
+	if (count <= 0)
+	{
+		*offset = 0;
+		return true;
+	}
+	// フリーリストから最初に収まる範囲を探す
+	for (int i = 0; i < ra->free_range_count; i++)
+	{
+		Arena_Range* r = &ra->free_ranges[i];
+		if (r->count >= count)
+		{
+			*offset = r->offset;
+			r->offset += count;
+			r->count -= count;
+			if (r->count == 0)
+			{
+				ra->free_ranges[i] = ra->free_ranges[--ra->free_range_count];
+			}
+			return true;
+		}
+	}
+	if (ra->top + count > ra->capacity)
+	{
+		return false;
+	}
+	*offset = ra->top;
+	ra->top += count;
+	return true;
+}
+
+static void range_free(Range_Allocator* ra, int offset, int count)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+	// 隣接する空き範囲と結合する
+	for (int i = 0; i < ra->free_range_count; i++)
+	{
+		Arena_Range* r = &ra->free_ranges[i];
+		if (r->offset + r->count == offset || offset + count == r->offset)
+		{
+			if (r->offset < offset)
+			{
+				offset = r->offset;
+			}
+			count += r->count;
+			ra->free_ranges[i] = ra->free_ranges[--ra->free_range_count];
+			i = -1;
+		}
+	}
+	// 末尾の範囲であればtopを下げるだけでよい
+	if (offset + count == ra->top)
+	{
+		ra->top = offset;
+		return;
+	}
+	if (ra->free_range_count >= MAX_ARENA_FREE_RANGES)
+	{
+		// フリーリストが溢れた場合、その範囲はリークするが破綻はしない
+		gl_log_err("WARNING: arena free list full, leaking %i elements\n", count);
+		return;
+	}
+	ra->free_ranges[ra->free_range_count].offset = offset;
+	ra->free_ranges[ra->free_range_count].count = count;
+	ra->free_range_count++;
+}
+
+/*--------------------Shared Vertex/Index Arena---------------------------*/
+int mesh_arena_stream_stride(const Mesh_Arena* arena, int stream)
+{
+	int format = arena->vertex_format;
+	switch (stream) {
+	case ARENA_STREAM_POSITION:
+		return (format & VERTEX_QUANTIZE_POSITION) ? 4 * sizeof(GLushort) : 3 * sizeof(GLfloat);
+	case ARENA_STREAM_NORMAL:
+		return (format & VERTEX_QUANTIZE_NORMAL) ? sizeof(GLuint) : 3 * sizeof(GLfloat);
+	case ARENA_STREAM_TEXCOORD:
+		return (format & VERTEX_QUANTIZE_TEXCOORD) ? 2 * sizeof(GLushort) : 2 * sizeof(GLfloat);
+	case ARENA_STREAM_BONE_ID: return 4 * sizeof(GLubyte);
+	case ARENA_STREAM_BONE_WEIGHT: return 4 * sizeof(Skin_Weight);
+	case ARENA_STREAM_TANGENT:
+		return (format & VERTEX_QUANTIZE_NORMAL) ? sizeof(GLuint) : 4 * sizeof(GLfloat);
+#if SKIN_INFLUENCES > 4
+	case ARENA_STREAM_BONE_ID_1: return 4 * sizeof(GLubyte);
+	case ARENA_STREAM_BONE_WEIGHT_1: return 4 * sizeof(Skin_Weight);
+#endif
+	default: break;
+	}
+	assert(false);
+	return 0;
+}
+
+// 現在バインドしているVAOに、アリーナの頂点ストリームを設定する
+static void setup_arena_streams(Mesh_Arena* arena)
+{
+	// 量子化した属性は正規化してシェーダに渡し、シェーダ側で復元する
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, arena->vbos[ARENA_STREAM_POSITION]);
+	if (arena->vertex_format & VERTEX_QUANTIZE_POSITION)
+	{
+		glVertexAttribPointer(ARENA_STREAM_POSITION, 4, GL_UNSIGNED_SHORT, GL_TRUE, 0, NULL);
+	}
+	else
+	{
+		glVertexAttribPointer(ARENA_STREAM_POSITION, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	}
+	glEnableVertexAttribArray(ARENA_STREAM_POSITION);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, arena->vbos[ARENA_STREAM_NORMAL]);
+	if (arena->vertex_format & VERTEX_QUANTIZE_NORMAL)
+	{
+		glVertexAttribPointer(ARENA_STREAM_NORMAL, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 0, NULL);
+	}
+	else
+	{
+		glVertexAttribPointer(ARENA_STREAM_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	}
+	glEnableVertexAttribArray(ARENA_STREAM_NORMAL);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, arena->vbos[ARENA_STREAM_TEXCOORD]);
+	if (arena->vertex_format & VERTEX_QUANTIZE_TEXCOORD)
+	{
+		glVertexAttribPointer(ARENA_STREAM_TEXCOORD, 2, GL_HALF_FLOAT, GL_FALSE, 0, NULL);
+	}
+	else
+	{
+		glVertexAttribPointer(ARENA_STREAM_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+	}
+	glEnableVertexAttribArray(ARENA_STREAM_TEXCOORD);
+	// 接線は法線と同じ形式。量子化した場合もwの2ビットで符号を渡す
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, arena->vbos[ARENA_STREAM_TANGENT]);
+	if (arena->vertex_format & VERTEX_QUANTIZE_NORMAL)
+	{
+		glVertexAttribPointer(ARENA_STREAM_TANGENT, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 0, NULL);
+	}
+	else
+	{
+		glVertexAttribPointer(ARENA_STREAM_TANGENT, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+	}
+	glEnableVertexAttribArray(ARENA_STREAM_TANGENT);
+	// ボーン番号は整数のまま、ウェイトは正規化して[0,1]で渡す
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, arena->vbos[ARENA_STREAM_BONE_ID]);
+	glVertexAttribIPointer(ARENA_STREAM_BONE_ID, 4, GL_UNSIGNED_BYTE, 0, NULL);
+	glEnableVertexAttribArray(ARENA_STREAM_BONE_ID);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, arena->vbos[ARENA_STREAM_BONE_WEIGHT]);
+	glVertexAttribPointer(ARENA_STREAM_BONE_WEIGHT, 4, SKIN_WEIGHT_GL_TYPE, GL_TRUE, 0, NULL);
+	glEnableVertexAttribArray(ARENA_STREAM_BONE_WEIGHT);
+#if SKIN_INFLUENCES > 4
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, arena->vbos[ARENA_STREAM_BONE_ID_1]);
+	glVertexAttribIPointer(ARENA_STREAM_BONE_ID_1, 4, GL_UNSIGNED_BYTE, 0, NULL);
+	glEnableVertexAttribArray(ARENA_STREAM_BONE_ID_1);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, arena->vbos[ARENA_STREAM_BONE_WEIGHT_1]);
+	glVertexAttribPointer(ARENA_STREAM_BONE_WEIGHT_1, 4, SKIN_WEIGHT_GL_TYPE, GL_TRUE, 0, NULL);
+	glEnableVertexAttribArray(ARENA_STREAM_BONE_WEIGHT_1);
+#endif
+	// インデックスバッファのバインドもVAOの状態として保存される
+	gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, arena->ibo);
+}
+
+bool create_mesh_arena(
+	Mesh_Arena* arena,
+	int max_vertices,
+	int max_indices,
+	int vertex_format)
+{
+	memset(arena, 0, sizeof(Mesh_Arena));
+	arena->vertex_format = vertex_format;
+	init_range_allocator(&arena->vertices, max_vertices);
+	init_range_allocator(&arena->indices, max_indices);
+
+	glGenVertexArrays(1, &arena->vao);
+	gl_state_bind_vertex_array(arena->vao);
+
+	// 各属性ストリームは容量分だけ確保しておき、後からglBufferSubData()で埋める
+	glGenBuffers(ARENA_STREAM_COUNT, arena->vbos);
+	for (int i = 0; i < ARENA_STREAM_COUNT; i++)
+	{
+		gpu_buffer_data(
+			arena->vbos[i],
+			GL_ARRAY_BUFFER,
+			max_vertices * mesh_arena_stream_stride(arena, i),
+			NULL,
+			GL_STATIC_DRAW,
+			GPU_MEMORY_VERTEX,
+			"mesh arena");
+	}
+	glGenBuffers(1, &arena->ibo);
+	gpu_buffer_data(
+		arena->ibo,
+		GL_ELEMENT_ARRAY_BUFFER,
+		max_indices * sizeof(GLuint),
+		NULL,
+		GL_STATIC_DRAW,
+		GPU_MEMORY_INDEX,
+		"mesh arena");
+	setup_arena_streams(arena);
+
+	// インスタンス描画用。同じストリームに加えてインスタンスごとの属性を持つ。
+	// 属性の位置は描画ごとにmesh_arena_bind_instances()で設定する
+	glGenVertexArrays(1, &arena->instanced_vao);
+	gl_state_bind_vertex_array(arena->instanced_vao);
+	setup_arena_streams(arena);
+	for (int i = 0; i < 4; i++)
+	{
+		glEnableVertexAttribArray(ARENA_INSTANCE_MODEL + i);
+		glVertexAttribDivisor(ARENA_INSTANCE_MODEL + i, 1);
+	}
+	glEnableVertexAttribArray(ARENA_INSTANCE_PALETTE);
+	glVertexAttribDivisor(ARENA_INSTANCE_PALETTE, 1);
+
+	gl_state_bind_vertex_array(0);
+	gl_log(
+		"created mesh arena: vao %u (instanced %u), %i vertices, %i indices, format 0x%x\n",
+		arena->vao,
+		arena->instanced_vao,
+		max_vertices,
+		max_indices,
+		vertex_format);
+	return true;
+}
+
+void mesh_arena_bind_instances(GLuint buffer, int offset)
+{
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, buffer);
+	for (int i = 0; i < 4; i++)
+	{
+		glVertexAttribPointer(
+			ARENA_INSTANCE_MODEL + i,
+			4,
+			GL_FLOAT,
+			GL_FALSE,
+			sizeof(Mesh_Instance),
+			(void*)(offset + offsetof(Mesh_Instance, model) + i * 4 * sizeof(float)));
+	}
+	glVertexAttribIPointer(
+		ARENA_INSTANCE_PALETTE,
+		1,
+		GL_UNSIGNED_INT,
+		sizeof(Mesh_Instance),
+		(void*)(offset + offsetof(Mesh_Instance, palette_texel)));
+}
+
+void destroy_mesh_arena(Mesh_Arena* arena)
+{
+	gpu_delete_buffers(ARENA_STREAM_COUNT, arena->vbos, GPU_MEMORY_VERTEX);
+	gpu_delete_buffers(1, &arena->ibo, GPU_MEMORY_INDEX);
+	gl_state_forget_vertex_array(arena->vao);
+	gl_state_forget_vertex_array(arena->instanced_vao);
+	glDeleteVertexArrays(1, &arena->vao);
+	glDeleteVertexArrays(1, &arena->instanced_vao);
+	memset(arena, 0, sizeof(Mesh_Arena));
+}
+
+bool mesh_arena_alloc(
+	Mesh_Arena* arena,
+	int vertex_count,
+	int index_count,
+	int* base_vertex,
+	int* first_index)
+{
+	if (!range_alloc(&arena->vertices, vertex_count, base_vertex))
+	{
+		gl_log_err("ERROR: mesh arena out of vertex space (%i requested)\n", vertex_count);
+		return false;
+	}
+	if (!range_alloc(&arena->indices, index_count, first_index))
+	{
+		gl_log_err("ERROR: mesh arena out of index space (%i requested)\n", index_count);
+		range_free(&arena->vertices, *base_vertex, vertex_count);
+		return false;
+	}
+	return true;
+}
+
+void mesh_arena_free(
+	Mesh_Arena* arena,
+	int base_vertex,
+	int vertex_count,
+	int first_index,
+	int index_count)
+{
+	range_free(&arena->vertices, base_vertex, vertex_count);
+	range_free(&arena->indices, first_index, index_count);
+}
+
+void mesh_arena_upload(
+	Mesh_Arena* arena,
+	int stream,
+	int base_vertex,
+	int vertex_count,
+	const void* data)
+{
+	int stride = mesh_arena_stream_stride(arena, stream);
+	if (arena->staging)
+	{
+		staging_ring_upload(
+			arena->staging,
+			arena->vbos[stream],
+			base_vertex * stride,
+			data,
+			vertex_count * stride);
+		return;
+	}
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, arena->vbos[stream]);
+	glBufferSubData(
+		GL_ARRAY_BUFFER,
+		base_vertex * stride,
+		vertex_count * stride,
+		data);
+}
+
+void mesh_arena_upload_indices(
+	Mesh_Arena* arena,
+	int first_index,
+	int index_count,
+	const GLuint* indices)
+{
+	if (arena->staging)
+	{
+		staging_ring_upload(
+			arena->staging,
+			arena->ibo,
+			first_index * sizeof(GLuint),
+			indices,
+			index_count * sizeof(GLuint));
+		return;
+	}
+	// ELEMENT_ARRAY_BUFFERのバインドはVAOを汚すので、COPY_WRITE_BUFFER経由で書き込む
+	gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, arena->ibo);
+	glBufferSubData(
+		GL_COPY_WRITE_BUFFER,
+		first_index * sizeof(GLuint),
+		index_count * sizeof(GLuint),
+		indices);
+}
@@ -0,0 +1,121 @@
+#ifndef _MESH_ARENA_H_
+#define _MESH_ARENA_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+#include "vertex_format.h"
+#include "staging_ring.h"
+
+/*--------------------Shared Vertex/Index Arena---------------------------*/
+// 複数のメッシュの頂点・インデックスを1つのVAOと少数のバッファにまとめて格納する。
+// 各メッシュは頂点範囲(base_vertex)とインデックス範囲(first_index)を割り当てられ、
+// glDrawElementsBaseVertex()でVAOを切り替えずに描画できる。
+
+// 1頂点あたりの最大ボーン影響数(4または8)
+#ifndef SKIN_INFLUENCES
+#define SKIN_INFLUENCES 4
+#endif
+// 定義するとボーンウェイトをunorm16で格納する(既定はunorm8)
+//#define SKIN_WEIGHTS_16BIT
+
+#ifdef SKIN_WEIGHTS_16BIT
+typedef GLushort Skin_Weight;
+#define SKIN_WEIGHT_MAX 65535
+#define SKIN_WEIGHT_GL_TYPE GL_UNSIGNED_SHORT
+#else
+typedef GLubyte Skin_Weight;
+#define SKIN_WEIGHT_MAX 255
+#define SKIN_WEIGHT_GL_TYPE GL_UNSIGNED_BYTE
+#endif
+
+// 属性ストリーム番号。シェーダのlocationと一致させる
+#define ARENA_STREAM_POSITION 0
+#define ARENA_STREAM_NORMAL 1
+#define ARENA_STREAM_TEXCOORD 2
+#define ARENA_STREAM_BONE_ID 3		// u8 x4
+#define ARENA_STREAM_BONE_WEIGHT 4	// unorm8/16 x4
+#define ARENA_STREAM_TANGENT 5		// xyzw。wは従接線の符号
+#if SKIN_INFLUENCES > 4
+#define ARENA_STREAM_BONE_ID_1 6	// 5～8番目の影響
+#define ARENA_STREAM_BONE_WEIGHT_1 7
+#define ARENA_STREAM_COUNT 8
+#else
+#define ARENA_STREAM_COUNT 6
+#endif
+
+// インスタンスごとの属性。instanced_vaoだけが持ち、モデル行列は4つのlocationを使う
+#define ARENA_INSTANCE_MODEL 8
+#define ARENA_INSTANCE_PALETTE 12
+
+// インスタンス描画で1インスタンスごとに読む値
+typedef struct Mesh_Instance
+{
+	float model[16];
+	GLuint palette_texel;	// ボーンパレットの先頭テクセル(bone_palette.h)
+	GLuint padding[3];
+}Mesh_Instance;
+
+#define MAX_ARENA_FREE_RANGES 256
+
+typedef struct Arena_Range
+{
+	int offset;
+	int count;
+}Arena_Range;
+
+// 先頭から詰めて確保し、解放された範囲はフリーリストで再利用する(first-fit)
+typedef struct Range_Allocator
+{
+	int capacity;
+	int top;
+	Arena_Range free_ranges[MAX_ARENA_FREE_RANGES];
+	int free_range_count;
+}Range_Allocator;
+
+typedef struct Mesh_Arena
+{
+	GLuint vao;
+	GLuint instanced_vao;	// vaoと同じストリームにインスタンスごとの属性を加えたもの
+	GLuint vbos[ARENA_STREAM_COUNT];
+	GLuint ibo;
+	int vertex_format;	// VERTEX_QUANTIZE_*の組み合わせ
+	Range_Allocator vertices;
+	Range_Allocator indices;
+	// NULLでなければアップロードはステージングリングを経由する。NULLならglBufferSubData()で直接書き込む
+	Staging_Ring* staging;
+}Mesh_Arena;
+
+bool create_mesh_arena(
+	Mesh_Arena* arena,
+	int max_vertices,
+	int max_indices,
+	int vertex_format);
+void destroy_mesh_arena(Mesh_Arena* arena);
+// 頂点とインデックスの範囲をまとめて確保する。どちらかが足りなければ何も確保しない
+bool mesh_arena_alloc(
+	Mesh_Arena* arena,
+	int vertex_count,
+	int index_count,
+	int* base_vertex,
+	int* first_index);
+void mesh_arena_free(
+	Mesh_Arena* arena,
+	int base_vertex,
+	int vertex_count,
+	int first_index,
+	int index_count);
+int mesh_arena_stream_stride(const Mesh_Arena* arena, int stream);
+// instanced_vaoがバインドされている前提で、bufferのoffsetから並ぶMesh_Instanceを読むように設定する
+void mesh_arena_bind_instances(GLuint buffer, int offset);
+void mesh_arena_upload(
+	Mesh_Arena* arena,
+	int stream,
+	int base_vertex,
+	int vertex_count,
+	const void* data);
+void mesh_arena_upload_indices(
+	Mesh_Arena* arena,
+	int first_index,
+	int index_count,
+	const GLuint* indices);
+
+#endif
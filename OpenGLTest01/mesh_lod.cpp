@@ -0,0 +1,478 @@
+#include "mesh_lod.h"
+#include "allocators.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+static int g_lod_count = 4;
+static float g_lod_reduction = 0.5f;
+
+void set_lod_chain_settings(int lod_count, float reduction)
+{
+	assert(lod_count >= 1 && lod_count <= MAX_MESH_LODS);
+	g_lod_count = lod_count;
+	g_lod_reduction = reduction;
+}
+
+/*--------------------Quadrics---------------------------*/
+// 対称4x4行列の上三角。xx xy xz xw yy yz yw zz zw ww。
+// 平面は三角形の面積で重み付けし、誤差は重みで割って平均二乗距離にする
+typedef struct Quadric
+{
+	double a[10];
+	double weight;
+}Quadric;
+
+static void add_plane_quadric(Quadric* q, double a, double b, double c, double d, double w)
+{
+	q->a[0] += w * a * a; q->a[1] += w * a * b; q->a[2] += w * a * c; q->a[3] += w * a * d;
+	q->a[4] += w * b * b; q->a[5] += w * b * c; q->a[6] += w * b * d;
+	q->a[7] += w * c * c; q->a[8] += w * c * d;
+	q->a[9] += w * d * d;
+	q->weight += w;
+}
+
+static void add_quadric(Quadric* dst, const Quadric* src)
+{
+	for (int i = 0; i < 10; i++)
+	{
+		dst->a[i] += src->a[i];
+	}
+	dst->weight += src->weight;
+}
+
+// 点から、quadricに含まれる平面への距離の二乗の平均
+static double quadric_error(const Quadric* q, const GLfloat* p)
+{
+	double x = p[0], y = p[1], z = p[2];
+	const double* a = q->a;
+	double e = a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x +
+		a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y +
+		a[7] * z * z + 2.0 * a[8] * z +
+		a[9];
+	if (q->weight <= 0.0 || e <= 0.0)
+	{
+		return 0.0;
+	}
+	return e / q->weight;
+}
+
+static void triangle_normal(const GLfloat* p0, const GLfloat* p1, const GLfloat* p2, double* n)
+{
+	double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+	double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+/*--------------------Vertex Classification---------------------------*/
+// 同じ位置を持つ頂点をまとめる。canonical[v] はその位置で最初に現れた頂点
+static void build_position_remap(const GLfloat* positions, int vertex_count, int* canonical)
+{
+	int table_size = 1;
+	while (table_size < vertex_count * 2)
+	{
+		table_size *= 2;
+	}
+	Scratch_Arena* scratch = thread_scratch_arena();
+	Scratch_Marker marker = scratch_mark(scratch);
+	int* table = (int*)scratch_alloc(scratch, table_size * sizeof(int));
+	for (int i = 0; i < table_size; i++)
+	{
+		table[i] = -1;
+	}
+	for (int v = 0; v < vertex_count; v++)
+	{
+		unsigned int bits[3];
+		memcpy(bits, &positions[v * 3], sizeof(bits));
+		unsigned int h = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		int slot = (int)(h & (table_size - 1));
+		for (;;)
+		{
+			int other = table[slot];
+			if (other < 0)
+			{
+				table[slot] = v;
+				canonical[v] = v;
+				break;
+			}
+			if (memcmp(&positions[other * 3], &positions[v * 3], 3 * sizeof(GLfloat)) == 0)
+			{
+				canonical[v] = other;
+				break;
+			}
+			slot = (slot + 1) & (table_size - 1);
+		}
+	}
+	scratch_release(scratch, marker);
+}
+
+// 頂点から三角形への逆引き(CSR形式)
+static void build_triangle_adjacency(
+	const GLuint* indices,
+	int index_count,
+	int vertex_count,
+	int* offsets,
+	int* triangles)
+{
+	memset(offsets, 0, (vertex_count + 1) * sizeof(int));
+	for (int i = 0; i < index_count; i++)
+	{
+		offsets[indices[i] + 1]++;
+	}
+	for (int v = 0; v < vertex_count; v++)
+	{
+		offsets[v + 1] += offsets[v];
+	}
+	Scratch_Arena* scratch = thread_scratch_arena();
+	Scratch_Marker marker = scratch_mark(scratch);
+	int* fill = (int*)scratch_alloc(scratch, vertex_count * sizeof(int));
+	memcpy(fill, offsets, vertex_count * sizeof(int));
+	for (int i = 0; i < index_count; i++)
+	{
+		triangles[fill[indices[i]]++] = i / 3;
+	}
+	scratch_release(scratch, marker);
+}
+
+// 継ぎ目と開いた境界の頂点をロックする。境界は位置でまとめた辺が1つの三角形にしか無いもの
+static void lock_seams_and_borders(
+	const GLuint* indices,
+	int index_count,
+	int vertex_count,
+	const int* canonical,
+	unsigned char* locked)
+{
+	Scratch_Arena* scratch = thread_scratch_arena();
+	Scratch_Marker marker = scratch_mark(scratch);
+	int* group_size = (int*)scratch_alloc(scratch, vertex_count * sizeof(int));
+	memset(group_size, 0, vertex_count * sizeof(int));
+	for (int v = 0; v < vertex_count; v++)
+	{
+		group_size[canonical[v]]++;
+	}
+	for (int v = 0; v < vertex_count; v++)
+	{
+		locked[v] = group_size[canonical[v]] > 1 ? 1 : 0;
+	}
+
+	GLuint* canonical_indices = (GLuint*)scratch_alloc(scratch, index_count * sizeof(GLuint));
+	for (int i = 0; i < index_count; i++)
+	{
+		canonical_indices[i] = (GLuint)canonical[indices[i]];
+	}
+	int* offsets = (int*)scratch_alloc(scratch, (vertex_count + 1) * sizeof(int));
+	int* triangles = (int*)scratch_alloc(scratch, index_count * sizeof(int));
+	build_triangle_adjacency(canonical_indices, index_count, vertex_count, offsets, triangles);
+	for (int i = 0; i < index_count; i++)
+	{
+		GLuint a = canonical_indices[i];
+		GLuint b = canonical_indices[i - i % 3 + (i + 1) % 3];
+		int sharing = 0;
+		for (int k = offsets[a]; k < offsets[a + 1]; k++)
+		{
+			const GLuint* tri = &canonical_indices[triangles[k] * 3];
+			if (tri[0] == b || tri[1] == b || tri[2] == b)
+			{
+				sharing++;
+			}
+		}
+		if (sharing == 1)
+		{
+			locked[indices[i]] = 1;
+			locked[indices[i - i % 3 + (i + 1) % 3]] = 1;
+		}
+	}
+	scratch_release(scratch, marker);
+}
+
+/*--------------------Edge Collapse---------------------------*/
+typedef struct Collapse
+{
+	GLuint from;
+	GLuint to;
+	float cost;
+}Collapse;
+
+static int compare_collapse(const void* a, const void* b)
+{
+	float ca = ((const Collapse*)a)->cost;
+	float cb = ((const Collapse*)b)->cost;
+	return ca < cb ? -1 : (ca > cb ? 1 : 0);
+}
+
+static bool can_collapse(GLuint from, GLuint to, const unsigned char* locked, const GLubyte* bone_ids)
+{
+	if (locked[from])
+	{
+		return false;
+	}
+	// 潰した頂点は行き先のウェイトを使うことになるので、主要ボーンが同じものに限る
+	return !bone_ids || bone_ids[from * 4] == bone_ids[to * 4];
+}
+
+// from を to に寄せた時に、from の周りの三角形が裏返らないか調べる
+static bool collapse_flips(
+	const GLfloat* positions,
+	const GLuint* indices,
+	const int* offsets,
+	const int* triangles,
+	GLuint from,
+	GLuint to)
+{
+	for (int k = offsets[from]; k < offsets[from + 1]; k++)
+	{
+		const GLuint* tri = &indices[triangles[k] * 3];
+		if (tri[0] == to || tri[1] == to || tri[2] == to)
+		{
+			continue;	// 崩壊で消える三角形
+		}
+		const GLfloat* p[3];
+		const GLfloat* q[3];
+		for (int c = 0; c < 3; c++)
+		{
+			p[c] = &positions[tri[c] * 3];
+			q[c] = tri[c] == from ? &positions[to * 3] : p[c];
+		}
+		double before[3], after[3];
+		triangle_normal(p[0], p[1], p[2], before);
+		triangle_normal(q[0], q[1], q[2], after);
+		if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+int simplify_mesh(
+	const GLfloat* positions,
+	int vertex_count,
+	const GLubyte* bone_ids,
+	const GLuint* indices,
+	int index_count,
+	int target_index_count,
+	GLuint* destination,
+	float* result_error)
+{
+	memcpy(destination, indices, index_count * sizeof(GLuint));
+	*result_error = 0.0f;
+
+	// 作業用の配列は全てスクラッチに置き、最後にまとめて戻す
+	Scratch_Arena* scratch = thread_scratch_arena();
+	Scratch_Marker marker = scratch_mark(scratch);
+	int* canonical = (int*)scratch_alloc(scratch, vertex_count * sizeof(int));
+	unsigned char* locked = (unsigned char*)scratch_alloc(scratch, vertex_count);
+	build_position_remap(positions, vertex_count, canonical);
+	lock_seams_and_borders(indices, index_count, vertex_count, canonical, locked);
+
+	// 三角形の平面をその頂点に集める
+	Quadric* quadrics = (Quadric*)scratch_alloc(scratch, vertex_count * sizeof(Quadric));
+	memset(quadrics, 0, vertex_count * sizeof(Quadric));
+	for (int t = 0; t < index_count / 3; t++)
+	{
+		const GLuint* tri = &indices[t * 3];
+		double n[3];
+		triangle_normal(&positions[tri[0] * 3], &positions[tri[1] * 3], &positions[tri[2] * 3], n);
+		double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len <= 0.0)
+		{
+			continue;
+		}
+		n[0] /= len; n[1] /= len; n[2] /= len;
+		const GLfloat* p0 = &positions[tri[0] * 3];
+		double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+		for (int c = 0; c < 3; c++)
+		{
+			add_plane_quadric(&quadrics[tri[c]], n[0], n[1], n[2], d, len * 0.5);
+		}
+	}
+
+	int* offsets = (int*)scratch_alloc(scratch, (vertex_count + 1) * sizeof(int));
+	int* triangles = (int*)scratch_alloc(scratch, index_count * sizeof(int));
+	Collapse* collapses = (Collapse*)scratch_alloc(scratch, index_count * sizeof(Collapse));
+	GLuint* remap = (GLuint*)scratch_alloc(scratch, vertex_count * sizeof(GLuint));
+	unsigned char* touched = (unsigned char*)scratch_alloc(scratch, vertex_count);
+	double max_error = 0.0;
+
+	// 1パスごとに安い順にできるだけ潰し、インデックスを書き直して繰り返す
+	while (index_count > target_index_count)
+	{
+		build_triangle_adjacency(destination, index_count, vertex_count, offsets, triangles);
+		int collapse_count = 0;
+		for (int i = 0; i < index_count; i++)
+		{
+			GLuint a = destination[i];
+			GLuint b = destination[i - i % 3 + (i + 1) % 3];
+			Quadric q = quadrics[a];
+			add_quadric(&q, &quadrics[b]);
+			float cost_ab = can_collapse(a, b, locked, bone_ids) ? (float)quadric_error(&q, &positions[b * 3]) : -1.0f;
+			float cost_ba = can_collapse(b, a, locked, bone_ids) ? (float)quadric_error(&q, &positions[a * 3]) : -1.0f;
+			if (cost_ab < 0.0f && cost_ba < 0.0f)
+			{
+				continue;
+			}
+			Collapse* c = &collapses[collapse_count++];
+			if (cost_ba < 0.0f || (cost_ab >= 0.0f && cost_ab <= cost_ba))
+			{
+				c->from = a; c->to = b; c->cost = cost_ab;
+			}
+			else
+			{
+				c->from = b; c->to = a; c->cost = cost_ba;
+			}
+		}
+		qsort(collapses, collapse_count, sizeof(Collapse), compare_collapse);
+
+		for (int v = 0; v < vertex_count; v++)
+		{
+			remap[v] = (GLuint)v;
+		}
+		memset(touched, 0, vertex_count);
+		// 崩壊1回でおよそ2つの三角形が消える
+		int remaining_triangles = index_count / 3;
+		int applied = 0;
+		for (int i = 0; i < collapse_count && remaining_triangles * 3 > target_index_count; i++)
+		{
+			const Collapse* c = &collapses[i];
+			if (touched[c->from] || touched[c->to])
+			{
+				continue;
+			}
+			if (collapse_flips(positions, destination, offsets, triangles, c->from, c->to))
+			{
+				continue;
+			}
+			remap[c->from] = c->to;
+			add_quadric(&quadrics[c->to], &quadrics[c->from]);
+			// from の周りの三角形は形が変わるので、同じパスでは触らない
+			for (int k = offsets[c->from]; k < offsets[c->from + 1]; k++)
+			{
+				const GLuint* tri = &destination[triangles[k] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+			}
+			if (c->cost > max_error)
+			{
+				max_error = c->cost;
+			}
+			remaining_triangles -= 2;
+			applied++;
+		}
+		if (applied == 0)
+		{
+			break;
+		}
+
+		// 縮退した三角形を取り除く
+		int written = 0;
+		for (int t = 0; t < index_count / 3; t++)
+		{
+			GLuint a = remap[destination[t * 3]];
+			GLuint b = remap[destination[t * 3 + 1]];
+			GLuint c = remap[destination[t * 3 + 2]];
+			if (a == b || b == c || c == a)
+			{
+				continue;
+			}
+			destination[written++] = a;
+			destination[written++] = b;
+			destination[written++] = c;
+		}
+		index_count = written;
+	}
+
+	scratch_release(scratch, marker);
+	*result_error = (float)sqrt(max_error);
+	return index_count;
+}
+
+int build_lod_chain(
+	const GLfloat* positions,
+	int vertex_count,
+	const GLubyte* bone_ids,
+	GLuint** indices,
+	int index_count,
+	Mesh_Lod* lods)
+{
+	lods[0].first_index = 0;
+	lods[0].index_count = index_count;
+	lods[0].error = 0.0f;
+	int lod_count = 1;
+	int total = index_count;
+
+	while (lod_count < g_lod_count)
+	{
+		const Mesh_Lod* prev = &lods[lod_count - 1];
+		int target = (int)(prev->index_count * g_lod_reduction) / 3 * 3;
+		if (target < 3)
+		{
+			break;
+		}
+		*indices = (GLuint*)realloc(*indices, (total + prev->index_count) * sizeof(GLuint));
+		float error;
+		// 1つ前のLODから簡略化する。誤差は累積させておく
+		int count = simplify_mesh(
+			positions,
+			vertex_count,
+			bone_ids,
+			*indices + prev->first_index,
+			prev->index_count,
+			target,
+			*indices + total,
+			&error);
+		// ほとんど減らせなければ、それ以上のLODは作らない
+		if (count > prev->index_count * 9 / 10)
+		{
+			break;
+		}
+		Mesh_Lod* lod = &lods[lod_count++];
+		lod->first_index = total;
+		lod->index_count = count;
+		lod->error = prev->error + error;
+		total += count;
+	}
+	*indices = (GLuint*)realloc(*indices, total * sizeof(GLuint));
+	return lod_count;
+}
+
+/*--------------------LOD Selection---------------------------*/
+int select_lod(
+	const Mesh_Lod* lods,
+	int lod_count,
+	int current_lod,
+	float distance,
+	float pixel_scale,
+	float threshold_px)
+{
+	if (distance <= 0.0f)
+	{
+		return 0;
+	}
+	float px_per_unit = pixel_scale / distance;
+	int fine = 0;
+	int coarse = 0;
+	for (int i = 0; i < lod_count; i++)
+	{
+		float error_px = lods[i].error * px_per_unit;
+		if (error_px <= threshold_px)
+		{
+			fine = i;
+		}
+		if (error_px <= threshold_px * LOD_HYSTERESIS)
+		{
+			coarse = i;
+		}
+	}
+	if (current_lod < coarse)
+	{
+		return coarse;
+	}
+	if (current_lod > fine)
+	{
+		return fine;
+	}
+	return current_lod < lod_count ? current_lod : lod_count - 1;
+}
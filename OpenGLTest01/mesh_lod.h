@@ -0,0 +1,56 @@
+#ifndef _MESH_LOD_H_
+#define _MESH_LOD_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+
+/*--------------------Quadric Simplification and LOD Chain---------------------------*/
+// 二次誤差距離(QEM)によるエッジ崩壊でインデックスだけを間引く。頂点は元のものを使い回すので、
+// 全てのLODが同じ頂点範囲(ボーンウェイトやUVを含む)を共有する。
+// UVの継ぎ目(同じ位置にある別の頂点)と開いた境界の頂点は動かさない
+#define MAX_MESH_LODS 6
+
+typedef struct Mesh_Lod
+{
+	int first_index;	// メッシュのインデックス範囲の先頭からの位置
+	int index_count;
+	float error;		// LOD0からの誤差(モデル空間での距離)
+}Mesh_Lod;
+
+// 生成するLODの数(LOD0を含む)と、1段ごとの三角形数の比率。読み込みを始める前に設定する
+void set_lod_chain_settings(int lod_count, float reduction);
+
+// indices を target_index_count 以下に簡略化して destination に書き、そのインデックス数を返す。
+// bone_ids(u8 x4、NULL可)があれば、主要ボーンが異なる頂点同士は潰さない
+int simplify_mesh(
+	const GLfloat* positions,
+	int vertex_count,
+	const GLubyte* bone_ids,
+	const GLuint* indices,
+	int index_count,
+	int target_index_count,
+	GLuint* destination,
+	float* result_error);
+
+// *indices(LOD0)の後ろに簡略化したLODを連結する。*indices は必要に応じて realloc される。
+// 戻り値はLOD数(1ならLOD0のみ)
+int build_lod_chain(
+	const GLfloat* positions,
+	int vertex_count,
+	const GLubyte* bone_ids,
+	GLuint** indices,
+	int index_count,
+	Mesh_Lod* lods);
+
+// 画面上の誤差が threshold_px 以下になる最も粗いLODを選ぶ。
+// pixel_scale は 1 / distance あたりのピクセル数(proj[1][1] * 画面の高さ / 2)。
+// 粗くする時は threshold_px * LOD_HYSTERESIS を下回るまで切り替えない
+#define LOD_HYSTERESIS 0.75f
+int select_lod(
+	const Mesh_Lod* lods,
+	int lod_count,
+	int current_lod,
+	float distance,
+	float pixel_scale,
+	float threshold_px);
+
+#endif
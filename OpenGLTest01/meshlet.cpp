@@ -0,0 +1,503 @@
+#include "meshlet.h"
+#include "gl_utils.h"
+#include "timer.h"
+#include "allocators.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+/*--------------------Meshlet Generation---------------------------*/
+// 頂点から、それを使う三角形への逆引き(CSR形式)。配列はスレッドのスクラッチに置く
+typedef struct Vertex_Adjacency
+{
+	int* offsets;	// vertex_count + 1
+	int* triangles;
+}Vertex_Adjacency;
+
+static void build_adjacency(
+	const GLuint* indices,
+	int index_count,
+	int vertex_count,
+	Vertex_Adjacency* adjacency)
+{
+	Scratch_Arena* scratch = thread_scratch_arena();
+	adjacency->offsets = (int*)scratch_alloc(scratch, (vertex_count + 1) * sizeof(int));
+	memset(adjacency->offsets, 0, (vertex_count + 1) * sizeof(int));
+	adjacency->triangles = (int*)scratch_alloc(scratch, index_count * sizeof(int));
+	Scratch_Marker marker = scratch_mark(scratch);
+	for (int i = 0; i < index_count; i++)
+	{
+		adjacency->offsets[indices[i] + 1]++;
+	}
+	for (int v = 0; v < vertex_count; v++)
+	{
+		adjacency->offsets[v + 1] += adjacency->offsets[v];
+	}
+	int* fill = (int*)scratch_alloc(scratch, vertex_count * sizeof(int));
+	memcpy(fill, adjacency->offsets, vertex_count * sizeof(int));
+	for (int i = 0; i < index_count; i++)
+	{
+		adjacency->triangles[fill[indices[i]]++] = i / 3;
+	}
+	scratch_release(scratch, marker);
+}
+
+static vec3 get_position(const GLfloat* positions, GLuint index)
+{
+	return vec3(positions[index * 3], positions[index * 3 + 1], positions[index * 3 + 2]);
+}
+
+// 並べ替え済みのインデックスからバウンディングスフィアと法線コーンを求める
+static void compute_meshlet_bounds(
+	const GLfloat* positions,
+	const GLuint* indices,
+	Meshlet* meshlet)
+{
+	const GLuint* tri = indices + meshlet->first_index;
+	int triangle_count = meshlet->index_count / 3;
+
+	vec3 mn = get_position(positions, tri[0]);
+	vec3 mx = mn;
+	for (int i = 1; i < meshlet->index_count; i++)
+	{
+		vec3 p = get_position(positions, tri[i]);
+		for (int c = 0; c < 3; c++)
+		{
+			if (p.v[c] < mn.v[c]) mn.v[c] = p.v[c];
+			if (p.v[c] > mx.v[c]) mx.v[c] = p.v[c];
+		}
+	}
+	meshlet->center = (mn + mx) * 0.5f;
+	float radius2 = 0.0f;
+	for (int i = 0; i < meshlet->index_count; i++)
+	{
+		float d2 = get_squared_dist(meshlet->center, get_position(positions, tri[i]));
+		if (d2 > radius2)
+		{
+			radius2 = d2;
+		}
+	}
+	meshlet->radius = sqrtf(radius2);
+
+	// 面積で重み付けした法線の平均をコーンの軸とする
+	vec3 axis(0.0f, 0.0f, 0.0f);
+	for (int t = 0; t < triangle_count; t++)
+	{
+		vec3 p0 = get_position(positions, tri[t * 3]);
+		vec3 p1 = get_position(positions, tri[t * 3 + 1]);
+		vec3 p2 = get_position(positions, tri[t * 3 + 2]);
+		axis += cross(p1 - p0, p2 - p0);
+	}
+	meshlet->cone_apex = meshlet->center;
+	meshlet->cone_axis = vec3(0.0f, 0.0f, 0.0f);
+	meshlet->cone_cutoff = 1.0f;
+	if (length(axis) <= 0.0f)
+	{
+		return;
+	}
+	axis = normalise(axis);
+
+	float min_dp = 1.0f;
+	float max_t = 0.0f;
+	for (int t = 0; t < triangle_count; t++)
+	{
+		vec3 p0 = get_position(positions, tri[t * 3]);
+		vec3 p1 = get_position(positions, tri[t * 3 + 1]);
+		vec3 p2 = get_position(positions, tri[t * 3 + 2]);
+		vec3 n = cross(p1 - p0, p2 - p0);
+		float area = length(n);
+		if (area <= 0.0f)
+		{
+			continue;
+		}
+		n = n / area;
+		float dp = dot(n, axis);
+		if (dp < min_dp)
+		{
+			min_dp = dp;
+		}
+		// 軸上で、全ての三角形の平面より裏側にある点を頂点とする
+		if (dp > 0.0f)
+		{
+			float t_apex = dot(meshlet->center - p0, n) / dp;
+			if (t_apex > max_t)
+			{
+				max_t = t_apex;
+			}
+		}
+	}
+	// 法線の広がりが大きいものは判定しても殆ど消えないので諦める
+	if (min_dp <= 0.1f)
+	{
+		return;
+	}
+	meshlet->cone_apex = meshlet->center - axis * max_t;
+	meshlet->cone_axis = axis;
+	meshlet->cone_cutoff = sqrtf(1.0f - min_dp * min_dp);
+}
+
+int build_meshlets(
+	const GLfloat* positions,
+	int vertex_count,
+	GLuint* indices,
+	int index_count,
+	Meshlet** meshlets)
+{
+	int triangle_count = index_count / 3;
+	*meshlets = NULL;
+	if (triangle_count == 0)
+	{
+		return 0;
+	}
+
+	// 作業用の配列は全てスクラッチに置き、最後にまとめて戻す
+	Scratch_Arena* scratch = thread_scratch_arena();
+	Scratch_Marker marker = scratch_mark(scratch);
+	Vertex_Adjacency adjacency;
+	build_adjacency(indices, index_count, vertex_count, &adjacency);
+	unsigned char* emitted = (unsigned char*)scratch_alloc(scratch, triangle_count);
+	memset(emitted, 0, triangle_count);
+	// 頂点が現在のメッシュレットに含まれていれば、そのメッシュレットの番号が入る
+	int* vertex_owner = (int*)scratch_alloc(scratch, vertex_count * sizeof(int));
+	for (int v = 0; v < vertex_count; v++)
+	{
+		vertex_owner[v] = -1;
+	}
+	GLuint* reordered = (GLuint*)scratch_alloc(scratch, index_count * sizeof(GLuint));
+	Meshlet* out = (Meshlet*)malloc(triangle_count * sizeof(Meshlet));
+	int meshlet_count = 0;
+
+	int meshlet_vertices[MESHLET_MAX_VERTICES];
+	int meshlet_vertex_count = 0;
+	int meshlet_triangle_count = 0;
+	int written = 0;
+	int first_written = 0;
+	int seed = 0;
+
+	while (written < index_count)
+	{
+		// 現在のメッシュレットの頂点に隣接する三角形から、新しい頂点が最も少ないものを選ぶ
+		int best = -1;
+		int best_new = 4;
+		for (int i = 0; i < meshlet_vertex_count && best_new > 0; i++)
+		{
+			int v = meshlet_vertices[i];
+			for (int a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; a++)
+			{
+				int t = adjacency.triangles[a];
+				if (emitted[t])
+				{
+					continue;
+				}
+				int new_vertices = 0;
+				for (int k = 0; k < 3; k++)
+				{
+					new_vertices += vertex_owner[indices[t * 3 + k]] == meshlet_count ? 0 : 1;
+				}
+				if (new_vertices < best_new)
+				{
+					best = t;
+					best_new = new_vertices;
+				}
+			}
+		}
+		// 隣接するものが無ければ、まだ使っていない次の三角形から始める
+		if (best < 0)
+		{
+			while (emitted[seed])
+			{
+				seed++;
+			}
+			best = seed;
+			best_new = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				best_new += vertex_owner[indices[best * 3 + k]] == meshlet_count ? 0 : 1;
+			}
+		}
+
+		if (meshlet_vertex_count + best_new > MESHLET_MAX_VERTICES ||
+			meshlet_triangle_count >= MESHLET_MAX_TRIANGLES)
+		{
+			// 入りきらないのでメッシュレットを閉じ、同じ三角形で次を始める
+			out[meshlet_count].first_index = first_written;
+			out[meshlet_count].index_count = written - first_written;
+			meshlet_count++;
+			first_written = written;
+			meshlet_vertex_count = 0;
+			meshlet_triangle_count = 0;
+			continue;
+		}
+
+		emitted[best] = 1;
+		for (int k = 0; k < 3; k++)
+		{
+			GLuint v = indices[best * 3 + k];
+			if (vertex_owner[v] != meshlet_count)
+			{
+				vertex_owner[v] = meshlet_count;
+				meshlet_vertices[meshlet_vertex_count++] = (int)v;
+			}
+			reordered[written++] = v;
+		}
+		meshlet_triangle_count++;
+	}
+	out[meshlet_count].first_index = first_written;
+	out[meshlet_count].index_count = written - first_written;
+	meshlet_count++;
+
+	memcpy(indices, reordered, index_count * sizeof(GLuint));
+	for (int i = 0; i < meshlet_count; i++)
+	{
+		compute_meshlet_bounds(positions, indices, &out[i]);
+	}
+
+	scratch_release(scratch, marker);
+	// 三角形の数で多めに取ったので詰め直す。vec3はそのまま動かしてよい型なので、
+	// void*へのキャストは-Wclass-memaccessを黙らせるためだけ。失敗したら大きいまま使う
+	Meshlet* shrunk = (Meshlet*)realloc((void*)out, meshlet_count * sizeof(Meshlet));
+	*meshlets = shrunk ? shrunk : out;
+	return meshlet_count;
+}
+
+/*--------------------Meshlet Culling---------------------------*/
+void extract_frustum(mat4 pvm, Frustum* frustum)
+{
+	// 列優先なので、i行目は m[i], m[4 + i], m[8 + i], m[12 + i]
+	for (int p = 0; p < 6; p++)
+	{
+		int row = p / 2;
+		float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+		float* plane = frustum->planes[p];
+		for (int c = 0; c < 4; c++)
+		{
+			plane[c] = pvm.m[c * 4 + 3] + sign * pvm.m[c * 4 + row];
+		}
+		float len = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (len > 0.0f)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				plane[c] /= len;
+			}
+		}
+	}
+}
+
+bool sphere_outside_frustum(const Frustum* frustum, vec3 center, float radius)
+{
+	for (int p = 0; p < 6; p++)
+	{
+		const float* plane = frustum->planes[p];
+		float d = plane[0] * center.v[0] + plane[1] * center.v[1] + plane[2] * center.v[2] + plane[3];
+		if (d < -radius)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool cone_backfacing(const Meshlet* meshlet, vec3 camera)
+{
+	if (meshlet->cone_cutoff >= 1.0f)
+	{
+		return false;
+	}
+	vec3 view = meshlet->cone_apex;
+	view -= camera;
+	float len = length(view);
+	if (len <= 0.0f)
+	{
+		return false;
+	}
+	return dot(view, meshlet->cone_axis) >= meshlet->cone_cutoff * len;
+}
+
+void reset_meshlet_draw_list(Meshlet_Draw_List* list)
+{
+	list->draw_count = 0;
+	list->meshlet_count = 0;
+	list->frustum_culled = 0;
+	list->cone_culled = 0;
+	list->triangle_count = 0;
+	list->visible_triangle_count = 0;
+}
+
+void free_meshlet_draw_list(Meshlet_Draw_List* list)
+{
+	free(list->counts);
+	free(list->offsets);
+	free(list->base_vertices);
+	memset(list, 0, sizeof(Meshlet_Draw_List));
+}
+
+static void push_draw(Meshlet_Draw_List* list, int first_index, int index_count, int base_vertex)
+{
+	// 直前の描画とインデックスが続いていれば伸ばす
+	if (list->draw_count > 0)
+	{
+		int last = list->draw_count - 1;
+		int last_end = (int)((size_t)list->offsets[last] / sizeof(GLuint)) + list->counts[last];
+		if (list->base_vertices[last] == base_vertex && last_end == first_index)
+		{
+			list->counts[last] += index_count;
+			return;
+		}
+	}
+	if (list->draw_count == list->capacity)
+	{
+		list->capacity = list->capacity ? list->capacity * 2 : 64;
+		list->counts = (GLsizei*)realloc(list->counts, list->capacity * sizeof(GLsizei));
+		list->offsets = (GLvoid**)realloc(list->offsets, list->capacity * sizeof(GLvoid*));
+		list->base_vertices = (GLint*)realloc(list->base_vertices, list->capacity * sizeof(GLint));
+	}
+	list->counts[list->draw_count] = index_count;
+	list->offsets[list->draw_count] = (GLvoid*)(first_index * sizeof(GLuint));
+	list->base_vertices[list->draw_count] = base_vertex;
+	list->draw_count++;
+}
+
+void cull_meshlets(
+	const Meshlet* meshlets,
+	int meshlet_count,
+	const Frustum* frustum,
+	vec3 camera,
+	int first_index,
+	int base_vertex,
+	Meshlet_Draw_List* list)
+{
+	for (int i = 0; i < meshlet_count; i++)
+	{
+		const Meshlet* m = &meshlets[i];
+		list->meshlet_count++;
+		list->triangle_count += m->index_count / 3;
+		if (sphere_outside_frustum(frustum, m->center, m->radius))
+		{
+			list->frustum_culled++;
+			continue;
+		}
+		if (cone_backfacing(m, camera))
+		{
+			list->cone_culled++;
+			continue;
+		}
+		list->visible_triangle_count += m->index_count / 3;
+		push_draw(list, first_index + m->first_index, m->index_count, base_vertex);
+	}
+}
+
+void draw_meshlet_list(const Meshlet_Draw_List* list)
+{
+	if (list->draw_count == 0)
+	{
+		return;
+	}
+	glMultiDrawElementsBaseVertex(
+		GL_TRIANGLES,
+		list->counts,
+		GL_UNSIGNED_INT,
+		list->offsets,
+		list->draw_count,
+		list->base_vertices);
+}
+
+/*--------------------Headless Culling Benchmark---------------------------*/
+// segments x segments の緯度経度球を作る
+static void make_sphere(int segments, GLfloat** positions, int* vertex_count, GLuint** indices, int* index_count)
+{
+	int rings = segments + 1;
+	*vertex_count = rings * rings;
+	*positions = (GLfloat*)malloc(*vertex_count * 3 * sizeof(GLfloat));
+	for (int y = 0; y < rings; y++)
+	{
+		float theta = (float)y / segments * 3.14159265f;
+		for (int x = 0; x < rings; x++)
+		{
+			float phi = (float)x / segments * 2.0f * 3.14159265f;
+			GLfloat* p = *positions + (y * rings + x) * 3;
+			p[0] = sinf(theta) * cosf(phi);
+			p[1] = cosf(theta);
+			p[2] = sinf(theta) * sinf(phi);
+		}
+	}
+	*index_count = segments * segments * 6;
+	*indices = (GLuint*)malloc(*index_count * sizeof(GLuint));
+	GLuint* idx = *indices;
+	for (int y = 0; y < segments; y++)
+	{
+		for (int x = 0; x < segments; x++)
+		{
+			GLuint a = y * rings + x;
+			GLuint b = a + rings;
+			// 外向きが表(CCW)
+			*idx++ = a; *idx++ = a + 1; *idx++ = b;
+			*idx++ = a + 1; *idx++ = b + 1; *idx++ = b;
+		}
+	}
+}
+
+void benchmark_meshlet_culling(int segments, int iterations)
+{
+	GLfloat* positions;
+	GLuint* indices;
+	int vertex_count, index_count;
+	make_sphere(segments, &positions, &vertex_count, &indices, &index_count);
+
+	double start = get_precise_time_ms();
+	Meshlet* meshlets;
+	int meshlet_count = build_meshlets(positions, vertex_count, indices, index_count, &meshlets);
+	double build_ms = get_precise_time_ms() - start;
+	printf(
+		"meshlet benchmark: %i triangles -> %i meshlets in %.2f ms\n",
+		index_count / 3,
+		meshlet_count,
+		build_ms);
+
+	// 球の周りを回るカメラ。一部だけ画面に入るよう近づけておく
+	mat4 proj = perspective(67.0f, 4.0f / 3.0f, 0.1f, 100.0f);
+	Meshlet_Draw_List list;
+	memset(&list, 0, sizeof(list));
+	long long visible = 0;
+	long long total = 0;
+	long long draws = 0;
+	start = get_precise_time_ms();
+	for (int i = 0; i < iterations; i++)
+	{
+		float angle = (float)i / iterations * 2.0f * 3.14159265f;
+		vec3 camera(cosf(angle) * 1.8f, sinf(angle * 3.0f) * 0.5f, sinf(angle) * 1.8f);
+		vec3 target(-sinf(angle) * 0.6f, 0.0f, cosf(angle) * 0.6f);
+		mat4 view = look_at(camera, target, vec3(0.0f, 1.0f, 0.0f));
+		Frustum frustum;
+		extract_frustum(proj * view, &frustum);
+		reset_meshlet_draw_list(&list);
+		cull_meshlets(meshlets, meshlet_count, &frustum, camera, 0, 0, &list);
+		visible += list.visible_triangle_count;
+		total += list.triangle_count;
+		draws += list.draw_count;
+	}
+	double cull_ms = get_precise_time_ms() - start;
+	double meshlets_per_ms = cull_ms > 0.0 ? (double)meshlet_count * iterations / cull_ms : 0.0;
+	printf(
+		"meshlet benchmark: %i iterations in %.2f ms (%.0f meshlets/ms)\n",
+		iterations,
+		cull_ms,
+		meshlets_per_ms);
+	printf(
+		"meshlet benchmark: %.1f%% of triangles kept, %.1f draws per view\n",
+		total > 0 ? 100.0 * visible / total : 0.0,
+		(double)draws / iterations);
+	gl_log(
+		"meshlet benchmark: %i meshlets, build %.2f ms, cull %.0f meshlets/ms, %.1f%% kept\n",
+		meshlet_count,
+		build_ms,
+		meshlets_per_ms,
+		total > 0 ? 100.0 * visible / total : 0.0);
+
+	free_meshlet_draw_list(&list);
+	free(meshlets);
+	free(positions);
+	free(indices);
+}
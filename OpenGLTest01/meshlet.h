@@ -0,0 +1,78 @@
+#ifndef _MESHLET_H_
+#define _MESHLET_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+#include "maths_funcs.h"
+
+/*--------------------Meshlet Generation and Culling---------------------------*/
+// インデックス付きの三角形を小さなクラスタ(メッシュレット)に分け、クラスタごとに
+// バウンディングスフィアと法線コーンを持たせる。描画時にCPUでフラスタムとコーンの
+// 判定を行い、残ったクラスタだけをglMultiDrawElementsBaseVertex()で描画する
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+typedef struct Meshlet
+{
+	int first_index;	// メッシュのインデックス範囲の先頭からの位置
+	int index_count;
+	vec3 center;		// バウンディングスフィア(モデル空間)
+	float radius;
+	// 法線コーン。視点からapexへの方向とaxisの内積がcutoff以上なら全て裏面。
+	// cutoffが1以上ならコーンによる判定はしない
+	vec3 cone_apex;
+	vec3 cone_axis;
+	float cone_cutoff;
+}Meshlet;
+
+// indices をメッシュレットごとに連続するよう並べ替え、メッシュレットの配列を作る。
+// positions は float xyz。戻り値はメッシュレット数で、配列は free() で解放する
+int build_meshlets(
+	const GLfloat* positions,
+	int vertex_count,
+	GLuint* indices,
+	int index_count,
+	Meshlet** meshlets);
+
+typedef struct Frustum
+{
+	float planes[6][4];	// ax + by + cz + d >= 0 が内側
+}Frustum;
+// proj * view * model から、モデル空間での視錐台を作る
+void extract_frustum(mat4 pvm, Frustum* frustum);
+// 球が視錐台の外側に完全に出ているか。中心と半径は視錐台と同じ空間で渡す
+bool sphere_outside_frustum(const Frustum* frustum, vec3 center, float radius);
+
+// 可視なメッシュレットの描画リスト。連続するメッシュレットは1つの描画にまとめる
+typedef struct Meshlet_Draw_List
+{
+	GLsizei* counts;
+	GLvoid** offsets;
+	GLint* base_vertices;
+	int draw_count;
+	int capacity;
+	// 統計
+	int meshlet_count;
+	int frustum_culled;
+	int cone_culled;
+	int triangle_count;
+	int visible_triangle_count;
+}Meshlet_Draw_List;
+
+void reset_meshlet_draw_list(Meshlet_Draw_List* list);
+void free_meshlet_draw_list(Meshlet_Draw_List* list);
+// camera はモデル空間での視点の位置。first_index, base_vertex はアリーナ上の範囲
+void cull_meshlets(
+	const Meshlet* meshlets,
+	int meshlet_count,
+	const Frustum* frustum,
+	vec3 camera,
+	int first_index,
+	int base_vertex,
+	Meshlet_Draw_List* list);
+// アリーナのVAOがバインドされている前提で描画する
+void draw_meshlet_list(const Meshlet_Draw_List* list);
+
+// GLを使わずに合成した球メッシュでメッシュレットの生成とカリングの速度を測る
+void benchmark_meshlet_culling(int segments, int iterations);
+
+#endif
@@ -0,0 +1,286 @@
+#include "render_queue.h"
+#include "gl_utils.h"
+#include "gl_state.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*--------------------Sort-Key Render Queue---------------------------*/
+#define RENDER_KEY_DEPTH_MAX 0xffffff
+
+bool create_render_queue(Render_Queue* queue, int capacity)
+{
+	memset(queue, 0, sizeof(Render_Queue));
+	queue->packets = (Draw_Packet*)malloc(capacity * sizeof(Draw_Packet));
+	queue->items = (Render_Sort_Item*)malloc(capacity * sizeof(Render_Sort_Item));
+	queue->sort_temp = (Render_Sort_Item*)malloc(capacity * sizeof(Render_Sort_Item));
+	queue->batch_datas = (void**)malloc(capacity * sizeof(void*));
+	if (!queue->packets || !queue->items || !queue->sort_temp || !queue->batch_datas)
+	{
+		gl_log_err("ERROR: could not allocate render queue of %i packets\n", capacity);
+		destroy_render_queue(queue);
+		return false;
+	}
+	queue->capacity = capacity;
+	queue->batching = true;
+	return true;
+}
+
+void destroy_render_queue(Render_Queue* queue)
+{
+	free(queue->packets);
+	free(queue->items);
+	free(queue->sort_temp);
+	free(queue->batch_datas);
+	memset(queue, 0, sizeof(Render_Queue));
+}
+
+// ポインタの全ビットを混ぜて上位bitsビットを取る(フィボナッチハッシュ)
+static unsigned long long fold_batch_key(const void* batch_key, int bits)
+{
+	if (!batch_key)
+	{
+		return 0;
+	}
+	return ((unsigned long long)(size_t)batch_key * 0x9e3779b97f4a7c15ull) >> (64 - bits);
+}
+
+unsigned long long make_render_key(int pass, GLuint programme, int material, GLuint vao, const void* batch_key, float depth)
+{
+	if (depth < 0.0f) depth = 0.0f;
+	if (depth > 1.0f) depth = 1.0f;
+	unsigned long long d = (unsigned long long)(depth * RENDER_KEY_DEPTH_MAX);
+	unsigned long long key = (unsigned long long)(pass & 0xf) << 60;
+	if (pass == RENDER_PASS_TRANSPARENT)
+	{
+		// 奥から手前へ。深度が同じものだけをステートでまとめる
+		key |= (RENDER_KEY_DEPTH_MAX - d) << 36;
+		key |= (unsigned long long)(programme & 0xff) << 28;
+		key |= (unsigned long long)(material & 0xfff) << 16;
+		key |= (unsigned long long)(vao & 0xff) << 8;
+		key |= fold_batch_key(batch_key, 8);
+	}
+	else
+	{
+		key |= (unsigned long long)(programme & 0xff) << 52;
+		key |= (unsigned long long)(material & 0xfff) << 40;
+		key |= (unsigned long long)(vao & 0xff) << 32;
+		// 不透明は手前から描いて早期の深度テストで捨てさせる。オーバーレイは積んだ順
+		if (pass == RENDER_PASS_OPAQUE)
+		{
+			key |= fold_batch_key(batch_key, 16) << 16;
+			key |= d >> 8;
+		}
+	}
+	return key;
+}
+
+void begin_render_queue(Render_Queue* queue)
+{
+	queue->count = 0;
+	memset(&queue->frame, 0, sizeof(Render_Queue_Stats));
+}
+
+Draw_Packet* submit_draw_packet(Render_Queue* queue, unsigned long long key)
+{
+	if (queue->count >= queue->capacity)
+	{
+		queue->frame.dropped++;
+		return NULL;
+	}
+	int i = queue->count++;
+	queue->items[i].key = key;
+	queue->items[i].packet = i;
+	Draw_Packet* packet = &queue->packets[i];
+	memset(packet, 0, sizeof(Draw_Packet));
+	return packet;
+}
+
+// 下位バイトから8bitずつの安定な基数ソート。全要素で同じ値のバイトは飛ばす
+static void radix_sort_items(Render_Sort_Item* items, Render_Sort_Item* temp, int count)
+{
+	int histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (int i = 0; i < count; i++)
+	{
+		unsigned long long key = items[i].key;
+		for (int b = 0; b < 8; b++)
+		{
+			histograms[b][(key >> (b * 8)) & 0xff]++;
+		}
+	}
+	Render_Sort_Item* src = items;
+	Render_Sort_Item* dst = temp;
+	for (int b = 0; b < 8; b++)
+	{
+		int* histogram = histograms[b];
+		if (histogram[(src[0].key >> (b * 8)) & 0xff] == count)
+		{
+			continue;
+		}
+		int offset = 0;
+		for (int v = 0; v < 256; v++)
+		{
+			int n = histogram[v];
+			histogram[v] = offset;
+			offset += n;
+		}
+		for (int i = 0; i < count; i++)
+		{
+			dst[histogram[(src[i].key >> (b * 8)) & 0xff]++] = src[i];
+		}
+		Render_Sort_Item* swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != items)
+	{
+		memcpy(items, src, count * sizeof(Render_Sort_Item));
+	}
+}
+
+void sort_render_queue(Render_Queue* queue)
+{
+	if (queue->count <= 1)
+	{
+		return;
+	}
+	double start = get_precise_time_ms();
+	radix_sort_items(queue->items, queue->sort_temp, queue->count);
+	queue->frame.sort_ms = get_precise_time_ms() - start;
+}
+
+// 変わったビットだけ切り替える。currentが~0なら全て設定する
+static void apply_render_state(unsigned int state, unsigned int current)
+{
+	unsigned int changed = state ^ current;
+	if (current == ~0u || (changed & RENDER_STATE_DEPTH_TEST))
+	{
+		gl_state_set_capability(GL_DEPTH_TEST, (state & RENDER_STATE_DEPTH_TEST) != 0);
+	}
+	if (current == ~0u || (changed & RENDER_STATE_PROGRAM_POINT_SIZE))
+	{
+		gl_state_set_capability(GL_PROGRAM_POINT_SIZE, (state & RENDER_STATE_PROGRAM_POINT_SIZE) != 0);
+	}
+}
+
+// iから始まる、まとめて描けるパケットの数
+static int batch_run_length(const Render_Queue* queue, int i)
+{
+	const Draw_Packet* first = &queue->packets[queue->items[i].packet];
+	if (!queue->batching || !first->batch)
+	{
+		return 1;
+	}
+	int n = 1;
+	while (i + n < queue->count)
+	{
+		const Draw_Packet* packet = &queue->packets[queue->items[i + n].packet];
+		if (packet->batch != first->batch ||
+			packet->batch_key != first->batch_key ||
+			packet->programme != first->programme ||
+			packet->vao != first->vao ||
+			packet->state != first->state)
+		{
+			break;
+		}
+		n++;
+	}
+	return n;
+}
+
+void flush_render_queue(Render_Queue* queue)
+{
+	Render_Queue_Stats* stats = &queue->frame;
+	stats->packets = queue->count;
+	// 最初のパケットとバッチの後ではGLの状態キャッシュに任せる(既に同じものが結ばれていれば省かれる)
+	bool bound = false;
+	GLuint programme = 0;
+	GLuint vao = 0;
+	unsigned int state = ~0u;
+	for (int i = 0; i < queue->count;)
+	{
+		const Draw_Packet* packet = &queue->packets[queue->items[i].packet];
+		if (!bound || packet->programme != programme)
+		{
+			gl_state_use_programme(packet->programme);
+			programme = packet->programme;
+			stats->programme_binds++;
+		}
+		if (!bound || packet->vao != vao)
+		{
+			gl_state_bind_vertex_array(packet->vao);
+			vao = packet->vao;
+			stats->vao_binds++;
+		}
+		bound = true;
+		if (packet->state != state)
+		{
+			apply_render_state(packet->state, state);
+			state = packet->state;
+			stats->state_changes++;
+		}
+		stats->draw_calls++;
+		int n = batch_run_length(queue, i);
+		if (n >= RENDER_BATCH_MIN)
+		{
+			for (int j = 0; j < n; j++)
+			{
+				queue->batch_datas[j] = queue->packets[queue->items[i + j].packet].data;
+			}
+			packet->batch(queue->batch_datas, n);
+			stats->batches++;
+			stats->batched_packets += n;
+			// バッチはプログラムやVAOを変えているかもしれない
+			bound = false;
+			i += n;
+		}
+		else
+		{
+			packet->draw(packet->data);
+			i++;
+		}
+	}
+	if (state != RENDER_STATE_DEFAULT)
+	{
+		apply_render_state(RENDER_STATE_DEFAULT, state);
+	}
+
+	queue->total.packets += stats->packets;
+	queue->total.programme_binds += stats->programme_binds;
+	queue->total.vao_binds += stats->vao_binds;
+	queue->total.state_changes += stats->state_changes;
+	queue->total.draw_calls += stats->draw_calls;
+	queue->total.batches += stats->batches;
+	queue->total.batched_packets += stats->batched_packets;
+	queue->total.dropped += stats->dropped;
+	queue->total.sort_ms += stats->sort_ms;
+	queue->frames++;
+	queue->count = 0;
+}
+
+void log_render_queue_stats(const Render_Queue* queue)
+{
+	int frames = queue->frames > 0 ? queue->frames : 1;
+	gl_log_print(
+		"render queue: %.1f packets/frame, %.1f programme binds, %.1f vao binds, %.1f state changes, sort %.3f ms/frame\n",
+		(double)queue->total.packets / frames,
+		(double)queue->total.programme_binds / frames,
+		(double)queue->total.vao_binds / frames,
+		(double)queue->total.state_changes / frames,
+		queue->total.sort_ms / frames);
+	if (queue->total.batches > 0)
+	{
+		gl_log_print(
+			"render queue batching: %.1f%% of packets merged into %.1f batches/frame, %.1f draw calls/frame (%.1f%% fewer)\n",
+			100.0 * queue->total.batched_packets / queue->total.packets,
+			(double)queue->total.batches / frames,
+			(double)queue->total.draw_calls / frames,
+			100.0 - 100.0 * queue->total.draw_calls / queue->total.packets);
+	}
+	if (queue->total.dropped > 0)
+	{
+		gl_log_err("WARNING: render queue dropped %i packets (capacity %i)\n", queue->total.dropped, queue->capacity);
+	}
+}
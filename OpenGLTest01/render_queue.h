@@ -0,0 +1,88 @@
+#ifndef _RENDER_QUEUE_H_
+#define _RENDER_QUEUE_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+
+/*--------------------Sort-Key Render Queue---------------------------*/
+// 描画をその場で発行せず、64bitのソートキーを付けたパケットとして積む。
+// フレームの最後にキーで基数ソートし、プログラム・VAO・ステートが変わるときだけGLを呼んで描画する。
+// 不透明パスのキー(上位から): パス 4bit | プログラム 8bit | マテリアル 12bit | VAO 8bit | バッチ 16bit | 深度 16bit
+// バッチは深度より先に並べ、まとめられるパケットがカメラの位置によらず隣り合うようにする。
+// 半透明パスは奥から描く必要があるので、深度(反転)24bitをパスの直後に置き、バッチ8bitは最下位に置く
+#define RENDER_PASS_OPAQUE 0
+#define RENDER_PASS_TRANSPARENT 1
+#define RENDER_PASS_OVERLAY 2		// 深度を使わない。積んだ順に描く
+
+// パケットが必要とするステート
+#define RENDER_STATE_DEPTH_TEST 0x1
+#define RENDER_STATE_PROGRAM_POINT_SIZE 0x2
+// フラッシュの後はこの状態に戻す
+#define RENDER_STATE_DEFAULT RENDER_STATE_DEPTH_TEST
+
+// プログラムとVAOを結んだ後に呼ばれる。パケット固有のuniformを設定して描画する
+typedef void (*Draw_Function)(void* data);
+// 動的バッチ。同じbatchとbatch_keyを持ち、プログラム・VAO・ステートも同じパケットが続いたとき、
+// drawの代わりにまとめて1回呼ばれる(datasは各パケットのdata)。プログラムとVAOは自分で結び直してよい
+typedef void (*Batch_Function)(void** datas, int count);
+// これより短い並びはまとめない
+#define RENDER_BATCH_MIN 2
+
+typedef struct Draw_Packet
+{
+	GLuint programme;
+	GLuint vao;
+	unsigned int state;		// RENDER_STATE_*
+	Draw_Function draw;
+	void* data;				// drawに渡す。フレームアロケータから取るとよい
+	Batch_Function batch;	// NULLならまとめない
+	const void* batch_key;	// 同じ値のパケットだけをまとめる(メッシュなど)
+}Draw_Packet;
+
+typedef struct Render_Sort_Item
+{
+	unsigned long long key;
+	int packet;
+}Render_Sort_Item;
+
+typedef struct Render_Queue_Stats
+{
+	int packets;
+	int programme_binds;
+	int vao_binds;
+	int state_changes;
+	int draw_calls;		// drawとbatchを呼んだ回数
+	int batches;
+	int batched_packets;	// バッチにまとめたパケットの数
+	int dropped;		// 容量を超えて積めなかった数
+	double sort_ms;
+}Render_Queue_Stats;
+
+typedef struct Render_Queue
+{
+	Draw_Packet* packets;
+	Render_Sort_Item* items;	// 積んだ順。ソートするとこちらが並べ替わる
+	Render_Sort_Item* sort_temp;
+	void** batch_datas;
+	int count;
+	int capacity;
+	Render_Queue_Stats frame;	// 最後にフラッシュしたフレーム
+	Render_Queue_Stats total;
+	int frames;
+	bool batching;		// 動的バッチを行うか
+}Render_Queue;
+
+bool create_render_queue(Render_Queue* queue, int capacity);
+void destroy_render_queue(Render_Queue* queue);
+// programmeとvaoはGLの名前の下位8bitだけをキーに使う(同じ値になっても描画は正しく、並びが粗くなるだけ)。
+// batch_keyはパケットに設定するものと同じ値(まとめないならNULL)。ポインタをハッシュして使う(衝突しても並びが粗くなるだけ)。
+// depthはビュー空間の距離を[0, 1]に正規化したもの
+unsigned long long make_render_key(int pass, GLuint programme, int material, GLuint vao, const void* batch_key, float depth);
+void begin_render_queue(Render_Queue* queue);
+// 書き込むパケットを返す。一杯ならNULL
+Draw_Packet* submit_draw_packet(Render_Queue* queue, unsigned long long key);
+// キーの昇順に並べる(安定ソートなので同じキーは積んだ順のまま)
+void sort_render_queue(Render_Queue* queue);
+void flush_render_queue(Render_Queue* queue);
+void log_render_queue_stats(const Render_Queue* queue);
+
+#endif
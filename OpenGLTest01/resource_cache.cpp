@@ -0,0 +1,446 @@
+#include "resource_cache.h"
+#include "timer.h"
+#include "gpu_memory.h"
+#include "gl_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+typedef struct Cached_Mesh
+{
+	bool used;
+	char path[MAX_RESOURCE_PATH];
+	Mesh_Arena* arena;
+	int state;
+	Async_Load_Handle load;
+	Scene_Mesh mesh;
+	size_t bytes;
+	int refcount;
+	double unused_since;
+	bool pinned;
+	unsigned int last_used_frame;
+}Cached_Mesh;
+
+typedef struct Cached_Programme
+{
+	bool used;
+	char vs_filename[MAX_RESOURCE_PATH];
+	char fs_filename[MAX_RESOURCE_PATH];
+	char* defines;
+	GLuint programme;
+	int refcount;
+	double unused_since;
+}Cached_Programme;
+
+static Cached_Mesh g_cached_meshes[MAX_CACHED_MESHES];
+static Cached_Programme g_cached_programmes[MAX_CACHED_PROGRAMMES];
+static double g_release_delay_s = 5.0;
+static size_t g_unused_budget_bytes = 64 * 1024 * 1024;
+
+// 統計
+static int g_mesh_imports = 0;
+static int g_mesh_hits = 0;
+static int g_mesh_releases = 0;
+static int g_mesh_evictions = 0;
+static int g_mesh_restreams = 0;
+static unsigned int g_frame = 0;
+static int g_programme_builds = 0;
+static int g_programme_hits = 0;
+
+void set_resource_release_policy(double release_delay_s, size_t unused_budget_bytes)
+{
+	g_release_delay_s = release_delay_s;
+	g_unused_budget_bytes = unused_budget_bytes;
+}
+
+/*--------------------Meshes---------------------------*/
+// アリーナ上で占めるバイト数
+static size_t scene_mesh_bytes(const Scene_Mesh* mesh)
+{
+	if (!mesh->arena)
+	{
+		return 0;
+	}
+	size_t vertex_size = 0;
+	for (int s = 0; s < ARENA_STREAM_COUNT; s++)
+	{
+		vertex_size += mesh_arena_stream_stride(mesh->arena, s);
+	}
+	return vertex_size * mesh->vertex_count + sizeof(GLuint) * mesh->index_count;
+}
+
+static void mesh_became_resident(Cached_Mesh* entry)
+{
+	entry->state = MESH_RESOURCE_READY;
+	entry->bytes = scene_mesh_bytes(&entry->mesh);
+	add_arena_occupancy(entry->bytes);
+}
+
+// アリーナ上の範囲を明け渡す。エントリ自体は残す
+static void evict_cached_mesh(Cached_Mesh* entry)
+{
+	assert(entry->state == MESH_RESOURCE_READY);
+	free_scene_mesh(&entry->mesh);
+	remove_arena_occupancy(entry->bytes);
+	entry->state = MESH_RESOURCE_EVICTED;
+}
+
+static void free_cached_mesh(Cached_Mesh* entry)
+{
+	if (entry->state == MESH_RESOURCE_READY)
+	{
+		evict_cached_mesh(entry);
+	}
+	g_mesh_releases++;
+	*entry = Cached_Mesh();
+}
+
+static void start_mesh_load(Cached_Mesh* entry, bool async)
+{
+	entry->load = INVALID_ASYNC_LOAD;
+	if (async)
+	{
+		entry->load = load_mesh_async(entry->path, entry->arena);
+		entry->state = entry->load == INVALID_ASYNC_LOAD ? MESH_RESOURCE_FAILED : MESH_RESOURCE_LOADING;
+	}
+	else if (load_mesh(entry->path, entry->arena, &entry->mesh))
+	{
+		mesh_became_resident(entry);
+	}
+	else
+	{
+		entry->state = MESH_RESOURCE_FAILED;
+	}
+}
+
+static Cached_Mesh* get_cached_mesh(Mesh_Handle handle)
+{
+	if (handle < 0 || handle >= MAX_CACHED_MESHES || !g_cached_meshes[handle].used)
+	{
+		return NULL;
+	}
+	return &g_cached_meshes[handle];
+}
+
+Mesh_Handle acquire_mesh(const char* path, Mesh_Arena* arena, bool async)
+{
+	int free_slot = -1;
+	for (int i = 0; i < MAX_CACHED_MESHES; i++)
+	{
+		Cached_Mesh* entry = &g_cached_meshes[i];
+		if (!entry->used)
+		{
+			if (free_slot < 0)
+			{
+				free_slot = i;
+			}
+			continue;
+		}
+		// 読み込みに失敗したものは再度読み込みを試す
+		if (entry->arena == arena && entry->state != MESH_RESOURCE_FAILED && strcmp(entry->path, path) == 0)
+		{
+			entry->refcount++;
+			g_mesh_hits++;
+			return i;
+		}
+	}
+	if (free_slot < 0)
+	{
+		gl_log_err("ERROR: resource cache is full, could not load %s\n", path);
+		return INVALID_MESH_HANDLE;
+	}
+
+	Cached_Mesh* entry = &g_cached_meshes[free_slot];
+	*entry = Cached_Mesh();
+	entry->used = true;
+	strncpy(entry->path, path, MAX_RESOURCE_PATH - 1);
+	entry->arena = arena;
+	entry->refcount = 1;
+	entry->last_used_frame = g_frame;
+	g_mesh_imports++;
+	start_mesh_load(entry, async);
+	return free_slot;
+}
+
+void release_mesh(Mesh_Handle handle)
+{
+	Cached_Mesh* entry = get_cached_mesh(handle);
+	if (!entry)
+	{
+		return;
+	}
+	assert(entry->refcount > 0);
+	if (--entry->refcount == 0)
+	{
+		entry->unused_since = get_precise_time();
+	}
+}
+
+int mesh_resource_state(Mesh_Handle handle)
+{
+	Cached_Mesh* entry = get_cached_mesh(handle);
+	return entry ? entry->state : MESH_RESOURCE_FAILED;
+}
+
+Scene_Mesh* get_mesh(Mesh_Handle handle)
+{
+	Cached_Mesh* entry = get_cached_mesh(handle);
+	if (!entry)
+	{
+		return NULL;
+	}
+	entry->last_used_frame = g_frame;
+	if (entry->state == MESH_RESOURCE_EVICTED)
+	{
+		g_mesh_restreams++;
+		start_mesh_load(entry, true);
+	}
+	if (entry->state != MESH_RESOURCE_READY)
+	{
+		return NULL;
+	}
+	return &entry->mesh;
+}
+
+void pin_mesh(Mesh_Handle handle, bool pinned)
+{
+	Cached_Mesh* entry = get_cached_mesh(handle);
+	if (entry)
+	{
+		entry->pinned = pinned;
+	}
+}
+
+/*--------------------Programmes---------------------------*/
+static bool same_defines(const char* a, const char* b)
+{
+	return strcmp(a ? a : "", b ? b : "") == 0;
+}
+
+GLuint acquire_programme(const char* vs_filename, const char* fs_filename, const char* defines)
+{
+	int free_slot = -1;
+	for (int i = 0; i < MAX_CACHED_PROGRAMMES; i++)
+	{
+		Cached_Programme* entry = &g_cached_programmes[i];
+		if (!entry->used)
+		{
+			if (free_slot < 0)
+			{
+				free_slot = i;
+			}
+			continue;
+		}
+		if (strcmp(entry->vs_filename, vs_filename) == 0 &&
+			strcmp(entry->fs_filename, fs_filename) == 0 &&
+			same_defines(entry->defines, defines))
+		{
+			entry->refcount++;
+			g_programme_hits++;
+			return entry->programme;
+		}
+	}
+	if (free_slot < 0)
+	{
+		gl_log_err("ERROR: resource cache is full, could not build programme %s %s\n", vs_filename, fs_filename);
+		return 0;
+	}
+
+	// 失敗したものは覚えない。acquire_mesh()と同じく、次に要求されたときに作り直す
+	GLuint programme = create_programme_from_files_with_defines(vs_filename, fs_filename, defines);
+	g_programme_builds++;
+	if (!programme)
+	{
+		return 0;
+	}
+	Cached_Programme* entry = &g_cached_programmes[free_slot];
+	memset(entry, 0, sizeof(Cached_Programme));
+	entry->used = true;
+	strncpy(entry->vs_filename, vs_filename, MAX_RESOURCE_PATH - 1);
+	strncpy(entry->fs_filename, fs_filename, MAX_RESOURCE_PATH - 1);
+	if (defines)
+	{
+		entry->defines = (char*)malloc(strlen(defines) + 1);
+		strcpy(entry->defines, defines);
+	}
+	entry->programme = programme;
+	entry->refcount = 1;
+	return programme;
+}
+
+void release_programme(GLuint programme)
+{
+	for (int i = 0; i < MAX_CACHED_PROGRAMMES; i++)
+	{
+		Cached_Programme* entry = &g_cached_programmes[i];
+		if (entry->used && entry->programme == programme)
+		{
+			assert(entry->refcount > 0);
+			if (--entry->refcount == 0)
+			{
+				entry->unused_since = get_precise_time();
+			}
+			return;
+		}
+	}
+}
+
+static void free_cached_programme(Cached_Programme* entry)
+{
+	gl_state_forget_programme(entry->programme);
+	glDeleteProgram(entry->programme);
+	free(entry->defines);
+	memset(entry, 0, sizeof(Cached_Programme));
+}
+
+/*--------------------Collection---------------------------*/
+void update_resource_cache()
+{
+	g_frame++;
+	double now = get_precise_time();
+	size_t unused_bytes = 0;
+	for (int i = 0; i < MAX_CACHED_MESHES; i++)
+	{
+		Cached_Mesh* entry = &g_cached_meshes[i];
+		if (!entry->used)
+		{
+			continue;
+		}
+		// 非同期読み込みの完了を受け取る
+		if (entry->state == MESH_RESOURCE_LOADING)
+		{
+			int state = async_load_state(entry->load);
+			if (state == ASYNC_LOAD_READY && take_async_loaded_mesh(entry->load, &entry->mesh))
+			{
+				mesh_became_resident(entry);
+				entry->load = INVALID_ASYNC_LOAD;
+			}
+			else if (state == ASYNC_LOAD_FAILED)
+			{
+				take_async_loaded_mesh(entry->load, NULL);
+				entry->state = MESH_RESOURCE_FAILED;
+				entry->load = INVALID_ASYNC_LOAD;
+			}
+			continue;
+		}
+		if (entry->refcount > 0)
+		{
+			continue;
+		}
+		if (now - entry->unused_since >= g_release_delay_s)
+		{
+			free_cached_mesh(entry);
+			continue;
+		}
+		if (entry->state == MESH_RESOURCE_READY)
+		{
+			unused_bytes += entry->bytes;
+		}
+	}
+
+	// 未使用分が予算を超えていれば、使われなくなったのが古いものから解放する
+	while (unused_bytes > g_unused_budget_bytes)
+	{
+		Cached_Mesh* oldest = NULL;
+		for (int i = 0; i < MAX_CACHED_MESHES; i++)
+		{
+			Cached_Mesh* entry = &g_cached_meshes[i];
+			if (entry->used && entry->refcount == 0 && entry->state == MESH_RESOURCE_READY &&
+				(!oldest || entry->unused_since < oldest->unused_since))
+			{
+				oldest = entry;
+			}
+		}
+		if (!oldest)
+		{
+			break;
+		}
+		unused_bytes -= oldest->bytes;
+		free_cached_mesh(oldest);
+	}
+
+	// 常駐しているメッシュがGPUメモリの予算を超えていれば、最後に描画されたのが古いものから追い出す。
+	// 前のフレームで描画したものは残す
+	while (gpu_memory_over_budget() > 0)
+	{
+		Cached_Mesh* lru = NULL;
+		for (int i = 0; i < MAX_CACHED_MESHES; i++)
+		{
+			Cached_Mesh* entry = &g_cached_meshes[i];
+			if (!entry->used || entry->pinned || entry->state != MESH_RESOURCE_READY ||
+				entry->last_used_frame + 1 >= g_frame)
+			{
+				continue;
+			}
+			// 参照の無いものを優先する
+			if (!lru ||
+				(entry->refcount == 0) > (lru->refcount == 0) ||
+				((entry->refcount == 0) == (lru->refcount == 0) && entry->last_used_frame < lru->last_used_frame))
+			{
+				lru = entry;
+			}
+		}
+		if (!lru)
+		{
+			break;
+		}
+		g_mesh_evictions++;
+		if (lru->refcount == 0)
+		{
+			free_cached_mesh(lru);
+		}
+		else
+		{
+			evict_cached_mesh(lru);
+		}
+	}
+
+	for (int i = 0; i < MAX_CACHED_PROGRAMMES; i++)
+	{
+		Cached_Programme* entry = &g_cached_programmes[i];
+		if (entry->used && entry->refcount == 0 && now - entry->unused_since >= g_release_delay_s)
+		{
+			free_cached_programme(entry);
+		}
+	}
+}
+
+void clear_resource_cache()
+{
+	for (int i = 0; i < MAX_CACHED_MESHES; i++)
+	{
+		Cached_Mesh* entry = &g_cached_meshes[i];
+		if (!entry->used)
+		{
+			continue;
+		}
+		// 読み込み中のものはスロットだけ解放する(stop_async_loader()の後に呼ぶこと)
+		if (entry->state == MESH_RESOURCE_LOADING)
+		{
+			take_async_loaded_mesh(entry->load, NULL);
+			entry->state = MESH_RESOURCE_FAILED;
+		}
+		free_cached_mesh(entry);
+	}
+	for (int i = 0; i < MAX_CACHED_PROGRAMMES; i++)
+	{
+		if (g_cached_programmes[i].used)
+		{
+			free_cached_programme(&g_cached_programmes[i]);
+		}
+	}
+}
+
+void log_resource_cache_stats()
+{
+	gl_log_print(
+		"resource cache: %i mesh imports, %i mesh hits, %i mesh releases, %i evictions, %i restreams, %i programme builds, %i programme hits\n",
+		g_mesh_imports,
+		g_mesh_hits,
+		g_mesh_releases,
+		g_mesh_evictions,
+		g_mesh_restreams,
+		g_programme_builds,
+		g_programme_hits);
+}
@@ -0,0 +1,50 @@
+#ifndef _RESOURCE_CACHE_H_
+#define _RESOURCE_CACHE_H_
+
+#include "gl_utils.h"
+#include "async_loader.h"
+
+/*--------------------Resource Cache---------------------------*/
+// パスと読み込み設定をキーにメッシュとシェーダプログラムを共有し、参照カウントで管理する。
+// 参照が無くなったものはすぐには解放せず、一定時間経つか、未使用分が予算を超えた時に古い順に解放する。
+// アリーナ上に常駐しているメッシュデータが予算(set_gpu_memory_budget())を超えると、
+// 参照があっても最後に描画されたのが古いものからアリーナを明け渡し、次に使われた時に読み直す。
+// 予算はアリーナの占有量だけを制限し、アリーナのバッファ自体の大きさは変わらない
+#define MAX_CACHED_MESHES 128
+#define MAX_CACHED_PROGRAMMES 64
+#define MAX_RESOURCE_PATH 256
+
+typedef int Mesh_Handle;
+#define INVALID_MESH_HANDLE -1
+
+#define MESH_RESOURCE_LOADING 0
+#define MESH_RESOURCE_READY 1
+#define MESH_RESOURCE_FAILED 2
+#define MESH_RESOURCE_EVICTED 3	// 予算のために追い出された。get_mesh()で読み直しが始まる
+
+// release_delay_s: 参照が無くなってから解放するまでの秒数。
+// unused_budget_bytes: 未使用のメッシュが保持してよいアリーナ上のバイト数
+void set_resource_release_policy(double release_delay_s, size_t unused_budget_bytes);
+
+// 同じパスとアリーナ(頂点フォーマット)のメッシュは再インポートせずに共有する。
+// async ならワーカースレッドで読み込み、完了するまでget_mesh()はNULLを返す
+Mesh_Handle acquire_mesh(const char* path, Mesh_Arena* arena, bool async);
+void release_mesh(Mesh_Handle handle);
+int mesh_resource_state(Mesh_Handle handle);
+// 描画する直前に呼ぶ。最後に使われたフレームを記録し、追い出されていれば読み直しを始める
+Scene_Mesh* get_mesh(Mesh_Handle handle);
+// 固定したメッシュは予算を超えても追い出さない(ポインタを持ち続けるものに使う)
+void pin_mesh(Mesh_Handle handle, bool pinned);
+
+// 同じシェーダファイルとdefinesの組み合わせは1つのプログラムを共有する。
+// 作れなければ0を返す(失敗は覚えないので、次の呼び出しで作り直す)
+GLuint acquire_programme(const char* vs_filename, const char* fs_filename, const char* defines);
+void release_programme(GLuint programme);
+
+// 毎フレームGLスレッドから呼ぶ。非同期読み込みの完了を受け取り、期限切れのものを解放する
+void update_resource_cache();
+// 参照の有無に関わらず全て解放する
+void clear_resource_cache();
+void log_resource_cache_stats();
+
+#endif
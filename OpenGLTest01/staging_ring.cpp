@@ -0,0 +1,254 @@
+#include "staging_ring.h"
+#include "gl_utils.h"
+#include "timer.h"
+#include "gpu_memory.h"
+#include "gl_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STAGING_FENCE_TIMEOUT_NS 1000000000
+
+bool create_staging_ring(Staging_Ring* ring, int size)
+{
+	memset(ring, 0, sizeof(Staging_Ring));
+	ring->size = size;
+	ring->persistent = GLEW_ARB_buffer_storage ? true : false;
+
+	glGenBuffers(1, &ring->buffer);
+	gl_state_bind_buffer(GL_COPY_READ_BUFFER, ring->buffer);
+	if (ring->persistent)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_READ_BUFFER, size, NULL, flags);
+		ring->mapped = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, flags);
+		if (!ring->mapped)
+		{
+			gl_log_err("ERROR: could not map staging ring of %i bytes\n", size);
+			gl_state_forget_buffer(ring->buffer);
+			glDeleteBuffers(1, &ring->buffer);
+			return false;
+		}
+	}
+	else
+	{
+		// フォールバック: CPU側に書き込み、使う時にglBufferSubData()で送る
+		glBufferData(GL_COPY_READ_BUFFER, size, NULL, GL_STREAM_DRAW);
+		ring->mapped = (unsigned char*)malloc(size);
+	}
+	track_gpu_alloc(ring->buffer, GPU_MEMORY_STAGING, "staging ring", size);
+	gl_log(
+		"created staging ring: %i bytes, %s\n",
+		size,
+		ring->persistent ? "persistent mapped" : "glBufferSubData fallback");
+	return true;
+}
+
+void destroy_staging_ring(Staging_Ring* ring)
+{
+	for (int i = 0; i < ring->fence_count; i++)
+	{
+		glDeleteSync(ring->fences[(ring->fence_head + i) % MAX_STAGING_FENCES].sync);
+	}
+	if (ring->persistent)
+	{
+		gl_state_bind_buffer(GL_COPY_READ_BUFFER, ring->buffer);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+	}
+	else
+	{
+		free(ring->mapped);
+	}
+	gpu_delete_buffers(1, &ring->buffer, GPU_MEMORY_STAGING);
+	memset(ring, 0, sizeof(Staging_Ring));
+}
+
+// 最も古いフェンスを待つ。block が false なら既に通過したものだけを回収する
+static bool reclaim_oldest(Staging_Ring* ring, bool block)
+{
+	if (ring->fence_count == 0)
+	{
+		return false;
+	}
+	Staging_Fence* fence = &ring->fences[ring->fence_head];
+	GLenum result = glClientWaitSync(fence->sync, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		if (!block)
+		{
+			return false;
+		}
+		double start = get_precise_time_ms();
+		do
+		{
+			result = glClientWaitSync(fence->sync, GL_SYNC_FLUSH_COMMANDS_BIT, STAGING_FENCE_TIMEOUT_NS);
+		} while (result == GL_TIMEOUT_EXPIRED);
+		ring->total_stall_ms += get_precise_time_ms() - start;
+		ring->total_stalls++;
+		ring->frame_stalls++;
+	}
+	glDeleteSync(fence->sync);
+	ring->reclaim_position = fence->position;
+	ring->fence_head = (ring->fence_head + 1) % MAX_STAGING_FENCES;
+	ring->fence_count--;
+	return true;
+}
+
+static void push_fence(Staging_Ring* ring)
+{
+	if (ring->fence_count >= MAX_STAGING_FENCES)
+	{
+		reclaim_oldest(ring, true);
+	}
+	Staging_Fence* fence = &ring->fences[(ring->fence_head + ring->fence_count) % MAX_STAGING_FENCES];
+	fence->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	fence->position = ring->write_position;
+	ring->fence_count++;
+}
+
+void* staging_ring_alloc(Staging_Ring* ring, int size, int alignment, int* offset)
+{
+	if (size > ring->size)
+	{
+		ring->total_overflows++;
+		ring->frame_overflows++;
+		return NULL;
+	}
+	if (alignment < 1)
+	{
+		alignment = 1;
+	}
+	for (;;)
+	{
+		long long position = ring->write_position;
+		int physical = (int)(position % ring->size);
+		int aligned = (physical + alignment - 1) / alignment * alignment;
+		// 末尾に収まらなければ先頭に戻る。余った分は捨てる
+		if (aligned + size > ring->size)
+		{
+			aligned = 0;
+		}
+		int padding = aligned >= physical ? aligned - physical : ring->size - physical;
+		long long end = position + padding + size;
+		if (end - ring->reclaim_position <= ring->size)
+		{
+			ring->write_position = end;
+			ring->frame_upload_bytes += size;
+			ring->total_upload_bytes += size;
+			*offset = aligned;
+			return ring->mapped + aligned;
+		}
+		// 空きが無い。まず通過済みのフェンスを回収し、それでも足りなければ待つ。
+		// フェンスが残っていなければ、残りは全てこのフレームの書き込みなので諦める
+		if (!reclaim_oldest(ring, false) && !reclaim_oldest(ring, true))
+		{
+			ring->total_overflows++;
+			ring->frame_overflows++;
+			return NULL;
+		}
+	}
+}
+
+void staging_ring_copy_to_buffer(
+	Staging_Ring* ring,
+	int offset,
+	int size,
+	GLuint dst_buffer,
+	GLintptr dst_offset)
+{
+	gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, dst_buffer);
+	if (ring->persistent)
+	{
+		gl_state_bind_buffer(GL_COPY_READ_BUFFER, ring->buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, dst_offset, size);
+	}
+	else
+	{
+		glBufferSubData(GL_COPY_WRITE_BUFFER, dst_offset, size, ring->mapped + offset);
+	}
+}
+
+void staging_ring_flush_range(Staging_Ring* ring, int offset, int size)
+{
+	if (!ring->persistent)
+	{
+		gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, ring->buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, ring->mapped + offset);
+	}
+}
+
+void staging_ring_bind_range(
+	Staging_Ring* ring,
+	GLenum target,
+	GLuint index,
+	int offset,
+	int size)
+{
+	staging_ring_flush_range(ring, offset, size);
+	gl_state_bind_buffer_range(target, index, ring->buffer, offset, size);
+}
+
+void staging_ring_upload(
+	Staging_Ring* ring,
+	GLuint dst_buffer,
+	GLintptr dst_offset,
+	const void* data,
+	int size)
+{
+	const unsigned char* src = (const unsigned char*)data;
+	int max_chunk = ring->size / 2;
+	while (size > 0)
+	{
+		int chunk = size < max_chunk ? size : max_chunk;
+		int offset;
+		void* dst = NULL;
+		if (ring->write_position - ring->frame_position + chunk <= max_chunk)
+		{
+			dst = staging_ring_alloc(ring, chunk, 4, &offset);
+		}
+		if (dst)
+		{
+			memcpy(dst, src, chunk);
+			staging_ring_copy_to_buffer(ring, offset, chunk, dst_buffer, dst_offset);
+		}
+		else
+		{
+			gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, dst_buffer);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, dst_offset, chunk, src);
+		}
+		src += chunk;
+		dst_offset += chunk;
+		size -= chunk;
+	}
+}
+
+void staging_ring_end_frame(Staging_Ring* ring)
+{
+	if (ring->write_position > ring->reclaim_position &&
+		(ring->fence_count == 0 ||
+		ring->fences[(ring->fence_head + ring->fence_count - 1) % MAX_STAGING_FENCES].position < ring->write_position))
+	{
+		push_fence(ring);
+	}
+	ring->frame_position = ring->write_position;
+	// GPUが追いついている分は待たずに回収しておく
+	while (reclaim_oldest(ring, false))
+	{
+	}
+	ring->frame_upload_bytes = 0;
+	ring->frame_stalls = 0;
+	ring->frame_overflows = 0;
+}
+
+void log_staging_ring_stats(const Staging_Ring* ring)
+{
+	gl_log_print(
+		"staging ring: %lld bytes uploaded, %i stalls (%.2f ms)\n",
+		ring->total_upload_bytes,
+		ring->total_stalls,
+		ring->total_stall_ms);
+	if (ring->total_overflows > 0)
+	{
+		gl_log_err("WARNING: staging ring was full %i times (%i bytes)\n", ring->total_overflows, ring->size);
+	}
+}
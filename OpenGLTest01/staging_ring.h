@@ -0,0 +1,80 @@
+#ifndef _STAGING_RING_H_
+#define _STAGING_RING_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+
+/*--------------------Persistent Mapped Staging Ring---------------------------*/
+// ARB_buffer_storageで永続的にマップしたリングバッファ。CPUはマップ済みのメモリに直接書き込み、
+// glCopyBufferSubData()で転送先へコピーするか、リングの範囲をそのままバインドして使う。
+// フレームの終わりにフェンスを置き、GPUが読み終えた範囲だけを再利用する。
+// フレームの途中ではフェンスを置かない(描画キューがまだ使っていない範囲まで回収してしまうため)。
+// 1フレームの書き込みがリングに収まらなければ、確保はNULLを返す
+// ARB_buffer_storageが無い環境ではCPU側のメモリに書き込み、glBufferSubData()で転送する
+#define MAX_STAGING_FENCES 16
+
+typedef struct Staging_Fence
+{
+	GLsync sync;
+	long long position;	// フェンスを置いた時点の書き込み位置
+}Staging_Fence;
+
+typedef struct Staging_Ring
+{
+	GLuint buffer;
+	unsigned char* mapped;
+	int size;
+	bool persistent;
+	// 書き込み位置と解放済み位置は単調増加させ、size で割った余りを物理オフセットとする
+	long long write_position;
+	long long reclaim_position;
+	long long frame_position;	// 最後にフェンスを置いた(フレームを終えた)時点の書き込み位置
+	Staging_Fence fences[MAX_STAGING_FENCES];
+	int fence_head;
+	int fence_count;
+
+	// 統計
+	long long total_upload_bytes;
+	long long frame_upload_bytes;
+	int total_stalls;
+	int frame_stalls;
+	double total_stall_ms;
+	int total_overflows;	// 空きが無くてNULLを返した回数
+	int frame_overflows;
+}Staging_Ring;
+
+bool create_staging_ring(Staging_Ring* ring, int size);
+void destroy_staging_ring(Staging_Ring* ring);
+// size バイトを alignment に揃えて確保し、書き込み先のポインタを返す。offset はリングバッファ内の位置。
+// 空きが無ければ古いフェンスを待つ(ストールとして数える)。
+// 終えたフレームの分を全て回収しても足りなければNULL(このフレームの書き込みは回収しない)
+void* staging_ring_alloc(Staging_Ring* ring, int size, int alignment, int* offset);
+// 確保した範囲を転送先バッファへコピーする
+void staging_ring_copy_to_buffer(
+	Staging_Ring* ring,
+	int offset,
+	int size,
+	GLuint dst_buffer,
+	GLintptr dst_offset);
+// 確保した範囲を頂点属性やテクスチャバッファとしてリングから直接読む前に呼ぶ。
+// 永続マップなら何もしない。フォールバックではCPU側の内容を転送する
+void staging_ring_flush_range(Staging_Ring* ring, int offset, int size);
+// 確保した範囲をUBOなどとして直接バインドする
+void staging_ring_bind_range(
+	Staging_Ring* ring,
+	GLenum target,
+	GLuint index,
+	int offset,
+	int size);
+// alloc + memcpy + copy。リングより大きいデータは分割して転送する。
+// このフレームの描画で読む分を残すため、リングはフレームごとに半分までしか使わず、残りはglBufferSubData()で送る
+void staging_ring_upload(
+	Staging_Ring* ring,
+	GLuint dst_buffer,
+	GLintptr dst_offset,
+	const void* data,
+	int size);
+// フレームの終わりに呼ぶ。このフレームで書いた範囲にフェンスを置き、統計をリセットする
+void staging_ring_end_frame(Staging_Ring* ring);
+void log_staging_ring_stats(const Staging_Ring* ring);
+
+#endif
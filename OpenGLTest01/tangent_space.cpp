@@ -0,0 +1,400 @@
+#include "tangent_space.h"
+#include "job_system.h"
+#include "allocators.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define MAX_TANGENT_JOBS 256	// 大きなメッシュではチャンクを大きくしてキューに収める
+
+typedef struct Tangent_Work
+{
+	const GLfloat* positions;
+	const GLfloat* normals;
+	const GLfloat* texcoords;
+	const GLuint* indices;
+	int vertex_count;
+	int triangle_count;
+	// 三角形ごとの結果(xyz)と角ごとの角度
+	float* face_normals;
+	float* face_tangents;
+	float* face_bitangents;
+	float* corner_angles;
+	// 頂点(または同じ位置の代表頂点)ごとの、その頂点を使う角(三角形*3+角)の一覧
+	const int* canonical;	// NULLなら頂点番号そのもの
+	int* corner_offsets;
+	int* corners;
+	GLfloat* out;
+}Tangent_Work;
+
+typedef void (*Range_Function)(Tangent_Work* work, int begin, int end);
+
+typedef struct Range_Job
+{
+	Tangent_Work* work;
+	Range_Function function;
+	int begin;
+	int end;
+}Range_Job;
+
+static void range_job(void* data)
+{
+	Range_Job* job = (Range_Job*)data;
+	job->function(job->work, job->begin, job->end);
+}
+
+// [0, count)をチャンクに分けてジョブとして実行し、全て終わるまで待つ
+static void parallel_for(Tangent_Work* work, int count, Range_Function function)
+{
+	int chunk = TANGENT_CHUNK_SIZE;
+	if (count > chunk * MAX_TANGENT_JOBS)
+	{
+		chunk = (count + MAX_TANGENT_JOBS - 1) / MAX_TANGENT_JOBS;
+	}
+	int job_count = (count + chunk - 1) / chunk;
+	if (job_count <= 1 || job_worker_count() == 0)
+	{
+		function(work, 0, count);
+		return;
+	}
+	Scratch_Arena* scratch = thread_scratch_arena();
+	Scratch_Marker marker = scratch_mark(scratch);
+	Range_Job* jobs = (Range_Job*)scratch_alloc(scratch, job_count * sizeof(Range_Job));
+	Job_Counter counter;
+	init_job_counter(&counter);
+	for (int i = 0; i < job_count; i++)
+	{
+		jobs[i].work = work;
+		jobs[i].function = function;
+		jobs[i].begin = i * chunk;
+		jobs[i].end = (i + 1) * chunk < count ? (i + 1) * chunk : count;
+		submit_job(range_job, &jobs[i], &counter);
+	}
+	wait_for_jobs(&counter);
+	scratch_release(scratch, marker);
+}
+
+/*--------------------Vector Helpers---------------------------*/
+static void sub3(const float* a, const float* b, float* r)
+{
+	r[0] = a[0] - b[0];
+	r[1] = a[1] - b[1];
+	r[2] = a[2] - b[2];
+}
+
+static float dot3(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void cross3(const float* a, const float* b, float* r)
+{
+	r[0] = a[1] * b[2] - a[2] * b[1];
+	r[1] = a[2] * b[0] - a[0] * b[2];
+	r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// 長さが0なら false を返して v はそのまま
+static bool normalise3(float* v)
+{
+	float len = sqrtf(dot3(v, v));
+	if (len <= 1e-20f)
+	{
+		return false;
+	}
+	v[0] /= len;
+	v[1] /= len;
+	v[2] /= len;
+	return true;
+}
+
+// n に垂直な平面へ射影して正規化する
+static bool project_onto_plane(const float* n, float* v)
+{
+	float d = dot3(n, v);
+	v[0] -= n[0] * d;
+	v[1] -= n[1] * d;
+	v[2] -= n[2] * d;
+	return normalise3(v);
+}
+
+/*--------------------Vertex Adjacency---------------------------*/
+// 位置が完全に一致する頂点を最初の1つに寄せる(開番地法のハッシュ)。
+// 結果はスレッドのスクラッチに置くので、呼び出し側がまとめて戻す
+static int* weld_positions(const GLfloat* positions, int vertex_count)
+{
+	Scratch_Arena* scratch = thread_scratch_arena();
+	int* canonical = (int*)scratch_alloc(scratch, vertex_count * sizeof(int));
+	Scratch_Marker marker = scratch_mark(scratch);
+	int table_size = 1;
+	while (table_size < vertex_count * 2)
+	{
+		table_size <<= 1;
+	}
+	int* table = (int*)scratch_alloc(scratch, table_size * sizeof(int));
+	memset(table, 0xff, table_size * sizeof(int));
+	for (int v = 0; v < vertex_count; v++)
+	{
+		const GLfloat* p = &positions[v * 3];
+		unsigned int bits[3];
+		memcpy(bits, p, sizeof(bits));
+		unsigned int h = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		int slot = (int)(h & (table_size - 1));
+		for (;;)
+		{
+			int other = table[slot];
+			if (other < 0)
+			{
+				table[slot] = v;
+				canonical[v] = v;
+				break;
+			}
+			if (memcmp(&positions[other * 3], p, 3 * sizeof(GLfloat)) == 0)
+			{
+				canonical[v] = other;
+				break;
+			}
+			slot = (slot + 1) & (table_size - 1);
+		}
+	}
+	scratch_release(scratch, marker);
+	return canonical;
+}
+
+// weld_positions()と同じく、結果はスレッドのスクラッチに置く
+static void build_vertex_corners(Tangent_Work* work, int index_count)
+{
+	int vertex_count = work->vertex_count;
+	Scratch_Arena* scratch = thread_scratch_arena();
+	work->corner_offsets = (int*)scratch_alloc(scratch, (vertex_count + 1) * sizeof(int));
+	memset(work->corner_offsets, 0, (vertex_count + 1) * sizeof(int));
+	work->corners = (int*)scratch_alloc(scratch, index_count * sizeof(int));
+	Scratch_Marker marker = scratch_mark(scratch);
+	for (int i = 0; i < index_count; i++)
+	{
+		int v = (int)work->indices[i];
+		work->corner_offsets[(work->canonical ? work->canonical[v] : v) + 1]++;
+	}
+	for (int v = 0; v < vertex_count; v++)
+	{
+		work->corner_offsets[v + 1] += work->corner_offsets[v];
+	}
+	int* cursor = (int*)scratch_alloc(scratch, vertex_count * sizeof(int));
+	memcpy(cursor, work->corner_offsets, vertex_count * sizeof(int));
+	for (int i = 0; i < index_count; i++)
+	{
+		int v = (int)work->indices[i];
+		work->corners[cursor[work->canonical ? work->canonical[v] : v]++] = i;
+	}
+	scratch_release(scratch, marker);
+}
+
+/*--------------------Smooth Normals---------------------------*/
+static void face_normal_range(Tangent_Work* work, int begin, int end)
+{
+	for (int t = begin; t < end; t++)
+	{
+		const GLfloat* p0 = &work->positions[work->indices[t * 3] * 3];
+		const GLfloat* p1 = &work->positions[work->indices[t * 3 + 1] * 3];
+		const GLfloat* p2 = &work->positions[work->indices[t * 3 + 2] * 3];
+		float e1[3], e2[3];
+		sub3(p1, p0, e1);
+		sub3(p2, p0, e2);
+		// 正規化しないので面積で重み付けされる
+		cross3(e1, e2, &work->face_normals[t * 3]);
+	}
+}
+
+static void vertex_normal_range(Tangent_Work* work, int begin, int end)
+{
+	for (int v = begin; v < end; v++)
+	{
+		int c = work->canonical[v];
+		float n[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = work->corner_offsets[c]; i < work->corner_offsets[c + 1]; i++)
+		{
+			const float* fn = &work->face_normals[(work->corners[i] / 3) * 3];
+			n[0] += fn[0];
+			n[1] += fn[1];
+			n[2] += fn[2];
+		}
+		if (!normalise3(n))
+		{
+			n[0] = 0.0f;
+			n[1] = 0.0f;
+			n[2] = 1.0f;
+		}
+		memcpy(&work->out[v * 3], n, sizeof(n));
+	}
+}
+
+void generate_smooth_normals(
+	const GLfloat* positions,
+	int vertex_count,
+	const GLuint* indices,
+	int index_count,
+	GLfloat* normals)
+{
+	Tangent_Work work;
+	memset(&work, 0, sizeof(work));
+	work.positions = positions;
+	work.indices = indices;
+	work.vertex_count = vertex_count;
+	work.triangle_count = index_count / 3;
+	work.out = normals;
+	// 作業用の配列は全てスクラッチに置き、最後にまとめて戻す
+	Scratch_Arena* scratch = thread_scratch_arena();
+	Scratch_Marker marker = scratch_mark(scratch);
+	work.face_normals = (float*)scratch_alloc(scratch, work.triangle_count * 3 * sizeof(float));
+	work.canonical = weld_positions(positions, vertex_count);
+	build_vertex_corners(&work, work.triangle_count * 3);
+
+	parallel_for(&work, work.triangle_count, face_normal_range);
+	parallel_for(&work, vertex_count, vertex_normal_range);
+
+	scratch_release(scratch, marker);
+}
+
+/*--------------------Tangents---------------------------*/
+static void face_tangent_range(Tangent_Work* work, int begin, int end)
+{
+	for (int t = begin; t < end; t++)
+	{
+		GLuint i0 = work->indices[t * 3];
+		GLuint i1 = work->indices[t * 3 + 1];
+		GLuint i2 = work->indices[t * 3 + 2];
+		const GLfloat* p[3] = { &work->positions[i0 * 3], &work->positions[i1 * 3], &work->positions[i2 * 3] };
+		const GLfloat* uv0 = &work->texcoords[i0 * 2];
+		const GLfloat* uv1 = &work->texcoords[i1 * 2];
+		const GLfloat* uv2 = &work->texcoords[i2 * 2];
+
+		// 各角の角度
+		for (int k = 0; k < 3; k++)
+		{
+			float a[3], b[3];
+			sub3(p[(k + 1) % 3], p[k], a);
+			sub3(p[(k + 2) % 3], p[k], b);
+			float angle = 0.0f;
+			if (normalise3(a) && normalise3(b))
+			{
+				float d = dot3(a, b);
+				if (d > 1.0f) d = 1.0f;
+				if (d < -1.0f) d = -1.0f;
+				angle = acosf(d);
+			}
+			work->corner_angles[t * 3 + k] = angle;
+		}
+
+		float e1[3], e2[3];
+		sub3(p[1], p[0], e1);
+		sub3(p[2], p[0], e2);
+		float du1 = uv1[0] - uv0[0];
+		float dv1 = uv1[1] - uv0[1];
+		float du2 = uv2[0] - uv0[0];
+		float dv2 = uv2[1] - uv0[1];
+		float* ft = &work->face_tangents[t * 3];
+		float* fb = &work->face_bitangents[t * 3];
+		float area = du1 * dv2 - du2 * dv1;
+		if (fabsf(area) <= 1e-20f)
+		{
+			// UVが縮退している面は寄与しない
+			memset(ft, 0, 3 * sizeof(float));
+			memset(fb, 0, 3 * sizeof(float));
+			continue;
+		}
+		// UVの向きが反転している面も、符号を合わせて同じ向きにする
+		float s = area > 0.0f ? 1.0f : -1.0f;
+		for (int c = 0; c < 3; c++)
+		{
+			ft[c] = (e1[c] * dv2 - e2[c] * dv1) * s;
+			fb[c] = (e2[c] * du1 - e1[c] * du2) * s;
+		}
+		if (!normalise3(ft) || !normalise3(fb))
+		{
+			memset(ft, 0, 3 * sizeof(float));
+			memset(fb, 0, 3 * sizeof(float));
+		}
+	}
+}
+
+static void vertex_tangent_range(Tangent_Work* work, int begin, int end)
+{
+	for (int v = begin; v < end; v++)
+	{
+		const GLfloat* n = &work->normals[v * 3];
+		float t[3] = { 0.0f, 0.0f, 0.0f };
+		float b[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = work->corner_offsets[v]; i < work->corner_offsets[v + 1]; i++)
+		{
+			int corner = work->corners[i];
+			int face = corner / 3;
+			float ct[3], cb[3];
+			memcpy(ct, &work->face_tangents[face * 3], sizeof(ct));
+			memcpy(cb, &work->face_bitangents[face * 3], sizeof(cb));
+			float w = work->corner_angles[corner];
+			if (project_onto_plane(n, ct))
+			{
+				t[0] += ct[0] * w;
+				t[1] += ct[1] * w;
+				t[2] += ct[2] * w;
+			}
+			if (project_onto_plane(n, cb))
+			{
+				b[0] += cb[0] * w;
+				b[1] += cb[1] * w;
+				b[2] += cb[2] * w;
+			}
+		}
+		if (!normalise3(t))
+		{
+			// 法線と最も平行でない軸から垂直な向きを作る
+			float axis[3] = { 0.0f, 0.0f, 0.0f };
+			float ax = fabsf(n[0]), ay = fabsf(n[1]), az = fabsf(n[2]);
+			axis[ax <= ay && ax <= az ? 0 : (ay <= az ? 1 : 2)] = 1.0f;
+			cross3(axis, n, t);
+			if (!normalise3(t))
+			{
+				t[0] = 1.0f;
+			}
+		}
+		float nt[3];
+		cross3(n, t, nt);
+		GLfloat* out = &work->out[v * 4];
+		out[0] = t[0];
+		out[1] = t[1];
+		out[2] = t[2];
+		out[3] = dot3(nt, b) < 0.0f ? -1.0f : 1.0f;
+	}
+}
+
+void generate_tangents(
+	const GLfloat* positions,
+	const GLfloat* normals,
+	const GLfloat* texcoords,
+	int vertex_count,
+	const GLuint* indices,
+	int index_count,
+	GLfloat* tangents)
+{
+	Tangent_Work work;
+	memset(&work, 0, sizeof(work));
+	work.positions = positions;
+	work.normals = normals;
+	work.texcoords = texcoords;
+	work.indices = indices;
+	work.vertex_count = vertex_count;
+	work.triangle_count = index_count / 3;
+	work.out = tangents;
+	Scratch_Arena* scratch = thread_scratch_arena();
+	Scratch_Marker marker = scratch_mark(scratch);
+	work.face_tangents = (float*)scratch_alloc(scratch, work.triangle_count * 3 * sizeof(float));
+	work.face_bitangents = (float*)scratch_alloc(scratch, work.triangle_count * 3 * sizeof(float));
+	work.corner_angles = (float*)scratch_alloc(scratch, work.triangle_count * 3 * sizeof(float));
+	// UVの継ぎ目で分かれた頂点は別々の接線を持つので、位置では寄せない
+	build_vertex_corners(&work, work.triangle_count * 3);
+
+	parallel_for(&work, work.triangle_count, face_tangent_range);
+	parallel_for(&work, vertex_count, vertex_tangent_range);
+
+	scratch_release(scratch, marker);
+}
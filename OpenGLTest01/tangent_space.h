@@ -0,0 +1,31 @@
+#ifndef _TANGENT_SPACE_H_
+#define _TANGENT_SPACE_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+
+/*--------------------Tangent Space Generation---------------------------*/
+// 法線と接線をインデックス付きの三角形から作る。三角形ごとの計算と頂点ごとの集計を
+// それぞれ一定数ずつのジョブに分けてジョブシステムで並列に実行する(ワーカーが無ければその場で実行)。
+// 接線はMikkTSpaceと同じく、面の接線を頂点法線に垂直な平面へ射影して角の角度で重み付けした和とし、
+// w に従接線の符号(bitangent = w * cross(normal, tangent))を入れる
+#define TANGENT_CHUNK_SIZE 4096	// 1つのジョブで扱う三角形・頂点の数
+
+// 面積で重み付けした面法線の和。位置が同じ頂点(UVの継ぎ目など)は同じ法線になる。
+// positions, normals は float xyz
+void generate_smooth_normals(
+	const GLfloat* positions,
+	int vertex_count,
+	const GLuint* indices,
+	int index_count,
+	GLfloat* normals);
+// texcoords は float uv、tangents は float xyzw。UVが縮退している頂点には法線に垂直な適当な向きを入れる
+void generate_tangents(
+	const GLfloat* positions,
+	const GLfloat* normals,
+	const GLfloat* texcoords,
+	int vertex_count,
+	const GLuint* indices,
+	int index_count,
+	GLfloat* tangents);
+
+#endif
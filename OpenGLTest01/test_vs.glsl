@@ -1,26 +1,145 @@
-#version 410
-
-layout(location = 0) in vec3 vertex_position;
-layout(location = 1) in vec3 vertex_colour;
-layout(location = 3) in int bone_id;
-
-uniform mat4 view, proj, model;
-uniform mat4 bone_matrices[64];
-
-out vec3 colour;
-
-void main() {
-	//colour = vertex_colour;
-	colour = vec3(0.0, 0.0, 0.0);
-	if (bone_id == 0){
-		colour.r = 1.0;
-	}
-	else if (bone_id == 1){
-		colour.g = 1.0;
-	}
-	else if (bone_id == 2){
-		colour.b = 1.0;
-	}
-
-	gl_Position = proj * view * model * bone_matrices[bone_id] * vec4(vertex_position, 1.0);
-}
+#version 410
+
+// SKIN_INFLUENCES is injected per mesh by the programme loader (0, 1, 2, 4 or 8)
+#ifndef SKIN_INFLUENCES
+#define SKIN_INFLUENCES 4
+#endif
+#ifndef BONE_PALETTE_SIZE
+#define BONE_PALETTE_SIZE 32
+#endif
+
+// QUANTIZED_POSITIONS: unorm16 xyz, restored with the per-mesh offset/scale
+// QUANTIZED_NORMALS: octahedral xy in snorm 10:10:10:2
+#ifdef QUANTIZED_POSITIONS
+layout(location = 0) in vec4 vertex_position;
+#else
+layout(location = 0) in vec3 vertex_position;
+#endif
+#ifdef QUANTIZED_NORMALS
+layout(location = 1) in vec4 vertex_normal;
+#else
+layout(location = 1) in vec3 vertex_normal;
+#endif
+layout(location = 3) in uvec4 bone_ids;
+layout(location = 4) in vec4 bone_weights;
+// location 5 holds the tangent (xyz) and bitangent sign (w)
+#if SKIN_INFLUENCES > 4
+layout(location = 6) in uvec4 bone_ids_1;
+layout(location = 7) in vec4 bone_weights_1;
+#endif
+
+// shared by every programme, written once per frame (see frame_uniforms.h)
+layout(std140) uniform Frame_Uniforms {
+	mat4 view, proj, view_proj;
+	vec4 camera_position;
+	float time;
+};
+uniform vec3 position_offset, position_scale;
+#ifdef INSTANCED
+// INSTANCED: the model matrix and palette come per instance (see Mesh_Instance in mesh_arena.h)
+// and the palettes are read from the whole staging ring as a texture buffer
+layout(location = 8) in mat4 instance_model;
+layout(location = 12) in uint instance_palette;
+uniform samplerBuffer bone_palettes;
+#else
+uniform mat4 model;
+// one palette per skinned instance, bound by range from the staging ring (see bone_palette.h)
+layout(std140) uniform Bone_Palette {
+	mat4 bone_matrices[BONE_PALETTE_SIZE];
+};
+#endif
+
+out vec3 colour;
+
+vec3 decode_position() {
+#ifdef QUANTIZED_POSITIONS
+	return position_offset + position_scale * vertex_position.xyz;
+#else
+	return vertex_position;
+#endif
+}
+
+vec3 decode_normal() {
+#ifdef QUANTIZED_NORMALS
+	vec3 n = vec3(vertex_normal.xy, 1.0 - abs(vertex_normal.x) - abs(vertex_normal.y));
+	if (n.z < 0.0) {
+		vec2 s = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+		n.xy = (1.0 - abs(n.yx)) * s;
+	}
+	return normalize(n);
+#else
+	return vertex_normal;
+#endif
+}
+
+mat4 model_matrix() {
+#ifdef INSTANCED
+	return instance_model;
+#else
+	return model;
+#endif
+}
+
+mat4 bone_matrix(uint bone) {
+#ifdef INSTANCED
+	// one RGBA32F texel per column
+	int texel = int(instance_palette + bone * 4u);
+	return mat4(
+		texelFetch(bone_palettes, texel),
+		texelFetch(bone_palettes, texel + 1),
+		texelFetch(bone_palettes, texel + 2),
+		texelFetch(bone_palettes, texel + 3));
+#else
+	return bone_matrices[bone];
+#endif
+}
+
+mat4 skin_matrix() {
+#if SKIN_INFLUENCES == 0
+	return mat4(1.0);
+#else
+	mat4 m = bone_matrix(bone_ids.x) * bone_weights.x;
+	float total = bone_weights.x;
+#if SKIN_INFLUENCES > 1
+	m += bone_matrix(bone_ids.y) * bone_weights.y;
+	total += bone_weights.y;
+#endif
+#if SKIN_INFLUENCES > 2
+	m += bone_matrix(bone_ids.z) * bone_weights.z;
+	m += bone_matrix(bone_ids.w) * bone_weights.w;
+	total += bone_weights.z + bone_weights.w;
+#endif
+#if SKIN_INFLUENCES > 4
+	m += bone_matrix(bone_ids_1.x) * bone_weights_1.x;
+	m += bone_matrix(bone_ids_1.y) * bone_weights_1.y;
+	m += bone_matrix(bone_ids_1.z) * bone_weights_1.z;
+	m += bone_matrix(bone_ids_1.w) * bone_weights_1.w;
+	total += dot(bone_weights_1, vec4(1.0));
+#endif
+	// vertices not weighted to any bone keep the identity
+	return m + mat4(1.0 - total);
+#endif
+}
+
+void main() {
+	colour = vec3(0.0, 0.0, 0.0);
+#if SKIN_INFLUENCES == 0
+	// unskinned meshes show their normals
+	colour = decode_normal() * 0.5 + 0.5;
+#else
+	// colour by the dominant bone
+	if (bone_weights.x > 0.0) {
+		if (bone_ids.x == 0u){
+			colour.r = 1.0;
+		}
+		else if (bone_ids.x == 1u){
+			colour.g = 1.0;
+		}
+		else if (bone_ids.x == 2u){
+			colour.b = 1.0;
+		}
+	}
+#endif
+
+	gl_Position = view_proj * model_matrix() * skin_matrix() * vec4(decode_position(), 1.0);
+}
@@ -0,0 +1,9 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/*--------------------High Resolution Timer---------------------------*/
+// GLFWに依存しない高分解能タイマー。ワーカースレッドやウィンドウ作成前でも使える
+double get_precise_time();
+double get_precise_time_ms();
+
+#endif
@@ -0,0 +1,322 @@
+#include "vertex_format.h"
+#include "gl_utils.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/*--------------------Scalar Encodings---------------------------*/
+// 最近接丸めでIEEE 754 binary16に変換する。非正規化数、無限大、NaNも扱う
+GLushort float_to_half(float f)
+{
+	unsigned int x;
+	memcpy(&x, &f, sizeof(x));
+	unsigned int sign = (x >> 16) & 0x8000;
+	unsigned int biased = (x >> 23) & 0xff;
+	unsigned int mantissa = x & 0x7fffff;
+	int exponent = (int)biased - 127 + 15;
+
+	if (biased == 0xff)
+	{
+		return (GLushort)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	}
+	if (exponent >= 31)
+	{
+		return (GLushort)(sign | 0x7c00);
+	}
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+		{
+			return (GLushort)sign;
+		}
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		unsigned int half_mantissa = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1)
+		{
+			half_mantissa++;
+		}
+		return (GLushort)(sign | half_mantissa);
+	}
+	unsigned int h = sign | ((unsigned int)exponent << 10) | (mantissa >> 13);
+	// 繰り上がりで指数部に溢れても正しい値になる
+	if (mantissa & 0x1000)
+	{
+		h++;
+	}
+	return (GLushort)h;
+}
+
+float half_to_float(GLushort h)
+{
+	unsigned int sign = ((unsigned int)h & 0x8000) << 16;
+	unsigned int exponent = (h >> 10) & 0x1f;
+	unsigned int mantissa = h & 0x3ff;
+	unsigned int x;
+	if (exponent == 0)
+	{
+		float f = (float)mantissa * (1.0f / 16777216.0f);
+		return sign ? -f : f;
+	}
+	if (exponent == 31)
+	{
+		x = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else
+	{
+		x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	}
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+static float sign_not_zero(float v)
+{
+	return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+static int g_snorm_rule = SNORM_RULE_GL42;
+
+void set_snorm_rule(int rule)
+{
+	g_snorm_rule = rule;
+}
+
+int get_snorm_rule()
+{
+	return g_snorm_rule;
+}
+
+static int to_snorm10(float v)
+{
+	if (v > 1.0f) v = 1.0f;
+	if (v < -1.0f) v = -1.0f;
+	int c;
+	if (g_snorm_rule == SNORM_RULE_LEGACY)
+	{
+		// (2c + 1) / 1023 が最も近くなるc。0はちょうどには表せない
+		c = (int)floorf((v * 1023.0f - 1.0f) * 0.5f + 0.5f);
+	}
+	else
+	{
+		c = (int)floorf(v * 511.0f + 0.5f);
+	}
+	if (c < -512) c = -512;
+	if (c > 511) c = 511;
+	return c;
+}
+
+// 単位ベクトルを八面体に射影した2成分をGL_INT_2_10_10_10_REVのx,yに入れる。
+// 復元の規則はset_snorm_rule()で選んだもの
+GLuint pack_oct_normal(float nx, float ny, float nz, int w)
+{
+	float l1 = fabsf(nx) + fabsf(ny) + fabsf(nz);
+	if (l1 <= 0.0f)
+	{
+		nz = 1.0f;
+		l1 = 1.0f;
+	}
+	float ox = nx / l1;
+	float oy = ny / l1;
+	if (nz < 0.0f)
+	{
+		float tx = (1.0f - fabsf(oy)) * sign_not_zero(ox);
+		oy = (1.0f - fabsf(ox)) * sign_not_zero(oy);
+		ox = tx;
+	}
+	GLuint x = (GLuint)to_snorm10(ox) & 0x3ff;
+	GLuint y = (GLuint)to_snorm10(oy) & 0x3ff;
+	GLuint a = (GLuint)w & 0x3;
+	return x | (y << 10) | (a << 30);
+}
+
+static float from_snorm10(GLuint bits)
+{
+	int v = (int)(bits & 0x3ff);
+	if (v & 0x200)
+	{
+		v -= 0x400;
+	}
+	if (g_snorm_rule == SNORM_RULE_LEGACY)
+	{
+		return (2.0f * v + 1.0f) / 1023.0f;
+	}
+	float f = (float)v / 511.0f;
+	return f < -1.0f ? -1.0f : f;
+}
+
+void unpack_oct_normal(GLuint packed, float* n)
+{
+	float x = from_snorm10(packed);
+	float y = from_snorm10(packed >> 10);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	if (z < 0.0f)
+	{
+		float tx = (1.0f - fabsf(y)) * sign_not_zero(x);
+		y = (1.0f - fabsf(x)) * sign_not_zero(y);
+		x = tx;
+	}
+	float len = sqrtf(x * x + y * y + z * z);
+	n[0] = x / len;
+	n[1] = y / len;
+	n[2] = z / len;
+}
+
+/*--------------------Attribute Streams---------------------------*/
+void quantize_positions(
+	const GLfloat* src,
+	int count,
+	GLushort* dst,
+	float* offset,
+	float* scale,
+	Quantization_Error* error)
+{
+	// メッシュのAABBを[0,65535]に割り当てる
+	float mn[3] = { 0.0f, 0.0f, 0.0f };
+	float mx[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < count; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			float v = src[i * 3 + c];
+			if (i == 0 || v < mn[c]) mn[c] = v;
+			if (i == 0 || v > mx[c]) mx[c] = v;
+		}
+	}
+	for (int c = 0; c < 3; c++)
+	{
+		offset[c] = mn[c];
+		scale[c] = mx[c] - mn[c];
+		if (scale[c] <= 0.0f)
+		{
+			scale[c] = 1.0f;
+		}
+	}
+
+	double error_sum = 0.0;
+	error->position_max = 0.0f;
+	for (int i = 0; i < count; i++)
+	{
+		float d2 = 0.0f;
+		for (int c = 0; c < 3; c++)
+		{
+			float v = src[i * 3 + c];
+			float t = (v - offset[c]) / scale[c];
+			int q = (int)floorf(t * 65535.0f + 0.5f);
+			if (q < 0) q = 0;
+			if (q > 65535) q = 65535;
+			dst[i * 4 + c] = (GLushort)q;
+			float restored = offset[c] + scale[c] * ((float)q / 65535.0f);
+			d2 += (restored - v) * (restored - v);
+		}
+		dst[i * 4 + 3] = 0;
+		float d = sqrtf(d2);
+		error_sum += d;
+		if (d > error->position_max)
+		{
+			error->position_max = d;
+		}
+	}
+	error->position_avg = count > 0 ? (float)(error_sum / count) : 0.0f;
+}
+
+void quantize_normals(
+	const GLfloat* src,
+	int count,
+	GLuint* dst,
+	Quantization_Error* error)
+{
+	double error_sum = 0.0;
+	error->normal_max_deg = 0.0f;
+	for (int i = 0; i < count; i++)
+	{
+		const GLfloat* n = &src[i * 3];
+		dst[i] = pack_oct_normal(n[0], n[1], n[2], 0);
+
+		float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len <= 0.0f)
+		{
+			continue;
+		}
+		float restored[3];
+		unpack_oct_normal(dst[i], restored);
+		float d = (restored[0] * n[0] + restored[1] * n[1] + restored[2] * n[2]) / len;
+		if (d > 1.0f) d = 1.0f;
+		if (d < -1.0f) d = -1.0f;
+		float deg = acosf(d) * (float)ONE_RAD_IN_DEG;
+		error_sum += deg;
+		if (deg > error->normal_max_deg)
+		{
+			error->normal_max_deg = deg;
+		}
+	}
+	error->normal_avg_deg = count > 0 ? (float)(error_sum / count) : 0.0f;
+}
+
+void quantize_tangents(
+	const GLfloat* src,
+	int count,
+	GLuint* dst)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const GLfloat* t = &src[i * 4];
+		dst[i] = pack_oct_normal(t[0], t[1], t[2], t[3] < 0.0f ? -1 : 1);
+	}
+}
+
+void quantize_texcoords(
+	const GLfloat* src,
+	int count,
+	GLushort* dst,
+	Quantization_Error* error)
+{
+	error->texcoord_max = 0.0f;
+	for (int i = 0; i < count * 2; i++)
+	{
+		dst[i] = float_to_half(src[i]);
+		float d = fabsf(half_to_float(dst[i]) - src[i]);
+		if (d > error->texcoord_max)
+		{
+			error->texcoord_max = d;
+		}
+	}
+}
+
+void print_quantization_error(const char* mesh_name, int format, const Quantization_Error* error)
+{
+	if (format & VERTEX_QUANTIZE_POSITION)
+	{
+		gl_log_print("%s position error: max %f avg %f\n", mesh_name, error->position_max, error->position_avg);
+	}
+	if (format & VERTEX_QUANTIZE_NORMAL)
+	{
+		gl_log_print("%s normal error: max %.3f deg avg %.3f deg\n", mesh_name, error->normal_max_deg, error->normal_avg_deg);
+	}
+	if (format & VERTEX_QUANTIZE_TEXCOORD)
+	{
+		gl_log_print("%s texcoord error: max %f\n", mesh_name, error->texcoord_max);
+	}
+}
+
+static void append_define(char* defines, int max_len, const char* line)
+{
+	if ((int)(strlen(defines) + strlen(line)) < max_len)
+	{
+		strcat(defines, line);
+	}
+}
+
+void vertex_format_defines(int format, char* defines, int max_len)
+{
+	defines[0] = 0;
+	if (format & VERTEX_QUANTIZE_POSITION)
+	{
+		append_define(defines, max_len, "#define QUANTIZED_POSITIONS\n");
+	}
+	if (format & VERTEX_QUANTIZE_NORMAL)
+	{
+		append_define(defines, max_len, "#define QUANTIZED_NORMALS\n");
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef _VERTEX_FORMAT_H_
+#define _VERTEX_FORMAT_H_
+
+#include <GL/glew.h> // include GLEW and new version of GL on Windows
+
+/*--------------------Vertex Attribute Quantization---------------------------*/
+// アリーナの頂点フォーマット。組み合わせて指定する
+// POSITION: unorm16 x4(wは未使用)。メッシュごとのoffset/scaleで復元する
+// NORMAL:   八面体エンコードしたxyをsnorm 10:10:10:2に格納する。接線も同じ形式で、wに従接線の符号を入れる
+// TEXCOORD: half float x2
+#define VERTEX_QUANTIZE_POSITION 0x1
+#define VERTEX_QUANTIZE_NORMAL 0x2
+#define VERTEX_QUANTIZE_TEXCOORD 0x4
+#define VERTEX_QUANTIZE_ALL (VERTEX_QUANTIZE_POSITION | VERTEX_QUANTIZE_NORMAL | VERTEX_QUANTIZE_TEXCOORD)
+
+// 量子化で生じた誤差。メッシュごとに集計して表示する
+typedef struct Quantization_Error
+{
+	float position_max;		// モデル空間での距離
+	float position_avg;
+	float normal_max_deg;	// 元の法線との角度
+	float normal_avg_deg;
+	float texcoord_max;
+}Quantization_Error;
+
+// GL_INT_2_10_10_10_REVを正規化して読むときの規則。4.2より前のコンテキストは(2c + 1) / 1023、
+// 4.2以降はmax(c / 511, -1)で復元する。エンコードと誤差の計算はここで選んだ規則に合わせる
+#define SNORM_RULE_GL42 0
+#define SNORM_RULE_LEGACY 1
+// コンテキストを作った後、メッシュを読み込む前に実際のバージョンから選ぶ。既定はSNORM_RULE_GL42
+void set_snorm_rule(int rule);
+int get_snorm_rule();
+
+GLushort float_to_half(float f);
+float half_to_float(GLushort h);
+GLuint pack_oct_normal(float nx, float ny, float nz, int w);
+void unpack_oct_normal(GLuint packed, float* n);
+
+// src は float xyz 配列、dst は unorm16 xyzw 配列。復元は offset + scale * (q / 65535)
+void quantize_positions(
+	const GLfloat* src,
+	int count,
+	GLushort* dst,
+	float* offset,
+	float* scale,
+	Quantization_Error* error);
+void quantize_normals(
+	const GLfloat* src,
+	int count,
+	GLuint* dst,
+	Quantization_Error* error);
+// src は float xyzw(wは従接線の符号)
+void quantize_tangents(
+	const GLfloat* src,
+	int count,
+	GLuint* dst);
+void quantize_texcoords(
+	const GLfloat* src,
+	int count,
+	GLushort* dst,
+	Quantization_Error* error);
+void print_quantization_error(const char* mesh_name, int format, const Quantization_Error* error);
+
+// シェーダ側のデコード処理を選ぶ#defineを作る
+void vertex_format_defines(int format, char* defines, int max_len);
+
+#endif